@@ -0,0 +1,333 @@
+/**
+ * \file async_bench.cpp
+ *
+ * \brief Wake-up overhead of the coroutine API against a thread per device.
+ * N devices pass a token in a ring: a device woken by its INTB fd (an
+ * eventfd here) reads a FIFO burst and raises INTB of the next one, so every
+ * op is one wake-up, one burst read and one switch to another device.
+ * Coroutines run all the devices on one epoll thread, the threaded ring
+ * blocks a thread per device in read().
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include "MAX30003_async.hpp"
+
+#define BENCH_NSEC_IN_SEC 1000000000.0
+#define BENCH_HOPS        200000
+#define BENCH_EFIT        8
+
+using namespace max30003;
+
+spi_t spi; /* bus of the C driver, not used by the cases */
+
+using bench_cfg_t = Config<Rate::sps512,
+                           Gain::x80,
+                           Hpf::hz0_5,
+                           lpf_default(Rate::sps512),
+                           BENCH_EFIT>;
+
+/**
+ * \brief Bus of a chip with a full FIFO, burst reads end with EOF
+ */
+class StubTransport {
+public:
+    int message(struct spi_ioc_transfer *const xfer, const unsigned int n)
+    {
+        uint8_t *rx;
+
+        if (n != 2 || !xfer[1].rx_buf) {
+            return 0;
+        }
+        rx = reinterpret_cast<uint8_t *>(xfer[1].rx_buf);
+        for (uint32_t i = 0; i < xfer[1].len; i += ECG_FIFO_WORD_BYTES) {
+            rx[i]     = (uint8_t)i;
+            rx[i + 1] = (uint8_t)seq_++;
+            rx[i + 2] = i + ECG_FIFO_WORD_BYTES < xfer[1].len
+                                ? ETAG_VALID << ECG_FIFO_ETAG_SHIFT
+                                : ETAG_VALID_EOF << ECG_FIFO_ETAG_SHIFT;
+        }
+        return (int)xfer[1].len;
+    }
+    uint32_t speed_hz() const { return SPI_MAX_SPEED; }
+    uint8_t  bits() const { return 8; }
+
+private:
+    uint32_t seq_ = 0;
+};
+
+using bench_dev_t = AsyncDevice<StubTransport, bench_cfg_t>;
+
+typedef struct {
+    char     name[32];
+    uint64_t ops;
+    double   wall_ns;
+    double   cpu_ns;
+} bench_result_t;
+
+/**
+ * \brief State shared by the devices of a ring
+ */
+typedef struct {
+    std::vector<int> fds; /* INTB eventfds */
+    uint64_t         hops;
+    uint64_t         total;
+    uint64_t         points;
+} ring_t;
+
+static double __clock_ns(const clockid_t clk)
+{
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return ts.tv_sec * BENCH_NSEC_IN_SEC + ts.tv_nsec;
+}
+
+static void __raise(const int fd)
+{
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof one) != sizeof one) {
+        perror("eventfd");
+    }
+}
+
+static Task __ring_task(bench_dev_t &dev, ring_t &ring, const uint32_t idx)
+{
+    int32_t  points[bench_dev_t::burst_words];
+    uint32_t next = (idx + 1) % ring.fds.size();
+    uint64_t hop;
+
+    for (;;) {
+        Batch b = co_await dev.read_batch(points);
+        if (b.ret != RET_CODE_SUCCESS) {
+            break;
+        }
+        ring.points += b.num;
+        /* Past the total the token goes round once more to end the tasks */
+        hop = ++ring.hops;
+        __raise(ring.fds[next]);
+        if (hop >= ring.total) {
+            break;
+        }
+    }
+}
+
+static ret_code_t __ring_open(ring_t &ring, const uint32_t devs)
+{
+    ring.fds.assign(devs, -1);
+    for (uint32_t i = 0; i < devs; ++i) {
+        ring.fds[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (ring.fds[i] < 0) {
+            return RET_CODE_ERROR;
+        }
+    }
+    return RET_CODE_SUCCESS;
+}
+
+static void __ring_close(ring_t &ring)
+{
+    for (int fd : ring.fds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+static ret_code_t __bench_coro(bench_result_t &res,
+                               const uint32_t  devs,
+                               const uint64_t  hops)
+{
+    ret_code_t                                ret = RET_CODE_SUCCESS;
+    Executor                                  exec;
+    std::vector<StubTransport>                bus(devs);
+    std::vector<std::unique_ptr<bench_dev_t>> dev;
+    ring_t                                    ring = {};
+    double                                    wall, cpu;
+
+    ring.total = hops;
+    if (!exec.valid() || __ring_open(ring, devs) != RET_CODE_SUCCESS) {
+        ret = RET_CODE_ERROR;
+        goto exit;
+    }
+    for (uint32_t i = 0; i < devs; ++i) {
+        dev.emplace_back(new bench_dev_t(exec, bus[i], ring.fds[i]));
+        if (dev.back()->status() != RET_CODE_SUCCESS) {
+            ret = RET_CODE_ERROR;
+            goto exit;
+        }
+    }
+    for (uint32_t i = 0; i < devs; ++i) {
+        exec.spawn(__ring_task(*dev[i], ring, i));
+    }
+    wall = __clock_ns(CLOCK_MONOTONIC);
+    cpu  = __clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+    __raise(ring.fds[0]);
+    ret         = exec.run();
+    res.wall_ns = __clock_ns(CLOCK_MONOTONIC) - wall;
+    res.cpu_ns  = __clock_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+    res.ops     = ring.hops;
+exit:
+    dev.clear();
+    __ring_close(ring);
+    return ret;
+}
+
+/**
+ * \brief Device thread of the threaded ring, blocking reads of its INTB
+ */
+static void __ring_thread(ring_t &ring, const uint32_t idx)
+{
+    StubTransport                        bus;
+    Max30003<StubTransport, bench_cfg_t> dev(bus);
+    int32_t                              points[BENCH_EFIT];
+    uint32_t                             next = (idx + 1) % ring.fds.size();
+    uint32_t                             num;
+    uint64_t                             ack, hop;
+
+    for (;;) {
+        if (read(ring.fds[idx], &ack, sizeof ack) != sizeof ack) {
+            break;
+        }
+        dev.read_fifo(points, num);
+        __atomic_add_fetch(&ring.points, num, __ATOMIC_RELAXED);
+        /* Counted before the token is passed, only its holder counts */
+        hop = __atomic_add_fetch(&ring.hops, 1, __ATOMIC_RELAXED);
+        __raise(ring.fds[next]);
+        if (hop >= ring.total) {
+            break;
+        }
+    }
+}
+
+static ret_code_t __bench_thread(bench_result_t &res,
+                                 const uint32_t  devs,
+                                 const uint64_t  hops)
+{
+    ret_code_t               ret  = RET_CODE_SUCCESS;
+    ring_t                   ring = {};
+    std::vector<std::thread> th;
+    double                   wall, cpu;
+
+    ring.total = hops;
+    ring.fds.assign(devs, -1);
+    for (uint32_t i = 0; i < devs; ++i) {
+        ring.fds[i] = eventfd(0, EFD_CLOEXEC); /* blocking */
+        if (ring.fds[i] < 0) {
+            ret = RET_CODE_ERROR;
+            goto exit;
+        }
+    }
+    wall = __clock_ns(CLOCK_MONOTONIC);
+    cpu  = __clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+    for (uint32_t i = 0; i < devs; ++i) {
+        th.emplace_back(__ring_thread, std::ref(ring), i);
+    }
+    __raise(ring.fds[0]);
+    for (std::thread &t : th) {
+        t.join();
+    }
+    res.wall_ns = __clock_ns(CLOCK_MONOTONIC) - wall;
+    res.cpu_ns  = __clock_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+    res.ops     = ring.hops;
+exit:
+    __ring_close(ring);
+    return ret;
+}
+
+static void __print(const bench_result_t *const res,
+                    const uint32_t              num,
+                    const uint8_t               csv)
+{
+    if (csv) {
+        printf("name,ops,wall_ns_per_op,cpu_ns_per_op,ops_per_sec\n");
+    } else {
+        printf("{\n  \"results\": [\n");
+    }
+    for (uint32_t i = 0; i < num; ++i) {
+        const bench_result_t *r    = &res[i];
+        double                wall = r->ops ? r->wall_ns / r->ops : 0;
+        double                cpu  = r->ops ? r->cpu_ns / r->ops : 0;
+        double                rate = wall > 0 ? BENCH_NSEC_IN_SEC / wall : 0;
+        if (csv) {
+            printf("%s,%llu,%.2f,%.2f,%.0f\n",
+                   r->name,
+                   (unsigned long long)r->ops,
+                   wall,
+                   cpu,
+                   rate);
+            continue;
+        }
+        printf("    { \"name\": \"%s\", \"ops\": %llu, "
+               "\"wall_ns_per_op\": %.2f, \"cpu_ns_per_op\": %.2f, "
+               "\"ops_per_sec\": %.0f }%s\n",
+               r->name,
+               (unsigned long long)r->ops,
+               wall,
+               cpu,
+               rate,
+               i + 1 < num ? "," : "");
+    }
+    if (!csv) {
+        printf("  ]\n}\n");
+    }
+}
+
+static void __usage(const char *const prog)
+{
+    printf("%s [-f json|csv] [-n scale]\n"
+           "-f --format  output format (default json)\n"
+           "-n --scale   hops multiplier (default 1)\n",
+           prog);
+}
+
+int main(int argc, char **argv)
+{
+    static const uint32_t devs[] = { 2, 8, 32, 64 };
+    static const struct option long_opts[] = {
+        { "format", 1, 0, 'f' },
+        { "scale", 1, 0, 'n' },
+        { 0, 0, 0, 0 },
+    };
+    bench_result_t res[2 * sizeof devs / sizeof devs[0]] = {};
+    uint32_t       num = 0, scale = 1;
+    uint8_t        csv = 0;
+    int            opt;
+
+    while ((opt = getopt_long(argc, argv, "f:n:", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'f':
+            csv = !strcmp(optarg, "csv");
+            break;
+        case 'n':
+            scale = (uint32_t)strtoul(optarg, NULL, 0);
+            scale = scale ? scale : 1;
+            break;
+        default:
+            __usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (uint32_t d : devs) {
+        bench_result_t *r = &res[num++];
+        snprintf(r->name, sizeof r->name, "coro_ring_%u", d);
+        if (__bench_coro(*r, d, (uint64_t)BENCH_HOPS * scale)) {
+            fprintf(stderr, "%s failed\n", r->name);
+            return EXIT_FAILURE;
+        }
+        r = &res[num++];
+        snprintf(r->name, sizeof r->name, "thread_ring_%u", d);
+        if (__bench_thread(*r, d, (uint64_t)BENCH_HOPS * scale)) {
+            fprintf(stderr, "%s failed\n", r->name);
+            return EXIT_FAILURE;
+        }
+    }
+    __print(res, num, csv);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,1052 @@
+/**
+ * \file ecg_bench.c
+ *
+ * \brief End-to-end benchmark suite of the MAX30003 userspace driver.
+ * All the cases run against the simulator (replay backend with a synthetic
+ * ECG), results are printed as JSON or CSV to track regressions.
+ */
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/utsname.h>
+#include "common_types.h"
+#include "common_check.h"
+#include "spi.h"
+#include "MAX30003.h"
+#include "reg_shadow.h"
+#include "spi_calib.h"
+#include "replay.h"
+#include "recording.h"
+#include "dsp.h"
+#include "qrs.h"
+#include "hrv.h"
+#include "sqi.h"
+#include "pipeline.h"
+#include "stats.h"
+#include "trace.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE MAIN_PRINT_EN
+#define DBG_TAG      "ecg_bench.c"
+#include "Log_dbg.h"
+
+#define BENCH_NSEC_IN_SEC     1000000000.0
+#define BENCH_SYNTH_SECONDS   60
+#define BENCH_REG_ITERS       200000
+#define BENCH_DECODE_WORDS    (ECG_FIFO_DEPTH * 64)
+#define BENCH_DECODE_ITERS    2000
+#define BENCH_ACQ_SAMPLES     100000
+#define BENCH_POOL_WARMUP     (2 * PIPE_POOL_BLOCKS * PIPE_BLOCK_POINTS)
+#define BENCH_SINK_SAMPLES    100000
+#define BENCH_DSP_SAMPLES     1000000
+#define BENCH_HRV_BEATS       10000000
+#define BENCH_HRV_SPEC_ITERS  100
+#define BENCH_QUEUE_OPS       2000000
+#define BENCH_STATS_ITERS     10000000
+#define BENCH_TRACE_ITERS     5000000
+#define BENCH_LOG_ITERS       1000000
+#define BENCH_NAME_LEN        32
+#define BENCH_START_ITERS     50
+#define BENCH_CALIB_ITERS     200
+#define BENCH_CALIB_SCLK_MAX  9000000
+#define BENCH_START_GAP_US    20000
+
+spi_t spi;
+
+typedef enum {
+    BENCH_FMT_JSON = 0,
+    BENCH_FMT_CSV,
+} bench_fmt_t;
+
+/**
+ * \brief Result of a single benchmark case
+ */
+typedef struct {
+    char     name[BENCH_NAME_LEN];
+    uint64_t ops;     /* operations measured */
+    double   wall_ns; /* total wall clock time */
+    double   cpu_ns;  /* total process CPU time */
+    uint64_t allocs;  /* heap allocations of the measured code */
+} bench_result_t;
+
+typedef ret_code_t (*bench_fn_t)(bench_result_t *const res,
+                                 const uint32_t        scale);
+
+/**
+ * \brief Measurement window around a benchmark loop
+ */
+typedef struct {
+    double   wall;
+    double   cpu;
+    uint64_t allocs;
+} bench_clock_t;
+
+static uint32_t sample_rate = 512;
+static uint64_t allocs; /* malloc() family calls of the linked objects */
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t num, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+int   __real_posix_memalign(void **ptr, size_t align, size_t size);
+
+/* Linked with --wrap, allocations inside libc itself are not seen */
+void *__wrap_malloc(size_t size)
+{
+    __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t num, size_t size)
+{
+    __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_calloc(num, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_realloc(ptr, size);
+}
+
+int __wrap_posix_memalign(void **ptr, size_t align, size_t size)
+{
+    __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_posix_memalign(ptr, align, size);
+}
+
+static uint64_t __allocs(void)
+{
+    return __atomic_load_n(&allocs, __ATOMIC_RELAXED);
+}
+
+static double __clock_ns(const clockid_t clk)
+{
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return ts.tv_sec * BENCH_NSEC_IN_SEC + ts.tv_nsec;
+}
+
+static void __start(bench_clock_t *const clk)
+{
+    clk->wall   = __clock_ns(CLOCK_MONOTONIC);
+    clk->cpu    = __clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+    clk->allocs = __allocs();
+}
+
+static void __stop(const bench_clock_t *const clk,
+                   bench_result_t *const      res,
+                   const uint64_t             ops)
+{
+    res->wall_ns = __clock_ns(CLOCK_MONOTONIC) - clk->wall;
+    res->cpu_ns  = __clock_ns(CLOCK_PROCESS_CPUTIME_ID) - clk->cpu;
+    res->allocs  = __allocs() - clk->allocs;
+    res->ops     = ops;
+}
+
+/**
+ * \brief Attaches the simulator to the global spi and configures the chip
+ */
+static ret_code_t __sim_open(replay_t **const       sim,
+                             ecg_data_t *const      ecg_data,
+                             const uint32_t         speed)
+{
+    ret_code_t ret = RET_CODE_SUCCESS;
+    memset(&spi, 0, sizeof spi);
+    *sim = replay_open_synth(sample_rate, BENCH_SYNTH_SECONDS, speed);
+    RET_ERR_ON_NULL(*sim);
+    CONTINUE_ON_SUCCESS(replay_attach(*sim, &spi));
+    CONTINUE_ON_SUCCESS(spi_init(&spi));
+    if (ecg_data) {
+        CONTINUE_ON_SUCCESS(max30003_init(ecg_data));
+    }
+exit:
+    return ret;
+}
+
+static void __sim_close(replay_t **const sim)
+{
+    spi_free(&spi);
+    replay_close(sim);
+}
+
+/**
+ * \brief Fresh handle with the sample rate of the simulated signal
+ */
+static ecg_data_t *__handle(const uint32_t data_len)
+{
+    ecg_data_t *ecg_data = ecg_create_handle();
+    if (PTR_INVALID(ecg_data) ||
+        RET_UNSUCCESS(ecg_init_handle(ecg_data)) ||
+        RET_UNSUCCESS(ecg_set_data_len(ecg_data, data_len))) {
+        return NULL;
+    }
+    BITMASK_CLEAR(ecg_data->cnfg_ecg, ECG_GAIN_512_RESET);
+    if (sample_rate == 256) {
+        BITMASK_SET(ecg_data->cnfg_ecg, ECG_RATE_256);
+    } else if (sample_rate == 128) {
+        BITMASK_SET(ecg_data->cnfg_ecg, ECG_RATE_128);
+    }
+    return ecg_data;
+}
+
+static void __handle_free(ecg_data_t *ecg_data)
+{
+    if (ecg_data) {
+        ecg_delete_handle(&ecg_data);
+    }
+}
+
+/**
+ * \brief Single register read: command byte + 24 bit shift
+ */
+static ret_code_t __bench_spi_read_reg(bench_result_t *const res,
+                                       const uint32_t        scale)
+{
+    ret_code_t    ret    = RET_CODE_SUCCESS;
+    replay_t *    sim    = NULL;
+    uint8_t       buf[4] = { 0 };
+    uint32_t      iters  = BENCH_REG_ITERS * scale;
+    bench_clock_t clk;
+
+    CONTINUE_ON_SUCCESS(__sim_open(&sim, NULL, REPLAY_SPEED_MAX));
+    __start(&clk);
+    for (uint32_t i = 0; i < iters; ++i) {
+        CONTINUE_ON_SUCCESS(max30003_read_reg(&spi, INFO, buf));
+    }
+    __stop(&clk, res, iters);
+exit:
+    __sim_close(&sim);
+    return ret;
+}
+
+/**
+ * \brief Single register write
+ */
+static ret_code_t __bench_spi_write_reg(bench_result_t *const res,
+                                        const uint32_t        scale)
+{
+    ret_code_t    ret   = RET_CODE_SUCCESS;
+    replay_t *    sim   = NULL;
+    uint32_t      iters = BENCH_REG_ITERS * scale;
+    bench_clock_t clk;
+
+    CONTINUE_ON_SUCCESS(__sim_open(&sim, NULL, REPLAY_SPEED_MAX));
+    __start(&clk);
+    for (uint32_t i = 0; i < iters; ++i) {
+        CONTINUE_ON_SUCCESS(
+                max30003_write_reg(&spi, CNFG_CAL, CNFG_CAL_DEFAULT));
+    }
+    __stop(&clk, res, iters);
+exit:
+    __sim_close(&sim);
+    return ret;
+}
+
+/**
+ * \brief Polls FIFO until a valid word, zero samples count too
+ */
+static ret_code_t __wait_sample(void)
+{
+    uint8_t buf[BYTES_NUM_IN_REG];
+    uint8_t etag;
+    do {
+        if (max30003_read_reg(&spi, ECG_FIFO, buf)) {
+            return RET_CODE_SPI_READ_ERR;
+        }
+        etag = (buf[2] & ECG_FIFO_ETAG_MASK) >> ECG_FIFO_ETAG_SHIFT;
+    } while (etag == ETAG_EMPTY || etag == ETAG_OVERFLOW);
+    return RET_CODE_SUCCESS;
+}
+
+/**
+ * \brief Restart of an acquiring chip: init plus wait for the first valid
+ * sample, the chip runs unattended for BENCH_START_GAP_US before each op
+ * (not measured). Simulator runs in real time.
+ */
+static ret_code_t __bench_start(bench_result_t *const res,
+                                const uint32_t        scale,
+                                const uint8_t         warm)
+{
+    ret_code_t  ret      = RET_CODE_SUCCESS;
+    replay_t *  sim      = NULL;
+    ecg_data_t *ecg_data = NULL;
+    uint32_t    iters    = BENCH_START_ITERS * scale;
+    double      wall, cpu;
+
+    ecg_data = __handle(1);
+    CHECK_PTR(ecg_data, ret, RET_CODE_ALLOC_FAIL);
+    CONTINUE_ON_SUCCESS(__sim_open(&sim, ecg_data, REPLAY_SPEED_DEFAULT));
+    for (uint32_t i = 0; i < iters; ++i) {
+        usleep(BENCH_START_GAP_US);
+        wall = __clock_ns(CLOCK_MONOTONIC);
+        cpu  = __clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+        if (warm) {
+            CONTINUE_ON_SUCCESS(max30003_warm_init(ecg_data, NULL));
+        } else {
+            CONTINUE_ON_SUCCESS(max30003_init(ecg_data));
+        }
+        CONTINUE_ON_SUCCESS(__wait_sample());
+        res->wall_ns += __clock_ns(CLOCK_MONOTONIC) - wall;
+        res->cpu_ns += __clock_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+    }
+    res->ops = iters;
+exit:
+    __sim_close(&sim);
+    __handle_free(ecg_data);
+    return ret;
+}
+
+static ret_code_t __bench_start_cold(bench_result_t *const res,
+                                     const uint32_t        scale)
+{
+    return __bench_start(res, scale, 0);
+}
+
+static ret_code_t __bench_start_warm(bench_result_t *const res,
+                                     const uint32_t        scale)
+{
+    return __bench_start(res, scale, 1);
+}
+
+/**
+ * \brief Live reconfiguration gap: max30003_reconfig() plus wait for the
+ * first valid sample, op is a change. Field toggles between two values
+ * of the mask, rate changes need SYNCH, gain changes FIFO_RST only.
+ */
+static ret_code_t __bench_reconf(bench_result_t *const res,
+                                 const uint32_t        scale,
+                                 const uint32_t        mask,
+                                 const uint32_t        toggle)
+{
+    ret_code_t    ret      = RET_CODE_SUCCESS;
+    replay_t *    sim      = NULL;
+    ecg_data_t *  ecg_data = NULL;
+    uint32_t      iters    = BENCH_START_ITERS * scale;
+    bench_clock_t clk;
+
+    ecg_data = __handle(ECG_FIFO_DEPTH + 1);
+    CHECK_PTR(ecg_data, ret, RET_CODE_ALLOC_FAIL);
+    CONTINUE_ON_SUCCESS(__sim_open(&sim, ecg_data, REPLAY_SPEED_DEFAULT));
+    __start(&clk);
+    for (uint32_t i = 0; i < iters; ++i) {
+        ecg_data->data_ID = 0;
+        BITMASK_CLEAR(ecg_data->cnfg_ecg, mask);
+        BITMASK_SET(ecg_data->cnfg_ecg, (i & 1) ? 0 : toggle);
+        CONTINUE_ON_SUCCESS(max30003_reconfig(ecg_data));
+        CONTINUE_ON_SUCCESS(__wait_sample());
+    }
+    __stop(&clk, res, iters);
+exit:
+    __sim_close(&sim);
+    __handle_free(ecg_data);
+    return ret;
+}
+
+static ret_code_t __bench_reconf_gain(bench_result_t *const res,
+                                      const uint32_t        scale)
+{
+    return __bench_reconf(res, scale, ECG_GAIN_20_RESET, ECG_GAIN_40);
+}
+
+static ret_code_t __bench_reconf_rate(bench_result_t *const res,
+                                      const uint32_t        scale)
+{
+    return __bench_reconf(res, scale, ECG_GAIN_512_RESET, ECG_RATE_256);
+}
+
+/**
+ * \brief Full clock sweep against a board limited to 9 MHz, op is a sweep
+ */
+static ret_code_t __bench_spi_calib(bench_result_t *const res,
+                                    const uint32_t        scale)
+{
+    ret_code_t    ret   = RET_CODE_SUCCESS;
+    replay_t *    sim   = NULL;
+    uint32_t      iters = BENCH_CALIB_ITERS * scale;
+    uint32_t      hz    = 0;
+    bench_clock_t clk;
+
+    CONTINUE_ON_SUCCESS(__sim_open(&sim, NULL, REPLAY_SPEED_MAX));
+    CONTINUE_ON_SUCCESS(replay_set_sclk_max(sim, BENCH_CALIB_SCLK_MAX));
+    __start(&clk);
+    for (uint32_t i = 0; i < iters; ++i) {
+        CONTINUE_ON_SUCCESS(spi_calib_sweep(&spi, &hz));
+    }
+    __stop(&clk, res, iters);
+    if (hz > BENCH_CALIB_SCLK_MAX) {
+        ret = RET_CODE_ERROR;
+    }
+exit:
+    __sim_close(&sim);
+    return ret;
+}
+
+/**
+ * \brief Shadow flush of the six init registers, all dirty, op is a flush
+ */
+static ret_code_t __bench_shadow_flush(bench_result_t *const res,
+                                       const uint32_t        scale)
+{
+    ret_code_t    ret   = RET_CODE_SUCCESS;
+    replay_t *    sim   = NULL;
+    reg_shadow_t  sh    = { 0 };
+    uint32_t      iters = BENCH_REG_ITERS * scale;
+    bench_clock_t clk;
+
+    CONTINUE_ON_SUCCESS(__sim_open(&sim, NULL, REPLAY_SPEED_MAX));
+    __start(&clk);
+    for (uint32_t i = 0; i < iters; ++i) {
+        reg_shadow_set(&sh, CNFG_GEN, CNFG_GEN_DEFAULT ^ (i & 1));
+        reg_shadow_set(&sh, CNFG_CAL, CNFG_CAL_DEFAULT ^ (i & 1));
+        reg_shadow_set(&sh, CNFG_EMUX, CNFG_EMUX_DEFAULT ^ (i & 1));
+        reg_shadow_set(&sh, CNFG_ECG, CNFG_ECG_DEFAULT ^ (i & 1));
+        reg_shadow_set(&sh, CNFG_RTOR1, CNFG_RTOR1_DEFAULT ^ (i & 1));
+        reg_shadow_set(&sh, MNGR_INT, MNGR_INT_DEFAULT ^ (i & 1));
+        CONTINUE_ON_SUCCESS(reg_shadow_flush(&sh, &spi));
+    }
+    __stop(&clk, res, iters);
+exit:
+    __sim_close(&sim);
+    return ret;
+}
+
+/**
+ * \brief Decoding of burst FIFO bytes, op is a single word
+ */
+static ret_code_t __bench_fifo_decode(bench_result_t *const res,
+                                      const uint32_t        scale)
+{
+    ret_code_t    ret    = RET_CODE_SUCCESS;
+    uint8_t *     buf    = NULL;
+    int32_t *     points = NULL;
+    uint32_t      iters  = BENCH_DECODE_ITERS * scale;
+    uint64_t      ops    = 0;
+    rec_t         rec    = { 0 };
+    bench_clock_t clk;
+
+    buf    = (uint8_t *)malloc(BENCH_DECODE_WORDS * ECG_FIFO_WORD_BYTES);
+    points = (int32_t *)malloc(BENCH_DECODE_WORDS * sizeof(int32_t));
+    CHECK_PTR(buf, ret, RET_CODE_ALLOC_FAIL);
+    CHECK_PTR(points, ret, RET_CODE_ALLOC_FAIL);
+    CONTINUE_ON_SUCCESS(rec_synth(&rec, sample_rate, BENCH_SYNTH_SECONDS));
+
+    for (uint32_t i = 0; i < BENCH_DECODE_WORDS; ++i) {
+        uint32_t word = rec.words[i % rec.words_num];
+        if (i == BENCH_DECODE_WORDS - 1) {
+            word |= ETAG_VALID_EOF << ECG_FIFO_ETAG_SHIFT;
+        }
+        buf[i * ECG_FIFO_WORD_BYTES]     = word >> 16;
+        buf[i * ECG_FIFO_WORD_BYTES + 1] = word >> 8;
+        buf[i * ECG_FIFO_WORD_BYTES + 2] = word;
+    }
+
+    __start(&clk);
+    for (uint32_t i = 0; i < iters; ++i) {
+        ops += max30003_decode_fifo(buf, BENCH_DECODE_WORDS, points);
+    }
+    __stop(&clk, res, ops);
+exit:
+    rec_free(&rec);
+    free(points);
+    free(buf);
+    return ret;
+}
+
+/**
+ * \brief Full acquisition loop of ecg_get_data(), op is a sample
+ */
+static ret_code_t __bench_acq(bench_result_t *const res,
+                              const uint32_t        samples,
+                              const uint32_t        speed,
+                              const uint32_t        poll_mode,
+                              const uint8_t         low_power)
+{
+    ret_code_t    ret      = RET_CODE_SUCCESS;
+    replay_t *    sim      = NULL;
+    ecg_data_t *  ecg_data = __handle(samples);
+    bench_clock_t clk;
+
+    CHECK_PTR(ecg_data, ret, RET_CODE_ALLOC_FAIL);
+    ecg_data->poll_mode = poll_mode;
+    if (low_power) {
+        CONTINUE_ON_SUCCESS(ecg_set_low_power(ecg_data, 0));
+    }
+    CONTINUE_ON_SUCCESS(__sim_open(&sim, ecg_data, speed));
+    __start(&clk);
+    CONTINUE_ON_SUCCESS(ecg_get_data(ecg_data));
+    __stop(&clk, res, ecg_data->data_ID);
+exit:
+    __sim_close(&sim);
+    __handle_free(ecg_data);
+    return ret;
+}
+
+/**
+ * \brief Busy polling as fast as the simulator delivers
+ */
+static ret_code_t __bench_acq_loop(bench_result_t *const res,
+                                   const uint32_t        scale)
+{
+    return __bench_acq(res,
+                       BENCH_ACQ_SAMPLES * scale,
+                       REPLAY_SPEED_MAX,
+                       ECG_POLL_BUSY,
+                       0);
+}
+
+/**
+ * \brief Real time acquisition of a second of samples, CPU per sample
+ * shows the cost of waiting for data
+ */
+static ret_code_t __bench_acq_rt_busy(bench_result_t *const res,
+                                      const uint32_t        scale)
+{
+    return __bench_acq(res,
+                       sample_rate * scale,
+                       REPLAY_SPEED_DEFAULT,
+                       ECG_POLL_BUSY,
+                       0);
+}
+
+static ret_code_t __bench_acq_rt_sched(bench_result_t *const res,
+                                       const uint32_t        scale)
+{
+    return __bench_acq(res,
+                       sample_rate * scale,
+                       REPLAY_SPEED_DEFAULT,
+                       ECG_POLL_SCHED,
+                       0);
+}
+
+/**
+ * \brief Real time acquisition in low power mode, deep EFIT batches
+ */
+static ret_code_t __bench_acq_rt_lowpow(bench_result_t *const res,
+                                        const uint32_t        scale)
+{
+    return __bench_acq(res,
+                       sample_rate * scale,
+                       REPLAY_SPEED_DEFAULT,
+                       ECG_POLL_SCHED,
+                       1);
+}
+
+/**
+ * \brief Start of the steady state of a pipeline run
+ */
+typedef struct {
+    uint64_t samples; /* STAT_SAMPLES_READ before the run */
+    uint64_t allocs;  /* allocations when the steady state started */
+    uint8_t  started;
+} bench_steady_t;
+
+/**
+ * \brief ecg_data_t::batch_hook marking the steady state once every pool
+ * block was filled twice
+ */
+static ret_code_t __steady_mark(ecg_data_t *const ecg_data, void *ctx)
+{
+    bench_steady_t *steady = (bench_steady_t *)ctx;
+    (void)ecg_data;
+
+    if (!steady->started && stats_get(STAT_SAMPLES_READ) - steady->samples >=
+                                    BENCH_POOL_WARMUP) {
+        steady->allocs  = __allocs();
+        steady->started = 1;
+    }
+    return RET_CODE_SUCCESS;
+}
+
+/**
+ * \brief Acquisition, DSP and binary recording sink on their own threads,
+ * busy polling as fast as the simulator delivers, op is a sample
+ */
+static ret_code_t __bench_acq_pipe(bench_result_t *const res,
+                                   const uint32_t        scale)
+{
+    ret_code_t     ret      = RET_CODE_SUCCESS;
+    replay_t *     sim      = NULL;
+    ecg_data_t *   ecg_data = __handle(BENCH_ACQ_SAMPLES * scale);
+    char           path[]   = "/tmp/ecg_bench_XXXXXX";
+    int            fd       = mkstemp(path);
+    bench_steady_t steady   = { 0 };
+    pipe_cfg_t     cfg      = { 0 };
+    bench_clock_t  clk;
+
+    CHECK_PTR(ecg_data, ret, RET_CODE_ALLOC_FAIL);
+    if (fd < 0) {
+        ret = RET_CODE_ERROR;
+        goto exit;
+    }
+    close(fd);
+    CONTINUE_ON_SUCCESS(pipe_cfg_init(&cfg));
+    cfg.output_path = path;
+    cfg.pool        = block_pool_create(PIPE_POOL_BLOCKS, PIPE_BLOCK_POINTS);
+    CHECK_PTR(cfg.pool, ret, RET_CODE_ALLOC_FAIL);
+    ecg_data->poll_mode  = ECG_POLL_BUSY;
+    ecg_data->batch_hook = __steady_mark;
+    ecg_data->batch_ctx  = &steady;
+    CONTINUE_ON_SUCCESS(__sim_open(&sim, ecg_data, REPLAY_SPEED_MAX));
+    steady.samples = stats_get(STAT_SAMPLES_READ);
+    __start(&clk);
+    CONTINUE_ON_SUCCESS(pipe_run(&cfg, ecg_data, NULL));
+    __stop(&clk, res, ecg_data->data_ID);
+    if (steady.started) {
+        /* Threads and blocks are set up, no allocations from here on */
+        res->allocs = __allocs() - steady.allocs;
+        if (res->allocs) {
+            LOG_ERR("%llu allocations in the steady state\n",
+                    (unsigned long long)res->allocs);
+            ret = RET_CODE_ERROR;
+        }
+    }
+exit:
+    if (fd >= 0) {
+        unlink(path);
+    }
+    if (cfg.pool) {
+        block_pool_destroy(&cfg.pool);
+    }
+    __sim_close(&sim);
+    __handle_free(ecg_data);
+    return ret;
+}
+
+/**
+ * \brief Fills the handle with simulated samples for the sink cases
+ */
+static ecg_data_t *__sink_data(const uint32_t samples)
+{
+    rec_t       rec      = { 0 };
+    ecg_data_t *ecg_data = __handle(samples);
+    if (PTR_INVALID(ecg_data) ||
+        RET_UNSUCCESS(rec_synth(&rec, sample_rate, BENCH_SYNTH_SECONDS))) {
+        __handle_free(ecg_data);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < samples; ++i) {
+        ecg_data->data_arr[i] = REC_WORD_TO_LEGACY(rec.words[i % rec.words_num]);
+    }
+    ecg_data->data_ID = samples;
+    rec_free(&rec);
+    return ecg_data;
+}
+
+/**
+ * \brief Text sink: ecg_print_data() into /dev/null, op is a sample
+ */
+static ret_code_t __bench_sink_text(bench_result_t *const res,
+                                    const uint32_t        scale)
+{
+    ret_code_t    ret      = RET_CODE_SUCCESS;
+    uint32_t      samples  = BENCH_SINK_SAMPLES * scale;
+    ecg_data_t *  ecg_data = __sink_data(samples);
+    bench_clock_t clk;
+
+    CHECK_PTR(ecg_data, ret, RET_CODE_ALLOC_FAIL);
+    __start(&clk);
+    CONTINUE_ON_SUCCESS(ecg_print_data(ecg_data));
+    fflush(stdout);
+    __stop(&clk, res, samples);
+exit:
+    __handle_free(ecg_data);
+    return ret;
+}
+
+/**
+ * \brief Binary recording sink: rec_save() to a temporary file
+ */
+static ret_code_t __bench_sink_rec(bench_result_t *const res,
+                                   const uint32_t        scale)
+{
+    ret_code_t    ret      = RET_CODE_SUCCESS;
+    uint32_t      samples  = BENCH_SINK_SAMPLES * scale;
+    ecg_data_t *  ecg_data = __sink_data(samples);
+    char          path[]   = "/tmp/ecg_bench_XXXXXX";
+    int           fd       = mkstemp(path);
+    bench_clock_t clk;
+
+    CHECK_PTR(ecg_data, ret, RET_CODE_ALLOC_FAIL);
+    if (fd < 0) {
+        ret = RET_CODE_ERROR;
+        goto exit;
+    }
+    close(fd);
+    __start(&clk);
+    CONTINUE_ON_SUCCESS(rec_save(path, ecg_data));
+    __stop(&clk, res, samples);
+exit:
+    if (fd >= 0) {
+        unlink(path);
+    }
+    __handle_free(ecg_data);
+    return ret;
+}
+
+/**
+ * \brief Baseline removal of the DSP stage, op is a sample
+ */
+static ret_code_t __bench_dsp_filter(bench_result_t *const res,
+                                     const uint32_t        scale)
+{
+    ret_code_t    ret      = RET_CODE_SUCCESS;
+    uint32_t      samples  = BENCH_DSP_SAMPLES * scale;
+    ecg_data_t *  ecg_data = __sink_data(samples);
+    int32_t *     out      = (int32_t *)malloc(samples * sizeof(int32_t));
+    dsp_t         dsp;
+    bench_clock_t clk;
+
+    CHECK_PTR(ecg_data, ret, RET_CODE_ALLOC_FAIL);
+    CHECK_PTR(out, ret, RET_CODE_ALLOC_FAIL);
+    CONTINUE_ON_SUCCESS(dsp_init(&dsp, ecg_data->cnfg_ecg));
+    __start(&clk);
+    dsp_process(&dsp, ecg_data->data_arr, out, samples);
+    __stop(&clk, res, samples);
+exit:
+    free(out);
+    __handle_free(ecg_data);
+    return ret;
+}
+
+/**
+ * \brief QRS detection on filtered samples, op is a sample
+ */
+static ret_code_t __bench_qrs_detect(bench_result_t *const res,
+                                     const uint32_t        scale)
+{
+    ret_code_t    ret      = RET_CODE_SUCCESS;
+    uint32_t      samples  = BENCH_DSP_SAMPLES * scale;
+    ecg_data_t *  ecg_data = __sink_data(samples);
+    int32_t *     out      = (int32_t *)malloc(samples * sizeof(int32_t));
+    dsp_t         dsp;
+    qrs_t         qrs;
+    bench_clock_t clk;
+
+    CHECK_PTR(ecg_data, ret, RET_CODE_ALLOC_FAIL);
+    CHECK_PTR(out, ret, RET_CODE_ALLOC_FAIL);
+    CONTINUE_ON_SUCCESS(dsp_init(&dsp, ecg_data->cnfg_ecg));
+    CONTINUE_ON_SUCCESS(qrs_init(&qrs, ecg_data->cnfg_ecg, 0));
+    dsp_process(&dsp, ecg_data->data_arr, out, samples);
+    __start(&clk);
+    qrs_process(&qrs, ecg_data->data_arr, out, samples, NULL, 0);
+    __stop(&clk, res, samples);
+exit:
+    free(out);
+    __handle_free(ecg_data);
+    return ret;
+}
+
+/**
+ * \brief Spectral signal quality of raw points, op is a sample
+ */
+static ret_code_t __bench_sqi_window(bench_result_t *const res,
+                                     const uint32_t        scale)
+{
+    ret_code_t    ret      = RET_CODE_SUCCESS;
+    uint32_t      samples  = BENCH_DSP_SAMPLES * scale;
+    ecg_data_t *  ecg_data = __sink_data(samples);
+    sqi_t *       sqi      = (sqi_t *)malloc(sizeof(sqi_t));
+    bench_clock_t clk;
+
+    CHECK_PTR(ecg_data, ret, RET_CODE_ALLOC_FAIL);
+    CHECK_PTR(sqi, ret, RET_CODE_ALLOC_FAIL);
+    CONTINUE_ON_SUCCESS(sqi_init(sqi, ecg_data->cnfg_ecg, 0));
+    __start(&clk);
+    sqi_process(sqi, ecg_data->data_arr, samples, NULL, 0);
+    __stop(&clk, res, samples);
+exit:
+    free(sqi);
+    __handle_free(ecg_data);
+    return ret;
+}
+
+/**
+ * \brief Sliding window update of the time domain HRV, op is an RR interval
+ */
+static ret_code_t __bench_hrv_update(bench_result_t *const res,
+                                     const uint32_t        scale)
+{
+    uint32_t      beats = BENCH_HRV_BEATS * scale;
+    hrv_t         hrv;
+    bench_clock_t clk;
+
+    hrv_init(&hrv, HRV_WINDOW_S_DEFAULT, 0);
+    __start(&clk);
+    for (uint32_t i = 0; i < beats; ++i) {
+        hrv_add_rr(&hrv, 800 + (i * 37) % 97);
+    }
+    __stop(&clk, res, beats);
+    return RET_CODE_SUCCESS;
+}
+
+/**
+ * \brief LF/HF of a full 5 minutes window, op is a spectral update
+ */
+static ret_code_t __bench_hrv_spectral(bench_result_t *const res,
+                                       const uint32_t        scale)
+{
+    uint32_t      iters = BENCH_HRV_SPEC_ITERS * scale;
+    hrv_t         hrv;
+    bench_clock_t clk;
+
+    hrv_init(&hrv, HRV_WINDOW_S_DEFAULT, 0);
+    for (uint32_t i = 0; i < HRV_RR_MAX; ++i) {
+        hrv_add_rr(&hrv, 800 + (i * 37) % 97);
+    }
+    __start(&clk);
+    for (uint32_t i = 0; i < iters; ++i) {
+        hrv_spectral(&hrv);
+    }
+    __stop(&clk, res, iters);
+    return RET_CODE_SUCCESS;
+}
+
+/**
+ * \brief Cost of a single hot path counter increment
+ */
+static ret_code_t __bench_stats_add(bench_result_t *const res,
+                                    const uint32_t        scale)
+{
+    uint32_t      iters = BENCH_STATS_ITERS * scale;
+    bench_clock_t clk;
+
+    STAT_INC(STAT_EMPTY_POLLS); /* shard allocation out of the loop */
+    __start(&clk);
+    for (uint32_t i = 0; i < iters; ++i) {
+        STAT_INC(STAT_EMPTY_POLLS);
+    }
+    __stop(&clk, res, iters);
+    return RET_CODE_SUCCESS;
+}
+
+/**
+ * \brief Throughput of the SPSC queue between pipeline stages, a producer
+ * and a consumer thread, op is a range pushed and popped
+ */
+static ret_code_t __bench_queue_spsc(bench_result_t *const res,
+                                     const uint32_t        scale)
+{
+    ret_code_t         ret = RET_CODE_SUCCESS;
+    uint64_t           ops = (uint64_t)BENCH_QUEUE_OPS * scale;
+    pipe_queue_stats_t qs;
+    bench_clock_t      clk;
+
+    __start(&clk);
+    CONTINUE_ON_SUCCESS(pipe_queue_run(ops, &qs));
+    __stop(&clk, res, ops);
+    LOG_INFO("Queue: depth max %u/%u mean %.2f, %llu full\n",
+             qs.max_depth,
+             PIPE_QUEUE_LEN,
+             qs.mean_depth,
+             (unsigned long long)qs.full);
+exit:
+    return ret;
+}
+
+/**
+ * \brief Cost of recording a single trace event
+ */
+static ret_code_t __bench_trace_event(bench_result_t *const res,
+                                      const uint32_t        scale)
+{
+    uint32_t      iters = BENCH_TRACE_ITERS * scale;
+    bench_clock_t clk;
+
+    TRACE(TRACE_EV_STATUS, 0, 0); /* ring allocation out of the loop */
+    __start(&clk);
+    for (uint32_t i = 0; i < iters; ++i) {
+        TRACE(TRACE_EV_SAMPLE, i, 0);
+    }
+    __stop(&clk, res, iters);
+    return RET_CODE_SUCCESS;
+}
+
+/**
+ * \brief Cost of a LOG_ERR() call on the caller side during a log storm
+ * (the call site is rate limited after LOG_RATE_LIMIT_PER_S messages)
+ */
+static ret_code_t __bench_log_storm(bench_result_t *const res,
+                                    const uint32_t        scale)
+{
+    uint32_t      iters = BENCH_LOG_ITERS * scale;
+    bench_clock_t clk;
+
+    if (log_start()) {
+        return RET_CODE_ERROR;
+    }
+    __start(&clk);
+    for (uint32_t i = 0; i < iters; ++i) {
+        LOG_ERR("FIFO overflow, status %x sample %u\n", EOVF, i);
+    }
+    __stop(&clk, res, iters);
+    log_stop();
+    return RET_CODE_SUCCESS;
+}
+
+static const struct {
+    const char *name;
+    bench_fn_t  fn;
+} cases[] = {
+    { "spi_read_reg", __bench_spi_read_reg },
+    { "spi_write_reg", __bench_spi_write_reg },
+    { "shadow_flush", __bench_shadow_flush },
+    { "spi_calib", __bench_spi_calib },
+    { "start_cold", __bench_start_cold },
+    { "start_warm", __bench_start_warm },
+    { "reconf_gain", __bench_reconf_gain },
+    { "reconf_rate", __bench_reconf_rate },
+    { "fifo_decode", __bench_fifo_decode },
+    { "acq_loop", __bench_acq_loop },
+    { "acq_rt_busy", __bench_acq_rt_busy },
+    { "acq_rt_sched", __bench_acq_rt_sched },
+    { "acq_rt_lowpow", __bench_acq_rt_lowpow },
+    { "acq_pipe", __bench_acq_pipe },
+    { "dsp_filter", __bench_dsp_filter },
+    { "qrs_detect", __bench_qrs_detect },
+    { "sqi_window", __bench_sqi_window },
+    { "hrv_update", __bench_hrv_update },
+    { "hrv_spectral", __bench_hrv_spectral },
+    { "sink_text", __bench_sink_text },
+    { "sink_rec", __bench_sink_rec },
+    { "queue_spsc", __bench_queue_spsc },
+    { "stats_add", __bench_stats_add },
+    { "trace_event", __bench_trace_event },
+    { "log_storm", __bench_log_storm },
+};
+
+static void __print_header(FILE *const out, const bench_fmt_t fmt)
+{
+    struct utsname uts = { 0 };
+    uname(&uts);
+    if (fmt == BENCH_FMT_CSV) {
+        fprintf(out,
+                "name,ops,wall_ns_per_op,cpu_ns_per_op,ops_per_sec,allocs\n");
+        return;
+    }
+    fprintf(out,
+            "{\n  \"machine\": \"%s\",\n  \"sample_rate\": %u,\n"
+            "  \"results\": [",
+            uts.machine,
+            sample_rate);
+}
+
+static void __print_result(FILE *const                 out,
+                           const bench_fmt_t           fmt,
+                           const bench_result_t *const res,
+                           const uint8_t               first)
+{
+    double ops     = res->ops ? (double)res->ops : 1;
+    double per_sec = res->wall_ns ? res->ops * BENCH_NSEC_IN_SEC / res->wall_ns
+                                  : 0;
+    if (fmt == BENCH_FMT_CSV) {
+        fprintf(out,
+                "%s,%llu,%.2f,%.2f,%.0f,%llu\n",
+                res->name,
+                (unsigned long long)res->ops,
+                res->wall_ns / ops,
+                res->cpu_ns / ops,
+                per_sec,
+                (unsigned long long)res->allocs);
+        return;
+    }
+    fprintf(out,
+            "%s\n    { \"name\": \"%s\", \"ops\": %llu, "
+            "\"wall_ns_per_op\": %.2f, \"cpu_ns_per_op\": %.2f, "
+            "\"ops_per_sec\": %.0f, \"allocs\": %llu }",
+            first ? "" : ",",
+            res->name,
+            (unsigned long long)res->ops,
+            res->wall_ns / ops,
+            res->cpu_ns / ops,
+            per_sec,
+            (unsigned long long)res->allocs);
+}
+
+static void __print_footer(FILE *const out, const bench_fmt_t fmt)
+{
+    if (fmt == BENCH_FMT_JSON) {
+        fprintf(out, "\n  ]\n}\n");
+    }
+}
+
+static void print_usage(void)
+{
+    fprintf(stderr,
+            "ecg_bench [-f json|csv] [-o file] [-c case] [-n scale] "
+            "[-S 128|256|512]\n"
+            "-f --format  output format (default json)\n"
+            "-o --output  results file (default stdout)\n"
+            "-c --case    run cases which names contain the string\n"
+            "-n --scale   iterations multiplier (default 1)\n"
+            "-S --s_rate  simulated sample rate (default 512)\n");
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    bench_fmt_t fmt    = BENCH_FMT_JSON;
+    const char *filter = NULL;
+    const char *path   = NULL;
+    uint32_t    scale  = 1;
+    uint8_t     first  = 1;
+    FILE *      out    = NULL;
+    int         c;
+
+    static const struct option lopts[] = {
+        { "format", 1, 0, 'f' }, { "output", 1, 0, 'o' },
+        { "case", 1, 0, 'c' },   { "scale", 1, 0, 'n' },
+        { "s_rate", 1, 0, 'S' }, { NULL, 0, 0, 0 },
+    };
+    while ((c = getopt_long(argc, argv, "f:o:c:n:S:", lopts, NULL)) != -1) {
+        switch (c) {
+        case 'f':
+            fmt = strcmp(optarg, "csv") ? BENCH_FMT_JSON : BENCH_FMT_CSV;
+            break;
+        case 'o':
+            path = optarg;
+            break;
+        case 'c':
+            filter = optarg;
+            break;
+        case 'n':
+            scale = atoi(optarg) > 0 ? atoi(optarg) : 1;
+            break;
+        case 'S':
+            sample_rate = atoi(optarg);
+            if (sample_rate != 128 && sample_rate != 256 && sample_rate != 512) {
+                print_usage();
+            }
+            break;
+        default:
+            print_usage();
+        }
+    }
+
+    /* Results go to the original stdout, driver logs and the text sink
+     * output are thrown away */
+    out = path ? fopen(path, "w") : fdopen(dup(STDOUT_FILENO), "w");
+    EXIT_ON_NULL(out);
+    EXIT_ON_NULL(freopen("/dev/null", "w", stdout));
+
+    __print_header(out, fmt);
+    for (uint32_t i = 0; i < ARRAY_SIZE(cases); ++i) {
+        bench_result_t res = { 0 };
+        if (filter && !strstr(cases[i].name, filter)) {
+            continue;
+        }
+        snprintf(res.name, sizeof res.name, "%s", cases[i].name);
+        if (RET_UNSUCCESS(cases[i].fn(&res, scale))) {
+            fprintf(stderr, "Benchmark %s failed\n", cases[i].name);
+            continue;
+        }
+        __print_result(out, fmt, &res, first);
+        first = 0;
+    }
+    __print_footer(out, fmt);
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,349 @@
+/**
+ * \file fault_bench.c
+ *
+ * \brief Stress benchmark of the acquisition under injected bus faults.
+ * Each fault profile (see fault_inj.h) runs a real time acquisition of the
+ * simulator behind the fault injector, results report throughput, samples
+ * lost and the recovery gaps of the supervisor as JSON or CSV.
+ */
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include "common_types.h"
+#include "common_check.h"
+#include "spi.h"
+#include "MAX30003.h"
+#include "reg_shadow.h"
+#include "replay.h"
+#include "fault_inj.h"
+#include "stats.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE MAIN_PRINT_EN
+#define DBG_TAG      "fault_bench.c"
+#include "Log_dbg.h"
+
+#define BENCH_NSEC_IN_SEC   1000000000.0
+#define BENCH_NSEC_IN_USEC  1000.0
+#define BENCH_SYNTH_SECONDS 60
+#define BENCH_RUN_SECONDS   5
+#define BENCH_VERIFY_PERIOD 4 /* batches between readbacks, finds resets */
+
+spi_t spi;
+
+typedef enum {
+    BENCH_FMT_JSON = 0,
+    BENCH_FMT_CSV,
+} bench_fmt_t;
+
+/**
+ * \brief Result of a fault profile run
+ */
+typedef struct {
+    char           name[FAULT_NAME_LEN];
+    ret_code_t     ret;      /* ecg_get_data() result */
+    double         wall_ns;  /* acquisition wall clock time */
+    uint64_t       samples;  /* valid samples stored */
+    uint64_t       produced; /* samples of the modelled chip */
+    uint64_t       lost;     /* overflows and FIFO flushes of the chip */
+    uint64_t       recoveries;
+    uint64_t       gaps;
+    uint64_t       gap_ns;
+    uint64_t       spi_errors;
+    fault_counts_t inj; /* faults injected during the acquisition */
+} bench_result_t;
+
+static uint32_t sample_rate = 512;
+static uint64_t seed        = FAULT_SEED_DEFAULT;
+
+static double __clock_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * BENCH_NSEC_IN_SEC + ts.tv_nsec;
+}
+
+/**
+ * \brief Fresh handle with the sample rate of the simulated signal
+ */
+static ecg_data_t *__handle(const uint32_t data_len)
+{
+    ecg_data_t *ecg_data = ecg_create_handle();
+    if (PTR_INVALID(ecg_data) ||
+        RET_UNSUCCESS(ecg_init_handle(ecg_data)) ||
+        RET_UNSUCCESS(ecg_set_data_len(ecg_data, data_len))) {
+        return NULL;
+    }
+    BITMASK_CLEAR(ecg_data->cnfg_ecg, ECG_GAIN_512_RESET);
+    if (sample_rate == 256) {
+        BITMASK_SET(ecg_data->cnfg_ecg, ECG_RATE_256);
+    } else if (sample_rate == 128) {
+        BITMASK_SET(ecg_data->cnfg_ecg, ECG_RATE_128);
+    }
+    return ecg_data;
+}
+
+/**
+ * \brief Injector counters of the acquisition only
+ */
+static void __counts_delta(fault_counts_t *const       now,
+                           const fault_counts_t *const before)
+{
+    now->messages -= before->messages;
+    now->failed -= before->failed;
+    now->delayed -= before->delayed;
+    now->flips -= before->flips;
+    now->ovfs -= before->ovfs;
+    now->stuck -= before->stuck;
+    now->resets -= before->resets;
+}
+
+/**
+ * \brief Chip is configured without faults, the profile is enabled for the
+ * acquisition only. A failed acquisition is reported, not skipped.
+ */
+static ret_code_t __bench_profile(bench_result_t *const        res,
+                                  const fault_profile_t *const profile,
+                                  const uint32_t               scale)
+{
+    ret_code_t      ret      = RET_CODE_SUCCESS;
+    replay_t *      sim      = NULL;
+    fault_inj_t *   fi       = NULL;
+    ecg_data_t *    ecg_data = NULL;
+    fault_profile_t clean    = { 0 };
+    fault_counts_t  before   = { 0 };
+    uint64_t        samples, recoveries, gaps, gap_ns, spi_errors;
+    double          wall;
+
+    memset(&spi, 0, sizeof spi);
+    ecg_data = __handle(sample_rate * BENCH_RUN_SECONDS * scale);
+    CHECK_PTR(ecg_data, ret, RET_CODE_ALLOC_FAIL);
+    ecg_data->poll_mode = ECG_POLL_SCHED;
+    sim = replay_open_synth(sample_rate,
+                            BENCH_SYNTH_SECONDS,
+                            REPLAY_SPEED_DEFAULT);
+    CHECK_PTR(sim, ret, RET_CODE_ALLOC_FAIL);
+    fi = fault_inj_open(&clean);
+    CHECK_PTR(fi, ret, RET_CODE_ALLOC_FAIL);
+    CONTINUE_ON_SUCCESS(replay_attach(sim, &spi));
+    CONTINUE_ON_SUCCESS(fault_inj_attach(fi, &spi));
+    CONTINUE_ON_SUCCESS(spi_init(&spi));
+    CONTINUE_ON_SUCCESS(max30003_init(ecg_data));
+    max30003_shadow.verify_period = BENCH_VERIFY_PERIOD;
+
+    CONTINUE_ON_SUCCESS(fault_inj_set_profile(fi, profile));
+    CONTINUE_ON_SUCCESS(fault_inj_counts(fi, &before));
+    res->produced = replay_samples_produced(sim);
+    res->lost     = replay_samples_lost(sim) + replay_samples_dropped(sim);
+    samples       = stats_get(STAT_SAMPLES_READ);
+    recoveries    = stats_get(STAT_RECOVERIES);
+    gaps          = stats_get(STAT_RECOVER_GAPS);
+    gap_ns        = stats_get(STAT_RECOVER_GAP_NS);
+    spi_errors    = stats_get(STAT_SPI_ERRORS);
+    wall          = __clock_ns();
+    res->ret      = ecg_get_data(ecg_data);
+    res->wall_ns  = __clock_ns() - wall;
+
+    res->produced   = replay_samples_produced(sim) - res->produced;
+    res->lost       = replay_samples_lost(sim) + replay_samples_dropped(sim) -
+                      res->lost;
+    res->samples    = stats_get(STAT_SAMPLES_READ) - samples;
+    res->recoveries = stats_get(STAT_RECOVERIES) - recoveries;
+    res->gaps       = stats_get(STAT_RECOVER_GAPS) - gaps;
+    res->gap_ns     = stats_get(STAT_RECOVER_GAP_NS) - gap_ns;
+    res->spi_errors = stats_get(STAT_SPI_ERRORS) - spi_errors;
+    CONTINUE_ON_SUCCESS(fault_inj_counts(fi, &res->inj));
+    __counts_delta(&res->inj, &before);
+exit:
+    max30003_shadow.verify_period = 0;
+    spi_free(&spi);
+    fault_inj_close(&fi);
+    replay_close(&sim);
+    if (ecg_data) {
+        ecg_delete_handle(&ecg_data);
+    }
+    return ret;
+}
+
+static void __print_header(FILE *const out, const bench_fmt_t fmt)
+{
+    if (fmt == BENCH_FMT_CSV) {
+        fprintf(out,
+                "profile,status,samples,samples_per_sec,lost,loss_ppm,"
+                "recoveries,gaps,gap_us_mean,spi_errors,injected_failed,"
+                "injected_delayed,injected_flips,injected_ovfs,"
+                "injected_stuck,injected_resets\n");
+        return;
+    }
+    fprintf(out,
+            "{\n  \"sample_rate\": %u,\n  \"seed\": %llu,\n"
+            "  \"results\": [",
+            sample_rate,
+            (unsigned long long)seed);
+}
+
+static void __print_result(FILE *const                 out,
+                           const bench_fmt_t           fmt,
+                           const bench_result_t *const res,
+                           const uint8_t               first)
+{
+    double per_sec  = res->wall_ns ?
+                              res->samples * BENCH_NSEC_IN_SEC / res->wall_ns :
+                              0;
+    double loss_ppm = res->produced ?
+                              (double)res->lost * FAULT_PPM / res->produced :
+                              0;
+    double gap_us   = res->gaps ?
+                              res->gap_ns / BENCH_NSEC_IN_USEC / res->gaps :
+                              0;
+    if (fmt == BENCH_FMT_CSV) {
+        fprintf(out,
+                "%s,%s,%llu,%.1f,%llu,%.0f,%llu,%llu,%.0f,%llu,"
+                "%llu,%llu,%llu,%llu,%llu,%llu\n",
+                res->name,
+                res->ret ? "failed" : "ok",
+                (unsigned long long)res->samples,
+                per_sec,
+                (unsigned long long)res->lost,
+                loss_ppm,
+                (unsigned long long)res->recoveries,
+                (unsigned long long)res->gaps,
+                gap_us,
+                (unsigned long long)res->spi_errors,
+                (unsigned long long)res->inj.failed,
+                (unsigned long long)res->inj.delayed,
+                (unsigned long long)res->inj.flips,
+                (unsigned long long)res->inj.ovfs,
+                (unsigned long long)res->inj.stuck,
+                (unsigned long long)res->inj.resets);
+        return;
+    }
+    fprintf(out,
+            "%s\n    { \"profile\": \"%s\", \"status\": \"%s\", "
+            "\"samples\": %llu, \"samples_per_sec\": %.1f, \"lost\": %llu, "
+            "\"loss_ppm\": %.0f, \"recoveries\": %llu, \"gaps\": %llu, "
+            "\"gap_us_mean\": %.0f, \"spi_errors\": %llu, \"injected\": "
+            "{ \"failed\": %llu, \"delayed\": %llu, \"flips\": %llu, "
+            "\"ovfs\": %llu, \"stuck\": %llu, \"resets\": %llu } }",
+            first ? "" : ",",
+            res->name,
+            res->ret ? "failed" : "ok",
+            (unsigned long long)res->samples,
+            per_sec,
+            (unsigned long long)res->lost,
+            loss_ppm,
+            (unsigned long long)res->recoveries,
+            (unsigned long long)res->gaps,
+            gap_us,
+            (unsigned long long)res->spi_errors,
+            (unsigned long long)res->inj.failed,
+            (unsigned long long)res->inj.delayed,
+            (unsigned long long)res->inj.flips,
+            (unsigned long long)res->inj.ovfs,
+            (unsigned long long)res->inj.stuck,
+            (unsigned long long)res->inj.resets);
+}
+
+static void __print_footer(FILE *const out, const bench_fmt_t fmt)
+{
+    if (fmt == BENCH_FMT_JSON) {
+        fprintf(out, "\n  ]\n}\n");
+    }
+}
+
+static void print_usage(void)
+{
+    fprintf(stderr,
+            "fault_bench [-f json|csv] [-o file] [-c profile] [-n scale] "
+            "[-S 128|256|512] [-s seed]\n"
+            "-f --format  output format (default json)\n"
+            "-o --output  results file (default stdout)\n"
+            "-c --case    run profiles which names contain the string\n"
+            "-n --scale   acquisition length, multiple of %u s (default 1)\n"
+            "-S --s_rate  simulated sample rate (default 512)\n"
+            "-s --seed    fault generator seed (default %u)\n",
+            BENCH_RUN_SECONDS,
+            FAULT_SEED_DEFAULT);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    bench_fmt_t fmt    = BENCH_FMT_JSON;
+    const char *filter = NULL;
+    const char *path   = NULL;
+    const char *name   = NULL;
+    uint32_t    scale  = 1;
+    uint8_t     first  = 1;
+    FILE *      out    = NULL;
+    int         c;
+
+    static const struct option lopts[] = {
+        { "format", 1, 0, 'f' }, { "output", 1, 0, 'o' },
+        { "case", 1, 0, 'c' },   { "scale", 1, 0, 'n' },
+        { "s_rate", 1, 0, 'S' }, { "seed", 1, 0, 's' },
+        { NULL, 0, 0, 0 },
+    };
+    while ((c = getopt_long(argc, argv, "f:o:c:n:S:s:", lopts, NULL)) != -1) {
+        switch (c) {
+        case 'f':
+            fmt = strcmp(optarg, "csv") ? BENCH_FMT_JSON : BENCH_FMT_CSV;
+            break;
+        case 'o':
+            path = optarg;
+            break;
+        case 'c':
+            filter = optarg;
+            break;
+        case 'n':
+            scale = atoi(optarg) > 0 ? atoi(optarg) : 1;
+            break;
+        case 'S':
+            sample_rate = atoi(optarg);
+            if (sample_rate != 128 && sample_rate != 256 && sample_rate != 512) {
+                print_usage();
+            }
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        default:
+            print_usage();
+        }
+    }
+
+    /* Results go to the original stdout, driver logs are thrown away */
+    out = path ? fopen(path, "w") : fdopen(dup(STDOUT_FILENO), "w");
+    EXIT_ON_NULL(out);
+    EXIT_ON_NULL(freopen("/dev/null", "w", stdout));
+
+    __print_header(out, fmt);
+    for (uint32_t i = 0; (name = fault_profile_name(i)); ++i) {
+        bench_result_t  res     = { 0 };
+        fault_profile_t profile = { 0 };
+        if (filter && !strstr(name, filter)) {
+            continue;
+        }
+        if (RET_UNSUCCESS(fault_profile_parse(&profile, name))) {
+            continue;
+        }
+        profile.seed = seed;
+        snprintf(res.name, sizeof res.name, "%s", name);
+        if (RET_UNSUCCESS(__bench_profile(&res, &profile, scale))) {
+            fprintf(stderr, "Benchmark %s failed\n", name);
+            continue;
+        }
+        if (res.ret) {
+            fprintf(stderr, "Acquisition under %s failed\n", name);
+        }
+        __print_result(out, fmt, &res, first);
+        fflush(out);
+        first = 0;
+    }
+    __print_footer(out, fmt);
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,353 @@
+/**
+ * \file latency_bench.c
+ *
+ * \brief Latency against CPU benchmark of the acquisition pipeline. Each
+ * polling configuration (poll mode and EFIT) runs the threaded pipeline
+ * against the simulator in real time, results report process CPU, polling
+ * wake-ups and the latency histograms of stats.h as JSON or CSV.
+ */
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include "common_types.h"
+#include "common_check.h"
+#include "spi.h"
+#include "MAX30003.h"
+#include "replay.h"
+#include "pipeline.h"
+#include "stats.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE MAIN_PRINT_EN
+#define DBG_TAG      "latency_bench.c"
+#include "Log_dbg.h"
+
+#define BENCH_NSEC_IN_SEC   1000000000.0
+#define BENCH_NSEC_IN_USEC  1000.0
+#define BENCH_SYNTH_SECONDS 60
+#define BENCH_RUN_SECONDS   2
+#define BENCH_NAME_LEN      16
+
+spi_t spi;
+
+typedef enum {
+    BENCH_FMT_JSON = 0,
+    BENCH_FMT_CSV,
+} bench_fmt_t;
+
+typedef enum {
+    BENCH_POLL_BUSY = 0, /* ECG_POLL_BUSY */
+    BENCH_POLL_SCHED,    /* ECG_POLL_SCHED */
+    BENCH_POLL_LOWPOW,   /* ecg_set_low_power() */
+} bench_poll_t;
+
+static const char *const poll_names[] = {
+    [BENCH_POLL_BUSY]   = "busy",
+    [BENCH_POLL_SCHED]  = "sched",
+    [BENCH_POLL_LOWPOW] = "lowpow",
+};
+
+/**
+ * \brief Polling configurations swept, busy polling reads single words
+ * whatever EFIT is
+ */
+static const struct {
+    bench_poll_t poll;
+    uint32_t     efit;
+} configs[] = {
+    { BENCH_POLL_BUSY, 1 },    { BENCH_POLL_SCHED, 1 },
+    { BENCH_POLL_SCHED, 2 },   { BENCH_POLL_SCHED, 4 },
+    { BENCH_POLL_SCHED, 8 },   { BENCH_POLL_SCHED, 16 },
+    { BENCH_POLL_SCHED, 32 },  { BENCH_POLL_LOWPOW, 4 },
+    { BENCH_POLL_LOWPOW, 8 },  { BENCH_POLL_LOWPOW, 16 },
+    { BENCH_POLL_LOWPOW, 28 },
+};
+
+/**
+ * \brief Result of a polling configuration
+ */
+typedef struct {
+    char        name[BENCH_NAME_LEN];
+    uint32_t    efit;
+    uint32_t    samples;
+    double      wall_ns;
+    double      cpu_ns; /* process CPU, all the stages */
+    uint64_t    wakeups;
+    stats_lat_t lat[LAT_NUM];
+} bench_result_t;
+
+static uint32_t sample_rate = 512;
+static uint32_t block_min   = PIPE_BLOCK_MIN;
+
+static double __clock_ns(const clockid_t clk)
+{
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return ts.tv_sec * BENCH_NSEC_IN_SEC + ts.tv_nsec;
+}
+
+/**
+ * \brief Fresh handle with the sample rate of the simulated signal
+ */
+static ecg_data_t *__handle(const uint32_t data_len)
+{
+    ecg_data_t *ecg_data = ecg_create_handle();
+    if (PTR_INVALID(ecg_data) ||
+        RET_UNSUCCESS(ecg_init_handle(ecg_data)) ||
+        RET_UNSUCCESS(ecg_set_data_len(ecg_data, data_len))) {
+        return NULL;
+    }
+    BITMASK_CLEAR(ecg_data->cnfg_ecg, ECG_GAIN_512_RESET);
+    if (sample_rate == 256) {
+        BITMASK_SET(ecg_data->cnfg_ecg, ECG_RATE_256);
+    } else if (sample_rate == 128) {
+        BITMASK_SET(ecg_data->cnfg_ecg, ECG_RATE_128);
+    }
+    return ecg_data;
+}
+
+/**
+ * \brief Real time pipeline run of a polling configuration, the text sink
+ * writes to /dev/null
+ */
+static ret_code_t __bench_config(bench_result_t *const res,
+                                 const bench_poll_t    poll,
+                                 const uint32_t        efit,
+                                 const uint32_t        scale)
+{
+    ret_code_t  ret      = RET_CODE_SUCCESS;
+    replay_t *  sim      = NULL;
+    ecg_data_t *ecg_data = NULL;
+    pipe_cfg_t  cfg      = { 0 };
+    double      wall, cpu;
+
+    memset(&spi, 0, sizeof spi);
+    ecg_data = __handle(sample_rate * BENCH_RUN_SECONDS * scale);
+    CHECK_PTR(ecg_data, ret, RET_CODE_ALLOC_FAIL);
+    if (poll == BENCH_POLL_LOWPOW) {
+        CONTINUE_ON_SUCCESS(ecg_set_low_power(ecg_data, efit));
+    } else {
+        BITMASK_CLEAR(ecg_data->mngr_int, EFIT_1_RESET);
+        BITMASK_SET(ecg_data->mngr_int, EFIT_WORDS(efit));
+        ecg_data->efit      = efit;
+        ecg_data->poll_mode = poll == BENCH_POLL_BUSY ? ECG_POLL_BUSY :
+                                                        ECG_POLL_SCHED;
+    }
+    CONTINUE_ON_SUCCESS(pipe_cfg_init(&cfg));
+    cfg.block_min = block_min;
+    sim = replay_open_synth(sample_rate,
+                            BENCH_SYNTH_SECONDS,
+                            REPLAY_SPEED_DEFAULT);
+    CHECK_PTR(sim, ret, RET_CODE_ALLOC_FAIL);
+    CONTINUE_ON_SUCCESS(replay_attach(sim, &spi));
+    CONTINUE_ON_SUCCESS(spi_init(&spi));
+    CONTINUE_ON_SUCCESS(max30003_init(ecg_data));
+
+    stats_lat_reset();
+    res->wakeups = stats_get(STAT_POLL_WAKEUPS);
+    wall         = __clock_ns(CLOCK_MONOTONIC);
+    cpu          = __clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+    CONTINUE_ON_SUCCESS(pipe_run(&cfg, ecg_data, NULL));
+    fflush(stdout);
+    res->wall_ns = __clock_ns(CLOCK_MONOTONIC) - wall;
+    res->cpu_ns  = __clock_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+    res->wakeups = stats_get(STAT_POLL_WAKEUPS) - res->wakeups;
+    res->samples = ecg_data->data_ID;
+    for (uint32_t i = 0; i < LAT_NUM; ++i) {
+        stats_lat_get((lat_id_t)i, &res->lat[i]);
+    }
+exit:
+    spi_free(&spi);
+    replay_close(&sim);
+    if (ecg_data) {
+        ecg_delete_handle(&ecg_data);
+    }
+    return ret;
+}
+
+static void __print_header(FILE *const out, const bench_fmt_t fmt)
+{
+    if (fmt == BENCH_FMT_CSV) {
+        fprintf(out,
+                "poll,efit,block_min,samples,cpu_pct,wakeups_per_sec,stage,"
+                "count,mean_us,p50_us,p99_us,p999_us,max_us\n");
+        return;
+    }
+    fprintf(out,
+            "{\n  \"sample_rate\": %u,\n  \"block_min\": %u,\n"
+            "  \"results\": [",
+            sample_rate,
+            block_min);
+}
+
+static void __print_result(FILE *const                 out,
+                           const bench_fmt_t           fmt,
+                           const bench_result_t *const res,
+                           const uint8_t               first)
+{
+    double  cpu_pct = res->wall_ns ? res->cpu_ns * 100 / res->wall_ns : 0;
+    double  wakeups = res->wall_ns ?
+                              res->wakeups * BENCH_NSEC_IN_SEC / res->wall_ns :
+                              0;
+    uint8_t first_lat = 1;
+
+    if (fmt == BENCH_FMT_JSON) {
+        fprintf(out,
+                "%s\n    { \"poll\": \"%s\", \"efit\": %u, \"samples\": %u, "
+                "\"cpu_pct\": %.2f, \"wakeups_per_sec\": %.1f, "
+                "\"latency_us\": {",
+                first ? "" : ",",
+                res->name,
+                res->efit,
+                res->samples,
+                cpu_pct,
+                wakeups);
+    }
+    for (uint32_t i = 0; i < LAT_NUM; ++i) {
+        const stats_lat_t *lat = &res->lat[i];
+        if (!lat->count) {
+            continue;
+        }
+        if (fmt == BENCH_FMT_CSV) {
+            fprintf(out,
+                    "%s,%u,%u,%u,%.2f,%.1f,%s,%llu,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+                    res->name,
+                    res->efit,
+                    block_min,
+                    res->samples,
+                    cpu_pct,
+                    wakeups,
+                    stats_lat_name((lat_id_t)i),
+                    (unsigned long long)lat->count,
+                    lat->mean_ns / BENCH_NSEC_IN_USEC,
+                    lat->p50_ns / BENCH_NSEC_IN_USEC,
+                    lat->p99_ns / BENCH_NSEC_IN_USEC,
+                    lat->p999_ns / BENCH_NSEC_IN_USEC,
+                    lat->max_ns / BENCH_NSEC_IN_USEC);
+            continue;
+        }
+        fprintf(out,
+                "%s\n        \"%s\": { \"count\": %llu, \"mean\": %.1f, "
+                "\"p50\": %.1f, \"p99\": %.1f, \"p999\": %.1f, "
+                "\"max\": %.1f }",
+                first_lat ? "" : ",",
+                stats_lat_name((lat_id_t)i),
+                (unsigned long long)lat->count,
+                lat->mean_ns / BENCH_NSEC_IN_USEC,
+                lat->p50_ns / BENCH_NSEC_IN_USEC,
+                lat->p99_ns / BENCH_NSEC_IN_USEC,
+                lat->p999_ns / BENCH_NSEC_IN_USEC,
+                lat->max_ns / BENCH_NSEC_IN_USEC);
+        first_lat = 0;
+    }
+    if (fmt == BENCH_FMT_JSON) {
+        fprintf(out, " } }");
+    }
+}
+
+static void __print_footer(FILE *const out, const bench_fmt_t fmt)
+{
+    if (fmt == BENCH_FMT_JSON) {
+        fprintf(out, "\n  ]\n}\n");
+    }
+}
+
+static void print_usage(void)
+{
+    fprintf(stderr,
+            "latency_bench [-f json|csv] [-o file] [-c poll] [-n scale] "
+            "[-S 128|256|512] [-b points]\n"
+            "-f --format     output format (default json)\n"
+            "-o --output     results file (default stdout)\n"
+            "-c --case       run poll modes which names contain the string\n"
+            "-n --scale      run length, multiple of %u s (default 1)\n"
+            "-S --s_rate     simulated sample rate (default 512)\n"
+            "-b --block_min  points per DSP range (default %u)\n",
+            BENCH_RUN_SECONDS,
+            PIPE_BLOCK_MIN);
+    exit(EXIT_FAILURE);
+}
+
+int main(int argc, char **argv)
+{
+    bench_fmt_t fmt    = BENCH_FMT_JSON;
+    const char *filter = NULL;
+    const char *path   = NULL;
+    uint32_t    scale  = 1;
+    uint8_t     first  = 1;
+    FILE *      out    = NULL;
+    int         c;
+
+    static const struct option lopts[] = {
+        { "format", 1, 0, 'f' }, { "output", 1, 0, 'o' },
+        { "case", 1, 0, 'c' },   { "scale", 1, 0, 'n' },
+        { "s_rate", 1, 0, 'S' }, { "block_min", 1, 0, 'b' },
+        { NULL, 0, 0, 0 },
+    };
+    while ((c = getopt_long(argc, argv, "f:o:c:n:S:b:", lopts, NULL)) != -1) {
+        switch (c) {
+        case 'f':
+            fmt = strcmp(optarg, "csv") ? BENCH_FMT_JSON : BENCH_FMT_CSV;
+            break;
+        case 'o':
+            path = optarg;
+            break;
+        case 'c':
+            filter = optarg;
+            break;
+        case 'n':
+            scale = atoi(optarg) > 0 ? atoi(optarg) : 1;
+            break;
+        case 'S':
+            sample_rate = atoi(optarg);
+            if (sample_rate != 128 && sample_rate != 256 && sample_rate != 512) {
+                print_usage();
+            }
+            break;
+        case 'b':
+            block_min = atoi(optarg);
+            if (!block_min ||
+                block_min >= PIPE_BLOCK_POINTS - ECG_FIFO_DEPTH) {
+                print_usage();
+            }
+            break;
+        default:
+            print_usage();
+        }
+    }
+
+    /* Results go to the original stdout, driver logs and the text sink
+     * output are thrown away */
+    out = path ? fopen(path, "w") : fdopen(dup(STDOUT_FILENO), "w");
+    EXIT_ON_NULL(out);
+    EXIT_ON_NULL(freopen("/dev/null", "w", stdout));
+
+    __print_header(out, fmt);
+    for (uint32_t i = 0; i < ARRAY_SIZE(configs); ++i) {
+        bench_result_t res = { 0 };
+        if (filter && !strstr(poll_names[configs[i].poll], filter)) {
+            continue;
+        }
+        snprintf(res.name, sizeof res.name, "%s", poll_names[configs[i].poll]);
+        res.efit = configs[i].efit;
+        if (RET_UNSUCCESS(__bench_config(&res,
+                                         configs[i].poll,
+                                         configs[i].efit,
+                                         scale))) {
+            fprintf(stderr,
+                    "Benchmark %s efit %u failed\n",
+                    res.name,
+                    res.efit);
+            continue;
+        }
+        __print_result(out, fmt, &res, first);
+        fflush(out);
+        first = 0;
+    }
+    __print_footer(out, fmt);
+    fclose(out);
+    return 0;
+}
@@ -29,6 +29,50 @@ extern "C" {
 #define HEXDUMP_COLUMN_NUM 8
 #define TRUE               1
 
+#ifndef LOG_DBG_ASYNC_
+#define LOG_DBG_ASYNC_
+
+#define LOG_QUEUE_LEN      1024 /* messages, power of two */
+#define LOG_MAX_ARGS       8
+#define LOG_STR_LEN        96 /* room for copies of %s arguments */
+#define LOG_RATE_LIMIT_PER_S 20 /* messages per call site per second */
+
+/**
+ * \brief Call site of a LOG_* macro, one static instance per call site
+ */
+typedef struct {
+    const char *fmt;
+    const char *tag;
+    uint32_t    window_s; /* current rate limiting window */
+    uint32_t    count;    /* messages in the window */
+    uint32_t    dropped;  /* messages dropped in the window */
+} log_site_t;
+
+/**
+* \brief queues message of the call site, formatting is deferred to the
+* logger thread. Synchronous printf() when the logger thread is not running.
+* \param site - call site
+*/
+void log_async(log_site_t *const site, ...);
+
+/**
+* \brief starts logger thread draining the queue to stdout
+* \retval 0 on success
+*/
+int log_start(void);
+
+/**
+* \brief drains the queue and stops logger thread
+*/
+void log_stop(void);
+
+/**
+* \brief messages dropped on full queue or by call site rate limits
+*/
+uint64_t log_dropped(void);
+
+#endif /* LOG_DBG_ASYNC_ */
+
 #undef LOG_DBG
 #undef LOG_INFO
 #undef LOG_WARN
@@ -47,77 +91,71 @@ extern "C" {
 #ifndef DBG_TEXT_COLOR
 #define DBG_TEXT_COLOR TEXT_COLOR_GREEN
 #endif
-/*
-#if (DEBUG_ENABLE >= SYS_LOG_LEVEL_DEBUG)
-#define APP_HEXDUPM_DEBUG(FORMAT, p_data, len)                         \
-  vPrintf(SYS_LOG_TAG_DBG DBG_TAG ": %s: " FORMAT "\r\n",__func__);              \
-  vPrintf(DBG_TEXT_COLOR);                                       \
-  hexdump_debug((p_data), (len));                                \
-  vPrintf(TEXT_COLOR_DEFAULT);
-#endif
-  */
+
 void hexdump_debug(const uint8_t *p_data, uint16_t length);
 
 #if (DEBUG_ENABLE >= SYS_LOG_LEVEL_DEBUG)
-#define APP_HEXDUPM_DEBUG(FORMAT, p_data, len)                 \
-    do {                                                       \
-        printf(TRUE,                                           \
-               SYS_LOG_TAG_DBG DBG_TAG ": %s: " FORMAT "\r\n", \
-               __func__);                                      \
-        printf(TRUE, DBG_TEXT_COLOR);                          \
-        hexdump_debug((p_data), (len));                        \
-        printf(TRUE, TEXT_COLOR_DEFAULT);                      \
+#define APP_HEXDUPM_DEBUG(FORMAT, p_data, len)                         \
+    do {                                                               \
+        printf(SYS_LOG_TAG_DBG DBG_TAG ": %s: " FORMAT "\r\n", __func__); \
+        printf(DBG_TEXT_COLOR);                                        \
+        hexdump_debug((p_data), (len));                                \
+        printf(TEXT_COLOR_DEFAULT);                                    \
     } while (0)
 #endif
 
-#define LOG_ERR(FORMAT, ...)                                  \
-    printf(TEXT_COLOR_RED SYS_LOG_TAG_ERR DBG_TAG             \
-           ": %s: " FORMAT                TEXT_COLOR_DEFAULT, \
-           __func__,                                          \
-           ##__VA_ARGS__)
-
-#if (DEBUG_ENABLE >= SYS_LOG_LEVEL_WARNING)
-#define LOG_WARN(FORMAT, ...)                                                  \
-    do {                                                                       \
-        printf(TRUE, SYS_LOG_TAG_WRN DBG_TAG ": %s: ", __func__);              \
-        printf(TRUE, DBG_TEXT_COLOR FORMAT TEXT_COLOR_DEFAULT, ##__VA_ARGS__); \
+/**
+ * \brief Captures format and arguments of the message into the log queue
+ */
+#define LOG_ASYNC(PREFIX, FORMAT, ...)                                      \
+    do {                                                                    \
+        static log_site_t __log_site = { PREFIX DBG_TAG ": %s: " FORMAT,   \
+                                         DBG_TAG,                           \
+                                         0,                                 \
+                                         0,                                 \
+                                         0 };                               \
+        log_async(&__log_site, __func__, ##__VA_ARGS__);                    \
     } while (0)
+
+#if (DEBUG_ENABLE >= SYS_LOG_LEVEL_ERROR)
+#define LOG_ERR(FORMAT, ...)                                                \
+    LOG_ASYNC(TEXT_COLOR_RED SYS_LOG_TAG_ERR,                               \
+              FORMAT TEXT_COLOR_DEFAULT,                                    \
+              ##__VA_ARGS__)
 #endif
-/*
-#if (DEBUG_ENABLE >= SYS_LOG_LEVEL_INFO)
-#define LOG_INFO(FORMAT,...) vPrintf(SYS_LOG_TAG_INF DBG_TAG  ": %s: ",__func__); \
-      vPrintf(DBG_TEXT_COLOR FORMAT TEXT_COLOR_DEFAULT, ##__VA_ARGS__)
-#endif
-      */
 
-#if (DEBUG_ENABLE >= SYS_LOG_LEVEL_INFO)
-#define LOG_INFO(FORMAT, ...)                                            \
-    do {                                                                 \
-        printf(SYS_LOG_TAG_INF DBG_TAG ": %s: ", __func__);              \
-        printf(DBG_TEXT_COLOR FORMAT TEXT_COLOR_DEFAULT, ##__VA_ARGS__); \
-    } while (0)
+#if (DEBUG_ENABLE >= SYS_LOG_LEVEL_WARNING)
+#define LOG_WARN(FORMAT, ...)                                               \
+    LOG_ASYNC(SYS_LOG_TAG_WRN,                                              \
+              DBG_TEXT_COLOR FORMAT TEXT_COLOR_DEFAULT,                     \
+              ##__VA_ARGS__)
 #endif
-/*
+
 #if (DEBUG_ENABLE >= SYS_LOG_LEVEL_INFO)
-#define LOG_INFO(FORMAT,...) \
-      do{ \
-        printf(SYS_LOG_TAG_INF DBG_TAG  ": %s: ","hello"); \
-      }while(0)
+#define LOG_INFO(FORMAT, ...)                                               \
+    LOG_ASYNC(SYS_LOG_TAG_INF,                                              \
+              DBG_TEXT_COLOR FORMAT TEXT_COLOR_DEFAULT,                     \
+              ##__VA_ARGS__)
 #endif
-        */
+
 #if (DEBUG_ENABLE == SYS_LOG_LEVEL_DEBUG)
 #define LOG_DBG(FORMAT, ...)                                                \
-    do {                                                                    \
-        printf(SYS_LOG_TAG_DBG DBG_TAG ": %s: ", __func__);                 \
-        printf(TEXT_COLOR_YELLOW FORMAT TEXT_COLOR_DEFAULT, ##__VA_ARGS__); \
-    } while (0)
+    LOG_ASYNC(SYS_LOG_TAG_DBG,                                              \
+              TEXT_COLOR_YELLOW FORMAT TEXT_COLOR_DEFAULT,                  \
+              ##__VA_ARGS__)
 #endif
 
 #if (DEBUG_ENABLE == SYS_LOG_LEVEL_TRACE)
-#define LOG_TRACE(FORMAT, ...)                                           \
-    do {                                                                 \
-        printf(SYS_LOG_TAG_TRC DBG_TAG ": %s: ", __func__);              \
-        printf(DBG_TEXT_COLOR FORMAT TEXT_COLOR_DEFAULT, ##__VA_ARGS__); \
+#define LOG_TRACE(FORMAT, ...)                                              \
+    LOG_ASYNC(SYS_LOG_TAG_TRC,                                              \
+              DBG_TEXT_COLOR FORMAT TEXT_COLOR_DEFAULT,                     \
+              ##__VA_ARGS__)
+#endif
+
+#if !defined(LOG_ERR)
+#define LOG_ERR(FORMAT, ...) \
+    do {                     \
+        ;                    \
     } while (0)
 #endif
 
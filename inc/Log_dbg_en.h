@@ -19,12 +19,40 @@
 #define SPI_PRINT_EN      SYS_LOG_LEVEL_DEBUG
 #define MAX30003_PRINT_EN SYS_LOG_LEVEL_DEBUG
 #define OPT_PARSER_EN     SYS_LOG_LEVEL_DEBUG
+#define REPLAY_PRINT_EN   SYS_LOG_LEVEL_DEBUG
+#define REC_PRINT_EN      SYS_LOG_LEVEL_DEBUG
+#define STATS_PRINT_EN    SYS_LOG_LEVEL_DEBUG
+#define TRACE_PRINT_EN    SYS_LOG_LEVEL_DEBUG
+#define SHADOW_PRINT_EN   SYS_LOG_LEVEL_DEBUG
+#define CTRL_PRINT_EN     SYS_LOG_LEVEL_DEBUG
+#define POLL_PRINT_EN     SYS_LOG_LEVEL_DEBUG
+#define CALIB_PRINT_EN    SYS_LOG_LEVEL_DEBUG
+#define DSP_PRINT_EN      SYS_LOG_LEVEL_DEBUG
+#define PIPE_PRINT_EN     SYS_LOG_LEVEL_DEBUG
+#define POOL_PRINT_EN     SYS_LOG_LEVEL_DEBUG
+#define ARROW_PRINT_EN    SYS_LOG_LEVEL_DEBUG
+#define SUP_PRINT_EN      SYS_LOG_LEVEL_DEBUG
+#define FAULT_PRINT_EN    SYS_LOG_LEVEL_DEBUG
 
 #else
 #define MAIN_PRINT_EN     SYS_LOG_LEVEL_INFO
 #define SPI_PRINT_EN      SYS_LOG_LEVEL_INFO
 #define MAX30003_PRINT_EN SYS_LOG_LEVEL_INFO
 #define OPT_PARSER_EN     SYS_LOG_LEVEL_INFO
+#define REPLAY_PRINT_EN   SYS_LOG_LEVEL_INFO
+#define REC_PRINT_EN      SYS_LOG_LEVEL_INFO
+#define STATS_PRINT_EN    SYS_LOG_LEVEL_INFO
+#define TRACE_PRINT_EN    SYS_LOG_LEVEL_INFO
+#define SHADOW_PRINT_EN   SYS_LOG_LEVEL_INFO
+#define CTRL_PRINT_EN     SYS_LOG_LEVEL_INFO
+#define POLL_PRINT_EN     SYS_LOG_LEVEL_INFO
+#define CALIB_PRINT_EN    SYS_LOG_LEVEL_INFO
+#define DSP_PRINT_EN      SYS_LOG_LEVEL_INFO
+#define PIPE_PRINT_EN     SYS_LOG_LEVEL_INFO
+#define POOL_PRINT_EN     SYS_LOG_LEVEL_INFO
+#define ARROW_PRINT_EN    SYS_LOG_LEVEL_INFO
+#define SUP_PRINT_EN      SYS_LOG_LEVEL_INFO
+#define FAULT_PRINT_EN    SYS_LOG_LEVEL_INFO
 
 #endif
 
@@ -14,6 +14,7 @@
 #ifndef DEF_ECG_DATA_LEN
 #define DEF_ECG_DATA_LEN 1024 /* default number of points to be read */
 #endif
+#define ECG_CACHE_LINE 64 /* handle and data_arr alignment */
 
 #define BYTES_NUM_IN_REG    4
 #define WREG                0x00
@@ -21,16 +22,45 @@
 #define TWO_LSB_BITS_MASK   3
 #define THREE_LSB_BITS_MASK 7
 /**
- * \brief Structure to store ecg data and register settings for MAX30003
+ * \brief FIFO polling of ecg_get_data()
  */
-typedef struct {
+#define ECG_POLL_SCHED 0 /* sleep between polls, see poll_sched.h */
+#define ECG_POLL_BUSY  1 /* poll as fast as possible */
+
+struct ecg_data_;
+
+/**
+ * \brief Called by ecg_get_data() between FIFO batches, e.g. to apply
+ * configuration changes with max30003_reconfig(), or after new points were
+ * stored to data_arr, e.g. to hand them over to other threads. The store
+ * hook may continue the acquisition in another buffer by replacing
+ * data_arr, data_len and data_ID.
+ */
+typedef ret_code_t (*ecg_batch_hook_t)(struct ecg_data_ *const ecg_data,
+                                       void *                  ctx);
+
+/**
+ * \brief Structure to store ecg data and register settings for MAX30003.
+ * The first cache line holds the state used for every FIFO batch, the
+ * register settings follow on their own lines. The handle is allocated
+ * ECG_CACHE_LINE aligned by ecg_create_handle().
+ */
+typedef struct ecg_data_ {
+    /* Acquisition state */
+    int32_t *        data_arr;   /* ECG_CACHE_LINE aligned */
+    ecg_batch_hook_t batch_hook; /* NULL if not used */
+    void *           batch_ctx;
+    ecg_batch_hook_t store_hook; /* after points were stored, may be NULL */
+    void *           store_ctx;
+    uint64_t first_sample_ns; /* CLOCK_MONOTONIC of the first valid sample */
     uint32_t data_ID;
-    int32_t *data_arr;
     int32_t  data_len;
     int32_t  timeout_val;
+    uint32_t poll_mode; /* ECG_POLL_SCHED or ECG_POLL_BUSY */
     /* Registers settings */
     /*CNFG_ECG settings*/
-    uint32_t cnfg_ecg;
+    uint32_t cnfg_ecg __attribute__((aligned(ECG_CACHE_LINE)));
+    uint32_t cnfg_ecg_acq; /* CNFG_ECG at acquisition start */
     uint32_t gain;
     uint32_t sample_rate;
     uint32_t hpf_cutoff; /* High-Pass Filter Cutoff Frequency */
@@ -60,7 +90,7 @@ typedef struct {
     uint32_t caln_sel;     /* ECGN Calibration Selection */
 
     uint32_t cnfg_rtor1;
-} __attribute__((packed)) ecg_data_t;
+} ecg_data_t;
 
 /* MAX30003 registers addresses */
 #define NO_OP          0x00
@@ -82,6 +112,7 @@ typedef struct {
 #define ECG_FIFO_BURST 0x20
 #define ECG_FIFO       0x21
 #define RTOR           0x25
+#define MAX30003_REGS_NUM (RTOR + 1)
 
 #define ECG_128_INTERVAL 8 /* interval for 128sps */
 #define ECG_256_INTERVAL 4 /* interval for 256sps */
@@ -105,6 +136,7 @@ typedef struct {
 #define ECG_GAIN_512_RESET (TWO_LSB_BITS_MASK << 22)
 #define ECG_RATE_128       0x00800000
 #define ECG_RATE_256       0x00400000
+#define ECG_RATE_SHIFT     22
 /* MAX30003 Digital High-Pass Filter Cutoff Frequency */
 #define DHPF_BYPASS_RESET (1 << 14)
 #define DHPF_05_HZ        0x00004000
@@ -115,6 +147,34 @@ typedef struct {
 #define DLPF_150_HZ 0x00003000 /* only of 500, 512sps */
 /* MAX30003 CNFG_ECG settings end */
 
+/* MAX30003 ECG FIFO word layout: [23:6] sample, [5:3] ETAG, [2:0] PTAG */
+#define ECG_FIFO_DEPTH      32
+#define ECG_FIFO_WORD_BYTES 3
+#define ECG_FIFO_DATA_SHIFT 6
+#define ECG_FIFO_ETAG_SHIFT 3
+#define ECG_FIFO_ETAG_MASK  (THREE_LSB_BITS_MASK << ECG_FIFO_ETAG_SHIFT)
+#define ETAG_VALID          0x0
+#define ETAG_FAST           0x1
+#define ETAG_VALID_EOF      0x2 /* last valid sample in FIFO */
+#define ETAG_FAST_EOF       0x3
+#define ETAG_CNFG           0x4 /* reserved by the chip, recordings only */
+#define ETAG_EMPTY          0x6
+#define ETAG_OVERFLOW       0x7
+
+/*
+ * Configuration change marker in data_arr: points of samples never have
+ * the low 16 bits set, the marker carries CNFG_ECG[23:12] (rate, gain,
+ * filters) which took effect for the following samples.
+ */
+#define ECG_MARKER_FLAG      0x8000
+#define ECG_MARKER_CNFG_MASK 0xFFF000
+#define ECG_MARKER(cnfg_ecg)                                                  \
+    ((int32_t)((((uint32_t)(cnfg_ecg)) & ECG_MARKER_CNFG_MASK) << 8 |         \
+               ECG_MARKER_FLAG))
+#define ECG_IS_MARKER(point) ((point) & ECG_MARKER_FLAG)
+#define ECG_MARKER_CNFG(point)                                                \
+    ((((uint32_t)(point)) >> 8) & ECG_MARKER_CNFG_MASK)
+
 /* MAX30003 STATUS register flags*/
 #define EINT      0x800000 /*ECG FIFO Interrupt. EFIT threshold reached */
 #define EOVF      0x400000 /*ECG FIFO Overflow*/
@@ -137,6 +197,9 @@ typedef struct {
 #define EFIT_16      0x780000
 #define EFIT_2       0x080000
 #define EFIT_1_RESET ((0b11111) << 19)
+#define EFIT_SHIFT   19
+#define EFIT_WORDS(_words) ((((_words)-1) << EFIT_SHIFT) & EFIT_1_RESET)
+#define EFIT_LOW_POWER_DEFAULT (ECG_FIFO_DEPTH - 4) /* words per batch */
 /*Setting RTOR R Detect Interrupt (RRINT) Clear Behavior*/
 #define CLEAR_PRINT_ON_STATUS_RESET (TWO_LSB_BITS_MASK << 4)
 #define CLEAR_PRINT_ON_RTOR         0x000010
@@ -251,6 +314,21 @@ typedef struct {
 /* Codes to be written */
 #define ZERO_SEQUENCE (uint32_t)0x000000
 
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+* \brief low power batching: EFIT is set to efit_words, SAMP pulses every
+* 16th sample and clear themselves, so a wake-up drains a deep FIFO batch
+* in one burst and needs no STATUS reads to clear interrupts
+* \param ecg_data - structure with ecg measurement parameters and registers
+* \param efit_words - FIFO words per batch, 1..ECG_FIFO_DEPTH, 0 - default
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t ecg_set_low_power(ecg_data_t *const ecg_data,
+                             uint32_t          efit_words);
+
 /**
 * \brief set timeout for ECG measurements
 * \param ecg_data - structure with ecg measurement parameters and registers
@@ -260,7 +338,7 @@ typedef struct {
 ret_code_t ecg_set_timeout(ecg_data_t *const ecg_data,
                            const int32_t     timeout_val);
 /**
-* \brief set data len for ECG measurements
+* \brief set data len for ECG measurements, data_arr is reallocated
 * \param ecg_data - structure with ecg measurement parameters and registers
 * \param data_len - lenght of data in samples to store
 * \retval ret_code_t RET_CODE_SUCCESS - no errors.
@@ -274,7 +352,7 @@ ret_code_t ecg_set_data_len(ecg_data_t *const ecg_data,
 ecg_data_t *ecg_create_handle(void);
 
 /**
-* \brief deletes ECG handler
+* \brief deletes ECG handler and its data_arr
 * \param ecg_data - structure with ecg measurement parameters and registers
 * \retval ret_code_t RET_CODE_SUCCESS - no errors.
 */
@@ -294,6 +372,24 @@ ret_code_t ecg_init_handle(ecg_data_t *const ecg_data);
 */
 ret_code_t ecg_print_data(const ecg_data_t *const ecg_data);
 
+/**
+* \brief prints a range of data_arr, a column of points in DEBUG builds
+* \param ecg_data - structure with ecg measurement parameters and registers
+* \param first - index of the first point
+* \param num - number of points
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t ecg_print_range(const ecg_data_t *const ecg_data,
+                           const uint32_t          first,
+                           const uint32_t          num);
+
+/**
+* \brief prints points, a column in DEBUG builds
+* \param points - data_arr points
+* \param num - number of points
+*/
+void ecg_print_points(const int32_t *const points, const uint32_t num);
+
 /**
 * \brief writes data to register of MAX30003
 * \param ecg_data - structure with ecg measurement parameters and registers
@@ -316,6 +412,33 @@ int max30003_read_reg(spi_t *const   self,
                       const uint8_t  read_addr,
                       uint8_t *const read_buff);
 
+/**
+* \brief writes several registers in a single SPI message, chip select is
+* toggled between registers
+* \param self - structure with spidev params
+* \param addrs - register addresses
+* \param vals - values to write
+* \param num - number of registers, up to MAX30003_REGS_NUM
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t max30003_write_regs(spi_t *const         self,
+                               const uint8_t *const  addrs,
+                               const uint32_t *const vals,
+                               const uint32_t        num);
+
+/**
+* \brief reads several registers in a single SPI message
+* \param self - structure with spidev params
+* \param addrs - register addresses
+* \param[out] vals - values read
+* \param num - number of registers, up to MAX30003_REGS_NUM
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t max30003_read_regs(spi_t *const        self,
+                              const uint8_t *const addrs,
+                              uint32_t *const      vals,
+                              const uint32_t       num);
+
 /**
 * \brief software reset of max30003
 * \retval ret_code_t RET_CODE_SUCCESS - no errors.
@@ -336,6 +459,49 @@ ret_code_t max30003_synch(void);
 */
 ret_code_t max30003_init(const ecg_data_t *ecg_data);
 
+/**
+* \brief warm start of an already running MAX30003: configuration registers
+* are read back in a single message and only the differences are written.
+* Reset and SYNCH are skipped if nothing differs, so the FIFO and the
+* settled filters survive, FIFO is reset only if it has overflowed.
+* \param ecg_data - structure with ECG measurement parameters and registers
+* \param[out] changed - number of registers rewritten, may be NULL
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t max30003_warm_init(const ecg_data_t *ecg_data,
+                              uint32_t *const   changed);
+
+/**
+* \brief applies the configuration in ecg_data to a running chip between
+* FIFO batches: the FIFO is drained into data_arr, only changed registers
+* are written, SYNCH is issued if the sample rate or CNFG_GEN changed,
+* FIFO_RST otherwise, and ECG_MARKER() is appended to data_arr. The gap
+* up to the next valid sample is counted in STAT_RECONF_GAP_NS.
+* \param ecg_data - structure with ECG measurement parameters and registers
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t max30003_reconfig(ecg_data_t *const ecg_data);
+
+/**
+* \brief reconstructed sample time of the oldest point of the last FIFO
+* batch of ecg_get_data(), within half a sample period. The pipeline
+* stamps blocks with it for the latency histograms, see stats.h.
+* \retval CLOCK_MONOTONIC ns, 0 - no batch read yet
+*/
+uint64_t max30003_batch_ns(void);
+
+/**
+* \brief reads FIFO words in a single burst transfer of ECG_FIFO_BURST
+* \param self - structure with spidev params
+* \param buf - words_num * ECG_FIFO_WORD_BYTES bytes, see
+* max30003_decode_fifo()
+* \param words_num - words to read, up to ECG_FIFO_DEPTH
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t max30003_read_fifo_burst(spi_t *const   self,
+                                    uint8_t *const buf,
+                                    const uint32_t words_num);
+
 /**
  * \brief Get single ECG point
  * \return ECG point int32_t value
@@ -343,10 +509,34 @@ ret_code_t max30003_init(const ecg_data_t *ecg_data);
 int32_t max30003_get_ecg_point(void);
 
 /**
- * \brief Fills ecg_data_t->data_arr field with ecg data
+ * \brief Decodes raw ECG FIFO bytes read in burst mode
+ * \param buf - ECG_FIFO_WORD_BYTES bytes per word as shifted out by the chip
+ * \param words_num - number of words in buf
+ * \param[out] points - points in max30003_get_ecg_point() format
+ * \return number of points decoded, stops after the EOF word and on empty or
+ * overflow tags
+ */
+uint32_t max30003_decode_fifo(const uint8_t *const buf,
+                              const uint32_t       words_num,
+                              int32_t *const       points);
+
+/**
+ * \brief Sample rate coded in CNFG_ECG register value
+ * \param cnfg_ecg - CNFG_ECG register value
+ * \return samples per second
+ */
+uint32_t max30003_rate_sps(const uint32_t cnfg_ecg);
+
+/**
+ * \brief Fills ecg_data_t->data_arr field with ecg data. FIFO overflow, PLL
+ * unlock, stuck FIFO and chip reset are recovered in place, see
+ * supervisor.h, ECG_MARKER() is stored once per gap.
  * \param[out] ecg_data_t pointer to med_data_t structure
  * \return ret_code_t
  */
 ret_code_t ecg_get_data(ecg_data_t *const ecg_data);
 
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
 #endif /* INC_MAX30003_H_  */
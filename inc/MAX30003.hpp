@@ -0,0 +1,344 @@
+/**
+ * \file MAX30003.hpp
+ *
+ * \brief Header-only C++17 driver over the C API. Rate, gain, filters and
+ * EFIT are template parameters of max30003::Config: combinations the chip
+ * does not support fail to compile and the register images are constants.
+ * max30003::Max30003<Transport, Config> writes the images and reads the
+ * FIFO in bursts sized by EFIT at compile time, transport calls are
+ * resolved statically. Config::to_handle() fills an ecg_data_t, so the
+ * validated images also drive the C acquisition loop, ecg_get_data().
+ */
+#ifndef INC_MAX30003_HPP_
+#define INC_MAX30003_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include "MAX30003.h"
+
+namespace max30003 {
+
+/**
+ * \brief CNFG_ECG fields, values are the register bits
+ */
+enum class Rate : uint32_t {
+    sps512 = 0,
+    sps256 = ECG_RATE_256,
+    sps128 = ECG_RATE_128,
+};
+
+enum class Gain : uint32_t {
+    x20  = 0,
+    x40  = ECG_GAIN_40,
+    x80  = ECG_GAIN_80,
+    x160 = ECG_GAIN_160,
+};
+
+enum class Hpf : uint32_t {
+    bypass = 0,
+    hz0_5  = DHPF_05_HZ,
+};
+
+enum class Lpf : uint32_t {
+    bypass = DLPF_BYPASS,
+    hz40   = DLPF_40_HZ,
+    hz100  = DLPF_100_HZ,
+    hz150  = DLPF_150_HZ,
+};
+
+/**
+ * \brief max30003_rate_sps() at compile time
+ */
+constexpr uint32_t rate_sps(const Rate rate)
+{
+    return rate == Rate::sps512 ? 512 : rate == Rate::sps256 ? 256 : 128;
+}
+
+/**
+ * \brief Low-pass cutoffs the decimation filter of a rate supports
+ */
+constexpr bool lpf_valid(const Rate rate, const Lpf lpf)
+{
+    switch (lpf) {
+    case Lpf::hz40:
+        return rate != Rate::sps128;
+    case Lpf::hz100:
+        return rate != Rate::sps128;
+    case Lpf::hz150:
+        return rate == Rate::sps512;
+    default:
+        return true;
+    }
+}
+
+/**
+ * \brief Widest low-pass cutoff of a rate
+ */
+constexpr Lpf lpf_default(const Rate rate)
+{
+    return rate == Rate::sps512   ? Lpf::hz150
+           : rate == Rate::sps256 ? Lpf::hz100
+                                  : Lpf::bypass;
+}
+
+/**
+ * \brief Compile-time configuration, registers other than CNFG_ECG and
+ * MNGR_INT keep the defaults of ecg_init_handle()
+ * \param R - sample rate
+ * \param G - gain
+ * \param H - high-pass cutoff
+ * \param L - low-pass cutoff, has to be supported at R
+ * \param Efit - FIFO words per interrupt and per burst read
+ */
+template <Rate     R    = Rate::sps128,
+          Gain     G    = Gain::x80,
+          Hpf      H    = Hpf::hz0_5,
+          Lpf      L    = lpf_default(R),
+          uint32_t Efit = 1>
+struct Config {
+    static_assert(lpf_valid(R, L), "low-pass cutoff not available at rate");
+    static_assert(Efit >= 1 && Efit <= ECG_FIFO_DEPTH,
+                  "EFIT is 1..ECG_FIFO_DEPTH words");
+
+    static constexpr uint32_t rate = rate_sps(R);
+    static constexpr uint32_t efit = Efit;
+
+    static constexpr uint32_t cnfg_ecg =
+            static_cast<uint32_t>(R) | static_cast<uint32_t>(G) |
+            static_cast<uint32_t>(H) | static_cast<uint32_t>(L);
+    static constexpr uint32_t mngr_int =
+            (MNGR_INT_DEFAULT & ~EFIT_1_RESET) | EFIT_WORDS(Efit);
+    static constexpr uint32_t cnfg_gen   = CNFG_GEN_DEFAULT;
+    static constexpr uint32_t cnfg_cal   = CNFG_CAL_DEFAULT;
+    static constexpr uint32_t cnfg_emux  = CNFG_EMUX_DEFAULT;
+    static constexpr uint32_t cnfg_rtor1 = CNFG_RTOR1_DEFAULT;
+
+    /* Written by init() in this order, as max30003_init() stages them */
+    static constexpr uint8_t  regs_num = 6;
+    static constexpr uint8_t  reg_addrs[regs_num] = {
+        CNFG_GEN, CNFG_CAL, CNFG_EMUX, CNFG_ECG, CNFG_RTOR1, MNGR_INT,
+    };
+    static constexpr uint32_t reg_images[regs_num] = {
+        cnfg_gen, cnfg_cal, cnfg_emux, cnfg_ecg, cnfg_rtor1, mngr_int,
+    };
+
+    /**
+    * \brief copies the images to the handle of the C driver
+    * \param ecg_data - handle inited by ecg_init_handle()
+    * \retval ret_code_t RET_CODE_SUCCESS - no errors.
+    */
+    static ret_code_t to_handle(ecg_data_t *const ecg_data)
+    {
+        if (!ecg_data) {
+            return RET_CODE_NULL_PTR;
+        }
+        ecg_data->cnfg_ecg   = cnfg_ecg;
+        ecg_data->mngr_int   = mngr_int;
+        ecg_data->efit       = efit;
+        ecg_data->cnfg_gen   = cnfg_gen;
+        ecg_data->cnfg_cal   = cnfg_cal;
+        ecg_data->cnfg_emux  = cnfg_emux;
+        ecg_data->cnfg_rtor1 = cnfg_rtor1;
+        return RET_CODE_SUCCESS;
+    }
+};
+
+/**
+ * \brief Transport of an initialized spi_t, every message goes through
+ * spi_message() and so through an attached backend as well
+ */
+class SpiTransport {
+public:
+    explicit SpiTransport(spi_t *const spi) : spi_(spi) {}
+
+    int message(struct spi_ioc_transfer *const xfer, const unsigned int n)
+    {
+        return spi_message(spi_, xfer, n);
+    }
+    uint32_t speed_hz() const { return spi_->xfer[0].speed_hz; }
+    uint8_t  bits() const { return spi_->xfer[0].bits_per_word; }
+
+private:
+    spi_t *spi_;
+};
+
+/**
+ * \brief Driver of a chip configured by Cfg. Transport provides
+ * message(xfer, n) with ioctl(SPI_IOC_MESSAGE(n)) semantics, speed_hz()
+ * and bits().
+ */
+template <class Transport, class Cfg = Config<>>
+class Max30003 {
+public:
+    using config = Cfg;
+
+    static constexpr uint32_t burst_words = Cfg::efit;
+    static constexpr uint32_t burst_bytes = burst_words * ECG_FIFO_WORD_BYTES;
+
+    explicit Max30003(Transport &transport) : t_(transport) {}
+
+    /**
+    * \brief software reset, writes the images in one message and SYNCH
+    * \retval ret_code_t RET_CODE_SUCCESS - no errors.
+    */
+    ret_code_t init()
+    {
+        struct spi_ioc_transfer xfer[Cfg::regs_num] = {};
+        uint8_t                 tx[Cfg::regs_num][BYTES_NUM_IN_REG];
+        ret_code_t              ret = write_reg(SW_RST, ZERO_SEQUENCE);
+
+        if (ret != RET_CODE_SUCCESS) {
+            return ret;
+        }
+        for (uint32_t i = 0; i < Cfg::regs_num; ++i) {
+            encode(tx[i], Cfg::reg_addrs[i], WREG, Cfg::reg_images[i]);
+            setup(xfer[i]);
+            xfer[i].tx_buf    = reinterpret_cast<uintptr_t>(tx[i]);
+            xfer[i].len       = BYTES_NUM_IN_REG;
+            xfer[i].cs_change = (i + 1 < Cfg::regs_num);
+        }
+        if (t_.message(xfer, Cfg::regs_num) < 0) {
+            return RET_CODE_SPI_WRITE_ERR;
+        }
+        return write_reg(SYNCH, ZERO_SEQUENCE);
+    }
+
+    /**
+    * \brief reads the configuration registers back
+    * \retval ret_code_t RET_CODE_CRC_MISMATCH - the chip differs from Cfg
+    */
+    ret_code_t verify()
+    {
+        uint32_t   val;
+        ret_code_t ret;
+
+        for (uint32_t i = 0; i < Cfg::regs_num; ++i) {
+            ret = read_reg(Cfg::reg_addrs[i], val);
+            if (ret != RET_CODE_SUCCESS) {
+                return ret;
+            }
+            if (val != Cfg::reg_images[i]) {
+                return RET_CODE_CRC_MISMATCH;
+            }
+        }
+        return RET_CODE_SUCCESS;
+    }
+
+    ret_code_t write_reg(const uint8_t addr, const uint32_t val)
+    {
+        struct spi_ioc_transfer xfer = {};
+        uint8_t                 tx[BYTES_NUM_IN_REG];
+
+        encode(tx, addr, WREG, val);
+        setup(xfer);
+        xfer.tx_buf = reinterpret_cast<uintptr_t>(tx);
+        xfer.len    = BYTES_NUM_IN_REG;
+        return t_.message(&xfer, 1) < 0 ? RET_CODE_SPI_WRITE_ERR
+                                        : RET_CODE_SUCCESS;
+    }
+
+    ret_code_t read_reg(const uint8_t addr, uint32_t &val)
+    {
+        uint8_t rx[ECG_FIFO_WORD_BYTES];
+
+        if (transfer(addr, rx, ECG_FIFO_WORD_BYTES) < 0) {
+            return RET_CODE_SPI_READ_ERR;
+        }
+        val = (uint32_t)rx[0] << 16 | (uint32_t)rx[1] << 8 | rx[2];
+        return RET_CODE_SUCCESS;
+    }
+
+    /**
+    * \brief reads one burst of burst_words FIFO words, the EINT interrupt
+    * guarantees that many are there
+    * \param[out] points - burst_words data_arr points
+    * \param[out] num - valid words, fewer on EOF, empty FIFO or overflow
+    * \param[out] ovf - an overflow word was read, the FIFO reads no more
+    * samples until FIFO_RST
+    * \retval ret_code_t RET_CODE_SUCCESS - no errors.
+    */
+    ret_code_t read_fifo(int32_t *const points, uint32_t &num, bool &ovf)
+    {
+        uint8_t buf[burst_bytes];
+
+        num = 0;
+        ovf = false;
+        if (transfer(ECG_FIFO_BURST, buf, burst_bytes) < 0) {
+            return RET_CODE_SPI_READ_ERR;
+        }
+        num = decode(buf, points, ovf);
+        return RET_CODE_SUCCESS;
+    }
+
+    ret_code_t read_fifo(int32_t *const points, uint32_t &num)
+    {
+        bool ovf;
+        return read_fifo(points, num, ovf);
+    }
+
+    /**
+    * \brief max30003_decode_fifo() of a burst, the trip count is constant
+    * \param[out] ovf - set when the burst stopped on an overflow word
+    */
+    static uint32_t decode(const uint8_t *const buf,
+                           int32_t *const       points,
+                           bool &               ovf)
+    {
+        for (uint32_t n = 0; n < burst_words; ++n) {
+            const uint8_t *word = buf + n * ECG_FIFO_WORD_BYTES;
+            uint8_t        etag =
+                    (word[2] & ECG_FIFO_ETAG_MASK) >> ECG_FIFO_ETAG_SHIFT;
+            if (etag == ETAG_EMPTY || etag == ETAG_OVERFLOW) {
+                ovf = etag == ETAG_OVERFLOW;
+                return n;
+            }
+            points[n] = (int32_t)((uint32_t)word[0] << 24 |
+                                  (uint32_t)word[1] << 16);
+            if (etag == ETAG_VALID_EOF || etag == ETAG_FAST_EOF) {
+                return n + 1;
+            }
+        }
+        return burst_words;
+    }
+
+private:
+    static void encode(uint8_t *const tx,
+                       const uint8_t  addr,
+                       const uint8_t  dir,
+                       const uint32_t val)
+    {
+        tx[0] = (uint8_t)(addr << 1 | dir);
+        tx[1] = (uint8_t)(val >> 16);
+        tx[2] = (uint8_t)(val >> 8);
+        tx[3] = (uint8_t)val;
+    }
+
+    void setup(struct spi_ioc_transfer &xfer) const
+    {
+        xfer.speed_hz      = t_.speed_hz();
+        xfer.bits_per_word = t_.bits();
+    }
+
+    /**
+     * \brief Command byte of addr, then len bytes read
+     */
+    int transfer(const uint8_t addr, uint8_t *const rx, const uint32_t len)
+    {
+        struct spi_ioc_transfer xfer[2] = {};
+        uint8_t                 cmd     = (uint8_t)(addr << 1 | RREG);
+
+        setup(xfer[0]);
+        setup(xfer[1]);
+        xfer[0].tx_buf = reinterpret_cast<uintptr_t>(&cmd);
+        xfer[0].len    = SPI_COMMAND_LEN;
+        xfer[1].rx_buf = reinterpret_cast<uintptr_t>(rx);
+        xfer[1].len    = len;
+        return t_.message(xfer, 2);
+    }
+
+    Transport &t_;
+};
+
+} // namespace max30003
+
+#endif /* INC_MAX30003_HPP_ */
@@ -0,0 +1,325 @@
+/**
+ * \file MAX30003_async.hpp
+ *
+ * \brief C++20 coroutines over MAX30003.hpp. One Executor thread drives
+ * any number of devices: co_await dev.read_batch() arms the wake-up fd of
+ * the device in epoll and suspends the task, the executor resumes it when
+ * the fd is readable and the burst read is done before the await returns.
+ * The wake-up fd is the INTB line event fd if the board has one, a timerfd
+ * armed by poll_sched for the next expected batch otherwise.
+ */
+#ifndef INC_MAX30003_ASYNC_HPP_
+#define INC_MAX30003_ASYNC_HPP_
+
+#include <coroutine>
+#include <exception>
+#include <cerrno>
+#include <ctime>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "MAX30003.hpp"
+#include "poll_sched.h"
+
+#define EXEC_EVENTS_MAX 64  /* events taken per epoll_wait() */
+#define EXEC_ACK_BYTES  256 /* wake-up fd read per ack, whole INTB events */
+
+namespace max30003 {
+
+class Executor;
+
+/**
+ * \brief Fire and forget coroutine, started by Executor::spawn(). The
+ * frame is freed when the coroutine returns.
+ */
+class Task {
+public:
+    struct promise_type {
+        Executor *exec = nullptr;
+
+        ~promise_type();
+        Task get_return_object()
+        {
+            return Task(std::coroutine_handle<promise_type>::from_promise(
+                    *this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never  final_suspend() noexcept { return {}; }
+        void                return_void() {}
+        void                unhandled_exception() { std::terminate(); }
+    };
+    using handle_t = std::coroutine_handle<promise_type>;
+
+    Task(Task &&other) noexcept : h_(other.h_) { other.h_ = nullptr; }
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    ~Task()
+    {
+        if (h_) {
+            h_.destroy();
+        }
+    }
+
+    handle_t release()
+    {
+        handle_t h = h_;
+        h_         = nullptr;
+        return h;
+    }
+
+private:
+    explicit Task(const handle_t h) : h_(h) {}
+
+    handle_t h_;
+};
+
+/**
+ * \brief Single threaded epoll loop. Every watched fd is registered once
+ * and re-armed one shot per wait, an event resumes the coroutine waiting
+ * on it.
+ */
+class Executor {
+public:
+    Executor() : epfd_(epoll_create1(EPOLL_CLOEXEC)) {}
+    ~Executor()
+    {
+        if (epfd_ >= 0) {
+            close(epfd_);
+        }
+    }
+    Executor(const Executor &) = delete;
+    Executor &operator=(const Executor &) = delete;
+
+    bool valid() const { return epfd_ >= 0; }
+
+    /**
+    * \brief runs the task to its first suspension, run() returns when
+    * all the spawned tasks did
+    */
+    void spawn(Task task)
+    {
+        Task::handle_t h = task.release();
+
+        h.promise().exec = this;
+        live_++;
+        h.resume();
+    }
+
+    ret_code_t watch(const int fd)
+    {
+        struct epoll_event ev = {};
+
+        return epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) ? RET_CODE_ERROR
+                                                        : RET_CODE_SUCCESS;
+    }
+
+    ret_code_t unwatch(const int fd)
+    {
+        return epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr) ? RET_CODE_ERROR
+                                                            : RET_CODE_SUCCESS;
+    }
+
+    /**
+    * \brief resumes h once when the watched fd is readable
+    */
+    ret_code_t arm(const int fd, const std::coroutine_handle<> h)
+    {
+        struct epoll_event ev = {};
+
+        ev.events   = EPOLLIN | EPOLLONESHOT;
+        ev.data.ptr = h.address();
+        return epoll_ctl(epfd_, EPOLL_CTL_MOD, fd, &ev) ? RET_CODE_ERROR
+                                                        : RET_CODE_SUCCESS;
+    }
+
+    /**
+    * \brief resumes the tasks as their fds become readable
+    * \retval ret_code_t RET_CODE_SUCCESS - all the tasks returned
+    */
+    ret_code_t run()
+    {
+        struct epoll_event ev[EXEC_EVENTS_MAX];
+        int                n;
+
+        while (live_) {
+            n = epoll_wait(epfd_, ev, EXEC_EVENTS_MAX, -1);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                return RET_CODE_ERROR;
+            }
+            for (int i = 0; i < n; ++i) {
+                std::coroutine_handle<>::from_address(ev[i].data.ptr).resume();
+            }
+            wakeups_ += n;
+        }
+        return RET_CODE_SUCCESS;
+    }
+
+    uint32_t live() const { return live_; }
+    uint64_t wakeups() const { return wakeups_; }
+
+private:
+    friend struct Task::promise_type;
+
+    int      epfd_;
+    uint32_t live_    = 0;
+    uint64_t wakeups_ = 0;
+};
+
+inline Task::promise_type::~promise_type()
+{
+    if (exec) {
+        exec->live_--;
+    }
+}
+
+/**
+ * \brief Batch read by an await
+ */
+struct Batch {
+    ret_code_t ret;
+    uint32_t   num; /* valid points */
+    bool       ovf; /* FIFO overflowed and was reset, samples lost before */
+};
+
+/**
+ * \brief Device of an Executor. Without irq_fd the batches are paced by
+ * poll_sched over a timerfd, as the ECG_POLL_SCHED loop of ecg_get_data().
+ */
+template <class Transport, class Cfg = Config<>>
+class AsyncDevice {
+public:
+    using device_t = Max30003<Transport, Cfg>;
+
+    static constexpr uint32_t burst_words = device_t::burst_words;
+
+    /**
+    * \param exec - executor of the tasks awaiting the device
+    * \param transport - bus of the device
+    * \param irq_fd - non-blocking fd readable on INTB, e.g. a GPIO line
+    * event fd, -1 if the board has no INTB line
+    */
+    AsyncDevice(Executor &exec, Transport &transport, const int irq_fd = -1)
+        : exec_(exec), dev_(transport), fd_(irq_fd), own_fd_(irq_fd < 0)
+    {
+        if (own_fd_) {
+            fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            poll_sched_init(&sched_, Cfg::cnfg_ecg, Cfg::mngr_int);
+        }
+        ret_ = fd_ < 0 ? RET_CODE_ERROR : exec_.watch(fd_);
+    }
+    ~AsyncDevice()
+    {
+        if (fd_ >= 0) {
+            exec_.unwatch(fd_);
+        }
+        if (own_fd_ && fd_ >= 0) {
+            close(fd_);
+        }
+    }
+    AsyncDevice(const AsyncDevice &) = delete;
+    AsyncDevice &operator=(const AsyncDevice &) = delete;
+
+    /**
+    * \brief status of the construction, RET_CODE_SUCCESS - usable
+    */
+    ret_code_t status() const { return ret_; }
+    device_t & device() { return dev_; }
+
+    class BatchAwaiter {
+    public:
+        BatchAwaiter(AsyncDevice &dev, int32_t *const points)
+            : dev_(dev), points_(points)
+        {
+        }
+        bool await_ready() const { return dev_.ret_ != RET_CODE_SUCCESS; }
+        bool await_suspend(const std::coroutine_handle<> h)
+        {
+            ret_ = dev_.arm(h);
+            return ret_ == RET_CODE_SUCCESS; /* resumes at once on error */
+        }
+        Batch await_resume()
+        {
+            if (dev_.ret_ != RET_CODE_SUCCESS) {
+                return { dev_.ret_, 0, false };
+            }
+            if (ret_ != RET_CODE_SUCCESS) {
+                return { ret_, 0, false };
+            }
+            return dev_.complete(points_);
+        }
+
+    private:
+        AsyncDevice &  dev_;
+        int32_t *const points_;
+        ret_code_t     ret_ = RET_CODE_SUCCESS;
+    };
+
+    /**
+    * \brief awaits the next batch
+    * \param points - burst_words data_arr points
+    * \retval awaiter, co_await gives the Batch read
+    */
+    BatchAwaiter read_batch(int32_t *const points)
+    {
+        return BatchAwaiter(*this, points);
+    }
+
+private:
+    ret_code_t arm(const std::coroutine_handle<> h)
+    {
+        struct itimerspec its = {};
+
+        if (own_fd_) {
+            its.it_value.tv_sec  = sched_.next_ns / NSEC_IN_SEC;
+            its.it_value.tv_nsec = sched_.next_ns % NSEC_IN_SEC;
+            /* A wake-up in the past fires at once */
+            if (timerfd_settime(fd_, TFD_TIMER_ABSTIME, &its, nullptr)) {
+                return RET_CODE_ERROR;
+            }
+        }
+        return exec_.arm(fd_, h);
+    }
+
+    Batch complete(int32_t *const points)
+    {
+        uint8_t ack[EXEC_ACK_BYTES];
+        Batch   b = { RET_CODE_SUCCESS, 0, false };
+
+        while (read(fd_, ack, sizeof ack) > 0) {
+        }
+        b.ret = dev_.read_fifo(points, b.num, b.ovf);
+        if (b.ret == RET_CODE_SUCCESS && b.ovf) {
+            /* An overflowed FIFO reads no samples until reset, as the
+             * FIFO_RST recovery of ecg_get_data() */
+            b.ret = dev_.write_reg(FIFO_RST, ZERO_SEQUENCE);
+        }
+        if (own_fd_) {
+            poll_sched_update(&sched_, b.num, b.ovf);
+        }
+        if (own_fd_ && b.ovf) {
+            /* The FIFO is empty after the reset, a wake-up before an
+             * interval would read a few words and stretch the interval */
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            sched_.next_ns = (uint64_t)ts.tv_sec * NSEC_IN_SEC + ts.tv_nsec +
+                             sched_.interval_ns;
+        }
+        return b;
+    }
+
+    static constexpr uint64_t NSEC_IN_SEC = 1000000000ULL;
+
+    Executor &   exec_;
+    device_t     dev_;
+    int          fd_;
+    bool         own_fd_;
+    poll_sched_t sched_ = {};
+    ret_code_t   ret_;
+};
+
+} // namespace max30003
+
+#endif /* INC_MAX30003_ASYNC_HPP_ */
@@ -0,0 +1,213 @@
+/**
+ * \file arrow_ipc.h
+ *
+ * \brief Apache Arrow IPC file writer for fixed width columns, no Arrow
+ * library is needed. Rows are gathered into column chunks and written as
+ * record batches of chunk_rows rows, every buffer starts on an ARROW_ALIGN
+ * boundary of the file, so readers memory-map the columns as they are.
+ *
+ * The ECG tables built on it share one time axis per stream:
+ * <prefix>.samples.arrow - idx, time, sample, etag of every sample
+ * <prefix>.beats.arrow   - idx, time, rr of every QRS detected, rr is 0
+ *                          after a gap or a configuration change
+ * <prefix>.events.arrow  - idx, time, kind, cnfg_ecg of configuration
+ *                          markers, FIFO overflows and fast recovery runs
+ * idx is the position in data_arr or the recording, time is nanoseconds
+ * since the first sample. Markers and overflow words take no time.
+ */
+#ifndef INC_ARROW_IPC_H_
+#define INC_ARROW_IPC_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "common_types.h"
+#include "MAX30003.h"
+
+#define ARROW_ALIGN              64    /* buffers and record batch bodies */
+#define ARROW_COLS_MAX           8
+#define ARROW_CHUNK_ROWS_DEFAULT 65536 /* rows per record batch */
+
+/**
+ * \brief Column types
+ */
+typedef enum {
+    ARROW_INT8 = 0,
+    ARROW_UINT8,
+    ARROW_INT32,
+    ARROW_UINT32,
+    ARROW_INT64,
+    ARROW_UINT64,
+    ARROW_DURATION_NS,
+    ARROW_TYPE_NUM
+} arrow_type_t;
+
+typedef struct {
+    const char * name;
+    arrow_type_t type;
+} arrow_field_t;
+
+/**
+ * \brief Footer entry of a record batch
+ */
+typedef struct {
+    uint64_t offset;    /* of the message in the file */
+    uint32_t meta_len;  /* prefix and metadata */
+    uint64_t body_len;
+} arrow_block_t;
+
+typedef struct {
+    FILE *               f;
+    const arrow_field_t *fields;
+    uint32_t             fields_num;
+    uint8_t *            col[ARROW_COLS_MAX]; /* ARROW_ALIGN aligned */
+    uint32_t             rows;                /* in the column chunks */
+    uint32_t             chunk_rows;
+    uint64_t             offset;              /* file position */
+    uint64_t             rows_total;
+    arrow_block_t *      blocks;
+    uint32_t             blocks_num;
+    uint32_t             blocks_cap;
+} arrow_writer_t;
+
+/**
+* \brief creates Arrow IPC file and writes the schema
+* \param w - writer
+* \param path - file path
+* \param fields - columns, must stay valid until arrow_writer_close()
+* \param fields_num - number of columns, up to ARROW_COLS_MAX
+* \param chunk_rows - rows per record batch, 0 - ARROW_CHUNK_ROWS_DEFAULT
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t arrow_writer_open(arrow_writer_t *const      w,
+                             const char *const          path,
+                             const arrow_field_t *const fields,
+                             const uint32_t             fields_num,
+                             const uint32_t             chunk_rows);
+
+/**
+* \brief appends rows, a record batch is written per chunk_rows rows
+* \param w - writer
+* \param cols - per column num values of its type
+* \param num - number of rows
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t arrow_writer_append(arrow_writer_t *const    w,
+                               const void *const *const cols,
+                               const uint32_t           num);
+
+/**
+* \brief writes the rows gathered as a record batch
+* \param w - writer
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t arrow_writer_flush(arrow_writer_t *const w);
+
+/**
+* \brief writes the last record batch and the footer, closes the file
+* \param w - writer
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t arrow_writer_close(arrow_writer_t *const w);
+
+#define ECG_ARROW_SAMPLES_EXT ".samples.arrow"
+#define ECG_ARROW_BEATS_EXT   ".beats.arrow"
+#define ECG_ARROW_EVENTS_EXT  ".events.arrow"
+#define ECG_ARROW_ROWS        256 /* rows converted per append */
+
+/**
+ * \brief Tables of an export, or-ed
+ */
+typedef enum {
+    ECG_ARROW_SAMPLES = 1 << 0,
+    ECG_ARROW_BEATS   = 1 << 1,
+    ECG_ARROW_EVENTS  = 1 << 2,
+    ECG_ARROW_ALL     = ECG_ARROW_SAMPLES | ECG_ARROW_BEATS | ECG_ARROW_EVENTS,
+} ecg_arrow_table_t;
+
+/**
+ * \brief Kinds of the events table
+ */
+typedef enum {
+    ECG_ARROW_EV_CNFG = 0, /* ECG_MARKER(), configuration of the next ones */
+    ECG_ARROW_EV_OVERFLOW, /* ETAG_OVERFLOW word, samples were lost */
+    ECG_ARROW_EV_FAST,     /* first sample of a fast recovery run */
+} ecg_arrow_event_t;
+
+/**
+ * \brief Points of constant rate starting at idx
+ */
+typedef struct {
+    uint64_t idx;
+    uint64_t t_ns;
+    uint64_t period_ns;
+} ecg_arrow_seg_t;
+
+/**
+ * \brief Export of one stream. Tables not opened are skipped but the time
+ * axis is kept, so an export of beats only on another thread than the one
+ * of samples gives the same times.
+ */
+typedef struct {
+    arrow_writer_t  samples;
+    arrow_writer_t  beats;
+    arrow_writer_t  events;
+    ecg_arrow_seg_t seg[2]; /* current and previous segment */
+    uint64_t        idx;    /* of the next point */
+    uint64_t        t_ns;   /* of the next sample */
+    uint64_t        last_beat_idx;
+    uint64_t        last_beat_ns;
+    uint8_t         beat_seen;
+    uint8_t         fast;
+} ecg_arrow_t;
+
+/**
+* \brief opens the tables <prefix><ext> selected
+* \param ex - export
+* \param prefix - path prefix of the files
+* \param tables - ecg_arrow_table_t or-ed
+* \param cnfg_ecg - CNFG_ECG register of the first points
+* \param first_idx - index of the first point
+* \param chunk_rows - rows per record batch, 0 - ARROW_CHUNK_ROWS_DEFAULT
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t ecg_arrow_open(ecg_arrow_t *const ex,
+                          const char *const  prefix,
+                          const uint32_t     tables,
+                          const uint32_t     cnfg_ecg,
+                          const uint64_t     first_idx,
+                          const uint32_t     chunk_rows);
+
+/**
+* \brief adds data_arr points to samples and events, ECG_MARKER() points
+* start a new rate
+* \param ex - export
+* \param points - points in max30003_get_ecg_point() format
+* \param etags - ETAG of every point, NULL - ETAG_VALID
+* \param num - number of points
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t ecg_arrow_points(ecg_arrow_t *const   ex,
+                            const int32_t *const points,
+                            const uint8_t *const etags,
+                            const uint32_t       num);
+
+/**
+* \brief adds qrs_process() beats, points up to them were added already or
+* follow within the current rate
+* \param ex - export
+* \param beats - indexes of R waves
+* \param num - number of beats
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t ecg_arrow_beats(ecg_arrow_t *const    ex,
+                           const uint64_t *const beats,
+                           const uint32_t        num);
+
+/**
+* \brief closes the tables opened
+* \param ex - export
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t ecg_arrow_close(ecg_arrow_t *const ex);
+
+#endif /* INC_ARROW_IPC_H_ */
@@ -0,0 +1,87 @@
+/**
+ * \file block_pool.h
+ *
+ * \brief Fixed pool of sample blocks allocated once. A block is taken by
+ * its writer with one reference, every reader sharing its points takes one
+ * more, the last block_release() puts it back to the pool. Get and release
+ * are lock-free and never allocate.
+ */
+#ifndef INC_BLOCK_POOL_H_
+#define INC_BLOCK_POOL_H_
+
+#include <stdint.h>
+#include "common_types.h"
+
+#define BLOCK_POOL_NONE UINT32_MAX /* end of the free list */
+
+typedef struct block_pool_ block_pool_t;
+
+/**
+ * \brief Block of data_arr points
+ */
+typedef struct {
+    int32_t *     points;
+    uint32_t      cap;   /* points the block holds */
+    uint32_t      num;   /* points stored by the writer */
+    uint64_t      first; /* stream index of points[0] */
+    uint32_t      refs;
+    uint32_t      next; /* free list link */
+    block_pool_t *pool;
+} ecg_block_t;
+
+/**
+ * \brief Pool counters
+ */
+typedef struct {
+    uint32_t blocks;
+    uint32_t points;   /* per block */
+    uint32_t free;     /* blocks in the pool now */
+    uint32_t min_free; /* fewest blocks left in the pool */
+    uint64_t gets;     /* blocks taken */
+    uint64_t empty;    /* block_pool_get() calls on an empty pool */
+} block_pool_stats_t;
+
+/**
+* \brief allocates all the blocks
+* \param blocks - number of blocks
+* \param points - points per block
+* \retval pool, NULL on error
+*/
+block_pool_t *block_pool_create(const uint32_t blocks, const uint32_t points);
+
+/**
+* \brief takes a free block with one reference, num 0
+* \param pool - block pool
+* \retval block, NULL if all the blocks are in use
+*/
+ecg_block_t *block_pool_get(block_pool_t *const pool);
+
+/**
+* \brief adds a reference to the block for another reader
+* \param blk - block
+*/
+void block_ref(ecg_block_t *const blk);
+
+/**
+* \brief drops a reference, the block returns to its pool with the last one
+* \param blk - block
+*/
+void block_release(ecg_block_t *const blk);
+
+/**
+* \brief pool counters
+* \param pool - block pool
+* \param[out] stats - counters
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t block_pool_stats(const block_pool_t *const pool,
+                            block_pool_stats_t *const stats);
+
+/**
+* \brief frees the pool, all the blocks have to be released
+* \param pool - block pool
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t block_pool_destroy(block_pool_t **const pool);
+
+#endif /* INC_BLOCK_POOL_H_ */
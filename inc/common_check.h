@@ -14,6 +14,9 @@
  * \brief get array size for one-dimensional array
  */
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
 /**
  * \brief reg = target variable or register, bit = bit to set or clear
  */
@@ -35,12 +38,13 @@
 /**
 * \brief macro to check  errors of ret_code_t type
 */
-#define CHECK_CODE_ERR(ret)                                               \
-    do {                                                                  \
-        if (ret != RET_CODE_SUCCESS) {                                    \
-            LOG_ERR("%s function failed with code %d \n", __func__, ret); \
-            exit(ret);                                                    \
-        }                                                                 \
+#define CHECK_CODE_ERR(ret)                                                 \
+    do {                                                                    \
+        const int _code = (ret); /* call once, its code is the exit code */ \
+        if (_code != RET_CODE_SUCCESS) {                                    \
+            LOG_ERR("%s function failed with code %d \n", __func__, _code); \
+            exit(_code);                                                    \
+        }                                                                   \
     } while (0)
 
 #define errExit(msg)        \
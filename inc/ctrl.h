@@ -0,0 +1,56 @@
+/**
+ * \file ctrl.h
+ *
+ * \brief Control socket for live reconfiguration. A unix datagram socket
+ * accepts "key value" pairs, one datagram is applied atomically between
+ * FIFO batches:
+ *
+ *     gain 20|40|80|160   rate 128|256|512   hpf 0|0.5   lpf 0|40|100|150
+ *
+ * e.g. echo "gain 40 rate 256" | socat - UNIX-SENDTO:/tmp/ecg.ctl
+ */
+#ifndef INC_CTRL_H_
+#define INC_CTRL_H_
+
+#include <stdint.h>
+#include "common_types.h"
+#include "MAX30003.h"
+
+#define CTRL_MSG_LEN 256
+
+typedef struct ctrl_ ctrl_t;
+
+/**
+* \brief creates control socket, a stale socket file is replaced
+* \param path - socket file path
+* \retval ctrl_t* - NULL on failure
+*/
+ctrl_t *ctrl_open(const char *const path);
+
+/**
+* \brief closes control socket and removes its file
+* \param ctrl - control socket, set to NULL
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t ctrl_close(ctrl_t **const ctrl);
+
+/**
+* \brief installs the batch hook of ecg_data which polls the socket and
+* calls max30003_reconfig() on changes
+* \param ctrl - control socket
+* \param ecg_data - structure with ECG measurement parameters and registers
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t ctrl_attach(ctrl_t *const ctrl, ecg_data_t *const ecg_data);
+
+/**
+* \brief applies "key value" pairs of a control message to the
+* configuration in ecg_data, the chip is not touched
+* \param ecg_data - structure with ECG measurement parameters and registers
+* \param msg - control message, modified
+* \retval ret_code_t RET_CODE_INVALID_PARAMS - unknown key or value, or an
+* lpf the resulting rate has not, nothing is changed
+*/
+ret_code_t ctrl_parse(ecg_data_t *const ecg_data, char *const msg);
+
+#endif /* INC_CTRL_H_ */
@@ -0,0 +1,56 @@
+/**
+ * \file dsp.h
+ *
+ * \brief Signal processing of data_arr points: points are converted to
+ * signed samples and the baseline wander is removed by a first order
+ * high-pass filter. ECG_MARKER() points are passed through and the filter
+ * is re-derived for the new sample rate.
+ */
+#ifndef INC_DSP_H_
+#define INC_DSP_H_
+
+#include <stdint.h>
+#include "common_types.h"
+#include "MAX30003.h"
+
+#define DSP_HPF_CUTOFF_HZ 0.5 /* baseline wander cutoff */
+#define DSP_COEF_SHIFT    15  /* filter coefficient is Q15 */
+
+/**
+ * \brief Converts a data_arr point to a signed sample, ADC counts << 2
+ */
+#define DSP_POINT_TO_SAMPLE(_point) ((int32_t)(_point) >> 14)
+
+/**
+ * \brief Filter state
+ */
+typedef struct {
+    int32_t  x1;    /* previous input sample */
+    int32_t  y1;    /* previous output sample */
+    int32_t  alpha; /* RC / (RC + dt), Q15 */
+    uint32_t rate;  /* samples per second */
+    uint8_t  primed;
+} dsp_t;
+
+/**
+* \brief resets filter state and derives coefficients from the sample rate
+* \param dsp - filter state
+* \param cnfg_ecg - CNFG_ECG register of the following points
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t dsp_init(dsp_t *const dsp, const uint32_t cnfg_ecg);
+
+/**
+* \brief filters points, in and out may be the same buffer
+* \param dsp - filter state
+* \param in - data_arr points
+* \param[out] out - filtered samples, markers are copied and have to be
+* told apart by the input point
+* \param num - number of points
+*/
+void dsp_process(dsp_t *const         dsp,
+                 const int32_t *const in,
+                 int32_t *const       out,
+                 const uint32_t       num);
+
+#endif /* INC_DSP_H_ */
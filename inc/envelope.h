@@ -0,0 +1,165 @@
+/**
+ * \file envelope.h
+ *
+ * \brief Min/max/mean envelope pyramid of a recording for zooming out
+ * without reading the samples. Level 0 buckets summarize ENV_BASE_POINTS
+ * samples, a bucket of level n summarizes ENV_FANOUT buckets of level n - 1.
+ * The pyramid grows as samples are appended, no allocation is made within
+ * the buckets of env_reserve(). The partial bucket of every level is kept
+ * aside, so queries see the newest samples too. A query tiles each pixel
+ * with buckets not wider than the pixel, its cost is bound by the pixels
+ * asked for, not by the samples they cover.
+ *
+ * File layout (<recording>.env): env_header_t, levels uint32_t bucket
+ * counts, then env_bucket_t arrays level by level. The last bucket of a
+ * level is partial when samples_num is not a multiple of its span.
+ */
+#ifndef INC_ENVELOPE_H_
+#define INC_ENVELOPE_H_
+
+#include <stdint.h>
+#include "common_types.h"
+
+#define ENV_MAGIC       0x5645334D /* "M3EV" */
+#define ENV_VERSION     1
+#define ENV_SUFFIX      ".env" /* appended to the recording path */
+#define ENV_BASE_POINTS 32     /* samples per level 0 bucket */
+#define ENV_FANOUT      4      /* buckets merged into one of the next level */
+#define ENV_LEVELS_MAX  16     /* 32 * 4^15 samples, years at 512 sps */
+
+/**
+ * \brief Header of the envelope file
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t sample_rate; /* samples per second, 0 if unknown */
+    uint16_t base;        /* ENV_BASE_POINTS */
+    uint16_t fanout;      /* ENV_FANOUT */
+    uint32_t levels;
+    uint64_t samples_num;
+} __attribute__((packed)) env_header_t;
+
+/**
+ * \brief Summary of consecutive samples, ADC counts as DSP_POINT_TO_SAMPLE()
+ */
+typedef struct {
+    int32_t min;
+    int32_t max;
+    int64_t sum;
+} env_bucket_t;
+
+/**
+ * \brief Column of a query result
+ */
+typedef struct {
+    int32_t  min;
+    int32_t  max;
+    int32_t  mean;
+    uint32_t num; /* samples summarized, 0 - past the end */
+} env_col_t;
+
+/**
+ * \brief Buckets of a level
+ */
+typedef struct {
+    env_bucket_t *b;   /* complete buckets */
+    uint64_t      num;
+    uint64_t      cap;
+    env_bucket_t  acc; /* complete buckets of the level below not merged */
+    uint32_t      acc_num;
+} env_level_t;
+
+/**
+ * \brief Envelope pyramid
+ */
+typedef struct {
+    env_level_t level[ENV_LEVELS_MAX];
+    uint32_t    levels; /* levels with at least one complete bucket */
+    uint32_t    sample_rate;
+    uint64_t    samples_num;
+} env_t;
+
+/**
+* \brief empties the envelope
+* \param env - envelope
+* \param sample_rate - samples per second, 0 if unknown
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t env_init(env_t *const env, const uint32_t sample_rate);
+
+/**
+* \brief allocates the buckets of samples_num samples up front, appending
+* them allocates nothing afterwards
+* \param env - envelope
+* \param samples_num - samples expected
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t env_reserve(env_t *const env, const uint64_t samples_num);
+
+/**
+* \brief frees the buckets, the envelope is empty afterwards
+* \param env - envelope
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t env_free(env_t *const env);
+
+/**
+* \brief appends data_arr points, ECG_MARKER() points are skipped
+* \param env - envelope
+* \param points - points in max30003_get_ecg_point() format
+* \param num - number of points
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t env_append(env_t *const         env,
+                      const int32_t *const points,
+                      const uint32_t       num);
+
+/**
+* \brief level a query of width columns over num samples reads, buckets of
+* level 0 are wider than a column when num < width * ENV_BASE_POINTS, read
+* the samples of such ranges instead
+* \param env - envelope
+* \param num - samples of the range
+* \param width - columns
+* \retval level
+*/
+uint32_t env_level(const env_t *const env,
+                   const uint64_t     num,
+                   const uint32_t     width);
+
+/**
+* \brief summarizes samples [first, first + num) in width columns. Column
+* edges are rounded to level 0 buckets, a column merges the fewest buckets
+* of the levels up to env_level() tiling its share exactly, neighbouring
+* columns do not overlap.
+* \param env - envelope
+* \param first - index of the first sample
+* \param num - samples of the range
+* \param width - columns
+* \param[out] cols - width columns
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t env_query(const env_t *const env,
+                     const uint64_t     first,
+                     const uint64_t     num,
+                     const uint32_t     width,
+                     env_col_t *const   cols);
+
+/**
+* \brief writes the envelope file
+* \param env - envelope
+* \param path - file path
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t env_save(const env_t *const env, const char *const path);
+
+/**
+* \brief loads the envelope file, appending to it continues the pyramid
+* \param env - envelope to fill
+* \param path - file path
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t env_load(env_t *const env, const char *const path);
+
+#endif /* INC_ENVELOPE_H_ */
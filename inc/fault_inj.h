@@ -0,0 +1,122 @@
+/**
+ * \file fault_inj.h
+ *
+ * \brief Fault injection decorator of the SPI transport. It wraps the
+ * backend attached to a spi_t (replay or the synthetic simulator) and
+ * makes the bus misbehave: failing messages, latency spikes, bit flips in
+ * FIFO words, spurious overflows, STATUS bits stuck for a number of reads
+ * and chip resets. Faults are drawn from a seeded generator per message,
+ * so a run against REPLAY_SPEED_MAX is repeated exactly by the same seed.
+ */
+#ifndef INC_FAULT_INJ_H_
+#define INC_FAULT_INJ_H_
+
+#include <stdint.h>
+#include "common_types.h"
+#include "spi.h"
+
+#define FAULT_PPM          1000000 /* probabilities are parts per million */
+#define FAULT_SEED_DEFAULT 1
+#define FAULT_NAME_LEN     32
+
+/**
+ * \brief Faults to inject, a zero probability disables the fault
+ */
+typedef struct {
+    char     name[FAULT_NAME_LEN];
+    uint64_t seed;
+    uint32_t ioctl_ppm;   /* messages failing with EIO, not passed on */
+    uint32_t latency_ppm; /* messages delayed by latency_us */
+    uint32_t latency_us;
+    uint32_t flip_ppm;    /* FIFO words read with one of 24 bits flipped */
+    uint32_t ovf_ppm;     /* STATUS reads with a spurious EOVF */
+    uint32_t stuck_ppm;   /* STATUS reads starting a stuck bits episode */
+    uint32_t stuck_reads; /* STATUS reads an episode lasts */
+    uint32_t stuck_set;   /* STATUS bits stuck at 1 */
+    uint32_t stuck_clr;   /* STATUS bits stuck at 0 */
+    uint32_t reset_ppm;   /* messages preceded by SW_RST of the chip */
+} fault_profile_t;
+
+/**
+ * \brief Faults injected so far
+ */
+typedef struct {
+    uint64_t messages;
+    uint64_t failed;
+    uint64_t delayed;
+    uint64_t flips;
+    uint64_t ovfs;
+    uint64_t stuck;
+    uint64_t resets;
+} fault_counts_t;
+
+typedef struct fault_inj_ fault_inj_t;
+
+/**
+* \brief fault injection backend, forwards to the wrapped one
+*/
+extern const spi_backend_t fault_inj_backend;
+
+/**
+* \brief fills the profile from a spec: a profile name and/or comma
+* separated key=value overrides, e.g. "overflow", "none,ioctl=100" or
+* "latency=500:100000,seed=7". Keys: seed, ioctl, latency (ppm:us), flip,
+* ovf, stuck (ppm:reads:set[:clr], masks of STATUS bits), reset. Names:
+* none, ioctl, latency, flip, overflow, pll, reset, mixed, a name resets
+* the keys before it
+* \param profile - profile to fill
+* \param spec - profile spec
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t fault_profile_parse(fault_profile_t *const profile,
+                               const char *const      spec);
+
+/**
+* \brief name of a built in profile
+* \param idx - profile index
+* \retval name, NULL past the last profile
+*/
+const char *fault_profile_name(const uint32_t idx);
+
+/**
+* \brief creates fault injector
+* \param profile - faults to inject, copied
+* \retval handle, NULL on failure
+*/
+fault_inj_t *fault_inj_open(const fault_profile_t *const profile);
+
+/**
+* \brief replaces the faults injected from the next message on, the
+* generator restarts from the seed of the profile
+* \param fi - fault injector
+* \param profile - faults to inject, copied
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t fault_inj_set_profile(fault_inj_t *const           fi,
+                                 const fault_profile_t *const profile);
+
+/**
+* \brief frees fault injector, detach it first with spi_free()
+* \param fi - handle pointer, set to NULL
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t fault_inj_close(fault_inj_t **fi);
+
+/**
+* \brief wraps the backend attached to spi, call before spi_init()
+* \param fi - fault injector
+* \param spi - structure with spidev params, a backend must be attached
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t fault_inj_attach(fault_inj_t *const fi, spi_t *const spi);
+
+/**
+* \brief faults injected so far
+* \param fi - fault injector
+* \param[out] counts - counters
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t fault_inj_counts(const fault_inj_t *const fi,
+                            fault_counts_t *const    counts);
+
+#endif /* INC_FAULT_INJ_H_ */
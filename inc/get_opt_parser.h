@@ -8,6 +8,25 @@
 #ifndef INC_GET_OPT_PARSER_H_
 #define INC_GET_OPT_PARSER_H_
 #include "MAX30003.h"
+#include "pipeline.h"
+
+/**
+* \brief Application options which are not spidev or MAX30003 settings
+*/
+typedef struct {
+    char *     replay_path;   /* play recording instead of spidev if set */
+    uint32_t   replay_speed;  /* speed multiplier, 0 - as fast as possible */
+    char *     faults;        /* fault profile of the replay if set */
+    char *     output_path;   /* binary recording output if set */
+    char *     stats_path;    /* counters file if set */
+    char *     trace_path;    /* trace dump written on exit if set */
+    uint32_t   verify_period; /* FIFO batches between register readbacks */
+    uint8_t    warm_start;    /* keep running chip configuration if possible */
+    char *     ctrl_path;     /* live reconfiguration socket if set */
+    char *     calib_path;    /* SPI clock cache, calibrate clock if set */
+    uint8_t    pipeline;      /* acquisition, DSP and sink on own threads */
+    pipe_cfg_t pipe;          /* stage placement of the pipeline */
+} app_opts_t;
 
 /**
 * \brief parsing options that passed to command line execution
@@ -16,11 +35,14 @@
 * \param argc - number of CL arguments
 * \param argv - buffer with CL arguments present
 * \param spi - structure with spidev params
+* \param ecg_data - structure with ecg measurement parameters and registers
+* \param opts - application options
 * \retval spi_dev_name "/dev/spidev0.0 for example
 */
 ret_code_t parse_opts(int               argc,
                       char *            argv[],
                       spi_t *const      spi,
-                      ecg_data_t *const ecg_data);
+                      ecg_data_t *const ecg_data,
+                      app_opts_t *const opts);
 
 #endif /* INC_GET_OPT_PARSER_H_ */
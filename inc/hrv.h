@@ -0,0 +1,131 @@
+/**
+ * \file hrv.h
+ *
+ * \brief Streaming heart rate variability over a sliding window of RR
+ * intervals. Time domain metrics (mean RR, SDNN, RMSSD, pNN50) are kept as
+ * integer running sums, every RR interval entering or leaving the window
+ * is an O(1) update. LF and HF powers are computed every spec_period_s by
+ * a Lomb-Scargle periodogram of the unevenly spaced RR series. Only the
+ * RR intervals of the window are stored, never the samples.
+ */
+#ifndef INC_HRV_H_
+#define INC_HRV_H_
+
+#include <stdint.h>
+#include "common_types.h"
+
+#define HRV_WINDOW_S_DEFAULT 300  /* short term HRV, 5 minutes */
+#define HRV_SPEC_S_DEFAULT   30   /* LF/HF refresh period */
+#define HRV_RR_MAX           1024 /* RR intervals in a window */
+#define HRV_RR_MIN_MS        300  /* shorter intervals are artifacts */
+#define HRV_RR_MAX_MS        2000 /* longer ones are missed beats */
+#define HRV_NN50_MS          50
+#define HRV_SPEC_MIN_S       60 /* window length needed for LF/HF */
+
+/* Frequency bands, Hz */
+#define HRV_LF_LO      0.04
+#define HRV_LF_HI      0.15
+#define HRV_HF_HI      0.40
+#define HRV_OVERSAMPLE 4 /* frequency steps per 1/window length */
+
+/**
+ * \brief RTOR register to RR interval, the R to R timer counts 1/128 s
+ */
+#define HRV_RTOR_SHIFT 10
+#define HRV_RTOR_MASK  0x3FFF
+#define HRV_RTOR_TO_MS(_reg)                                                  \
+    ((((_reg) >> HRV_RTOR_SHIFT) & HRV_RTOR_MASK) * 1000 / 128)
+
+/**
+ * \brief Metrics of the current window
+ */
+typedef struct {
+    uint32_t beats;   /* RR intervals in the window */
+    double   mean_rr; /* ms */
+    double   hr;      /* beats per minute */
+    double   sdnn;    /* ms */
+    double   rmssd;   /* ms */
+    double   pnn50;   /* % */
+    double   lf;      /* ms^2, 0 until the first spectral update */
+    double   hf;      /* ms^2 */
+    double   lf_hf;
+} hrv_metrics_t;
+
+/**
+ * \brief Window state
+ */
+typedef struct {
+    uint16_t rr[HRV_RR_MAX];     /* ms, ring */
+    uint8_t  linked[HRV_RR_MAX]; /* follows the previous interval */
+    uint32_t head;               /* oldest interval */
+    uint32_t num;
+    uint32_t window_ms;
+    uint32_t spec_period_ms;
+    uint32_t spec_due_ms; /* window time left to the next LF/HF update */
+    int64_t  sum;         /* of RR */
+    int64_t  sum2;        /* of RR^2 */
+    int64_t  sum_d2;      /* of successive differences squared */
+    uint32_t diffs;       /* successive differences in the window */
+    uint32_t nn50;        /* of them above HRV_NN50_MS */
+    uint8_t  chained;     /* next interval follows the newest one */
+    uint64_t last_beat;   /* sample index of the previous beat */
+    uint32_t rate;        /* of last_beat, 0 - no beat yet */
+    double   lf;
+    double   hf;
+} hrv_t;
+
+/**
+* \brief empties the window
+* \param hrv - window state
+* \param window_s - window length
+* \param spec_period_s - LF/HF refresh period, 0 - never
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t hrv_init(hrv_t *const   hrv,
+                    const uint32_t window_s,
+                    const uint32_t spec_period_s);
+
+/**
+* \brief adds RR interval, intervals out of HRV_RR_MIN_MS..HRV_RR_MAX_MS
+* are dropped and break the successive differences
+* \param hrv - window state
+* \param rr_ms - RR interval
+* \retval 1 - LF/HF were refreshed
+*/
+uint8_t hrv_add_rr(hrv_t *const hrv, const uint32_t rr_ms);
+
+/**
+* \brief adds RR interval of the MAX30003 R to R detector
+* \param hrv - window state
+* \param rtor - RTOR register read on RRINT
+* \retval 1 - LF/HF were refreshed
+*/
+uint8_t hrv_add_rtor(hrv_t *const hrv, const uint32_t rtor);
+
+/**
+* \brief adds beat detected in software, the RR interval to the previous
+* beat is added. A sample rate change starts a new chain of beats.
+* \param hrv - window state
+* \param beat - sample index of the R wave, see qrs_process()
+* \param rate - samples per second
+* \retval 1 - LF/HF were refreshed
+*/
+uint8_t hrv_add_beat(hrv_t *const   hrv,
+                     const uint64_t beat,
+                     const uint32_t rate);
+
+/**
+* \brief recomputes LF and HF from the RR intervals of the window
+* \param hrv - window state
+*/
+void hrv_spectral(hrv_t *const hrv);
+
+/**
+* \brief metrics of the window, LF/HF of the last spectral update
+* \param hrv - window state
+* \param[out] m - metrics
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t hrv_get(const hrv_t *const hrv, hrv_metrics_t *const m);
+
+#endif /* INC_HRV_H_ */
@@ -0,0 +1,110 @@
+/**
+ * \file pipeline.h
+ *
+ * \brief Threaded acquisition pipeline: acquisition, DSP and sink stages run
+ * on their own threads connected by bounded single producer single consumer
+ * lock-free queues. Acquisition fills blocks of a block_pool_t and queues
+ * carry ranges of them, each range holding a block reference, so samples
+ * are never copied and a block returns to the pool when its last range is
+ * done. Acquisition never blocks on a full queue, its points stay pending
+ * and are handed over with the next batch. Consumers sleep on a futex only
+ * when their queue is empty.
+ */
+#ifndef INC_PIPELINE_H_
+#define INC_PIPELINE_H_
+
+#include <stdint.h>
+#include "common_types.h"
+#include "MAX30003.h"
+#include "block_pool.h"
+
+#define PIPE_QUEUE_LEN    64   /* ranges per queue, power of two */
+#define PIPE_BLOCK_MIN    16   /* points handed over to DSP at once */
+#define PIPE_POOL_BLOCKS  8    /* default pool */
+#define PIPE_BLOCK_POINTS 1024 /* 2 s at 512 sps */
+#define PIPE_CPU_ANY      (-1)
+
+/**
+ * \brief Pipeline stages
+ */
+typedef enum {
+    PIPE_STAGE_ACQ = 0, /* ecg_get_data() */
+    PIPE_STAGE_DSP,     /* baseline removal, QRS, HRV and signal quality */
+    PIPE_STAGE_SINK,    /* binary recording and text output */
+    PIPE_STAGE_NUM
+} pipe_stage_id_t;
+
+#define PIPE_QUEUE_NUM (PIPE_STAGE_NUM - 1) /* queue N feeds stage N + 1 */
+
+/**
+ * \brief Placement of a stage thread
+ */
+typedef struct {
+    int32_t  cpu;  /* CPU to pin the thread to, PIPE_CPU_ANY - not pinned */
+    uint32_t prio; /* SCHED_FIFO priority, 0 - default policy */
+} pipe_stage_cfg_t;
+
+/**
+ * \brief Pipeline settings
+ */
+typedef struct {
+    pipe_stage_cfg_t stage[PIPE_STAGE_NUM];
+    block_pool_t *   pool;         /* NULL - a default pool per run */
+    uint32_t         block_min;    /* points per DSP range */
+    const char *     output_path;  /* binary recording if set */
+    const char *     quality_path; /* signal quality CSV if set */
+    const char *     arrow_path;   /* Arrow IPC tables prefix if set */
+    int32_t *        filtered;     /* DSP output by point index or NULL */
+} pipe_cfg_t;
+
+/**
+ * \brief Queue metrics of a run
+ */
+typedef struct {
+    uint64_t blocks;     /* ranges passed */
+    uint64_t full;       /* pushes rejected by a full queue */
+    uint32_t max_depth;  /* deepest fill seen by the producer */
+    double   mean_depth; /* fill seen by the consumer, averaged per block */
+} pipe_queue_stats_t;
+
+/**
+* \brief default settings: threads not pinned, default policy
+* \param cfg - pipeline settings
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t pipe_cfg_init(pipe_cfg_t *const cfg);
+
+/**
+* \brief parses stage placement "acq|dsp|sink:cpu[:prio]", cpu may be
+* "any"
+* \param cfg - pipeline settings
+* \param spec - stage placement string
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t pipe_cfg_stage(pipe_cfg_t *const cfg, const char *const spec);
+
+/**
+* \brief acquires ecg_data->data_len points with the stages on their own
+* threads and returns when all of them were written by the sink. Points
+* are not kept in data_arr, data_ID is set to the number acquired. Queue
+* and pool metrics and CPU time of the stages are logged.
+* \param cfg - pipeline settings
+* \param ecg_data - structure with ECG measurement parameters and data
+* \param[out] qstats - PIPE_QUEUE_NUM queue metrics, may be NULL
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t pipe_run(const pipe_cfg_t *const cfg,
+                    ecg_data_t *const       ecg_data,
+                    pipe_queue_stats_t *    qstats);
+
+/**
+* \brief passes ops ranges through a pipeline queue from the calling thread
+* to a consumer thread, as acquisition hands ranges over to DSP. No block
+* is attached to the ranges, queue throughput alone is measured.
+* \param ops - ranges to pass, the end of stream range is not counted
+* \param[out] qstats - queue metrics, may be NULL
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t pipe_queue_run(const uint64_t ops, pipe_queue_stats_t *qstats);
+
+#endif /* INC_PIPELINE_H_ */
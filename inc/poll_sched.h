@@ -0,0 +1,71 @@
+/**
+ * \file poll_sched.h
+ *
+ * \brief FIFO polling scheduler for boards without the INTB line. The
+ * wake-up interval starts from the sample period times EFIT and follows
+ * the observed FIFO fill: empty polls stretch it, near-overflow halves it.
+ */
+#ifndef INC_POLL_SCHED_H_
+#define INC_POLL_SCHED_H_
+
+#include <stdint.h>
+#include "common_types.h"
+#include "MAX30003.h"
+
+#define POLL_HEADROOM 4 /* FIFO words kept free for wake-up latency */
+#define POLL_MIN_DIV  4 /* shortest interval is sample period / 4 */
+
+/**
+ * \brief Polling schedule
+ */
+typedef struct {
+    uint64_t sample_ns;   /* sample period */
+    uint64_t interval_ns; /* current wake-up interval */
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t next_ns;     /* next wake-up, CLOCK_MONOTONIC */
+    uint32_t target;      /* FIFO words expected per wake-up */
+    uint32_t near_full;   /* FIFO words which halve the interval */
+    uint32_t cnfg_ecg;    /* configuration the schedule is derived from */
+    uint32_t mngr_int;
+} poll_sched_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+* \brief derives the schedule from sample rate and EFIT, first wake-up is
+* one interval from now
+* \param ps - polling schedule
+* \param cnfg_ecg - CNFG_ECG register
+* \param mngr_int - MNGR_INT register
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t poll_sched_init(poll_sched_t *const ps,
+                           const uint32_t      cnfg_ecg,
+                           const uint32_t      mngr_int);
+
+/**
+* \brief sleeps until the next wake-up, returns at once if it has passed
+* \param ps - polling schedule
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t poll_sched_wait(poll_sched_t *const ps);
+
+/**
+* \brief adapts the interval to FIFO words read at the wake-up and
+* schedules the next one
+* \param ps - polling schedule
+* \param words - valid FIFO words read
+* \param ovf - FIFO overflow seen
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t poll_sched_update(poll_sched_t *const ps,
+                             const uint32_t      words,
+                             const uint8_t       ovf);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* INC_POLL_SCHED_H_ */
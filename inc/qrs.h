@@ -0,0 +1,72 @@
+/**
+ * \file qrs.h
+ *
+ * \brief QRS detection on the output of dsp_process(): slope, squaring and
+ * moving window integration with an adaptive threshold between signal and
+ * noise peak levels (Pan-Tompkins). The first QRS_LEARN_MS after a reset
+ * only set the levels, beats are reported after that.
+ */
+#ifndef INC_QRS_H_
+#define INC_QRS_H_
+
+#include <stdint.h>
+#include "common_types.h"
+#include "MAX30003.h"
+
+#define QRS_WINDOW_MS     150  /* moving window integration */
+#define QRS_REFRACTORY_MS 200  /* no beat closer to the previous one */
+#define QRS_LEARN_MS      2000 /* signal and noise levels learning */
+#define QRS_WINDOW_MAX    128  /* integration window at 512 sps fits */
+#define QRS_SQUARE_SHIFT  8    /* squared slope scaling */
+
+/**
+ * \brief Detector state
+ */
+typedef struct {
+    uint32_t rate;
+    uint32_t window; /* samples integrated */
+    uint32_t refractory;
+    uint32_t learn;  /* samples left in the learning phase */
+    int32_t  x1, x2; /* previous filtered samples */
+    uint32_t sq[QRS_WINDOW_MAX];
+    uint32_t sq_pos;
+    uint64_t integ;  /* sum of sq */
+    uint64_t spk;    /* signal peak level */
+    uint64_t npk;    /* noise peak level */
+    uint64_t ep_max; /* peak of the current episode over threshold */
+    uint64_t ep_idx;
+    uint64_t last_beat;
+    uint64_t idx; /* index of the next sample */
+    uint8_t  above;
+    uint8_t  beat_seen;
+} qrs_t;
+
+/**
+* \brief resets detector for the sample rate coded in cnfg_ecg
+* \param qrs - detector state
+* \param cnfg_ecg - CNFG_ECG register of the following samples
+* \param idx - index of the next sample, beats are reported in this base
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t qrs_init(qrs_t *const   qrs,
+                    const uint32_t cnfg_ecg,
+                    const uint64_t idx);
+
+/**
+* \brief detects beats, the detector is reset on ECG_MARKER() points
+* \param qrs - detector state
+* \param points - data_arr points the samples were filtered from
+* \param filtered - dsp_process() output
+* \param num - number of samples
+* \param[out] beats - indexes of R waves, may be NULL
+* \param max_beats - size of beats
+* \retval number of beats detected, beats beyond max_beats are counted only
+*/
+uint32_t qrs_process(qrs_t *const         qrs,
+                     const int32_t *const points,
+                     const int32_t *const filtered,
+                     const uint32_t       num,
+                     uint64_t *const      beats,
+                     const uint32_t       max_beats);
+
+#endif /* INC_QRS_H_ */
@@ -0,0 +1,158 @@
+/**
+ * \file recording.h
+ *
+ * \brief Binary ECG recordings and legacy ecg_print_data() text output
+ *
+ * Binary layout: rec_header_t followed by words_num little endian uint32_t
+ * raw ECG FIFO words (sample, ETAG and PTAG as read from the chip).
+ * Configuration changes are stored as words tagged ETAG_CNFG carrying
+ * CNFG_ECG[23:12] of the following samples. Recordings written by
+ * rec_writer_*() get the envelope pyramid of envelope.h alongside, in the
+ * recording path followed by ENV_SUFFIX.
+ */
+#ifndef INC_RECORDING_H_
+#define INC_RECORDING_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "common_types.h"
+#include "MAX30003.h"
+#include "envelope.h"
+
+#define REC_MAGIC   0x4352334D /* "M3RC" */
+#define REC_VERSION 1
+
+#define REC_SAMPLE_BITS 18 /* ECG sample is 18 bit two's complement */
+#define REC_SAMPLE_MASK ((1 << REC_SAMPLE_BITS) - 1)
+
+/**
+ * \brief Header of the binary recording file
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t sample_rate; /* samples per second, 0 if unknown */
+    uint32_t cnfg_ecg;    /* CNFG_ECG register at recording time */
+    uint32_t words_num;
+} __attribute__((packed)) rec_header_t;
+
+/**
+ * \brief Recording loaded into memory
+ */
+typedef struct {
+    rec_header_t hdr;
+    uint32_t *   words; /* raw ECG FIFO words */
+    uint32_t     words_num;
+} rec_t;
+
+/**
+ * \brief Recording written while samples arrive, words_num in the header is
+ * updated by rec_writer_close(). The envelope grows with the samples and is
+ * saved to env_path on close.
+ */
+typedef struct {
+    FILE *       f;
+    rec_header_t hdr;
+    env_t        env;
+    char *       env_path;
+} rec_writer_t;
+
+/**
+ * \brief Converts a point of ecg_print_data() output to a FIFO word
+ */
+#define REC_LEGACY_TO_WORD(_point) ((((uint32_t)(_point)) >> 8) & 0xFFFF00)
+/**
+ * \brief Converts a FIFO word to the point format of max30003_get_ecg_point()
+ */
+#define REC_WORD_TO_LEGACY(_word) ((int32_t)(((_word)&0xFFFF00) << 8))
+/**
+ * \brief Converts a recording word to a data_arr point, ETAG_CNFG words to
+ * ECG_MARKER()
+ */
+#define REC_WORD_TO_POINT(_word)                                              \
+    ((((_word)&ECG_FIFO_ETAG_MASK) >> ECG_FIFO_ETAG_SHIFT) == ETAG_CNFG ?    \
+             ECG_MARKER(_word) :                                              \
+             REC_WORD_TO_LEGACY(_word))
+/**
+ * \brief Converts ECG_MARKER() of data_arr to a recording word
+ */
+#define REC_MARKER_TO_WORD(_point)                                            \
+    (ECG_MARKER_CNFG(_point) | (ETAG_CNFG << ECG_FIFO_ETAG_SHIFT))
+
+/**
+* \brief loads binary recording or legacy text output of ecg_print_data()
+* \param rec - recording to fill
+* \param path - file path
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t rec_load(rec_t *const rec, const char *const path);
+
+/**
+* \brief generates a synthetic ECG (P, QRS and T waves at 72 bpm)
+* \param rec - recording to fill
+* \param sample_rate - samples per second
+* \param seconds - length of the recording
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t rec_synth(rec_t *const   rec,
+                     const uint32_t sample_rate,
+                     const uint32_t seconds);
+
+/**
+* \brief frees memory of loaded recording
+* \param rec - recording
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t rec_free(rec_t *const rec);
+
+/**
+* \brief builds the envelope pyramid of a loaded recording
+* \param rec - recording
+* \param env - envelope to fill
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t rec_envelope(const rec_t *const rec, env_t *const env);
+
+/**
+* \brief saves data measured into ecg_data to binary recording
+* \param path - file path
+* \param ecg_data - structure with ecg measurement parameters and data
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t rec_save(const char *const path, const ecg_data_t *const ecg_data);
+
+/**
+* \brief creates binary recording to be filled by rec_writer_append()
+* \param w - writer
+* \param path - file path
+* \param cnfg_ecg - CNFG_ECG register of the first samples
+* \param words_num - words expected, the envelope is allocated for them up
+* front so appending them allocates nothing, 0 - grown as they come
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t rec_writer_open(rec_writer_t *const w,
+                           const char *const   path,
+                           const uint32_t      cnfg_ecg,
+                           const uint32_t      words_num);
+
+/**
+* \brief appends data_arr points to the recording, ECG_MARKER() points are
+* stored as ETAG_CNFG words
+* \param w - writer
+* \param points - points in max30003_get_ecg_point() format
+* \param num - number of points
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t rec_writer_append(rec_writer_t *const  w,
+                             const int32_t *const points,
+                             const uint32_t       num);
+
+/**
+* \brief writes the final header, closes the recording and saves its
+* envelope
+* \param w - writer
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t rec_writer_close(rec_writer_t *const w);
+
+#endif /* INC_RECORDING_H_ */
@@ -0,0 +1,127 @@
+/**
+ * \file reg_shadow.h
+ *
+ * \brief In-memory mirror of MAX30003 registers. Fields are changed with
+ * the bitmask macros of MAX30003.h, only registers which differ from the
+ * chip are written on flush, all of them in a single SPI message.
+ */
+#ifndef INC_REG_SHADOW_H_
+#define INC_REG_SHADOW_H_
+
+#include <stdint.h>
+#include "common_types.h"
+#include "MAX30003.h"
+
+#define REG_BIT(_addr) (1ULL << (_addr))
+
+/**
+ * \brief Writable configuration registers (strobes like SYNCH are not
+ * mirrored)
+ */
+#define REG_SHADOW_CNFG_MASK                                                 \
+    (REG_BIT(EN_INT) | REG_BIT(EN_INT2) | REG_BIT(MNGR_INT) |                \
+     REG_BIT(MNGR_DYN) | REG_BIT(CNFG_GEN) | REG_BIT(CNFG_CAL) |             \
+     REG_BIT(CNFG_EMUX) | REG_BIT(CNFG_ECG) | REG_BIT(CNFG_RTOR1) |          \
+     REG_BIT(CNFG_RTOR2))
+
+/**
+ * \brief Register shadow
+ */
+typedef struct {
+    uint32_t val[MAX30003_REGS_NUM];
+    uint64_t dirty;         /* registers to write on flush */
+    uint64_t valid;         /* registers known to match the chip */
+    uint64_t used;          /* registers ever set by the driver */
+    uint32_t verify_period; /* ticks between readback checks, 0 - off */
+    uint32_t ticks;
+} reg_shadow_t;
+
+/**
+* \brief global shadow of the chip on the global spi
+*/
+extern reg_shadow_t max30003_shadow;
+
+/**
+* \brief marks all registers unknown and the ones set by the driver
+* dirty, call after chip reset
+* \param sh - register shadow
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t reg_shadow_invalidate(reg_shadow_t *const sh);
+
+/**
+* \brief sets register value, the register gets dirty if it changes
+* \param sh - register shadow
+* \param addr - register address
+* \param val - 24 bit value
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t reg_shadow_set(reg_shadow_t *const sh,
+                          const uint8_t       addr,
+                          const uint32_t      val);
+
+/**
+* \brief BITMASK_SET() on the register
+*/
+ret_code_t reg_shadow_set_bits(reg_shadow_t *const sh,
+                               const uint8_t       addr,
+                               const uint32_t      mask);
+
+/**
+* \brief BITMASK_CLEAR() on the register
+*/
+ret_code_t reg_shadow_clear_bits(reg_shadow_t *const sh,
+                                 const uint8_t       addr,
+                                 const uint32_t      mask);
+
+/**
+* \brief replaces bits of the field selected by mask with value bits
+*/
+ret_code_t reg_shadow_set_field(reg_shadow_t *const sh,
+                                const uint8_t       addr,
+                                const uint32_t      mask,
+                                const uint32_t      val);
+
+/**
+* \brief value of register in the shadow
+*/
+uint32_t reg_shadow_get(const reg_shadow_t *const sh, const uint8_t addr);
+
+/**
+* \brief writes dirty registers in one SPI message
+* \param sh - register shadow
+* \param spi - structure with spidev params
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t reg_shadow_flush(reg_shadow_t *const sh, spi_t *const spi);
+
+/**
+* \brief reads configuration registers in one SPI message into the shadow
+* \param sh - register shadow
+* \param spi - structure with spidev params
+* \param mask - REG_BIT() of registers to read
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t reg_shadow_load(reg_shadow_t *const sh,
+                           spi_t *const        spi,
+                           const uint64_t      mask);
+
+/**
+* \brief reads back valid configuration registers and compares them with
+* the shadow, mismatching registers get dirty
+* \param sh - register shadow
+* \param spi - structure with spidev params
+* \param[out] mismatch - REG_BIT() of mismatching registers, may be NULL
+* \retval ret_code_t RET_CODE_CRC_MISMATCH - chip differs (was reset)
+*/
+ret_code_t reg_shadow_verify(reg_shadow_t *const sh,
+                             spi_t *const        spi,
+                             uint64_t *const     mismatch);
+
+/**
+* \brief counts calls and runs reg_shadow_verify() every verify_period
+* calls, meant to be called once per FIFO batch
+*/
+ret_code_t reg_shadow_tick(reg_shadow_t *const sh, spi_t *const spi);
+
+#endif /* INC_REG_SHADOW_H_ */
@@ -0,0 +1,85 @@
+/**
+ * \file replay.h
+ *
+ * \brief Replay backend for the SPI transport: plays a recording through
+ * a model of the MAX30003 (registers, 32 words ECG FIFO, STATUS bits and
+ * FIFO tags) at real time, N times faster or as fast as possible.
+ */
+#ifndef INC_REPLAY_H_
+#define INC_REPLAY_H_
+
+#include <stdint.h>
+#include "common_types.h"
+#include "spi.h"
+
+#define REPLAY_SPEED_MAX     0 /* samples are available as soon as read */
+#define REPLAY_SPEED_DEFAULT 1 /* real time */
+
+typedef struct replay_ replay_t;
+
+/**
+* \brief spi_t backend operations of the replay engine
+*/
+extern const spi_backend_t replay_backend;
+
+/**
+* \brief opens a recording for replay
+* \param path - binary recording or ecg_print_data() text output
+* \param speed - speed multiplier, REPLAY_SPEED_MAX - as fast as possible
+* \retval replay handle, NULL on failure
+*/
+replay_t *replay_open(const char *const path, const uint32_t speed);
+
+/**
+* \brief opens the simulator: replay of a synthetic ECG (see rec_synth())
+* \param sample_rate - samples per second of the generated signal
+* \param seconds - length of the looped signal
+* \param speed - speed multiplier, REPLAY_SPEED_MAX - as fast as possible
+* \retval replay handle, NULL on failure
+*/
+replay_t *replay_open_synth(const uint32_t sample_rate,
+                            const uint32_t seconds,
+                            const uint32_t speed);
+
+/**
+* \brief closes replay handle and frees the recording
+* \param replay - replay handle
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t replay_close(replay_t **replay);
+
+/**
+* \brief attaches replay engine as the spi backend, call before spi_init()
+* \param replay - replay handle
+* \param spi - structure with spidev params
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t replay_attach(replay_t *const replay, spi_t *const spi);
+
+/**
+* \brief number of samples produced by the modelled chip so far
+* (including samples lost on FIFO overflow)
+*/
+uint64_t replay_samples_produced(const replay_t *const replay);
+
+/**
+* \brief number of samples lost on modelled FIFO overflow
+*/
+uint64_t replay_samples_lost(const replay_t *const replay);
+
+/**
+* \brief number of samples dropped unread from the modelled FIFO by
+* FIFO_RST, SYNCH or SW_RST
+*/
+uint64_t replay_samples_dropped(const replay_t *const replay);
+
+/**
+* \brief models the board SCLK limit: transfers faster than sclk_max read
+* MISO a bit late, all the read bytes are shifted by one bit
+* \param replay - replay handle
+* \param sclk_max - clock limit [Hz], 0 - no limit (default)
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t replay_set_sclk_max(replay_t *const replay, const uint32_t sclk_max);
+
+#endif /* INC_REPLAY_H_ */
@@ -7,6 +7,7 @@
 #ifndef INC_SPI_H_
 #define INC_SPI_H_
 //-----------------------------------------------------------------------------
+#include <stddef.h>
 #include <linux/spi/spidev.h>
 #include "../inc/common_types.h"
 
@@ -18,6 +19,23 @@
 #define SPI_BUFF_SIZE          4
 #define SPI_COMMAND_LEN        1
 
+struct spi_;
+
+/**
+* \brief Transport backend used instead of spidev ioctls.
+* All the register accesses of the driver end up in message(), so a backend
+* that understands the MAX30003 command bytes can stand in for the chip.
+*/
+typedef struct spi_backend_ {
+    const char *name;
+    ret_code_t (*open)(struct spi_ *const self);
+    ret_code_t (*close)(struct spi_ *const self);
+    /* same semantics as ioctl(fd, SPI_IOC_MESSAGE(n), xfer) */
+    int (*message)(struct spi_ *const           self,
+                   struct spi_ioc_transfer *const xfer,
+                   const unsigned int             n);
+} spi_backend_t;
+
 /**
 * \brief Struct contains spidev parameters to set
 */
@@ -31,7 +49,9 @@ typedef struct spi_ {
     __u8  rx_buf[SPI_BUFF_SIZE];
     __u8  tx_buf[SPI_BUFF_SIZE];
     struct spi_ioc_transfer xfer[2];
-} __attribute__((packed)) spi_t;
+    const spi_backend_t *   backend;     /* NULL - spidev */
+    void *                  backend_ctx; /* backend private data */
+} spi_t;
 
 #ifdef __cplusplus
 extern "C" {
@@ -71,6 +91,37 @@ ret_code_t spi_read(spi_t *const self, char *const rx_buf, const size_t len);
 ret_code_t
 spi_write(spi_t *const self, const char *const tx_buf, const size_t len);
 
+/**
+* \brief changes the bus clock of an initialized spi, transfers built by
+* the driver take speed_hz from xfer[0]
+* \param self - structure with spidev params
+* \param speed_hz - clock [Hz]
+* \retval ret_code_t
+*/
+ret_code_t spi_set_speed(spi_t *const self, const __u32 speed_hz);
+
+/**
+* \brief attach a transport backend, must be called before spi_init()
+* \param self - structure with spidev params
+* \param backend - backend operations
+* \param ctx - backend private data
+* \retval ret_code_t
+*/
+ret_code_t spi_attach_backend(spi_t *const               self,
+                              const spi_backend_t *const backend,
+                              void *const                ctx);
+
+/**
+* \brief run a full duplex message of n transfers on the bus
+* \param self - structure with spidev params
+* \param xfer - transfers to run
+* \param n - number of transfers
+* \retval ioctl() like result, negative on failure
+*/
+int spi_message(spi_t *const                   self,
+                struct spi_ioc_transfer *const xfer,
+                const unsigned int             n);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
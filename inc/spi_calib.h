@@ -0,0 +1,53 @@
+/**
+ * \file spi_calib.h
+ *
+ * \brief SPI clock calibration. Clock rates are swept upwards, each one is
+ * verified with repeated INFO readbacks and write/readback patterns of a
+ * scratch configuration register (CNFG_RTOR2, restored afterwards). The
+ * fastest contiguous passing rate minus a safety margin is used and cached
+ * per device, the cached rate is re-verified on the next start.
+ */
+#ifndef INC_SPI_CALIB_H_
+#define INC_SPI_CALIB_H_
+
+#include <stdint.h>
+#include "common_types.h"
+#include "spi.h"
+
+#define SPI_CALIB_SCLK_MAX    12000000 /* MAX30003 SCLK limit [Hz] */
+#define SPI_CALIB_MARGIN_PCT  75       /* of the fastest passing rate */
+#define SPI_CALIB_READS       64       /* INFO readbacks per rate */
+#define SPI_CALIB_PATTERNS    8        /* scratch write/readbacks per rate */
+#define SPI_CALIB_VERIFY_DIV  4        /* fewer checks for a cached rate */
+#define SPI_CALIB_DEV_LEN     64
+
+/**
+* \brief verifies bus integrity at the current clock, the scratch register
+* is saved and restored at the slowest clock
+* \param spi - structure with spidev params
+* \param reads - INFO readbacks
+* \param patterns - scratch register write/readbacks
+* \retval ret_code_t RET_CODE_CRC_MISMATCH - data corrupted on the bus
+*/
+ret_code_t spi_calib_verify(spi_t *const   spi,
+                            const uint32_t reads,
+                            const uint32_t patterns);
+
+/**
+* \brief sweeps clock rates and sets the fastest reliable one with margin
+* \param spi - structure with spidev params, initialized
+* \param[out] speed_hz - selected clock, may be NULL
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t spi_calib_sweep(spi_t *const spi, uint32_t *const speed_hz);
+
+/**
+* \brief sets the clock cached for the device in cache_path if it still
+* verifies, calibrates and updates the cache otherwise
+* \param spi - structure with spidev params, initialized
+* \param cache_path - text file of "device speed_hz" lines
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t spi_calib_run(spi_t *const spi, const char *const cache_path);
+
+#endif /* INC_SPI_CALIB_H_ */
@@ -0,0 +1,109 @@
+/**
+ * \file sqi.h
+ *
+ * \brief Spectral signal quality of the raw ECG: consecutive windows of
+ * about SQI_WINDOW_S are Hann windowed and transformed by a real FFT
+ * planned once per sample rate. Band powers of every window and a quality
+ * index, the share of the QRS band in the noise and signal bands, form a
+ * low rate metric stream.
+ */
+#ifndef INC_SQI_H_
+#define INC_SQI_H_
+
+#include <stdint.h>
+#include "common_types.h"
+#include "MAX30003.h"
+
+#define SQI_WINDOW_S  2    /* window length at least, rounded to 2^n */
+#define SQI_FFT_MAX   1024 /* window at 512 sps */
+#define SQI_POOR      50   /* quality index under which a window is poor */
+#define SQI_MAINS_DHZ 1.0  /* mains band half width */
+
+/* Band edges, Hz */
+#define SQI_BASELINE_HI 1.0
+#define SQI_QRS_LO      5.0
+#define SQI_QRS_HI      25.0
+#define SQI_HF_LO       40.0
+#define SQI_MAINS_50    50.0
+#define SQI_MAINS_60    60.0
+
+/**
+ * \brief Bands, bins out of all of them do not count
+ */
+typedef enum {
+    SQI_BAND_BASELINE = 0, /* wander, electrode motion */
+    SQI_BAND_QRS,
+    SQI_BAND_MAINS, /* 50 and 60 Hz */
+    SQI_BAND_HF,    /* EMG and other wideband noise above SQI_HF_LO */
+    SQI_BAND_NUM,
+    SQI_BAND_NONE = SQI_BAND_NUM
+} sqi_band_t;
+
+/**
+ * \brief Metrics of a window
+ */
+typedef struct {
+    uint64_t start;               /* index of the first sample */
+    uint32_t len;                 /* samples */
+    float    power[SQI_BAND_NUM]; /* mean square, (ADC counts << 2)^2 */
+    uint8_t  quality;             /* 0..100, QRS share of the band powers */
+} sqi_metrics_t;
+
+/**
+ * \brief Plan and window state
+ */
+typedef struct {
+    float    win[SQI_FFT_MAX];       /* Hann window */
+    float    tw_re[SQI_FFT_MAX / 2]; /* stage twiddles, stage of half h */
+    float    tw_im[SQI_FFT_MAX / 2]; /* starts at h */
+    float    rtw_re[SQI_FFT_MAX / 2]; /* real FFT split twiddles */
+    float    rtw_im[SQI_FFT_MAX / 2];
+    uint16_t rev[SQI_FFT_MAX / 2];      /* bit reversed order */
+    uint8_t  band[SQI_FFT_MAX / 2 + 1]; /* sqi_band_t of a bin */
+    float    scale;                     /* bin power to mean square */
+    float    re[SQI_FFT_MAX / 2];
+    float    im[SQI_FFT_MAX / 2];
+    int32_t  buf[SQI_FFT_MAX]; /* samples of the current window */
+    uint32_t len;              /* window and FFT length */
+    uint32_t fill;
+    uint32_t rate;
+    uint64_t idx; /* index of the next sample */
+} sqi_t;
+
+/**
+* \brief plans the FFT for the sample rate coded in cnfg_ecg and empties
+* the window
+* \param sqi - plan and window state
+* \param cnfg_ecg - CNFG_ECG register of the following points
+* \param idx - index of the next point, windows are reported in this base
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t sqi_init(sqi_t *const   sqi,
+                    const uint32_t cnfg_ecg,
+                    const uint64_t idx);
+
+/**
+* \brief adds points, the plan is redone on ECG_MARKER() points and the
+* partial window is dropped
+* \param sqi - plan and window state
+* \param points - data_arr points
+* \param num - number of points
+* \param[out] metrics - metrics of the windows completed, may be NULL
+* \param max_metrics - size of metrics
+* \retval number of windows completed, windows beyond max_metrics are
+* counted only
+*/
+uint32_t sqi_process(sqi_t *const         sqi,
+                     const int32_t *const points,
+                     const uint32_t       num,
+                     sqi_metrics_t *const metrics,
+                     const uint32_t       max_metrics);
+
+/**
+* \brief name of a band
+* \param band - band
+* \retval name
+*/
+const char *sqi_band_name(const sqi_band_t band);
+
+#endif /* INC_SQI_H_ */
@@ -0,0 +1,220 @@
+/**
+ * \file stats.h
+ *
+ * \brief Always-on hot path counters. Every thread increments its own
+ * cache line aligned shard with relaxed atomics, readers sum the shards.
+ * Latencies go to log-linear histograms of the shards the same way: a
+ * bucket per 1/16 of each power of two of nanoseconds, 6.25 % precision.
+ */
+#ifndef INC_STATS_H_
+#define INC_STATS_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "common_types.h"
+
+#define STATS_PERIOD_S_DEFAULT 1 /* stats file refresh period */
+
+/**
+ * \brief Counters ids
+ */
+typedef enum {
+    STAT_IOCTLS = 0,     /* SPI messages issued */
+    STAT_SPI_BYTES,      /* bytes clocked on the bus */
+    STAT_SAMPLES_READ,   /* valid ECG samples stored */
+    STAT_EMPTY_POLLS,    /* FIFO reads without a valid sample */
+    STAT_FIFO_OVERFLOWS, /* EOVF seen in STATUS */
+    STAT_SAMPLES_LOST,   /* overflow tagged FIFO words, lower bound */
+    STAT_SINK_WRITES,    /* sink write calls */
+    STAT_SINK_NS,        /* time spent in sink writes */
+    STAT_LOG_DROPS,      /* log messages dropped (rate limit, full queue) */
+    STAT_REG_MISMATCH,   /* shadow readback mismatches */
+    STAT_RECONFIGS,      /* live configuration changes applied */
+    STAT_RECONF_GAP_NS,  /* change request to first sample after it */
+    STAT_POLL_WAKEUPS,   /* polling scheduler wake-ups */
+    STAT_PIPE_FULL,      /* pushes to a full pipeline queue */
+    STAT_DSP_NS,         /* time spent in the DSP stage */
+    STAT_BEATS,          /* QRS complexes detected by the DSP stage */
+    STAT_POOL_EMPTY,     /* acquisition waits for a free block */
+    STAT_RECOVERIES,     /* supervisor recovery actions, see supervisor.h */
+    STAT_RECOVER_GAP_NS, /* fault to first sample after the recovery */
+    STAT_RECOVER_GAPS,   /* gaps closed, a gap may take several actions */
+    STAT_SPI_ERRORS,     /* failed SPI messages retried by acquisition */
+    STAT_NUM
+} stat_id_t;
+
+/**
+ * \brief Latency histograms ids. A latency is measured per block of points,
+ * from the reconstructed chip sample time of its oldest point to the end of
+ * the step, see max30003_batch_ns()
+ */
+typedef enum {
+    LAT_FIFO_READ = 0, /* FIFO words read */
+    LAT_DECODE,        /* points decoded and stored to data_arr */
+    LAT_DSP_FILTER,    /* baseline removal of the DSP stage */
+    LAT_DSP_QRS,       /* QRS detection and HRV */
+    LAT_DSP_SQI,       /* signal quality */
+    LAT_SINK_REC,      /* binary recording written */
+    LAT_SINK_ARROW,    /* Arrow samples table written */
+    LAT_SINK_TEXT,     /* text output written */
+    LAT_NUM
+} lat_id_t;
+
+#define LAT_SUB_BITS 4  /* sub-buckets per power of two, log2 */
+#define LAT_MAX_BITS 36 /* latencies clamp at 2^36 ns, about 68 s */
+#define LAT_BUCKETS  ((LAT_MAX_BITS - LAT_SUB_BITS + 1) << LAT_SUB_BITS)
+
+/**
+ * \brief Latency histogram of a thread
+ */
+typedef struct {
+    uint64_t bucket[LAT_BUCKETS];
+    uint64_t sum_ns;
+    uint64_t max_ns;
+} stats_hist_t;
+
+/**
+ * \brief Latency summary, percentiles are the highest value of their bucket
+ */
+typedef struct {
+    uint64_t count;
+    uint64_t mean_ns;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+    uint64_t max_ns;
+} stats_lat_t;
+
+/**
+ * \brief Per thread counters, owned and written by a single thread only
+ */
+typedef struct stats_shard_ {
+    uint64_t             cnt[STAT_NUM];
+    struct stats_shard_ *next;
+    stats_hist_t         lat[LAT_NUM];
+} __attribute__((aligned(64))) stats_shard_t;
+
+extern __thread stats_shard_t *stats_tls_shard;
+
+/**
+* \brief registers shard of the calling thread
+* \retval shard of the calling thread
+*/
+stats_shard_t *stats_shard_new(void);
+
+/**
+ * \brief Adds value to counter of the calling thread. Single writer, so a
+ * relaxed load and store is enough and no locked instruction is issued
+ */
+static inline void stats_add(const stat_id_t id, const uint64_t val)
+{
+    stats_shard_t *shard = stats_tls_shard;
+    if (__builtin_expect(!shard, 0)) {
+        shard = stats_shard_new();
+        if (!shard) {
+            return;
+        }
+    }
+    __atomic_store_n(&shard->cnt[id],
+                     __atomic_load_n(&shard->cnt[id], __ATOMIC_RELAXED) + val,
+                     __ATOMIC_RELAXED);
+}
+
+#define STAT_INC(_id)       stats_add((_id), 1)
+#define STAT_ADD(_id, _val) stats_add((_id), (_val))
+
+/**
+ * \brief Histogram bucket of a latency, values below 2^LAT_SUB_BITS ns
+ * have a bucket each
+ */
+static inline uint32_t stats_lat_bucket(uint64_t ns)
+{
+    uint32_t shift;
+
+    if (ns >> LAT_MAX_BITS) {
+        ns = (1ULL << LAT_MAX_BITS) - 1;
+    }
+    if (ns < (1U << LAT_SUB_BITS)) {
+        return (uint32_t)ns;
+    }
+    shift = 63 - __builtin_clzll(ns) - LAT_SUB_BITS;
+    return ((shift + 1) << LAT_SUB_BITS) + (uint32_t)(ns >> shift) -
+           (1U << LAT_SUB_BITS);
+}
+
+/**
+ * \brief Records a latency in the histogram of the calling thread
+ */
+static inline void stats_lat(const lat_id_t id, const uint64_t ns)
+{
+    stats_shard_t *shard = stats_tls_shard;
+    stats_hist_t * h;
+    uint32_t       b = stats_lat_bucket(ns);
+    if (__builtin_expect(!shard, 0)) {
+        shard = stats_shard_new();
+        if (!shard) {
+            return;
+        }
+    }
+    h = &shard->lat[id];
+    __atomic_store_n(&h->bucket[b],
+                     __atomic_load_n(&h->bucket[b], __ATOMIC_RELAXED) + 1,
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&h->sum_ns,
+                     __atomic_load_n(&h->sum_ns, __ATOMIC_RELAXED) + ns,
+                     __ATOMIC_RELAXED);
+    if (ns > __atomic_load_n(&h->max_ns, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&h->max_ns, ns, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+* \brief sum of the counter over all threads
+* \param id - counter id
+* \retval counter value
+*/
+uint64_t stats_get(const stat_id_t id);
+
+/**
+* \brief latency summary of the histograms of all threads
+* \param id - histogram id
+* \param[out] lat - summary, zeroed if nothing was recorded
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t stats_lat_get(const lat_id_t id, stats_lat_t *const lat);
+
+/**
+* \brief clears the histograms of all threads, none may record meanwhile
+*/
+void stats_lat_reset(void);
+
+/**
+* \brief name of the histogram, e.g. "fifo_read"
+*/
+const char *stats_lat_name(const lat_id_t id);
+
+/**
+* \brief writes all counters as "name value" lines, the latencies follow
+* as lat_<name>_<count|mean_ns|p50_ns|p99_ns|p999_ns|max_ns> lines
+* \param out - stream to write
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t stats_dump(FILE *const out);
+
+/**
+* \brief starts stats thread which rewrites the stats file every period_s
+* and dumps counters to stderr on SIGUSR1. SIGUSR1 gets blocked in the
+* calling thread, so call it before other threads are created.
+* \param path - stats file path, NULL - SIGUSR1 dump only
+* \param period_s - stats file refresh period
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t stats_start(const char *const path, const uint32_t period_s);
+
+/**
+* \brief stops stats thread, the stats file gets the final values
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t stats_stop(void);
+
+#endif /* INC_STATS_H_ */
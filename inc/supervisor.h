@@ -0,0 +1,121 @@
+/**
+ * \file supervisor.h
+ *
+ * \brief Fault supervisor of the acquisition loop. It classifies STATUS
+ * reads, FIFO progress and configuration readbacks into faults and picks
+ * the least disruptive recovery: FIFO_RST for an overflow, SYNCH once the
+ * PLL locks again, register replay from the shadow for a reset chip. The
+ * gap from a fault to the first sample after it is reported.
+ */
+#ifndef INC_SUPERVISOR_H_
+#define INC_SUPERVISOR_H_
+
+#include <stdint.h>
+#include "common_types.h"
+#include "MAX30003.h"
+
+#define SUP_STALL_BATCHES 4          /* FIFO batches without a sample */
+#define SUP_STALL_MIN_NS  50000000ULL /* shortest stuck FIFO timeout */
+
+/**
+ * \brief Faults
+ */
+typedef enum {
+    SUP_FAULT_NONE = 0,
+    SUP_FAULT_OVERFLOW, /* EOVF, samples were lost */
+    SUP_FAULT_PLL,      /* PLLINT, samples are not valid until it locks */
+    SUP_FAULT_STALL,    /* no samples and no EINT for stall_ns */
+    SUP_FAULT_RESET,    /* configuration readback mismatch */
+    SUP_FAULT_NUM
+} sup_fault_t;
+
+/**
+ * \brief Recovery actions, the FIFO contents are dropped by all but
+ * SUP_ACT_NONE, the ones of SUP_FAULT_OVERFLOW are read out before
+ */
+typedef enum {
+    SUP_ACT_NONE = 0,
+    SUP_ACT_FIFO_RST, /* FIFO_RST */
+    SUP_ACT_SYNCH,    /* SYNCH, decimation restarts */
+    SUP_ACT_VERIFY,   /* configuration readback, SUP_ACT_REPLAY on
+                         mismatch and SUP_ACT_SYNCH otherwise */
+    SUP_ACT_REPLAY,   /* all registers written from the shadow, SYNCH */
+    SUP_ACT_NUM
+} sup_action_t;
+
+/**
+ * \brief Supervisor state, kept across acquisitions so a gap open at the
+ * end of one is closed by the first sample of the next
+ */
+typedef struct {
+    uint64_t    sample_ns;   /* sample period */
+    uint64_t    stall_ns;    /* stuck FIFO timeout */
+    uint64_t    progress_ns; /* last sample or stuck FIFO recovery */
+    uint64_t    unlock_ns;   /* PLL unlocked since, 0 - locked */
+    uint64_t    gap_ns;      /* first fault of the open gap, 0 - none */
+    sup_fault_t gap_fault;
+    uint32_t    stalls;     /* stuck FIFO recoveries without a sample */
+    uint32_t    cnfg_ecg;   /* configuration the timeouts are derived from */
+    uint8_t     marker_due; /* gap opened, ECG_MARKER() is to be stored */
+} sup_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+* \brief derives the sample period and the stuck FIFO timeout from sample
+* rate and EFIT, an open gap is kept
+* \param sup - supervisor
+* \param cnfg_ecg - CNFG_ECG register
+* \param mngr_int - MNGR_INT register
+* \param now_ns - CLOCK_MONOTONIC
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t sup_init(sup_t *const   sup,
+                    const uint32_t cnfg_ecg,
+                    const uint32_t mngr_int,
+                    const uint64_t now_ns);
+
+/**
+* \brief classifies a STATUS read, PLL unlock takes precedence over
+* overflow, a stuck FIFO is checked last
+* \param sup - supervisor
+* \param status - STATUS register
+* \param now_ns - CLOCK_MONOTONIC of the read
+* \retval action to run before the FIFO is read
+*/
+sup_action_t sup_check(sup_t *const   sup,
+                       const uint32_t status,
+                       const uint64_t now_ns);
+
+/**
+* \brief records a fault found by the caller, e.g. by reg_shadow_verify()
+* \param sup - supervisor
+* \param fault - fault found
+* \param now_ns - CLOCK_MONOTONIC
+* \retval action to run
+*/
+sup_action_t sup_report(sup_t *const      sup,
+                        const sup_fault_t fault,
+                        const uint64_t    now_ns);
+
+/**
+* \brief records samples read, the first ones after a fault close its gap
+* \param sup - supervisor
+* \param words - valid samples read
+* \param now_ns - CLOCK_MONOTONIC of the read
+*/
+void sup_progress(sup_t *const   sup,
+                  const uint32_t words,
+                  const uint64_t now_ns);
+
+/**
+* \brief name of the fault
+*/
+const char *sup_fault_name(const sup_fault_t fault);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* INC_SUPERVISOR_H_ */
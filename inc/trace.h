@@ -0,0 +1,172 @@
+/**
+ * \file trace.h
+ *
+ * \brief Binary tracing into per thread in-memory rings. Events are fixed
+ * size records (timestamp, event id, two arguments), nothing is formatted
+ * on the hot path. tools/trace_decode renders the dump as text or
+ * Chrome-trace/Perfetto JSON.
+ */
+#ifndef INC_TRACE_H_
+#define INC_TRACE_H_
+
+#include <stdint.h>
+#include <time.h>
+#include "common_types.h"
+
+#ifndef TRACE_ENABLE
+#define TRACE_ENABLE 1
+#endif
+
+#define TRACE_MAGIC              0x4352544D /* "MTRC" */
+#define TRACE_VERSION            1
+#define TRACE_RING_EVENTS_DEFAULT 4096     /* per thread, power of two */
+
+/**
+ * \brief Events ids
+ */
+typedef enum {
+    TRACE_EV_SPI_MSG = 0, /* arg0 - transfers, arg1 - bytes */
+    TRACE_EV_ACQ_BEGIN,   /* arg0 - samples requested */
+    TRACE_EV_ACQ_END,     /* arg0 - samples read */
+    TRACE_EV_STATUS,      /* arg0 - STATUS register */
+    TRACE_EV_FIFO_OVF,    /* arg0 - STATUS register */
+    TRACE_EV_SAMPLE,      /* arg0 - sample index, arg1 - point */
+    TRACE_EV_SINK_BEGIN,  /* arg0 - samples to write */
+    TRACE_EV_SINK_END,
+    TRACE_EV_RECONF,      /* arg0 - new CNFG_ECG, arg1 - registers written */
+    TRACE_EV_QUEUE,       /* arg0 - pipeline queue, arg1 - depth after push */
+    TRACE_EV_RECOVER,     /* arg0 - sup_fault_t, arg1 - sup_action_t */
+    TRACE_EV_RECOVERED,   /* arg0 - sup_fault_t of the gap, arg1 - gap us */
+    TRACE_EV_NUM
+} trace_ev_id_t;
+
+/**
+ * \brief Chrome trace phase of the event
+ */
+typedef enum {
+    TRACE_PH_INSTANT = 'i',
+    TRACE_PH_BEGIN   = 'B',
+    TRACE_PH_END     = 'E',
+} trace_phase_t;
+
+/**
+ * \brief Event record as stored in the ring and in the dump file
+ */
+typedef struct {
+    uint64_t ts_ns; /* CLOCK_MONOTONIC */
+    uint16_t id;
+    uint16_t reserved;
+    uint32_t tid;
+    uint32_t arg0;
+    uint32_t arg1;
+} trace_event_t;
+
+/**
+ * \brief Ring of a single thread, written by its owner only. The ring of an
+ * exited thread is taken over by the next thread which traces, its older
+ * events are kept until overwritten.
+ */
+typedef struct trace_ring_ {
+    trace_event_t *      ev;
+    uint32_t             mask;
+    uint32_t             tid;
+    uint64_t             head; /* events written so far */
+    uint32_t             idle; /* 1 - the owner exited */
+    struct trace_ring_ * next;
+} trace_ring_t;
+
+/**
+ * \brief Dump file header, followed by rings_num rings
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t ev_size;
+    uint32_t rings_num;
+} __attribute__((packed)) trace_file_hdr_t;
+
+/**
+ * \brief Ring header in the dump file, followed by events_num events
+ */
+typedef struct {
+    uint32_t tid;
+    uint32_t events_num;
+    uint64_t dropped; /* overwritten by newer events */
+} __attribute__((packed)) trace_ring_hdr_t;
+
+/**
+ * \brief Event description used by the decoder
+ */
+typedef struct {
+    const char *  name;
+    trace_phase_t phase;
+    const char *  arg0;
+    const char *  arg1;
+} trace_ev_info_t;
+
+extern __thread trace_ring_t *trace_tls_ring;
+extern uint8_t                trace_enabled;
+
+/**
+* \brief takes the ring of an exited thread or allocates one for the
+* calling thread
+* \retval ring, NULL on failure or when tracing is disabled
+*/
+trace_ring_t *trace_ring_new(void);
+
+static inline void trace_event(const trace_ev_id_t id,
+                               const uint32_t      arg0,
+                               const uint32_t      arg1)
+{
+    struct timespec ts;
+    trace_ring_t *  ring = trace_tls_ring;
+    trace_event_t * ev;
+
+    if (__builtin_expect(!ring, 0)) {
+        if (!trace_enabled || !(ring = trace_ring_new())) {
+            return;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ev        = &ring->ev[ring->head & ring->mask];
+    ev->ts_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    ev->id    = id;
+    ev->tid   = ring->tid;
+    ev->arg0  = arg0;
+    ev->arg1  = arg1;
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+#if TRACE_ENABLE
+#define TRACE(_id, _arg0, _arg1) trace_event((_id), (_arg0), (_arg1))
+#else
+#define TRACE(_id, _arg0, _arg1) \
+    do {                         \
+        ;                        \
+    } while (0)
+#endif
+
+/**
+* \brief sets ring size and enables or disables tracing, rings of threads
+* which already traced keep their size
+* \param ring_events - events per thread, rounded up to power of two
+* \param enable - 0 - no rings are allocated and events are not recorded
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t trace_init(const uint32_t ring_events, const uint8_t enable);
+
+/**
+* \brief writes all the rings to a file, oldest events first
+* \param path - dump file path
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t trace_dump(const char *const path);
+
+/**
+* \brief description of the event
+* \param id - event id
+* \retval event info, NULL for unknown id
+*/
+const trace_ev_info_t *trace_ev_info(const uint16_t id);
+
+#endif /* INC_TRACE_H_ */
@@ -0,0 +1,68 @@
+/**
+ * \file work_pool.h
+ *
+ * \brief Work-stealing thread pool for offline processing. Every worker
+ * owns a deque: tasks submitted by a worker go to its own deque and are
+ * taken newest first, idle workers steal the oldest tasks of the others.
+ * Tasks submitted from outside are spread round robin.
+ */
+#ifndef INC_WORK_POOL_H_
+#define INC_WORK_POOL_H_
+
+#include <stdint.h>
+#include "common_types.h"
+
+typedef void (*work_fn_t)(void *arg);
+
+typedef struct work_pool_ work_pool_t;
+
+/**
+ * \brief Pool counters
+ */
+typedef struct {
+    uint64_t tasks;  /* tasks run */
+    uint64_t steals; /* tasks taken from the deque of another worker */
+} work_pool_stats_t;
+
+/**
+* \brief starts worker threads
+* \param threads - number of workers, 0 - online CPUs
+* \retval pool, NULL on error
+*/
+work_pool_t *work_pool_create(uint32_t threads);
+
+/**
+* \brief queues task, may be called from tasks
+* \param pool - thread pool
+* \param fn - task function
+* \param arg - task argument
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t work_pool_submit(work_pool_t *const pool,
+                            const work_fn_t    fn,
+                            void *             arg);
+
+/**
+* \brief waits until all submitted tasks and tasks they submitted finished
+* \param pool - thread pool
+* \param[out] stats - pool counters, may be NULL
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t work_pool_wait(work_pool_t *const       pool,
+                          work_pool_stats_t *const stats);
+
+/**
+* \brief stops workers and frees the pool, queued tasks are not run
+* \param pool - thread pool
+* \retval ret_code_t RET_CODE_SUCCESS - no errors.
+*/
+ret_code_t work_pool_destroy(work_pool_t **const pool);
+
+/**
+* \brief number of worker threads
+* \param pool - thread pool
+* \retval workers
+*/
+uint32_t work_pool_threads(const work_pool_t *const pool);
+
+#endif /* INC_WORK_POOL_H_ */
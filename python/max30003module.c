@@ -0,0 +1,552 @@
+/**
+ * \file max30003module.c
+ *
+ * \brief Python extension module "max30003". A Stream acquires from a
+ * recording replay or a spidev device on its own thread into the blocks of
+ * a block_pool_t, iterating it gives Block objects which export the points
+ * of a block through the buffer protocol, read-only and without a copy:
+ *
+ *     s = max30003.Stream(samples=100000, replay="run.rec")
+ *     for blk in s:
+ *         points = numpy.frombuffer(blk, dtype=numpy.int32)
+ *         samples = points >> max30003.POINT_SHIFT
+ *
+ * A block returns to the pool when its Block and all the views of it are
+ * gone, the acquisition waits for a free block meanwhile. The driver keeps
+ * a single global spi_t, so one Stream can be open at a time.
+ */
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <structmember.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+#include "MAX30003.h"
+#include "block_pool.h"
+#include "pipeline.h"
+#include "replay.h"
+#include "spi.h"
+#include "stats.h"
+#include "common_check.h"
+
+#define PY_TIMEOUT_MARGIN_S 5       /* on top of the stream duration */
+#define PY_POOL_WAIT_NS     1000000 /* retry period on an empty pool */
+#define PY_POINT_SHIFT      14      /* DSP_POINT_TO_SAMPLE() */
+
+spi_t spi;
+
+static uint8_t spi_busy; /* a Stream owns the global spi */
+
+/**
+ * \brief Stream object
+ */
+typedef struct {
+    PyObject_HEAD
+    ecg_data_t *    ecg_data;
+    block_pool_t *  pool;
+    replay_t *      replay;
+    pthread_t       thr;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    /* Filled blocks in order, the pool bounds their number */
+    ecg_block_t **  ready;
+    uint32_t        blocks;
+    uint32_t        head;
+    uint32_t        num;
+    ecg_block_t *   cur;
+    uint64_t        acquired; /* points in blocks handed over */
+    uint64_t        total;
+    uint32_t        rate;
+    uint8_t         started;
+    uint8_t         done;
+    uint8_t         stop;
+    uint8_t         spi_open;
+    uint8_t         bus; /* holds spi_busy */
+    ret_code_t      ret;
+} stream_t;
+
+/**
+ * \brief Block object, holds a reference to the pool block and the Stream
+ */
+typedef struct {
+    PyObject_HEAD
+    stream_t *   stream;
+    ecg_block_t *blk;
+    Py_ssize_t   shape;
+} block_t;
+
+static PyTypeObject block_type;
+
+static void __ready_push(stream_t *const s, ecg_block_t *const blk)
+{
+    pthread_mutex_lock(&s->lock);
+    s->ready[(s->head + s->num++) % s->blocks] = blk;
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+}
+
+/**
+ * \brief Continues the acquisition in a free block
+ */
+static ret_code_t __next_block(stream_t *const s, ecg_data_t *const ecg_data)
+{
+    const struct timespec wait = { 0, PY_POOL_WAIT_NS };
+    ecg_block_t *         blk;
+
+    while (!(blk = block_pool_get(s->pool))) {
+        /* Python holds all the blocks, the FIFO buffers meanwhile */
+        if (__atomic_load_n(&s->stop, __ATOMIC_RELAXED)) {
+            return RET_CODE_BUSY;
+        }
+        STAT_INC(STAT_POOL_EMPTY);
+        nanosleep(&wait, NULL);
+    }
+    blk->first         = s->acquired;
+    s->cur             = blk;
+    ecg_data->data_arr = blk->points;
+    ecg_data->data_len = (int32_t)MIN(blk->cap, s->total - s->acquired);
+    ecg_data->data_ID  = 0;
+    return RET_CODE_SUCCESS;
+}
+
+/**
+ * \brief Hands the current block over to Python
+ */
+static void __publish(stream_t *const s, ecg_data_t *const ecg_data)
+{
+    s->cur->num = ecg_data->data_ID;
+    s->acquired += ecg_data->data_ID;
+    if (ecg_data->data_ID) {
+        __ready_push(s, s->cur);
+    } else {
+        block_release(s->cur);
+    }
+    s->cur = NULL;
+}
+
+/**
+ * \brief ecg_data_t::store_hook, switches to the next block before a FIFO
+ * drain could overrun the current one
+ */
+static ret_code_t __store(ecg_data_t *const ecg_data, void *ctx)
+{
+    stream_t *s    = (stream_t *)ctx;
+    uint32_t  room = ecg_data->data_len - ecg_data->data_ID;
+
+    if (__atomic_load_n(&s->stop, __ATOMIC_RELAXED)) {
+        return RET_CODE_BUSY; /* ends ecg_get_data() */
+    }
+    if (room > ECG_FIFO_DEPTH ||
+        s->acquired + ecg_data->data_len >= s->total) {
+        return RET_CODE_SUCCESS;
+    }
+    __publish(s, ecg_data);
+    return __next_block(s, ecg_data);
+}
+
+static void *__acq_thread(void *arg)
+{
+    stream_t *  s        = (stream_t *)arg;
+    ecg_data_t *ecg_data = s->ecg_data;
+    ret_code_t  ret;
+
+    pthread_setname_np(pthread_self(), "ecg_py_acq");
+    ret = __next_block(s, ecg_data);
+    if (ret == RET_CODE_SUCCESS) {
+        ret = ecg_get_data(ecg_data);
+    }
+    if (s->cur) {
+        __publish(s, ecg_data);
+    }
+    pthread_mutex_lock(&s->lock);
+    s->ret  = s->stop ? RET_CODE_SUCCESS : ret;
+    s->done = 1;
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+/**
+ * \brief Stops the acquisition and frees the bus, the pool stays until
+ * the last Block is gone
+ */
+static void __stream_stop(stream_t *const s)
+{
+    if (s->started) {
+        __atomic_store_n(&s->stop, 1, __ATOMIC_RELAXED);
+        Py_BEGIN_ALLOW_THREADS
+        pthread_join(s->thr, NULL);
+        Py_END_ALLOW_THREADS
+        s->started = 0;
+    }
+    while (s->num) {
+        block_release(s->ready[s->head]);
+        s->head = (s->head + 1) % s->blocks;
+        s->num--;
+    }
+    if (s->ecg_data) {
+        /* data_arr pointed to a pool block */
+        s->ecg_data->data_arr = NULL;
+        ecg_delete_handle(&s->ecg_data);
+    }
+    if (s->spi_open) {
+        spi_free(&spi);
+        s->spi_open = 0;
+    }
+    if (s->replay) {
+        replay_close(&s->replay);
+    }
+    if (s->bus) {
+        spi_busy = 0;
+        s->bus   = 0;
+    }
+}
+
+static int __stream_init(stream_t *s, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = { "samples",  "replay", "device",
+                              "speed",    "rate",   "spi_speed",
+                              "blocks",   "block_points", "timeout",
+                              NULL };
+    unsigned long long samples;
+    const char *       replay_path  = NULL;
+    const char *       device       = NULL;
+    unsigned int       speed        = REPLAY_SPEED_MAX;
+    unsigned int       rate         = 512;
+    unsigned int       spi_speed    = SPI_MAX_SPEED;
+    unsigned int       blocks       = PIPE_POOL_BLOCKS;
+    unsigned int       block_points = PIPE_BLOCK_POINTS;
+    int                timeout      = 0;
+    ret_code_t         ret          = RET_CODE_SUCCESS;
+
+    if (!PyArg_ParseTupleAndKeywords(args,
+                                     kwds,
+                                     "K|zzIIIIIi",
+                                     kwlist,
+                                     &samples,
+                                     &replay_path,
+                                     &device,
+                                     &speed,
+                                     &rate,
+                                     &spi_speed,
+                                     &blocks,
+                                     &block_points,
+                                     &timeout)) {
+        return -1;
+    }
+    if (s->pool) {
+        PyErr_SetString(PyExc_RuntimeError, "Stream is already initialized");
+        return -1;
+    }
+    if (!samples || samples > INT32_MAX || !blocks ||
+        block_points <= ECG_FIFO_DEPTH ||
+        (rate != 512 && rate != 256 && rate != 128) ||
+        (replay_path && device)) {
+        PyErr_SetString(PyExc_ValueError, "invalid stream parameters");
+        return -1;
+    }
+    if (spi_busy) {
+        PyErr_SetString(PyExc_RuntimeError, "another Stream owns the bus");
+        return -1;
+    }
+
+    s->blocks = blocks;
+    s->total  = samples;
+    s->rate   = rate;
+    s->pool   = block_pool_create(blocks, block_points);
+    s->ready  = (ecg_block_t **)calloc(blocks, sizeof(ecg_block_t *));
+    if (PTR_INVALID(s->pool) || PTR_INVALID(s->ready)) {
+        PyErr_NoMemory();
+        return -1;
+    }
+    spi_busy = 1;
+    s->bus   = 1;
+
+    s->ecg_data = ecg_create_handle();
+    CHECK_PTR(s->ecg_data, ret, RET_CODE_ALLOC_FAIL);
+    CONTINUE_ON_SUCCESS(ecg_init_handle(s->ecg_data));
+    /* Points go to the pool blocks */
+    free(s->ecg_data->data_arr);
+    s->ecg_data->data_arr = NULL;
+    BITMASK_CLEAR(s->ecg_data->cnfg_ecg, ECG_GAIN_512_RESET);
+    if (rate == 256) {
+        BITMASK_SET(s->ecg_data->cnfg_ecg, ECG_RATE_256);
+    } else if (rate == 128) {
+        BITMASK_SET(s->ecg_data->cnfg_ecg, ECG_RATE_128);
+    }
+    CONTINUE_ON_SUCCESS(ecg_set_timeout(
+            s->ecg_data,
+            timeout > 0 ? timeout
+                        : (int32_t)(samples / rate + PY_TIMEOUT_MARGIN_S)));
+    s->ecg_data->store_hook = __store;
+    s->ecg_data->store_ctx  = s;
+
+    memset(&spi, 0, sizeof spi);
+    spi.dev_name = (__u8 *)(device ? device : SPI_DEVICE_NAME);
+    spi.speed    = spi_speed;
+    spi.mode     = SPI_MODE_DEFAULT;
+    spi.bits     = 8;
+    if (replay_path) {
+        s->replay = replay_open(replay_path, speed);
+        CHECK_PTR(s->replay, ret, RET_CODE_ERROR);
+        CONTINUE_ON_SUCCESS(replay_attach(s->replay, &spi));
+    }
+    CONTINUE_ON_SUCCESS(spi_init(&spi));
+    s->spi_open = 1;
+    CONTINUE_ON_SUCCESS(max30003_init(s->ecg_data));
+
+    if (pthread_create(&s->thr, NULL, __acq_thread, s)) {
+        ret = RET_CODE_ERROR;
+        goto exit;
+    }
+    s->started = 1;
+exit:
+    if (ret != RET_CODE_SUCCESS) {
+        __stream_stop(s);
+        PyErr_Format(PyExc_OSError, "stream open failed, ret_code_t %d", ret);
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject *__stream_new(PyTypeObject *type, PyObject *args, PyObject *kw)
+{
+    stream_t *s = (stream_t *)type->tp_alloc(type, 0);
+
+    (void)args;
+    (void)kw;
+    if (s) {
+        pthread_mutex_init(&s->lock, NULL);
+        pthread_cond_init(&s->cond, NULL);
+    }
+    return (PyObject *)s;
+}
+
+static void __stream_dealloc(stream_t *s)
+{
+    __stream_stop(s);
+    if (s->pool) {
+        block_pool_destroy(&s->pool);
+    }
+    free(s->ready);
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond);
+    Py_TYPE(s)->tp_free((PyObject *)s);
+}
+
+static PyObject *__stream_next(stream_t *s)
+{
+    ecg_block_t *blk = NULL;
+    block_t *    b;
+    ret_code_t   ret;
+
+    if (!s->ready) {
+        PyErr_SetString(PyExc_RuntimeError, "Stream is not initialized");
+        return NULL;
+    }
+    Py_BEGIN_ALLOW_THREADS
+    pthread_mutex_lock(&s->lock);
+    while (!s->num && !s->done) {
+        pthread_cond_wait(&s->cond, &s->lock);
+    }
+    if (s->num) {
+        blk     = s->ready[s->head];
+        s->head = (s->head + 1) % s->blocks;
+        s->num--;
+    }
+    ret = s->ret;
+    pthread_mutex_unlock(&s->lock);
+    Py_END_ALLOW_THREADS
+
+    if (!blk) {
+        if (ret != RET_CODE_SUCCESS) {
+            PyErr_Format(PyExc_OSError, "acquisition failed, ret_code_t %d",
+                         ret);
+        }
+        return NULL; /* StopIteration */
+    }
+    b = PyObject_New(block_t, &block_type);
+    if (!b) {
+        block_release(blk);
+        return NULL;
+    }
+    Py_INCREF(s);
+    b->stream = s;
+    b->blk    = blk;
+    b->shape  = blk->num;
+    return (PyObject *)b;
+}
+
+static PyObject *__stream_close(stream_t *s, PyObject *unused)
+{
+    (void)unused;
+    __stream_stop(s);
+    Py_RETURN_NONE;
+}
+
+static PyObject *__stream_enter(stream_t *s, PyObject *unused)
+{
+    (void)unused;
+    Py_INCREF(s);
+    return (PyObject *)s;
+}
+
+static PyObject *__stream_exit(stream_t *s, PyObject *args)
+{
+    (void)args;
+    __stream_stop(s);
+    Py_RETURN_FALSE;
+}
+
+static PyObject *__stream_lost(stream_t *s, void *closure)
+{
+    (void)closure;
+    return PyLong_FromUnsignedLongLong(
+            s->replay ? replay_samples_lost(s->replay) : 0);
+}
+
+static PyMethodDef stream_methods[] = {
+    { "close",
+      (PyCFunction)__stream_close,
+      METH_NOARGS,
+      "Stops the acquisition and frees the bus, queued blocks are dropped" },
+    { "__enter__", (PyCFunction)__stream_enter, METH_NOARGS, NULL },
+    { "__exit__", (PyCFunction)__stream_exit, METH_VARARGS, NULL },
+    { NULL, NULL, 0, NULL },
+};
+
+static PyMemberDef stream_members[] = {
+    { "rate",
+      T_UINT,
+      offsetof(stream_t, rate),
+      READONLY,
+      "Sample rate, sps" },
+    { "samples",
+      T_ULONGLONG,
+      offsetof(stream_t, total),
+      READONLY,
+      "Points to acquire" },
+    { NULL, 0, 0, 0, NULL },
+};
+
+static PyGetSetDef stream_getset[] = {
+    { "samples_lost",
+      (getter)__stream_lost,
+      NULL,
+      "Samples lost on FIFO overflow of a replay",
+      NULL },
+    { NULL, NULL, NULL, NULL, NULL },
+};
+
+static PyTypeObject stream_type = {
+    PyVarObject_HEAD_INIT(NULL, 0).tp_name = "max30003.Stream",
+    .tp_doc = "Stream(samples, replay=None, device=None, speed=0, rate=512, "
+              "spi_speed=SPI_MAX_SPEED, blocks=8, block_points=1024, "
+              "timeout=0)\n\nIterates Block objects of acquired points.",
+    .tp_basicsize = sizeof(stream_t),
+    .tp_flags     = Py_TPFLAGS_DEFAULT,
+    .tp_new       = __stream_new,
+    .tp_init      = (initproc)__stream_init,
+    .tp_dealloc   = (destructor)__stream_dealloc,
+    .tp_iter      = PyObject_SelfIter,
+    .tp_iternext  = (iternextfunc)__stream_next,
+    .tp_methods   = stream_methods,
+    .tp_members   = stream_members,
+    .tp_getset    = stream_getset,
+};
+
+static int __block_getbuffer(block_t *b, Py_buffer *view, int flags)
+{
+    if (flags & PyBUF_WRITABLE) {
+        PyErr_SetString(PyExc_BufferError, "Block is read-only");
+        view->obj = NULL;
+        return -1;
+    }
+    view->obj        = Py_NewRef(b);
+    view->buf        = b->blk->points;
+    view->len        = b->shape * (Py_ssize_t)sizeof(int32_t);
+    view->readonly   = 1;
+    view->itemsize   = sizeof(int32_t);
+    view->format     = (flags & PyBUF_FORMAT) ? "i" : NULL;
+    view->ndim       = 1;
+    view->shape      = (flags & PyBUF_ND) ? &b->shape : NULL;
+    view->strides    = (flags & PyBUF_STRIDES) ? &view->itemsize : NULL;
+    view->suboffsets = NULL;
+    view->internal   = NULL;
+    return 0;
+}
+
+static void __block_dealloc(block_t *b)
+{
+    /* Views hold the Block, no one reads the points any more */
+    block_release(b->blk);
+    Py_DECREF(b->stream);
+    PyObject_Free(b);
+}
+
+static Py_ssize_t __block_len(block_t *b)
+{
+    return b->shape;
+}
+
+static PyObject *__block_first(block_t *b, void *closure)
+{
+    (void)closure;
+    return PyLong_FromUnsignedLongLong(b->blk->first);
+}
+
+static PyBufferProcs block_buffer = {
+    .bf_getbuffer = (getbufferproc)__block_getbuffer,
+};
+
+static PySequenceMethods block_sequence = {
+    .sq_length = (lenfunc)__block_len,
+};
+
+static PyGetSetDef block_getset[] = {
+    { "first",
+      (getter)__block_first,
+      NULL,
+      "Stream index of the first point",
+      NULL },
+    { NULL, NULL, NULL, NULL, NULL },
+};
+
+static PyTypeObject block_type = {
+    PyVarObject_HEAD_INIT(NULL, 0).tp_name = "max30003.Block",
+    .tp_doc = "Read-only int32 points of a pool block, buffer protocol",
+    .tp_basicsize  = sizeof(block_t),
+    .tp_flags      = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc    = (destructor)__block_dealloc,
+    .tp_as_buffer  = &block_buffer,
+    .tp_as_sequence = &block_sequence,
+    .tp_getset     = block_getset,
+};
+
+static struct PyModuleDef max30003_module = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "max30003",
+    .m_doc  = "MAX30003 acquisition with zero-copy sample blocks",
+    .m_size = -1,
+};
+
+PyMODINIT_FUNC PyInit_max30003(void)
+{
+    PyObject *m;
+
+    if (PyType_Ready(&stream_type) < 0 || PyType_Ready(&block_type) < 0) {
+        return NULL;
+    }
+    m = PyModule_Create(&max30003_module);
+    if (!m) {
+        return NULL;
+    }
+    if (PyModule_AddObjectRef(m, "Stream", (PyObject *)&stream_type) < 0 ||
+        PyModule_AddObjectRef(m, "Block", (PyObject *)&block_type) < 0 ||
+        PyModule_AddIntConstant(m, "POINT_SHIFT", PY_POINT_SHIFT) < 0 ||
+        PyModule_AddIntConstant(m, "MARKER_FLAG", ECG_MARKER_FLAG) < 0) {
+        Py_DECREF(m);
+        return NULL;
+    }
+    return m;
+}
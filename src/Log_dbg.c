@@ -1,5 +1,66 @@
 
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <semaphore.h>
 #include "Log_dbg.h"
+#include "stats.h"
+
+#define LOG_SPEC_LEN 48
+#define LOG_STR_NULL UINT32_MAX
+
+/**
+ * \brief Conversion specification found in the format string
+ */
+typedef struct {
+    const char *start; /* '%' */
+    uint32_t    len;   /* up to and including conversion */
+    uint32_t    mod;   /* offset of length modifier */
+    char        conv;
+    char        lmod; /* 'H' - hh, 'h', 'l', 'q' - ll, 'j', 'z', 't', 'L' */
+    uint8_t     stars;
+} log_spec_t;
+
+typedef union {
+    long long          i;
+    unsigned long long u; /* 'u', 'o', 'x', 'X' widened without sign */
+    double             d;
+    const void *p;
+    uint32_t    str; /* offset in log_slot_t.str */
+} log_arg_t;
+
+/**
+ * \brief Queued message: format pointer and captured arguments
+ */
+typedef struct {
+    uint32_t    seq;
+    const char *fmt;
+    uint8_t     nargs;
+    uint8_t     str_len;
+    log_arg_t   args[LOG_MAX_ARGS];
+    char        str[LOG_STR_LEN];
+} log_slot_t;
+
+static log_slot_t log_queue[LOG_QUEUE_LEN];
+static uint32_t   log_tail;
+static uint32_t   log_head;
+static uint64_t   log_dropped_num;
+static sem_t      log_sem;
+static pthread_t  log_thread;
+static uint8_t    log_running;
+static uint8_t    log_stopping;
+
+static log_site_t log_suppressed_site = {
+    SYS_LOG_TAG_WRN "log: %s: %u messages of %s suppressed\n",
+    "log",
+    0,
+    0,
+    0
+};
 
 void hexdump_debug(const uint8_t *p_data, uint16_t length)
 {
@@ -28,3 +89,439 @@ int fputc(int ch, FILE *f)
     printf("%c\n", ch);
     return ch;
 }
+
+/**
+ * \brief Finds next conversion specification, "%%" is skipped
+ * \return pointer after the specification, NULL if there is no more
+ */
+static const char *__spec_next(const char *p, log_spec_t *const s)
+{
+    for (; *p; ++p) {
+        const char *q = p + 1;
+        if (*p != '%') {
+            continue;
+        }
+        if (*q == '%') {
+            p = q;
+            continue;
+        }
+        s->stars = 0;
+        s->lmod  = 0;
+        while (*q && strchr("-+ #0'", *q)) {
+            q++;
+        }
+        if (*q == '*') {
+            s->stars++;
+            q++;
+        }
+        while (isdigit((unsigned char)*q)) {
+            q++;
+        }
+        if (*q == '.') {
+            q++;
+            if (*q == '*') {
+                s->stars++;
+                q++;
+            }
+            while (isdigit((unsigned char)*q)) {
+                q++;
+            }
+        }
+        s->mod = q - p;
+        if ((q[0] == 'h' && q[1] == 'h') || (q[0] == 'l' && q[1] == 'l')) {
+            s->lmod = q[0] == 'h' ? 'H' : 'q';
+            q += 2;
+        } else if (*q && strchr("hljztL", *q)) {
+            s->lmod = *q++;
+        }
+        if (!*q) {
+            return NULL;
+        }
+        s->conv  = *q;
+        s->start = p;
+        s->len   = q - p + 1;
+        return q + 1;
+    }
+    return NULL;
+}
+
+static void __capture_str(log_slot_t *const slot, const char *str)
+{
+    log_arg_t *arg = &slot->args[slot->nargs++];
+    size_t     len;
+    if (!str) {
+        arg->str = LOG_STR_NULL;
+        return;
+    }
+    if (slot->str_len >= LOG_STR_LEN) {
+        /* Earlier strings took the room, the last byte is their '\0' */
+        arg->str = LOG_STR_LEN - 1;
+        return;
+    }
+    len = strlen(str);
+    if (len > (size_t)(LOG_STR_LEN - 1 - slot->str_len)) {
+        len = LOG_STR_LEN - 1 - slot->str_len;
+    }
+    arg->str = slot->str_len;
+    memcpy(&slot->str[slot->str_len], str, len);
+    slot->str_len += len;
+    slot->str[slot->str_len++] = '\0';
+}
+
+/**
+ * \brief Stores arguments by the types of format conversions, strings are
+ * copied as they may not outlive the queue. First %s is the function name.
+ */
+static void __capture(log_slot_t *const slot,
+                      const char *const fmt,
+                      const char *const func,
+                      va_list           ap)
+{
+    log_spec_t  s;
+    const char *p = fmt;
+
+    slot->fmt     = fmt;
+    slot->nargs   = 0;
+    slot->str_len = 0;
+    __capture_str(slot, func);
+    p = __spec_next(p, &s); /* function name */
+
+    while (p && (p = __spec_next(p, &s)) &&
+           slot->nargs + s.stars < LOG_MAX_ARGS) {
+        for (uint8_t i = 0; i < s.stars; ++i) {
+            slot->args[slot->nargs++].i = va_arg(ap, int);
+        }
+        switch (s.conv) {
+        case 'd':
+        case 'i':
+        case 'c': {
+            log_arg_t *arg = &slot->args[slot->nargs++];
+            switch (s.lmod) {
+            case 'H':
+                arg->i = (signed char)va_arg(ap, int);
+                break;
+            case 'h':
+                arg->i = (short)va_arg(ap, int);
+                break;
+            case 'l':
+                arg->i = va_arg(ap, long);
+                break;
+            case 'q':
+            case 'j':
+                arg->i = va_arg(ap, long long);
+                break;
+            case 'z':
+            case 't':
+                arg->i = va_arg(ap, ssize_t);
+                break;
+            default:
+                arg->i = va_arg(ap, int);
+                break;
+            }
+            break;
+        }
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X': {
+            log_arg_t *arg = &slot->args[slot->nargs++];
+            switch (s.lmod) {
+            case 'H':
+                arg->u = (unsigned char)va_arg(ap, unsigned int);
+                break;
+            case 'h':
+                arg->u = (unsigned short)va_arg(ap, unsigned int);
+                break;
+            case 'l':
+                arg->u = va_arg(ap, unsigned long);
+                break;
+            case 'q':
+            case 'j':
+                arg->u = va_arg(ap, unsigned long long);
+                break;
+            case 'z':
+            case 't':
+                arg->u = va_arg(ap, size_t);
+                break;
+            default:
+                arg->u = va_arg(ap, unsigned int);
+                break;
+            }
+            break;
+        }
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            slot->args[slot->nargs++].d = s.lmod == 'L'
+                                                  ? (double)va_arg(ap,
+                                                                   long double)
+                                                  : va_arg(ap, double);
+            break;
+        case 's':
+            __capture_str(slot, va_arg(ap, const char *));
+            break;
+        default: /* 'p', 'n' */
+            slot->args[slot->nargs++].p = va_arg(ap, void *);
+            break;
+        }
+    }
+}
+
+/**
+ * \brief Literal text of the format up to end, "%%" collapsed
+ */
+static const char *__render_text(const char *p,
+                                 const char *const end,
+                                 FILE *const       out)
+{
+    for (; *p && (!end || p < end); ++p) {
+        putc_unlocked(*p, out);
+        if (p[0] == '%' && p[1] == '%') {
+            p++;
+        }
+    }
+    return p;
+}
+
+/**
+ * \brief Formats captured message to the stream, one conversion at a time,
+ * so messages of any length are written whole
+ */
+static void __render(const log_slot_t *const slot, FILE *const out)
+{
+    log_spec_t  s;
+    const char *p    = slot->fmt;
+    const char *next = NULL;
+    uint8_t     arg  = 0;
+
+    flockfile(out);
+    while ((next = __spec_next(p, &s))) {
+        char     spec[LOG_SPEC_LEN];
+        uint32_t sp = 0;
+        p           = __render_text(p, s.start, out);
+        /* rebuild specification with stars substituted and integers
+         * widened to the captured long long */
+        for (uint32_t i = 0; i < s.mod && sp < LOG_SPEC_LEN - 8; ++i) {
+            if (s.start[i] == '*') {
+                sp += snprintf(&spec[sp],
+                               LOG_SPEC_LEN - sp,
+                               "%d",
+                               arg < slot->nargs ? (int)slot->args[arg++].i
+                                                 : 0);
+            } else {
+                spec[sp++] = s.start[i];
+            }
+        }
+        if (strchr("diuoxX", s.conv)) {
+            spec[sp++] = 'l';
+            spec[sp++] = 'l';
+        }
+        spec[sp++] = s.conv;
+        spec[sp]   = '\0';
+
+        if (arg >= slot->nargs) {
+            break;
+        }
+        switch (s.conv) {
+        case 'd':
+        case 'i':
+            fprintf(out, spec, slot->args[arg++].i);
+            break;
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            fprintf(out, spec, slot->args[arg++].u);
+            break;
+        case 'c':
+            fprintf(out, spec, (int)slot->args[arg++].i);
+            break;
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            fprintf(out, spec, slot->args[arg++].d);
+            break;
+        case 's': {
+            uint32_t off = slot->args[arg++].str;
+            fprintf(out,
+                    spec,
+                    off == LOG_STR_NULL ? "(null)" : &slot->str[off]);
+            break;
+        }
+        case 'p':
+            fprintf(out, spec, slot->args[arg++].p);
+            break;
+        default:
+            arg++;
+            break;
+        }
+        p = next;
+    }
+    __render_text(p, NULL, out);
+    funlockfile(out);
+}
+
+/**
+ * \brief Bounded MPMC queue enqueue (Vyukov), drops the message when full
+ */
+static void __enqueue(const char *const fmt, const char *const func, va_list ap)
+{
+    uint32_t    pos = __atomic_load_n(&log_tail, __ATOMIC_RELAXED);
+    log_slot_t *slot;
+
+    for (;;) {
+        int32_t diff;
+        slot = &log_queue[pos & (LOG_QUEUE_LEN - 1)];
+        diff = (int32_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+        if (!diff) {
+            if (__atomic_compare_exchange_n(&log_tail,
+                                            &pos,
+                                            pos + 1,
+                                            1,
+                                            __ATOMIC_RELAXED,
+                                            __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (diff < 0) {
+            __atomic_add_fetch(&log_dropped_num, 1, __ATOMIC_RELAXED);
+            STAT_INC(STAT_LOG_DROPS);
+            return;
+        } else {
+            pos = __atomic_load_n(&log_tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    __capture(slot, fmt, func, ap);
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    sem_post(&log_sem);
+}
+
+static void __log(const char *const fmt, const char *const func, ...)
+{
+    va_list ap;
+    va_start(ap, func);
+    __enqueue(fmt, func, ap);
+    va_end(ap);
+}
+
+/**
+ * \brief Per call site rate limit
+ * \return 1 if the message may be logged
+ */
+static uint8_t __rate_ok(log_site_t *const site, const char *const func)
+{
+    struct timespec ts;
+    uint32_t        now;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    now = (uint32_t)ts.tv_sec;
+    if (__atomic_load_n(&site->window_s, __ATOMIC_RELAXED) != now) {
+        uint32_t dropped = __atomic_exchange_n(&site->dropped, 0,
+                                               __ATOMIC_RELAXED);
+        __atomic_store_n(&site->window_s, now, __ATOMIC_RELAXED);
+        __atomic_store_n(&site->count, 0, __ATOMIC_RELAXED);
+        if (dropped && log_running) {
+            __log(log_suppressed_site.fmt, func, dropped, site->tag);
+        }
+    }
+    if (__atomic_fetch_add(&site->count, 1, __ATOMIC_RELAXED) >=
+        LOG_RATE_LIMIT_PER_S) {
+        __atomic_add_fetch(&site->dropped, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&log_dropped_num, 1, __ATOMIC_RELAXED);
+        STAT_INC(STAT_LOG_DROPS);
+        return 0;
+    }
+    return 1;
+}
+
+void log_async(log_site_t *const site, ...)
+{
+    va_list     ap;
+    const char *func;
+
+    va_start(ap, site);
+    func = va_arg(ap, const char *);
+    if (__rate_ok(site, func)) {
+        if (__atomic_load_n(&log_running, __ATOMIC_ACQUIRE)) {
+            __enqueue(site->fmt, func, ap);
+        } else {
+            log_slot_t slot;
+            __capture(&slot, site->fmt, func, ap);
+            __render(&slot, stdout);
+        }
+    }
+    va_end(ap);
+}
+
+/**
+ * \brief Drains messages queued so far
+ */
+static void __drain(void)
+{
+    for (;;) {
+        log_slot_t *slot = &log_queue[log_head & (LOG_QUEUE_LEN - 1)];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != log_head + 1) {
+            break;
+        }
+        __render(slot, stdout);
+        __atomic_store_n(&slot->seq, log_head + LOG_QUEUE_LEN, __ATOMIC_RELEASE);
+        log_head++;
+    }
+    fflush(stdout);
+}
+
+static void *__log_thread(void *arg)
+{
+    (void)arg;
+    while (!__atomic_load_n(&log_stopping, __ATOMIC_ACQUIRE)) {
+        sem_wait(&log_sem);
+        __drain();
+    }
+    __drain();
+    return NULL;
+}
+
+int log_start(void)
+{
+    if (log_running) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < LOG_QUEUE_LEN; ++i) {
+        log_queue[i].seq = i;
+    }
+    log_head = log_tail = 0;
+    log_stopping        = 0;
+    if (sem_init(&log_sem, 0, 0) ||
+        pthread_create(&log_thread, NULL, __log_thread, NULL)) {
+        return -1;
+    }
+    __atomic_store_n(&log_running, 1, __ATOMIC_RELEASE);
+    atexit(log_stop);
+    return 0;
+}
+
+void log_stop(void)
+{
+    if (!__atomic_exchange_n(&log_running, 0, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+    __atomic_store_n(&log_stopping, 1, __ATOMIC_RELEASE);
+    sem_post(&log_sem);
+    pthread_join(log_thread, NULL);
+    sem_destroy(&log_sem);
+}
+
+uint64_t log_dropped(void)
+{
+    return __atomic_load_n(&log_dropped_num, __ATOMIC_RELAXED);
+}
@@ -11,6 +11,11 @@
 #include "common_check.h"
 #include "string.h"
 #include "MAX30003.h"
+#include "reg_shadow.h"
+#include "poll_sched.h"
+#include "supervisor.h"
+#include "stats.h"
+#include "trace.h"
 
 #include "Log_dbg_en.h"
 #define DEBUG_ENABLE MAX30003_PRINT_EN
@@ -28,24 +33,39 @@
 #define EINT_TO_LAST_BYTE 16
 
 #define ECG_DEFAULT_DATA_LEN 1024
+#define ECG_NSEC_IN_SEC      1000000000ULL
+#define ECG_BUS_RETRIES      8 /* failed SPI messages in a row tolerated */
 
 extern spi_t spi;
 
+static uint64_t reconf_start_ns; /* pending reconfiguration gap, 0 - none */
+static sup_t    acq_sup;         /* kept across ecg_get_data() calls */
+static uint64_t acq_batch_ns;    /* sample time of the last batch, 0 - none */
+
 char SPI_temp_32b[BYTES_NUM_IN_REG];
 char SPI_temp_Burst[BURST_BYTES_NUM];
 
 /**
  * \brief Check in status register EINT interrupt is present
  * or FIFO overflow detected
+ * \param[out] val - STATUS register for the supervisor
  */
-static uint8_t __check_fifo_present()
+static uint8_t __check_fifo_present(uint8_t *const ovf, uint32_t *const val)
 {
     uint8_t status[4] = { 0 };
     uint8_t ret_flag  = 0;
-    max30003_read_reg(&spi, STATUS, status);
-
-    if (status[0] & (EOVF >> EINT_TO_LAST_BYTE)) {
-        LOG_ERR("FIFO OVERFLOW");
+    if (max30003_read_reg(&spi, STATUS, status)) {
+        STAT_INC(STAT_SPI_ERRORS); /* read as no EINT, polled again */
+    }
+    *val = ((uint32_t)status[0] << 16) | (status[1] << 8) | status[2];
+    TRACE(TRACE_EV_STATUS, *val, 0);
+
+    *ovf = status[0] & (EOVF >> EINT_TO_LAST_BYTE) ? 1 : 0;
+    if (*ovf) {
+        STAT_INC(STAT_FIFO_OVERFLOWS);
+        TRACE(TRACE_EV_FIFO_OVF,
+              (status[0] << 16) | (status[1] << 8) | status[2],
+              0);
     }
     if (status[0] & (EINT >> EINT_TO_LAST_BYTE)) {
         ret_flag = 1;
@@ -89,23 +109,391 @@ int max30003_write_reg(spi_t *const   self,
     return spi_write(self, command_buff, BYTES_NUM_IN_REG);
 }
 
-ret_code_t max30003_init(const ecg_data_t *ecg_data)
+ret_code_t max30003_write_regs(spi_t *const         self,
+                               const uint8_t *const  addrs,
+                               const uint32_t *const vals,
+                               const uint32_t        num)
+{
+    struct spi_ioc_transfer xfer[MAX30003_REGS_NUM];
+    uint8_t                 tx[MAX30003_REGS_NUM][BYTES_NUM_IN_REG];
+
+    if (!self || !addrs || !vals || num > MAX30003_REGS_NUM) {
+        return RET_CODE_INVALID_PARAMS;
+    }
+    if (!num) {
+        return RET_CODE_SUCCESS;
+    }
+
+    memset(xfer, 0, num * sizeof xfer[0]);
+    for (uint32_t i = 0; i < num; ++i) {
+        tx[i][COMMAND_BYTE_NUM] = (addrs[i] << 1) | WREG;
+        tx[i][1]                = vals[i] >> 16;
+        tx[i][2]                = vals[i] >> 8;
+        tx[i][3]                = vals[i];
+        xfer[i].tx_buf          = (__u64)(uintptr_t)tx[i];
+        xfer[i].len             = BYTES_NUM_IN_REG;
+        xfer[i].speed_hz        = self->xfer[0].speed_hz;
+        xfer[i].bits_per_word   = self->xfer[0].bits_per_word;
+        xfer[i].cs_change       = (i + 1 < num); /* CS toggle between regs */
+    }
+
+    if (spi_message(self, xfer, num) < 0) {
+        LOG_ERR("failed to write %u registers\n", num);
+        return RET_CODE_SPI_WRITE_ERR;
+    }
+    return RET_CODE_SUCCESS;
+}
+
+ret_code_t max30003_read_regs(spi_t *const        self,
+                              const uint8_t *const addrs,
+                              uint32_t *const      vals,
+                              const uint32_t       num)
+{
+    struct spi_ioc_transfer xfer[MAX30003_REGS_NUM * 2];
+    uint8_t                 cmd[MAX30003_REGS_NUM];
+    uint8_t                 rx[MAX30003_REGS_NUM][ECG_FIFO_WORD_BYTES];
+
+    if (!self || !addrs || !vals || num > MAX30003_REGS_NUM) {
+        return RET_CODE_INVALID_PARAMS;
+    }
+    if (!num) {
+        return RET_CODE_SUCCESS;
+    }
+
+    memset(xfer, 0, 2 * num * sizeof xfer[0]);
+    for (uint32_t i = 0; i < num; ++i) {
+        struct spi_ioc_transfer *c = &xfer[2 * i];
+        struct spi_ioc_transfer *d = &xfer[2 * i + 1];
+        cmd[i]                     = (addrs[i] << 1) | RREG;
+        c->tx_buf                  = (__u64)(uintptr_t)&cmd[i];
+        c->len                     = SPI_COMMAND_LEN;
+        d->rx_buf                  = (__u64)(uintptr_t)rx[i];
+        d->len                     = ECG_FIFO_WORD_BYTES;
+        c->speed_hz = d->speed_hz = self->xfer[0].speed_hz;
+        c->bits_per_word = d->bits_per_word = self->xfer[0].bits_per_word;
+        d->cs_change                        = (i + 1 < num);
+    }
+
+    if (spi_message(self, xfer, 2 * num) < 0) {
+        LOG_ERR("failed to read %u registers\n", num);
+        return RET_CODE_SPI_READ_ERR;
+    }
+    for (uint32_t i = 0; i < num; ++i) {
+        vals[i] = (rx[i][0] << 16) | (rx[i][1] << 8) | rx[i][2];
+    }
+    return RET_CODE_SUCCESS;
+}
+
+/**
+ * \brief Stages the desired configuration from ecg_data in the shadow
+ */
+static ret_code_t __stage_cnfg(reg_shadow_t *const sh,
+                               const ecg_data_t *  ecg_data)
 {
     ret_code_t ret = RET_CODE_SUCCESS;
+    /* ecg_data keeps the desired image, the shadow what the chip holds */
+    CONTINUE_ON_SUCCESS(reg_shadow_set(sh, CNFG_GEN, ecg_data->cnfg_gen));
+    CONTINUE_ON_SUCCESS(reg_shadow_set(sh, CNFG_CAL, ecg_data->cnfg_cal));
+    CONTINUE_ON_SUCCESS(reg_shadow_set(sh, CNFG_EMUX, ecg_data->cnfg_emux));
+    CONTINUE_ON_SUCCESS(reg_shadow_set(sh, CNFG_ECG, ecg_data->cnfg_ecg));
+    CONTINUE_ON_SUCCESS(reg_shadow_set(sh, CNFG_RTOR1, ecg_data->cnfg_rtor1));
+    CONTINUE_ON_SUCCESS(reg_shadow_set(sh, MNGR_INT, ecg_data->mngr_int));
+exit:
+    return ret;
+}
+
+ret_code_t max30003_read_fifo_burst(spi_t *const   self,
+                                    uint8_t *const buf,
+                                    const uint32_t words_num)
+{
+    struct spi_ioc_transfer xfer[2];
+    uint8_t                 cmd = (ECG_FIFO_BURST << 1) | RREG;
+
+    if (!self || !buf || !words_num || words_num > ECG_FIFO_DEPTH) {
+        return RET_CODE_INVALID_PARAMS;
+    }
+
+    memset(xfer, 0, sizeof xfer);
+    xfer[0].tx_buf        = (__u64)(uintptr_t)&cmd;
+    xfer[0].len           = SPI_COMMAND_LEN;
+    xfer[1].rx_buf        = (__u64)(uintptr_t)buf;
+    xfer[1].len           = words_num * ECG_FIFO_WORD_BYTES;
+    xfer[0].speed_hz      = xfer[1].speed_hz      = self->xfer[0].speed_hz;
+    xfer[0].bits_per_word = xfer[1].bits_per_word = self->xfer[0].bits_per_word;
+
+    if (spi_message(self, xfer, 2) < 0) {
+        LOG_ERR("failed to burst read %u FIFO words\n", words_num);
+        return RET_CODE_SPI_READ_ERR;
+    }
+    return RET_CODE_SUCCESS;
+}
+
+ret_code_t max30003_init(const ecg_data_t *ecg_data)
+{
+    ret_code_t    ret = RET_CODE_SUCCESS;
+    reg_shadow_t *sh  = &max30003_shadow;
+    memset(&acq_sup, 0, sizeof acq_sup); /* no gap across a restart */
     CONTINUE_ON_SUCCESS(max30003_sw_reset());
-    CONTINUE_ON_SUCCESS(max30003_write_reg(&spi, CNFG_GEN, ecg_data->cnfg_gen));
-    CONTINUE_ON_SUCCESS(max30003_write_reg(&spi, CNFG_CAL, ecg_data->cnfg_cal));
-    CONTINUE_ON_SUCCESS(
-            max30003_write_reg(&spi, CNFG_EMUX, ecg_data->cnfg_emux));
-    CONTINUE_ON_SUCCESS(max30003_write_reg(&spi, CNFG_ECG, ecg_data->cnfg_ecg));
-    CONTINUE_ON_SUCCESS(
-            max30003_write_reg(&spi, CNFG_RTOR1, ecg_data->cnfg_rtor1));
-    CONTINUE_ON_SUCCESS(max30003_write_reg(&spi, MNGR_INT, ecg_data->mngr_int));
+    CONTINUE_ON_SUCCESS(reg_shadow_invalidate(sh));
+    CONTINUE_ON_SUCCESS(__stage_cnfg(sh, ecg_data));
+    CONTINUE_ON_SUCCESS(reg_shadow_flush(sh, &spi));
     CONTINUE_ON_SUCCESS(max30003_synch());
 exit:
     return ret;
 }
 
+ret_code_t max30003_warm_init(const ecg_data_t *ecg_data,
+                              uint32_t *const   changed)
+{
+    ret_code_t    ret                      = RET_CODE_SUCCESS;
+    reg_shadow_t *sh                       = &max30003_shadow;
+    uint8_t       status[BYTES_NUM_IN_REG] = { 0 };
+    uint32_t      num                      = 0;
+    RET_ERR_ON_NULL(ecg_data);
+
+    CONTINUE_ON_SUCCESS(reg_shadow_invalidate(sh));
+    CONTINUE_ON_SUCCESS(reg_shadow_load(sh, &spi, REG_SHADOW_CNFG_MASK));
+    CONTINUE_ON_SUCCESS(__stage_cnfg(sh, ecg_data));
+    num = __builtin_popcountll(sh->dirty);
+
+    if (num) {
+        LOG_INFO("Warm start: %u registers differ, rewriting\n", num);
+        CONTINUE_ON_SUCCESS(reg_shadow_flush(sh, &spi));
+        CONTINUE_ON_SUCCESS(max30003_synch());
+        goto exit;
+    }
+
+    /* Configuration kept, samples of an overflowed FIFO are stale */
+    CONTINUE_ON_SUCCESS(max30003_read_reg(&spi, STATUS, status));
+    if (status[0] & (EOVF >> EINT_TO_LAST_BYTE)) {
+        LOG_INFO("Warm start: FIFO overflowed, resetting it\n");
+        CONTINUE_ON_SUCCESS(max30003_write_reg(&spi, FIFO_RST, ZERO_SEQUENCE));
+    } else {
+        LOG_INFO("Warm start: configuration matches, FIFO kept\n");
+    }
+exit:
+    if (changed) {
+        *changed = num;
+    }
+    return ret;
+}
+
+static uint64_t __now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * ECG_NSEC_IN_SEC + ts.tv_nsec;
+}
+
+/**
+ * \brief Appends a point to data_arr, data_arr must have room
+ */
+static void __store_point(ecg_data_t *const ecg_data, const int32_t point)
+{
+    if (!ecg_data->first_sample_ns) {
+        ecg_data->first_sample_ns = __now_ns();
+    }
+    if (reconf_start_ns) {
+        STAT_ADD(STAT_RECONF_GAP_NS, __now_ns() - reconf_start_ns);
+        reconf_start_ns = 0;
+    }
+    TRACE(TRACE_EV_SAMPLE, ecg_data->data_ID, point);
+    ecg_data->data_arr[ecg_data->data_ID++] = point;
+    STAT_INC(STAT_SAMPLES_READ);
+}
+
+/**
+ * \brief Reconstructs the sample time of the oldest word of a FIFO batch:
+ * the newest word of the FIFO was sampled within a sample period before
+ * the read, half of it is taken, the older ones a sample period apart
+ * \param fifo_words - words in FIFO at the read, the batch is the oldest
+ * \param read_ns - CLOCK_MONOTONIC after the read
+ */
+static void __batch_time(const uint32_t fifo_words, const uint64_t read_ns)
+{
+    acq_batch_ns = read_ns - acq_sup.sample_ns / 2 -
+                   (fifo_words - 1) * acq_sup.sample_ns;
+    stats_lat(LAT_FIFO_READ, read_ns - acq_batch_ns);
+    stats_lat(LAT_DECODE, __now_ns() - acq_batch_ns);
+}
+
+/**
+ * \brief Moves samples in FIFO to data_arr until EOF or data_arr is full.
+ * FIFO is read in bursts, the first one of burst words, the rest of the
+ * FIFO if the burst ended before EOF.
+ * \param burst - expected FIFO fill
+ * \param[out] words - valid FIFO words read, may be NULL
+ */
+static ret_code_t __drain_fifo(ecg_data_t *const ecg_data,
+                               uint32_t          burst,
+                               uint32_t *const   words)
+{
+    ret_code_t ret     = RET_CODE_SUCCESS;
+    uint8_t    buf[ECG_FIFO_DEPTH * ECG_FIFO_WORD_BYTES];
+    int32_t    points[ECG_FIFO_DEPTH];
+    uint32_t   num     = 0, n, etag;
+    uint64_t   read_ns = 0;
+
+    burst = burst ? burst : 1;
+    while (num < ECG_FIFO_DEPTH &&
+           ecg_data->data_ID < (uint32_t)ecg_data->data_len) {
+        burst = MIN(burst, ECG_FIFO_DEPTH - num);
+        burst = MIN(burst, ecg_data->data_len - ecg_data->data_ID);
+        CONTINUE_ON_SUCCESS(max30003_read_fifo_burst(&spi, buf, burst));
+        read_ns = __now_ns();
+        n       = max30003_decode_fifo(buf, burst, points);
+        for (uint32_t i = 0; i < n; ++i) {
+            __store_point(ecg_data, points[i]);
+        }
+        num += n;
+        if (n < burst) {
+            break; /* EOF inside the burst, empty or overflow */
+        }
+        etag = (buf[n * ECG_FIFO_WORD_BYTES - 1] & ECG_FIFO_ETAG_MASK) >>
+               ECG_FIFO_ETAG_SHIFT;
+        if (etag == ETAG_VALID_EOF || etag == ETAG_FAST_EOF) {
+            break;
+        }
+        burst = ECG_FIFO_DEPTH - num;
+    }
+exit:
+    if (num) {
+        __batch_time(num, read_ns);
+    }
+    if (words) {
+        *words = num;
+    }
+    return ret;
+}
+
+/**
+ * \brief Runs a supervisor action. Samples read before an overflow are
+ * kept, the FIFO contents are dropped otherwise. ECG_MARKER() of the chip
+ * configuration is appended once per gap, so consumers restart their
+ * filters across it.
+ */
+static ret_code_t __recover(ecg_data_t *const ecg_data, sup_action_t act)
+{
+    ret_code_t    ret   = RET_CODE_SUCCESS;
+    reg_shadow_t *sh    = &max30003_shadow;
+    uint32_t      words = 0;
+
+    if (act == SUP_ACT_FIFO_RST && !acq_sup.unlock_ns) {
+        CONTINUE_ON_SUCCESS(__drain_fifo(ecg_data, ECG_FIFO_DEPTH, &words));
+        if (words && ecg_data->store_hook) {
+            CONTINUE_ON_SUCCESS(
+                    ecg_data->store_hook(ecg_data, ecg_data->store_ctx));
+        }
+    }
+    switch (act) {
+    case SUP_ACT_FIFO_RST:
+        CONTINUE_ON_SUCCESS(max30003_write_reg(&spi, FIFO_RST, ZERO_SEQUENCE));
+        break;
+    case SUP_ACT_VERIFY:
+        if (reg_shadow_verify(sh, &spi, NULL) != RET_CODE_CRC_MISMATCH) {
+            CONTINUE_ON_SUCCESS(max30003_synch());
+            break;
+        }
+        sup_report(&acq_sup, SUP_FAULT_RESET, __now_ns());
+        /* fall through */
+    case SUP_ACT_REPLAY:
+        CONTINUE_ON_SUCCESS(reg_shadow_invalidate(sh));
+        CONTINUE_ON_SUCCESS(reg_shadow_flush(sh, &spi));
+        /* fall through */
+    case SUP_ACT_SYNCH:
+        CONTINUE_ON_SUCCESS(max30003_synch());
+        break;
+    default:
+        break;
+    }
+
+    if (acq_sup.marker_due &&
+        ecg_data->data_ID < (uint32_t)ecg_data->data_len) {
+        ecg_data->data_arr[ecg_data->data_ID++] =
+                ECG_MARKER(reg_shadow_get(sh, CNFG_ECG));
+    }
+    acq_sup.marker_due = 0;
+exit:
+    return ret;
+}
+
+/**
+ * \brief Bus errors of the acquisition loop are retried on the next poll,
+ * the state they leave is seen again in STATUS. ECG_BUS_RETRIES errors in
+ * a row end the acquisition.
+ * \param[in,out] errors - bus errors in a row
+ */
+static ret_code_t __bus_retry(const ret_code_t ret, uint32_t *const errors)
+{
+    if (ret == RET_CODE_SUCCESS) {
+        *errors = 0;
+        return ret;
+    }
+    if (ret < RET_CODE_SPI_ERROR || ret > RET_CODE_SPI_EXCHANGE_ERR ||
+        ++*errors > ECG_BUS_RETRIES) {
+        return ret;
+    }
+    STAT_INC(STAT_SPI_ERRORS);
+    return RET_CODE_SUCCESS;
+}
+
+uint64_t max30003_batch_ns(void)
+{
+    return acq_batch_ns;
+}
+
+ret_code_t max30003_reconfig(ecg_data_t *const ecg_data)
+{
+    ret_code_t    ret = RET_CODE_SUCCESS;
+    reg_shadow_t *sh  = &max30003_shadow;
+    uint32_t      old_ecg, num;
+    uint8_t       synch;
+    RET_ERR_ON_NULL(ecg_data);
+
+    reconf_start_ns = __now_ns();
+    old_ecg         = reg_shadow_get(sh, CNFG_ECG);
+    CONTINUE_ON_SUCCESS(__drain_fifo(ecg_data, ECG_FIFO_DEPTH, NULL));
+    CONTINUE_ON_SUCCESS(__stage_cnfg(sh, ecg_data));
+    num = __builtin_popcountll(sh->dirty);
+    if (!num) {
+        reconf_start_ns = 0;
+        goto exit;
+    }
+    /* Decimation restarts on rate change, FIFO_RST is enough otherwise */
+    synch = ((old_ecg ^ ecg_data->cnfg_ecg) & ECG_GAIN_512_RESET) ||
+            (sh->dirty & REG_BIT(CNFG_GEN));
+    CONTINUE_ON_SUCCESS(reg_shadow_flush(sh, &spi));
+    if (synch) {
+        CONTINUE_ON_SUCCESS(max30003_synch());
+    } else {
+        CONTINUE_ON_SUCCESS(max30003_write_reg(&spi, FIFO_RST, ZERO_SEQUENCE));
+    }
+
+    if (ecg_data->data_ID < (uint32_t)ecg_data->data_len) {
+        ecg_data->data_arr[ecg_data->data_ID++] = ECG_MARKER(ecg_data->cnfg_ecg);
+    }
+    STAT_INC(STAT_RECONFIGS);
+    TRACE(TRACE_EV_RECONF, ecg_data->cnfg_ecg, num);
+    LOG_INFO("Reconfigured: CNFG_ECG 0x%06x, %u registers, %s\n",
+             ecg_data->cnfg_ecg,
+             num,
+             synch ? "SYNCH" : "FIFO_RST");
+exit:
+    return ret;
+}
+
+uint32_t max30003_rate_sps(const uint32_t cnfg_ecg)
+{
+    switch ((cnfg_ecg >> ECG_RATE_SHIFT) & TWO_LSB_BITS_MASK) {
+    case 0:
+        return 512;
+    case 1:
+        return 256;
+    default:
+        return 128;
+    }
+}
+
 ret_code_t ecg_delete_handle(ecg_data_t **ecg_data)
 {
     ret_code_t ret = RET_CODE_SUCCESS;
@@ -115,15 +503,16 @@ ret_code_t ecg_delete_handle(ecg_data_t **ecg_data)
         goto exit;
     }
 
+    free((*ecg_data)->data_arr);
     free(*ecg_data);
-    ecg_data = NULL;
+    *ecg_data = NULL;
 exit:
     return ret;
 }
 
 int32_t max30003_get_ecg_point(void)
 {
-    uint8_t fifo_data[3] = { 0 };
+    uint8_t fifo_data[BYTES_NUM_IN_REG] = { 0 };
     int32_t ecg_point    = 0;
 
     if (max30003_read_reg(&spi, ECG_FIFO, fifo_data)) {
@@ -131,6 +520,10 @@ int32_t max30003_get_ecg_point(void)
         ecg_point = 0;
         return ecg_point;
     }
+    if (((fifo_data[2] & ECG_FIFO_ETAG_MASK) >> ECG_FIFO_ETAG_SHIFT) ==
+        ETAG_OVERFLOW) {
+        STAT_INC(STAT_SAMPLES_LOST);
+    }
 
     uint32_t data0 = (int32_t)(fifo_data[0]);
     data0          = data0 << 24;
@@ -147,6 +540,46 @@ int32_t max30003_get_ecg_point(void)
     return ecg_point;
 }
 
+uint32_t max30003_decode_fifo(const uint8_t *const buf,
+                              const uint32_t       words_num,
+                              int32_t *const       points)
+{
+    uint32_t       n    = 0;
+    const uint8_t *word = buf;
+
+    for (; n < words_num; ++n, word += ECG_FIFO_WORD_BYTES) {
+        uint8_t etag = (word[2] & ECG_FIFO_ETAG_MASK) >> ECG_FIFO_ETAG_SHIFT;
+        if (etag == ETAG_EMPTY || etag == ETAG_OVERFLOW) {
+            break;
+        }
+        points[n] = (int32_t)(((uint32_t)word[0] << 24) |
+                              ((uint32_t)word[1] << 16));
+        if (etag == ETAG_VALID_EOF || etag == ETAG_FAST_EOF) {
+            n++;
+            break;
+        }
+    }
+    return n;
+}
+
+ret_code_t ecg_set_low_power(ecg_data_t *const ecg_data,
+                             uint32_t          efit_words)
+{
+    if (!ecg_data || efit_words > ECG_FIFO_DEPTH) {
+        return RET_CODE_INVALID_PARAMS;
+    }
+    efit_words = efit_words ? efit_words : EFIT_LOW_POWER_DEFAULT;
+
+    BITMASK_CLEAR(ecg_data->mngr_int, EFIT_1_RESET);
+    BITMASK_SET(ecg_data->mngr_int, EFIT_WORDS(efit_words));
+    BITMASK_CLEAR(ecg_data->mngr_int, SAMP_EVERY_SAMPLE_RESET);
+    BITMASK_SET(ecg_data->mngr_int, SAMP_EVERY_SIXTEENTH);
+    BITMASK_SET(ecg_data->mngr_int, CLR_SAMP_AUTO);
+    ecg_data->efit      = efit_words;
+    ecg_data->poll_mode = ECG_POLL_SCHED;
+    return RET_CODE_SUCCESS;
+}
+
 ret_code_t ecg_set_timeout(ecg_data_t *const ecg_data,
                            const int32_t     timeout_val)
 {
@@ -160,8 +593,14 @@ ret_code_t ecg_set_timeout(ecg_data_t *const ecg_data,
 
 ecg_data_t *ecg_create_handle(void)
 {
+    ecg_data_t *ecg_data = NULL;
+
     LOG_DBG("Creating a handle for ECG data\n");
-    return (ecg_data_t *)malloc(sizeof(ecg_data_t));
+    if (posix_memalign((void **)&ecg_data, ECG_CACHE_LINE, sizeof *ecg_data)) {
+        return NULL;
+    }
+    memset(ecg_data, 0, sizeof *ecg_data);
+    return ecg_data;
 }
 
 ret_code_t ecg_init_handle(ecg_data_t *const ecg_data)
@@ -172,7 +611,9 @@ ret_code_t ecg_init_handle(ecg_data_t *const ecg_data)
         ret = RET_CODE_NULL_PTR;
         goto exit;
     }
-    memset(ecg_data, 0, sizeof(ecg_data));
+    /* The handle is zeroed by ecg_create_handle() or was inited before */
+    free(ecg_data->data_arr);
+    memset(ecg_data, 0, sizeof(*ecg_data));
 
     ecg_data->data_len   = DEF_ECG_DATA_LEN;
     ecg_data->cnfg_ecg   = CNFG_ECG_DEFAULT;
@@ -197,7 +638,13 @@ ret_code_t ecg_set_data_len(ecg_data_t *const ecg_data, const uint32_t data_len)
 
     ecg_data->data_len = data_len;
 
-    ecg_data->data_arr = (int32_t *)malloc(sizeof(int32_t) * data_len);
+    free(ecg_data->data_arr);
+    /* Whole cache lines for the consumers' vector loops */
+    if (posix_memalign((void **)&ecg_data->data_arr,
+                       ECG_CACHE_LINE,
+                       sizeof(int32_t) * data_len)) {
+        ecg_data->data_arr = NULL;
+    }
 
     if (PTR_INVALID(ecg_data->data_arr)) {
         return RET_CODE_ALLOC_FAIL;
@@ -214,7 +661,9 @@ ret_code_t ecg_get_data(ecg_data_t *const ecg_data)
     }
 
     int32_t data      = 0;
-    ecg_data->data_ID = 0;
+    ecg_data->data_ID         = 0;
+    ecg_data->first_sample_ns = 0;
+    ecg_data->cnfg_ecg_acq    = reg_shadow_get(&max30003_shadow, CNFG_ECG);
     struct timespec ts;
 
     /* Set timeout value if it's not specified*/
@@ -235,10 +684,29 @@ ret_code_t ecg_get_data(ecg_data_t *const ecg_data)
         goto exit;
     }
     first_time_point_s = (uint32_t)ts.tv_sec;
-
-    uint8_t sample_ready = 0;
+    TRACE(TRACE_EV_ACQ_BEGIN, ecg_data->data_len, 0);
+
+    uint8_t      sample_ready = 0;
+    uint8_t      ovf          = 0;
+    uint32_t     words        = 0;
+    uint32_t     status       = 0;
+    uint32_t     bus_errors   = 0;
+    uint32_t     etag         = 0;
+    uint64_t     now_ns       = 0;
+    uint8_t      word[ECG_FIFO_WORD_BYTES];
+    ret_code_t   read;
+    sup_action_t act;
+    poll_sched_t sched;
+    CONTINUE_ON_SUCCESS(poll_sched_init(&sched,
+                                        ecg_data->cnfg_ecg_acq,
+                                        reg_shadow_get(&max30003_shadow,
+                                                       MNGR_INT)));
+    CONTINUE_ON_SUCCESS(sup_init(&acq_sup,
+                                 ecg_data->cnfg_ecg_acq,
+                                 reg_shadow_get(&max30003_shadow, MNGR_INT),
+                                 __now_ns()));
     /* Measurement loop */
-    while (ecg_data->data_ID < DEF_ECG_DATA_LEN) {
+    while (ecg_data->data_ID < (uint32_t)ecg_data->data_len) {
         /* Check timeout */
         if (clock_gettime(CLOCK_REALTIME, &ts) == -1) {
             LOG_ERR("clock_gettime failure in %s", __func__);
@@ -252,10 +720,86 @@ ret_code_t ecg_get_data(ecg_data_t *const ecg_data)
             ret = RET_CODE_ERROR;
             goto exit;
         }
-        sample_ready = __check_fifo_present();
-        data         = max30003_get_ecg_point();
-        if (data) {
-            ecg_data->data_arr[ecg_data->data_ID++] = data;
+        if (ecg_data->poll_mode == ECG_POLL_SCHED) {
+            CONTINUE_ON_SUCCESS(poll_sched_wait(&sched));
+        }
+        sample_ready = __check_fifo_present(&ovf, &status);
+        now_ns       = __now_ns();
+        act          = sup_check(&acq_sup, status, now_ns);
+        /* Scheduled polls drain the FIFO below EFIT, each one is a batch */
+        if (act == SUP_ACT_NONE &&
+            (sample_ready || ecg_data->poll_mode == ECG_POLL_SCHED) &&
+            reg_shadow_tick(&max30003_shadow, &spi) == RET_CODE_CRC_MISMATCH) {
+            /* Chip lost its configuration */
+            act = sup_report(&acq_sup, SUP_FAULT_RESET, now_ns);
+        }
+        if (act != SUP_ACT_NONE) {
+            CONTINUE_ON_SUCCESS(
+                    __bus_retry(__recover(ecg_data, act), &bus_errors));
+            if (ecg_data->poll_mode == ECG_POLL_SCHED) {
+                poll_sched_update(&sched, 0, ovf);
+            }
+            continue;
+        }
+        if (sample_ready && ecg_data->batch_hook) {
+            CONTINUE_ON_SUCCESS(
+                    ecg_data->batch_hook(ecg_data, ecg_data->batch_ctx));
+            if (ecg_data->data_ID >= (uint32_t)ecg_data->data_len) {
+                break;
+            }
+            if (acq_sup.cnfg_ecg != reg_shadow_get(&max30003_shadow,
+                                                   CNFG_ECG)) {
+                /* Reconfigured by the hook, stuck FIFO timeout follows */
+                sup_init(&acq_sup,
+                         reg_shadow_get(&max30003_shadow, CNFG_ECG),
+                         reg_shadow_get(&max30003_shadow, MNGR_INT),
+                         now_ns);
+            }
+        }
+        if (ecg_data->poll_mode == ECG_POLL_SCHED) {
+            if (sched.cnfg_ecg != ecg_data->cnfg_ecg) {
+                /* Reconfigured by the hook */
+                poll_sched_init(&sched,
+                                ecg_data->cnfg_ecg,
+                                reg_shadow_get(&max30003_shadow, MNGR_INT));
+            }
+            CONTINUE_ON_SUCCESS(__bus_retry(
+                    __drain_fifo(ecg_data, sched.target, &words),
+                    &bus_errors));
+            sup_progress(&acq_sup, words, now_ns);
+            if (!words) {
+                STAT_INC(STAT_EMPTY_POLLS);
+            } else if (ecg_data->store_hook) {
+                CONTINUE_ON_SUCCESS(
+                        ecg_data->store_hook(ecg_data, ecg_data->store_ctx));
+            }
+            poll_sched_update(&sched, words, ovf);
+            continue;
+        }
+        /* A word per poll, its ETAG tells an empty FIFO from a zero sample */
+        read = max30003_read_fifo_burst(&spi, word, 1);
+        ret  = __bus_retry(read, &bus_errors);
+        if (RET_UNSUCCESS(ret)) {
+            goto exit;
+        }
+        if (RET_UNSUCCESS(read)) {
+            continue;
+        }
+        etag = (word[2] & ECG_FIFO_ETAG_MASK) >> ECG_FIFO_ETAG_SHIFT;
+        if (max30003_decode_fifo(word, 1, &data)) {
+            __store_point(ecg_data, data);
+            /* Busy polling keeps FIFO empty, the word is the newest one */
+            __batch_time(1, __now_ns());
+            sup_progress(&acq_sup, 1, now_ns);
+            if (ecg_data->store_hook) {
+                CONTINUE_ON_SUCCESS(
+                        ecg_data->store_hook(ecg_data, ecg_data->store_ctx));
+            }
+        } else if (etag == ETAG_EMPTY) {
+            STAT_INC(STAT_EMPTY_POLLS);
+        } else {
+            /* Overflow, recovered once STATUS shows EOVF */
+            STAT_INC(STAT_SAMPLES_LOST);
         }
 #ifdef CHECK_DATA_ON_TIME_INTERVAL
         if ((current_time_ns - prev_time_point_ns) >=
@@ -269,23 +813,43 @@ ret_code_t ecg_get_data(ecg_data_t *const ecg_data)
     }
 #endif
 }
-exit : return ret;
+exit:
+    TRACE(TRACE_EV_ACQ_END, ecg_data ? ecg_data->data_ID : 0, 0);
+    return ret;
 }
 
 ret_code_t ecg_print_data(const ecg_data_t *const ecg_data)
 {
-    ret_code_t ret = RET_CODE_SUCCESS;
     if (!ecg_data) {
+        return RET_CODE_INVALID_PARAMS;
+    }
+    return ecg_print_range(ecg_data, 0, ecg_data->data_len);
+}
+
+ret_code_t ecg_print_range(const ecg_data_t *const ecg_data,
+                           const uint32_t          first,
+                           const uint32_t          num)
+{
+    ret_code_t ret = RET_CODE_SUCCESS;
+    if (!ecg_data || first + num > (uint32_t)ecg_data->data_len) {
         ret = RET_CODE_INVALID_PARAMS;
         goto exit;
     }
+    ecg_print_points(ecg_data->data_arr + first, num);
+
+exit:
+    return ret;
+}
+
+void ecg_print_points(const int32_t *const points, const uint32_t num)
+{
 #ifdef DEBUG
     /*Print array as a col */
-    for (int i = 0; i < ecg_data->data_len; ++i) {
-        printf("%d\n", ecg_data->data_arr[i]);
+    for (uint32_t i = 0; i < num; ++i) {
+        printf("%d\n", points[i]);
     }
+#else
+    (void)points;
+    (void)num;
 #endif
-
-exit:
-    return ret;
 }
@@ -0,0 +1,800 @@
+/**
+ * \file arrow_ipc.c
+ *
+ * \brief Apache Arrow IPC file writer and ECG tables
+ *
+ * File layout: "ARROW1\0\0", schema message, record batch messages, end of
+ * stream marker, footer, footer length, "ARROW1". A message is a 0xFFFFFFFF
+ * continuation, the metadata length, a Message flatbuffer and the body.
+ * Flatbuffers are written front to back: a table references children
+ * written after it and its vtable is right before it.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "arrow_ipc.h"
+#include "dsp.h"
+#include "common_check.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE ARROW_PRINT_EN
+#define DBG_TAG      "arrow_ipc.c"
+#include "Log_dbg.h"
+
+#define ARROW_MAGIC        "ARROW1\0\0"
+#define ARROW_MAGIC_LEN    6 /* of the trailer, the header is padded to 8 */
+#define ARROW_HEADER_LEN   8
+#define ARROW_CONTINUATION 0xFFFFFFFF
+#define ARROW_BLOCKS_INIT  16
+#define ARROW_PAD(_len)                                                       \
+    (((_len) + ARROW_ALIGN - 1) & ~(uint64_t)(ARROW_ALIGN - 1))
+#define ARROW_NSEC_IN_SEC  1000000000ULL
+
+/* Schema.fbs, Message.fbs and File.fbs */
+#define FB_OFFSET        0xFF /* fb_field_t::size of a child reference */
+#define FB_FIELDS_MAX    8
+#define FB_VERSION_V5    4
+#define FB_HEADER_SCHEMA 1
+#define FB_HEADER_BATCH  3
+#define FB_TYPE_INT      2
+#define FB_TYPE_DURATION 18
+#define FB_UNIT_NS       3
+#define FB_STRUCT_BYTES  16 /* FieldNode and Buffer */
+#define FB_BLOCK_BYTES   24
+
+/**
+ * \brief Flatbuffer being written
+ */
+typedef struct {
+    uint8_t *  buf;
+    uint32_t   len;
+    uint32_t   cap;
+    ret_code_t ret;
+} fb_t;
+
+/**
+ * \brief Table field, absent if size is 0
+ */
+typedef struct {
+    uint8_t  size; /* bytes of a scalar or FB_OFFSET */
+    uint64_t val;
+} fb_field_t;
+
+static const struct {
+    uint8_t width;
+    uint8_t fb_type;
+    uint8_t is_signed;
+} arrow_types[ARROW_TYPE_NUM] = {
+    [ARROW_INT8]        = { 1, FB_TYPE_INT, 1 },
+    [ARROW_UINT8]       = { 1, FB_TYPE_INT, 0 },
+    [ARROW_INT32]       = { 4, FB_TYPE_INT, 1 },
+    [ARROW_UINT32]      = { 4, FB_TYPE_INT, 0 },
+    [ARROW_INT64]       = { 8, FB_TYPE_INT, 1 },
+    [ARROW_UINT64]      = { 8, FB_TYPE_INT, 0 },
+    [ARROW_DURATION_NS] = { 8, FB_TYPE_DURATION, 1 },
+};
+
+static const uint8_t zeros[ARROW_ALIGN];
+
+/**
+ * \brief Appends size bytes of data, zeros if data is NULL
+ * \retval position of the bytes
+ */
+static uint32_t __fb_put(fb_t *const       fb,
+                         const void *const data,
+                         const uint32_t    size)
+{
+    uint32_t pos = fb->len;
+    uint32_t cap = fb->cap ? fb->cap : 1024;
+    uint8_t *buf;
+
+    if (fb->ret != RET_CODE_SUCCESS) {
+        return pos;
+    }
+    while (cap < fb->len + size) {
+        cap *= 2;
+    }
+    if (cap != fb->cap) {
+        buf = (uint8_t *)realloc(fb->buf, cap);
+        if (PTR_INVALID(buf)) {
+            fb->ret = RET_CODE_ALLOC_FAIL;
+            return pos;
+        }
+        fb->buf = buf;
+        fb->cap = cap;
+    }
+    if (data) {
+        memcpy(fb->buf + pos, data, size);
+    } else {
+        memset(fb->buf + pos, 0, size);
+    }
+    fb->len += size;
+    return pos;
+}
+
+/**
+ * \brief Pads so that extra bytes written next end aligned
+ */
+static void __fb_pad(fb_t *const fb, const uint32_t align, const uint32_t extra)
+{
+    __fb_put(fb, NULL, (align - (fb->len + extra) % align) % align);
+}
+
+/**
+ * \brief Points the reference at to target
+ */
+static void __fb_patch(fb_t *const fb, const uint32_t at, const uint32_t target)
+{
+    uint32_t rel = target - at;
+
+    if (fb->ret == RET_CODE_SUCCESS) {
+        memcpy(fb->buf + at, &rel, sizeof rel);
+    }
+}
+
+/**
+ * \brief Starts a flatbuffer with the root reference
+ */
+static void __fb_begin(fb_t *const fb)
+{
+    fb->len = 0;
+    fb->ret = RET_CODE_SUCCESS;
+    __fb_put(fb, NULL, sizeof(uint32_t));
+}
+
+/**
+ * \brief Writes vtable and table, widest fields first in an 8 aligned table
+ * \param[out] pos - positions of the fields, references are patched there
+ * \retval position of the table
+ */
+static uint32_t __fb_table(fb_t *const             fb,
+                           const fb_field_t *const f,
+                           const uint8_t           num,
+                           uint32_t *const         pos)
+{
+    uint16_t vt[2 + FB_FIELDS_MAX] = { 0 };
+    uint32_t off = sizeof(int32_t), table;
+    int32_t  soff;
+    uint8_t  width;
+
+    for (uint8_t size = sizeof(uint64_t); size; size >>= 1) {
+        for (uint8_t i = 0; i < num; ++i) {
+            width = f[i].size == FB_OFFSET ? sizeof(uint32_t) : f[i].size;
+            if (width != size) {
+                continue;
+            }
+            off       = (off + size - 1) & ~(uint32_t)(size - 1);
+            vt[2 + i] = (uint16_t)off;
+            off += size;
+        }
+    }
+    vt[0] = (uint16_t)((2 + num) * sizeof(uint16_t));
+    vt[1] = (uint16_t)off;
+    __fb_pad(fb, sizeof(uint64_t), vt[0]);
+    __fb_put(fb, vt, vt[0]);
+    table = __fb_put(fb, NULL, off);
+    if (fb->ret != RET_CODE_SUCCESS) {
+        return table;
+    }
+    /* The vtable is at table - soff */
+    soff = vt[0];
+    memcpy(fb->buf + table, &soff, sizeof soff);
+    for (uint8_t i = 0; i < num; ++i) {
+        pos[i] = table + vt[2 + i];
+        if (f[i].size && f[i].size != FB_OFFSET) {
+            memcpy(fb->buf + pos[i], &f[i].val, f[i].size);
+        }
+    }
+    return table;
+}
+
+/**
+ * \brief Writes a vector, zeroed elements if data is NULL
+ * \retval position of the length, elements follow
+ */
+static uint32_t __fb_vector(fb_t *const       fb,
+                            const void *const data,
+                            const uint32_t    elem,
+                            const uint32_t    count,
+                            const uint32_t    align)
+{
+    uint32_t pos;
+
+    __fb_pad(fb, align > sizeof(uint32_t) ? align : sizeof(uint32_t),
+             sizeof(uint32_t));
+    pos = __fb_put(fb, &count, sizeof count);
+    __fb_put(fb, data, elem * count);
+    return pos;
+}
+
+static uint32_t __fb_string(fb_t *const fb, const char *const str)
+{
+    uint32_t pos = __fb_vector(fb, str, 1, (uint32_t)strlen(str), 1);
+
+    __fb_put(fb, NULL, 1);
+    return pos;
+}
+
+/**
+ * \brief Int or Duration table of a column type
+ */
+static uint32_t __fb_type(fb_t *const fb, const arrow_type_t type)
+{
+    fb_field_t f[2] = {
+        { sizeof(int32_t), arrow_types[type].width * CHAR_BIT }, /* bitWidth */
+        { 1, arrow_types[type].is_signed },                      /* is_signed */
+    };
+    uint32_t pos[2];
+
+    if (arrow_types[type].fb_type == FB_TYPE_DURATION) {
+        f[0].size = sizeof(int16_t);
+        f[0].val  = FB_UNIT_NS; /* unit */
+        return __fb_table(fb, f, 1, pos);
+    }
+    return __fb_table(fb, f, 2, pos);
+}
+
+static uint32_t __fb_field(fb_t *const fb, const arrow_field_t *const field)
+{
+    const fb_field_t f[6] = {
+        { FB_OFFSET, 0 },                          /* name */
+        { 1, 0 },                                  /* nullable */
+        { 1, arrow_types[field->type].fb_type },   /* type_type */
+        { FB_OFFSET, 0 },                          /* type */
+        { 0, 0 },                                  /* dictionary */
+        { FB_OFFSET, 0 },                          /* children */
+    };
+    uint32_t pos[6], table;
+
+    table = __fb_table(fb, f, ARRAY_SIZE(f), pos);
+    __fb_patch(fb, pos[0], __fb_string(fb, field->name));
+    __fb_patch(fb, pos[3], __fb_type(fb, field->type));
+    /* Readers want the vector even if it is empty */
+    __fb_patch(fb, pos[5], __fb_vector(fb, NULL, sizeof(uint32_t), 0, 0));
+    return table;
+}
+
+static uint32_t __fb_schema(fb_t *const fb, const arrow_writer_t *const w)
+{
+    const fb_field_t f[2] = {
+        { sizeof(int16_t), 0 }, /* endianness, little */
+        { FB_OFFSET, 0 },       /* fields */
+    };
+    uint32_t pos[2], table, vec;
+
+    table = __fb_table(fb, f, ARRAY_SIZE(f), pos);
+    vec   = __fb_vector(fb, NULL, sizeof(uint32_t), w->fields_num, 0);
+    __fb_patch(fb, pos[1], vec);
+    for (uint32_t i = 0; i < w->fields_num; ++i) {
+        __fb_patch(fb,
+                   vec + sizeof(uint32_t) * (i + 1),
+                   __fb_field(fb, &w->fields[i]));
+    }
+    return table;
+}
+
+/**
+ * \brief Starts a Message flatbuffer
+ * \retval position of the header reference
+ */
+static uint32_t __fb_message(fb_t *const    fb,
+                             const uint8_t  header_type,
+                             const uint64_t body_len)
+{
+    const fb_field_t f[4] = {
+        { sizeof(int16_t), FB_VERSION_V5 }, /* version */
+        { 1, header_type },                 /* header_type */
+        { FB_OFFSET, 0 },                   /* header */
+        { sizeof(int64_t), body_len },      /* bodyLength */
+    };
+    uint32_t pos[4];
+
+    __fb_begin(fb);
+    __fb_patch(fb, 0, __fb_table(fb, f, ARRAY_SIZE(f), pos));
+    return pos[2];
+}
+
+/**
+ * \brief Data bytes of the rows gathered in column i
+ */
+static uint64_t __col_len(const arrow_writer_t *const w, const uint32_t i)
+{
+    return (uint64_t)w->rows * arrow_types[w->fields[i].type].width;
+}
+
+/**
+ * \brief Body of the rows gathered: validity and data buffer per column,
+ * no nulls, so validity buffers are empty
+ */
+static uint64_t __body_len(const arrow_writer_t *const w)
+{
+    uint64_t len = 0;
+
+    for (uint32_t i = 0; i < w->fields_num; ++i) {
+        len += ARROW_PAD(__col_len(w, i));
+    }
+    return len;
+}
+
+static uint32_t __fb_batch(fb_t *const fb, const arrow_writer_t *const w)
+{
+    const fb_field_t f[3] = {
+        { sizeof(int64_t), w->rows }, /* length */
+        { FB_OFFSET, 0 },             /* nodes */
+        { FB_OFFSET, 0 },             /* buffers */
+    };
+    uint64_t node[2 * ARROW_COLS_MAX], buf[4 * ARROW_COLS_MAX];
+    uint64_t off = 0, len;
+    uint32_t pos[3], table;
+
+    for (uint32_t i = 0; i < w->fields_num; ++i) {
+        len             = __col_len(w, i);
+        node[2 * i]     = w->rows; /* length */
+        node[2 * i + 1] = 0;       /* null_count */
+        buf[4 * i]      = off;     /* validity */
+        buf[4 * i + 1]  = 0;
+        buf[4 * i + 2]  = off;     /* data */
+        buf[4 * i + 3]  = len;
+        off += ARROW_PAD(len);
+    }
+    table = __fb_table(fb, f, ARRAY_SIZE(f), pos);
+    __fb_patch(fb,
+               pos[1],
+               __fb_vector(fb, node, FB_STRUCT_BYTES, w->fields_num,
+                           sizeof(uint64_t)));
+    __fb_patch(fb,
+               pos[2],
+               __fb_vector(fb, buf, FB_STRUCT_BYTES, 2 * w->fields_num,
+                           sizeof(uint64_t)));
+    return table;
+}
+
+static uint32_t __fb_footer(fb_t *const fb, const arrow_writer_t *const w)
+{
+    const fb_field_t f[4] = {
+        { sizeof(int16_t), FB_VERSION_V5 }, /* version */
+        { FB_OFFSET, 0 },                   /* schema */
+        { FB_OFFSET, 0 },                   /* dictionaries */
+        { FB_OFFSET, 0 },                   /* recordBatches */
+    };
+    uint32_t pos[4], table, vec;
+    uint8_t *blk;
+
+    __fb_begin(fb);
+    table = __fb_table(fb, f, ARRAY_SIZE(f), pos);
+    __fb_patch(fb, 0, table);
+    __fb_patch(fb, pos[1], __fb_schema(fb, w));
+    __fb_patch(fb,
+               pos[2],
+               __fb_vector(fb, NULL, FB_BLOCK_BYTES, 0, sizeof(uint64_t)));
+    vec = __fb_vector(fb, NULL, FB_BLOCK_BYTES, w->blocks_num,
+                      sizeof(uint64_t));
+    __fb_patch(fb, pos[3], vec);
+    if (fb->ret != RET_CODE_SUCCESS) {
+        return table;
+    }
+    for (uint32_t i = 0; i < w->blocks_num; ++i) {
+        blk = fb->buf + vec + sizeof(uint32_t) + i * FB_BLOCK_BYTES;
+        memcpy(blk, &w->blocks[i].offset, sizeof(uint64_t));
+        memcpy(blk + 8, &w->blocks[i].meta_len, sizeof(uint32_t));
+        memcpy(blk + 16, &w->blocks[i].body_len, sizeof(uint64_t));
+    }
+    return table;
+}
+
+/**
+ * \brief Writes continuation, length and the Message, padded so that the
+ * body starts ARROW_ALIGN aligned
+ */
+static ret_code_t __write_message(arrow_writer_t *const w, fb_t *const fb)
+{
+    uint32_t prefix[2];
+
+    __fb_pad(fb, ARROW_ALIGN, (uint32_t)(w->offset + sizeof prefix));
+    if (fb->ret != RET_CODE_SUCCESS) {
+        return fb->ret;
+    }
+    prefix[0] = ARROW_CONTINUATION;
+    prefix[1] = fb->len;
+    if (fwrite(prefix, sizeof prefix, 1, w->f) != 1 ||
+        fwrite(fb->buf, fb->len, 1, w->f) != 1) {
+        return RET_CODE_ERROR;
+    }
+    w->offset += sizeof prefix + fb->len;
+    return RET_CODE_SUCCESS;
+}
+
+static void __writer_free(arrow_writer_t *const w)
+{
+    for (uint32_t i = 0; i < ARROW_COLS_MAX; ++i) {
+        free(w->col[i]);
+        w->col[i] = NULL;
+    }
+    free(w->blocks);
+    w->blocks = NULL;
+    if (w->f) {
+        fclose(w->f);
+        w->f = NULL;
+    }
+}
+
+ret_code_t arrow_writer_open(arrow_writer_t *const      w,
+                             const char *const          path,
+                             const arrow_field_t *const fields,
+                             const uint32_t             fields_num,
+                             const uint32_t             chunk_rows)
+{
+    ret_code_t ret = RET_CODE_SUCCESS;
+    fb_t       fb  = { 0 };
+    uint32_t   hdr;
+    RET_ERR_ON_NULL(w);
+    RET_ERR_ON_NULL(path);
+    RET_ERR_ON_NULL(fields);
+
+    if (!fields_num || fields_num > ARROW_COLS_MAX) {
+        return RET_CODE_INVALID_PARAMS;
+    }
+    memset(w, 0, sizeof *w);
+    w->fields     = fields;
+    w->fields_num = fields_num;
+    w->chunk_rows = chunk_rows ? chunk_rows : ARROW_CHUNK_ROWS_DEFAULT;
+    for (uint32_t i = 0; i < fields_num; ++i) {
+        if (fields[i].type >= ARROW_TYPE_NUM) {
+            ret = RET_CODE_INVALID_PARAMS;
+            goto exit;
+        }
+        if (posix_memalign((void **)&w->col[i],
+                           ARROW_ALIGN,
+                           ARROW_PAD((uint64_t)w->chunk_rows *
+                                     arrow_types[fields[i].type].width))) {
+            w->col[i] = NULL;
+            ret       = RET_CODE_ALLOC_FAIL;
+            goto exit;
+        }
+    }
+
+    w->f = fopen(path, "wb");
+    CHECK_PTR(w->f, ret, RET_CODE_ERROR);
+    if (fwrite(ARROW_MAGIC, ARROW_HEADER_LEN, 1, w->f) != 1) {
+        ret = RET_CODE_ERROR;
+        goto exit;
+    }
+    w->offset = ARROW_HEADER_LEN;
+    hdr       = __fb_message(&fb, FB_HEADER_SCHEMA, 0);
+    __fb_patch(&fb, hdr, __fb_schema(&fb, w));
+    ret = __write_message(w, &fb);
+
+exit:
+    free(fb.buf);
+    if (ret != RET_CODE_SUCCESS) {
+        LOG_ERR("Can't create %s\n", path);
+        __writer_free(w);
+    }
+    return ret;
+}
+
+ret_code_t arrow_writer_append(arrow_writer_t *const    w,
+                               const void *const *const cols,
+                               const uint32_t           num)
+{
+    ret_code_t ret = RET_CODE_SUCCESS;
+    uint32_t   n, width;
+    RET_ERR_ON_NULL(w);
+    RET_ERR_ON_NULL(w->f);
+    RET_ERR_ON_NULL(cols);
+
+    for (uint32_t done = 0; done < num; done += n) {
+        n = MIN(num - done, w->chunk_rows - w->rows);
+        for (uint32_t i = 0; i < w->fields_num; ++i) {
+            width = arrow_types[w->fields[i].type].width;
+            memcpy(w->col[i] + (size_t)w->rows * width,
+                   (const uint8_t *)cols[i] + (size_t)done * width,
+                   (size_t)n * width);
+        }
+        w->rows += n;
+        w->rows_total += n;
+        if (w->rows == w->chunk_rows) {
+            CONTINUE_ON_SUCCESS(arrow_writer_flush(w));
+        }
+    }
+exit:
+    return ret;
+}
+
+ret_code_t arrow_writer_flush(arrow_writer_t *const w)
+{
+    ret_code_t     ret = RET_CODE_SUCCESS;
+    fb_t           fb  = { 0 };
+    arrow_block_t  blk;
+    arrow_block_t *blocks;
+    uint64_t       len;
+    uint32_t       hdr, cap;
+    RET_ERR_ON_NULL(w);
+    RET_ERR_ON_NULL(w->f);
+
+    if (!w->rows) {
+        return RET_CODE_SUCCESS;
+    }
+    if (w->blocks_num == w->blocks_cap) {
+        cap    = w->blocks_cap ? 2 * w->blocks_cap : ARROW_BLOCKS_INIT;
+        blocks = (arrow_block_t *)realloc(w->blocks, cap * sizeof *blocks);
+        CHECK_PTR(blocks, ret, RET_CODE_ALLOC_FAIL);
+        w->blocks     = blocks;
+        w->blocks_cap = cap;
+    }
+
+    blk.offset   = w->offset;
+    blk.body_len = __body_len(w);
+    hdr          = __fb_message(&fb, FB_HEADER_BATCH, blk.body_len);
+    __fb_patch(&fb, hdr, __fb_batch(&fb, w));
+    CONTINUE_ON_SUCCESS(__write_message(w, &fb));
+    blk.meta_len = (uint32_t)(w->offset - blk.offset);
+
+    for (uint32_t i = 0; i < w->fields_num; ++i) {
+        len = __col_len(w, i);
+        if (fwrite(w->col[i], 1, len, w->f) != len ||
+            fwrite(zeros, 1, ARROW_PAD(len) - len, w->f) !=
+                    ARROW_PAD(len) - len) {
+            ret = RET_CODE_ERROR;
+            goto exit;
+        }
+    }
+    w->offset += blk.body_len;
+    w->blocks[w->blocks_num++] = blk;
+    w->rows                    = 0;
+
+exit:
+    free(fb.buf);
+    return ret;
+}
+
+ret_code_t arrow_writer_close(arrow_writer_t *const w)
+{
+    ret_code_t     ret = RET_CODE_SUCCESS;
+    fb_t           fb  = { 0 };
+    const uint32_t eos[2] = { ARROW_CONTINUATION, 0 };
+    RET_ERR_ON_NULL(w);
+    RET_ERR_ON_NULL(w->f);
+
+    CONTINUE_ON_SUCCESS(arrow_writer_flush(w));
+    __fb_footer(&fb, w);
+    CONTINUE_ON_SUCCESS(fb.ret);
+    if (fwrite(eos, sizeof eos, 1, w->f) != 1 ||
+        fwrite(fb.buf, fb.len, 1, w->f) != 1 ||
+        fwrite(&fb.len, sizeof fb.len, 1, w->f) != 1 ||
+        fwrite(ARROW_MAGIC, ARROW_MAGIC_LEN, 1, w->f) != 1) {
+        ret = RET_CODE_ERROR;
+        goto exit;
+    }
+    LOG_DBG("%llu rows in %u record batches\n",
+            (unsigned long long)w->rows_total,
+            w->blocks_num);
+
+exit:
+    if (w->f && fclose(w->f)) {
+        ret = RET_CODE_ERROR;
+    }
+    w->f = NULL;
+    __writer_free(w);
+    free(fb.buf);
+    return ret;
+}
+
+static const arrow_field_t samples_fields[] = {
+    { "idx", ARROW_UINT64 },
+    { "time", ARROW_DURATION_NS },
+    { "sample", ARROW_INT32 },
+    { "etag", ARROW_UINT8 },
+};
+
+static const arrow_field_t beats_fields[] = {
+    { "idx", ARROW_UINT64 },
+    { "time", ARROW_DURATION_NS },
+    { "rr", ARROW_DURATION_NS },
+};
+
+static const arrow_field_t events_fields[] = {
+    { "idx", ARROW_UINT64 },
+    { "time", ARROW_DURATION_NS },
+    { "kind", ARROW_UINT8 },
+    { "cnfg_ecg", ARROW_UINT32 },
+};
+
+/**
+ * \brief Starts a segment at the next point
+ */
+static void __seg_start(ecg_arrow_t *const ex, const uint64_t period_ns)
+{
+    ex->seg[1] = ex->seg[0];
+    ex->seg[0] = (ecg_arrow_seg_t){ ex->idx, ex->t_ns, period_ns };
+}
+
+static ret_code_t __table_open(arrow_writer_t *const      w,
+                               const char *const          prefix,
+                               const char *const          ext,
+                               const arrow_field_t *const fields,
+                               const uint32_t             fields_num,
+                               const uint32_t             chunk_rows)
+{
+    char path[PATH_MAX];
+
+    if ((size_t)snprintf(path, sizeof path, "%s%s", prefix, ext) >=
+        sizeof path) {
+        return RET_CODE_INVALID_PARAMS;
+    }
+    return arrow_writer_open(w, path, fields, fields_num, chunk_rows);
+}
+
+ret_code_t ecg_arrow_open(ecg_arrow_t *const ex,
+                          const char *const  prefix,
+                          const uint32_t     tables,
+                          const uint32_t     cnfg_ecg,
+                          const uint64_t     first_idx,
+                          const uint32_t     chunk_rows)
+{
+    ret_code_t ret = RET_CODE_SUCCESS;
+    RET_ERR_ON_NULL(ex);
+    RET_ERR_ON_NULL(prefix);
+
+    memset(ex, 0, sizeof *ex);
+    ex->idx = first_idx;
+    __seg_start(ex, ARROW_NSEC_IN_SEC / max30003_rate_sps(cnfg_ecg));
+    ex->seg[1] = ex->seg[0];
+    if (tables & ECG_ARROW_SAMPLES) {
+        CONTINUE_ON_SUCCESS(__table_open(&ex->samples,
+                                         prefix,
+                                         ECG_ARROW_SAMPLES_EXT,
+                                         samples_fields,
+                                         ARRAY_SIZE(samples_fields),
+                                         chunk_rows));
+    }
+    if (tables & ECG_ARROW_BEATS) {
+        CONTINUE_ON_SUCCESS(__table_open(&ex->beats,
+                                         prefix,
+                                         ECG_ARROW_BEATS_EXT,
+                                         beats_fields,
+                                         ARRAY_SIZE(beats_fields),
+                                         chunk_rows));
+    }
+    if (tables & ECG_ARROW_EVENTS) {
+        CONTINUE_ON_SUCCESS(__table_open(&ex->events,
+                                         prefix,
+                                         ECG_ARROW_EVENTS_EXT,
+                                         events_fields,
+                                         ARRAY_SIZE(events_fields),
+                                         chunk_rows));
+    }
+exit:
+    if (ret != RET_CODE_SUCCESS) {
+        ecg_arrow_close(ex);
+    }
+    return ret;
+}
+
+ret_code_t ecg_arrow_points(ecg_arrow_t *const   ex,
+                            const int32_t *const points,
+                            const uint8_t *const etags,
+                            const uint32_t       num)
+{
+    ret_code_t ret = RET_CODE_SUCCESS;
+    uint64_t   s_idx[ECG_ARROW_ROWS], s_t[ECG_ARROW_ROWS];
+    int32_t    s_val[ECG_ARROW_ROWS];
+    uint8_t    s_tag[ECG_ARROW_ROWS];
+    uint64_t   e_idx[ECG_ARROW_ROWS], e_t[ECG_ARROW_ROWS];
+    uint8_t    e_kind[ECG_ARROW_ROWS];
+    uint32_t   e_cnfg[ECG_ARROW_ROWS];
+    const void *s_cols[] = { s_idx, s_t, s_val, s_tag };
+    const void *e_cols[] = { e_idx, e_t, e_kind, e_cnfg };
+    uint32_t   s_n = 0, e_n = 0, cnfg;
+    uint8_t    etag, fast, marker;
+    RET_ERR_ON_NULL(ex);
+    RET_ERR_ON_NULL(points);
+
+    for (uint32_t i = 0; i < num; ++i) {
+        etag   = etags ? etags[i] : ETAG_VALID;
+        marker = ECG_IS_MARKER(points[i]) ? 1 : 0;
+        if (marker || etag == ETAG_OVERFLOW || etag == ETAG_EMPTY) {
+            /* Not a sample: no time passes, a new segment follows */
+            cnfg = marker ? ECG_MARKER_CNFG(points[i]) : 0;
+            if (ex->events.f && etag != ETAG_EMPTY) {
+                e_idx[e_n]  = ex->idx;
+                e_t[e_n]    = ex->t_ns;
+                e_kind[e_n] = marker ? ECG_ARROW_EV_CNFG
+                                     : ECG_ARROW_EV_OVERFLOW;
+                e_cnfg[e_n] = cnfg;
+                e_n++;
+            }
+            ex->idx++;
+            __seg_start(ex,
+                        marker ? ARROW_NSEC_IN_SEC / max30003_rate_sps(cnfg)
+                               : ex->seg[0].period_ns);
+            ex->fast = 0;
+        } else {
+            fast = etag == ETAG_FAST || etag == ETAG_FAST_EOF;
+            if (ex->events.f && fast && !ex->fast) {
+                e_idx[e_n]  = ex->idx;
+                e_t[e_n]    = ex->t_ns;
+                e_kind[e_n] = ECG_ARROW_EV_FAST;
+                e_cnfg[e_n] = 0;
+                e_n++;
+            }
+            ex->fast = fast;
+            if (ex->samples.f) {
+                s_idx[s_n] = ex->idx;
+                s_t[s_n]   = ex->t_ns;
+                s_val[s_n] = DSP_POINT_TO_SAMPLE(points[i]);
+                s_tag[s_n] = etag;
+                s_n++;
+            }
+            ex->idx++;
+            ex->t_ns += ex->seg[0].period_ns;
+        }
+        if (s_n == ECG_ARROW_ROWS || i + 1 == num) {
+            CONTINUE_ON_SUCCESS(s_n ? arrow_writer_append(&ex->samples,
+                                                          s_cols,
+                                                          s_n)
+                                    : RET_CODE_SUCCESS);
+            s_n = 0;
+        }
+        if (e_n == ECG_ARROW_ROWS || i + 1 == num) {
+            CONTINUE_ON_SUCCESS(e_n ? arrow_writer_append(&ex->events,
+                                                          e_cols,
+                                                          e_n)
+                                    : RET_CODE_SUCCESS);
+            e_n = 0;
+        }
+    }
+exit:
+    return ret;
+}
+
+ret_code_t ecg_arrow_beats(ecg_arrow_t *const    ex,
+                           const uint64_t *const beats,
+                           const uint32_t        num)
+{
+    ret_code_t             ret = RET_CODE_SUCCESS;
+    uint64_t               b_idx[ECG_ARROW_ROWS], b_t[ECG_ARROW_ROWS];
+    uint64_t               b_rr[ECG_ARROW_ROWS];
+    const void *           b_cols[] = { b_idx, b_t, b_rr };
+    const ecg_arrow_seg_t *seg;
+    uint32_t               n = 0;
+    RET_ERR_ON_NULL(ex);
+    RET_ERR_ON_NULL(beats);
+
+    for (uint32_t i = 0; i < num; ++i) {
+        seg      = beats[i] >= ex->seg[0].idx ? &ex->seg[0] : &ex->seg[1];
+        b_idx[n] = beats[i];
+        b_t[n]   = seg->t_ns + (beats[i] - seg->idx) * seg->period_ns;
+        /* No interval across a gap or a configuration change */
+        b_rr[n] = ex->beat_seen && ex->last_beat_idx >= seg->idx &&
+                                  b_t[n] > ex->last_beat_ns ?
+                          b_t[n] - ex->last_beat_ns :
+                          0;
+        ex->last_beat_idx = beats[i];
+        ex->last_beat_ns  = b_t[n];
+        ex->beat_seen     = 1;
+        if (ex->beats.f && (++n == ECG_ARROW_ROWS || i + 1 == num)) {
+            CONTINUE_ON_SUCCESS(arrow_writer_append(&ex->beats, b_cols, n));
+            n = 0;
+        }
+    }
+exit:
+    return ret;
+}
+
+ret_code_t ecg_arrow_close(ecg_arrow_t *const ex)
+{
+    ret_code_t      ret = RET_CODE_SUCCESS;
+    arrow_writer_t *tbl[3];
+    RET_ERR_ON_NULL(ex);
+
+    tbl[0] = &ex->samples;
+    tbl[1] = &ex->beats;
+    tbl[2] = &ex->events;
+    for (uint32_t i = 0; i < ARRAY_SIZE(tbl); ++i) {
+        if (tbl[i]->f && arrow_writer_close(tbl[i]) != RET_CODE_SUCCESS) {
+            ret = RET_CODE_ERROR;
+        }
+    }
+    return ret;
+}
@@ -0,0 +1,175 @@
+/**
+ * \file block_pool.c
+ *
+ * \brief Pool of reference-counted sample blocks
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "block_pool.h"
+#include "common_check.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE POOL_PRINT_EN
+#define DBG_TAG      "block_pool.c"
+#include "Log_dbg.h"
+
+#define BLOCK_CACHE_LINE 64
+#define BLOCK_IDX_MASK   0xFFFFFFFFULL
+#define BLOCK_TAG_SHIFT  32
+/* Points of a block start on a cache line, blocks of different writers and
+ * readers never share one */
+#define BLOCK_LINE_POINTS (BLOCK_CACHE_LINE / sizeof(int32_t))
+#define BLOCK_STRIDE(points)                             \
+    (((points) + BLOCK_LINE_POINTS - 1) & ~(BLOCK_LINE_POINTS - 1))
+
+struct block_pool_ {
+    /* Free list head: index of the top block, ABA tag in the upper half */
+    uint64_t     head __attribute__((aligned(BLOCK_CACHE_LINE)));
+    uint32_t     free;
+    uint32_t     min_free;
+    uint64_t     gets;
+    uint64_t     empty;
+    ecg_block_t *blk;
+    int32_t *    points;
+    uint32_t     blocks;
+    uint32_t     cap;
+};
+
+static void __push(block_pool_t *const pool, ecg_block_t *const blk)
+{
+    uint64_t head = __atomic_load_n(&pool->head, __ATOMIC_RELAXED);
+    uint64_t next;
+
+    do {
+        __atomic_store_n(&blk->next,
+                         (uint32_t)(head & BLOCK_IDX_MASK),
+                         __ATOMIC_RELAXED);
+        next = ((head >> BLOCK_TAG_SHIFT) + 1) << BLOCK_TAG_SHIFT |
+               (uint64_t)(blk - pool->blk);
+    } while (!__atomic_compare_exchange_n(&pool->head,
+                                          &head,
+                                          next,
+                                          1,
+                                          __ATOMIC_RELEASE,
+                                          __ATOMIC_RELAXED));
+    __atomic_add_fetch(&pool->free, 1, __ATOMIC_RELAXED);
+}
+
+block_pool_t *block_pool_create(const uint32_t blocks, const uint32_t points)
+{
+    block_pool_t *pool   = NULL;
+    size_t        stride = BLOCK_STRIDE((size_t)points);
+
+    if (!blocks || !points || blocks >= BLOCK_POOL_NONE) {
+        return NULL;
+    }
+    if (posix_memalign((void **)&pool, BLOCK_CACHE_LINE, sizeof *pool)) {
+        return NULL;
+    }
+    memset(pool, 0, sizeof *pool);
+    pool->head   = BLOCK_POOL_NONE;
+    pool->blocks = blocks;
+    pool->cap    = points;
+    pool->blk    = (ecg_block_t *)calloc(blocks, sizeof(ecg_block_t));
+    if (posix_memalign((void **)&pool->points,
+                       BLOCK_CACHE_LINE,
+                       (size_t)blocks * stride * sizeof(int32_t))) {
+        pool->points = NULL;
+    }
+    if (PTR_INVALID(pool->blk) || PTR_INVALID(pool->points)) {
+        LOG_ERR("Can't allocate %u blocks of %u points\n", blocks, points);
+        block_pool_destroy(&pool);
+        return NULL;
+    }
+    for (uint32_t i = blocks; i-- > 0;) {
+        pool->blk[i].points = pool->points + i * stride;
+        pool->blk[i].cap    = points;
+        pool->blk[i].pool   = pool;
+        __push(pool, &pool->blk[i]);
+    }
+    pool->min_free = blocks;
+    LOG_DBG("%u blocks of %u points\n", blocks, points);
+    return pool;
+}
+
+ecg_block_t *block_pool_get(block_pool_t *const pool)
+{
+    uint64_t     head, next;
+    uint32_t     idx, free;
+    ecg_block_t *blk;
+
+    if (PTR_INVALID(pool)) {
+        return NULL;
+    }
+    head = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
+    do {
+        idx = (uint32_t)(head & BLOCK_IDX_MASK);
+        if (idx == BLOCK_POOL_NONE) {
+            __atomic_add_fetch(&pool->empty, 1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+        /* A stale link fails the exchange, the tag changed meanwhile */
+        next = ((head >> BLOCK_TAG_SHIFT) + 1) << BLOCK_TAG_SHIFT |
+               __atomic_load_n(&pool->blk[idx].next, __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(&pool->head,
+                                          &head,
+                                          next,
+                                          1,
+                                          __ATOMIC_ACQUIRE,
+                                          __ATOMIC_ACQUIRE));
+
+    free = __atomic_sub_fetch(&pool->free, 1, __ATOMIC_RELAXED);
+    if (free < __atomic_load_n(&pool->min_free, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&pool->min_free, free, __ATOMIC_RELAXED);
+    }
+    __atomic_add_fetch(&pool->gets, 1, __ATOMIC_RELAXED);
+    blk        = &pool->blk[idx];
+    blk->num   = 0;
+    blk->first = 0;
+    __atomic_store_n(&blk->refs, 1, __ATOMIC_RELAXED);
+    return blk;
+}
+
+void block_ref(ecg_block_t *const blk)
+{
+    __atomic_add_fetch(&blk->refs, 1, __ATOMIC_RELAXED);
+}
+
+void block_release(ecg_block_t *const blk)
+{
+    /* Points written by any reader are visible to the next writer */
+    if (!__atomic_sub_fetch(&blk->refs, 1, __ATOMIC_ACQ_REL)) {
+        __push(blk->pool, blk);
+    }
+}
+
+ret_code_t block_pool_stats(const block_pool_t *const pool,
+                            block_pool_stats_t *const stats)
+{
+    RET_ERR_ON_NULL(pool);
+    RET_ERR_ON_NULL(stats);
+
+    stats->blocks   = pool->blocks;
+    stats->points   = pool->cap;
+    stats->free     = __atomic_load_n(&pool->free, __ATOMIC_RELAXED);
+    stats->min_free = __atomic_load_n(&pool->min_free, __ATOMIC_RELAXED);
+    stats->gets     = __atomic_load_n(&pool->gets, __ATOMIC_RELAXED);
+    stats->empty    = __atomic_load_n(&pool->empty, __ATOMIC_RELAXED);
+    return RET_CODE_SUCCESS;
+}
+
+ret_code_t block_pool_destroy(block_pool_t **const pool)
+{
+    RET_ERR_ON_NULL(pool);
+    RET_ERR_ON_NULL(*pool);
+
+    if ((*pool)->blk && (*pool)->free != (*pool)->blocks) {
+        LOG_WARN("%u blocks still in use\n",
+                 (*pool)->blocks - (*pool)->free);
+    }
+    free((*pool)->points);
+    free((*pool)->blk);
+    free(*pool);
+    *pool = NULL;
+    return RET_CODE_SUCCESS;
+}
@@ -0,0 +1,262 @@
+/**
+ * \file ctrl.c
+ *
+ * \brief Control socket for live reconfiguration
+ */
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "ctrl.h"
+#include "common_check.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE CTRL_PRINT_EN
+#define DBG_TAG      "ctrl.c"
+#include "Log_dbg.h"
+
+#define CTRL_DELIM " \t\r\n,"
+
+struct ctrl_ {
+    int                fd;
+    struct sockaddr_un addr;
+};
+
+/**
+ * \brief Value of a key and its CNFG_ECG field bits
+ */
+typedef struct {
+    const char *str;
+    uint32_t    num;  /* value of ecg_data field */
+    uint32_t    bits; /* CNFG_ECG bits */
+} ctrl_val_t;
+
+typedef struct {
+    const char *      key;
+    uint32_t          mask; /* CNFG_ECG field */
+    const ctrl_val_t *vals;
+    uint32_t          vals_num;
+    size_t            field; /* offsetof ecg_data_t */
+} ctrl_key_t;
+
+static const ctrl_val_t gain_vals[] = {
+    { "20", 20, 0 },
+    { "40", 40, ECG_GAIN_40 },
+    { "80", 80, ECG_GAIN_80 },
+    { "160", 160, ECG_GAIN_160 },
+};
+
+static const ctrl_val_t rate_vals[] = {
+    { "512", 512, 0 },
+    { "256", 256, ECG_RATE_256 },
+    { "128", 128, ECG_RATE_128 },
+};
+
+/* hpf_cutoff keeps the -H option values: 1 - bypass, 2 - 0.5 Hz */
+static const ctrl_val_t hpf_vals[] = {
+    { "0", 1, 0 },
+    { "0.5", 2, DHPF_05_HZ },
+};
+
+static const ctrl_val_t lpf_vals[] = {
+    { "0", 0, DLPF_BYPASS },
+    { "40", 40, DLPF_40_HZ },
+    { "100", 100, DLPF_100_HZ },
+    { "150", 150, DLPF_150_HZ },
+};
+
+static const ctrl_key_t keys[] = {
+    { "gain", ECG_GAIN_20_RESET, gain_vals, ARRAY_SIZE(gain_vals),
+      offsetof(ecg_data_t, gain) },
+    { "rate", ECG_GAIN_512_RESET, rate_vals, ARRAY_SIZE(rate_vals),
+      offsetof(ecg_data_t, sample_rate) },
+    { "hpf", DHPF_BYPASS_RESET, hpf_vals, ARRAY_SIZE(hpf_vals),
+      offsetof(ecg_data_t, hpf_cutoff) },
+    { "lpf", DLPF_150_HZ, lpf_vals, ARRAY_SIZE(lpf_vals),
+      offsetof(ecg_data_t, lpf_cutoff) },
+};
+
+/**
+ * \brief DLPF cutoffs the sample rate of cnfg has, see DLPF_* settings
+ */
+static uint8_t __lpf_ok(const uint32_t cnfg)
+{
+    uint32_t rate = max30003_rate_sps(cnfg);
+    switch (cnfg & DLPF_150_HZ) {
+    case DLPF_40_HZ:
+    case DLPF_100_HZ:
+        return rate != 128;
+    case DLPF_150_HZ:
+        return rate == 512;
+    default:
+        return 1;
+    }
+}
+
+static const ctrl_val_t *__find_val(const ctrl_key_t *const k,
+                                    const char *const       str)
+{
+    for (uint32_t i = 0; i < k->vals_num; ++i) {
+        if (!strcmp(k->vals[i].str, str)) {
+            return &k->vals[i];
+        }
+    }
+    return NULL;
+}
+
+static const ctrl_key_t *__find_key(const char *const str)
+{
+    for (uint32_t i = 0; i < ARRAY_SIZE(keys); ++i) {
+        if (!strcmp(keys[i].key, str)) {
+            return &keys[i];
+        }
+    }
+    return NULL;
+}
+
+ret_code_t ctrl_parse(ecg_data_t *const ecg_data, char *const msg)
+{
+    const ctrl_key_t *k[ARRAY_SIZE(keys) * 2];
+    const ctrl_val_t *v[ARRAY_SIZE(keys) * 2];
+    uint32_t          num    = 0;
+    uint8_t           filter = 0; /* rate or lpf changed */
+    uint32_t          lpf;
+    uint32_t          cnfg;
+    char *            save   = NULL;
+    char *            tok;
+    RET_ERR_ON_NULL(ecg_data);
+    RET_ERR_ON_NULL(msg);
+
+    /* Validate the whole message first, it's applied all or nothing */
+    for (tok = strtok_r(msg, CTRL_DELIM, &save); tok;
+         tok = strtok_r(NULL, CTRL_DELIM, &save)) {
+        char *val_str = strtok_r(NULL, CTRL_DELIM, &save);
+        if (num == ARRAY_SIZE(k)) {
+            LOG_ERR("Too many settings in a control message\n");
+            return RET_CODE_INVALID_PARAMS;
+        }
+        k[num] = __find_key(tok);
+        if (!k[num] || !val_str) {
+            LOG_ERR("Unknown control setting %s\n", tok);
+            return RET_CODE_INVALID_PARAMS;
+        }
+        v[num] = __find_val(k[num], val_str);
+        if (!v[num]) {
+            LOG_ERR("Wrong %s value %s\n", tok, val_str);
+            return RET_CODE_INVALID_PARAMS;
+        }
+        num++;
+    }
+
+    cnfg = ecg_data->cnfg_ecg;
+    lpf  = ecg_data->lpf_cutoff;
+    for (uint32_t i = 0; i < num; ++i) {
+        BITMASK_CLEAR(cnfg, k[i]->mask);
+        BITMASK_SET(cnfg, v[i]->bits);
+        if (k[i]->mask == DLPF_150_HZ) {
+            lpf = v[i]->num;
+        }
+        filter |= k[i]->mask == DLPF_150_HZ ||
+                  k[i]->mask == ECG_GAIN_512_RESET;
+    }
+    /* Not checked for other settings, the chip may run a combination the
+     * table has not (CNFG_ECG_DEFAULT) */
+    if (filter && !__lpf_ok(cnfg)) {
+        LOG_ERR("lpf %u Hz is not available at %u sps\n",
+                lpf,
+                max30003_rate_sps(cnfg));
+        return RET_CODE_INVALID_PARAMS;
+    }
+
+    for (uint32_t i = 0; i < num; ++i) {
+        *(uint32_t *)((uint8_t *)ecg_data + k[i]->field) = v[i]->num;
+    }
+    ecg_data->cnfg_ecg = cnfg;
+    return RET_CODE_SUCCESS;
+}
+
+/**
+ * \brief Batch hook: drains pending control messages, the chip is
+ * reconfigured once for all of them
+ */
+static ret_code_t __hook(ecg_data_t *const ecg_data, void *ctx)
+{
+    ctrl_t * ctrl = (ctrl_t *)ctx;
+    char     msg[CTRL_MSG_LEN];
+    uint32_t cnfg = ecg_data->cnfg_ecg;
+    ssize_t  len;
+
+    for (;;) {
+        len = recv(ctrl->fd, msg, sizeof msg - 1, MSG_DONTWAIT);
+        if (len < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                LOG_ERR("Control socket recv failed: %s\n", strerror(errno));
+            }
+            break;
+        }
+        msg[len] = '\0';
+        if (RET_UNSUCCESS(ctrl_parse(ecg_data, msg))) {
+            LOG_ERR("Control message rejected, configuration unchanged\n");
+        }
+    }
+    if (cnfg == ecg_data->cnfg_ecg) {
+        return RET_CODE_SUCCESS;
+    }
+    return max30003_reconfig(ecg_data);
+}
+
+ctrl_t *ctrl_open(const char *const path)
+{
+    ctrl_t *ctrl = NULL;
+    if (PTR_INVALID(path) ||
+        strlen(path) >= sizeof(((struct sockaddr_un *)0)->sun_path)) {
+        LOG_ERR("Wrong control socket path\n");
+        return NULL;
+    }
+
+    ctrl = (ctrl_t *)calloc(1, sizeof(ctrl_t));
+    if (PTR_INVALID(ctrl)) {
+        return NULL;
+    }
+    ctrl->addr.sun_family = AF_UNIX;
+    strcpy(ctrl->addr.sun_path, path);
+
+    ctrl->fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (ctrl->fd < 0) {
+        LOG_ERR("Can't create control socket: %s\n", strerror(errno));
+        free(ctrl);
+        return NULL;
+    }
+    unlink(path);
+    if (bind(ctrl->fd, (struct sockaddr *)&ctrl->addr, sizeof ctrl->addr)) {
+        LOG_ERR("Can't bind control socket %s: %s\n", path, strerror(errno));
+        close(ctrl->fd);
+        free(ctrl);
+        return NULL;
+    }
+    LOG_INFO("Control socket %s\n", path);
+    return ctrl;
+}
+
+ret_code_t ctrl_close(ctrl_t **const ctrl)
+{
+    RET_ERR_ON_NULL(ctrl);
+    RET_ERR_ON_NULL(*ctrl);
+    close((*ctrl)->fd);
+    unlink((*ctrl)->addr.sun_path);
+    free(*ctrl);
+    *ctrl = NULL;
+    return RET_CODE_SUCCESS;
+}
+
+ret_code_t ctrl_attach(ctrl_t *const ctrl, ecg_data_t *const ecg_data)
+{
+    RET_ERR_ON_NULL(ctrl);
+    RET_ERR_ON_NULL(ecg_data);
+    ecg_data->batch_hook = __hook;
+    ecg_data->batch_ctx  = ctrl;
+    return RET_CODE_SUCCESS;
+}
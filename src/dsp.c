@@ -0,0 +1,52 @@
+/**
+ * \file dsp.c
+ *
+ * \brief Baseline removal of ECG points
+ */
+#include <string.h>
+#include <math.h>
+#include "dsp.h"
+#include "common_check.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE DSP_PRINT_EN
+#define DBG_TAG      "dsp.c"
+#include "Log_dbg.h"
+
+ret_code_t dsp_init(dsp_t *const dsp, const uint32_t cnfg_ecg)
+{
+    double rc_dt;
+    RET_ERR_ON_NULL(dsp);
+
+    memset(dsp, 0, sizeof *dsp);
+    dsp->rate  = max30003_rate_sps(cnfg_ecg);
+    rc_dt      = dsp->rate / (2 * M_PI * DSP_HPF_CUTOFF_HZ);
+    dsp->alpha = (int32_t)lround(rc_dt / (rc_dt + 1) * (1 << DSP_COEF_SHIFT));
+    return RET_CODE_SUCCESS;
+}
+
+void dsp_process(dsp_t *const         dsp,
+                 const int32_t *const in,
+                 int32_t *const       out,
+                 const uint32_t       num)
+{
+    int32_t x;
+
+    for (uint32_t i = 0; i < num; ++i) {
+        if (ECG_IS_MARKER(in[i])) {
+            dsp_init(dsp, ECG_MARKER_CNFG(in[i]));
+            out[i] = in[i];
+            continue;
+        }
+        x = DSP_POINT_TO_SAMPLE(in[i]);
+        if (!dsp->primed) {
+            /* Start from zero output instead of a step of the DC level */
+            dsp->x1     = x;
+            dsp->primed = 1;
+        }
+        dsp->y1 = (int32_t)(((int64_t)dsp->alpha * (dsp->y1 + x - dsp->x1)) >>
+                            DSP_COEF_SHIFT);
+        dsp->x1 = x;
+        out[i]  = dsp->y1;
+    }
+}
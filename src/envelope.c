@@ -0,0 +1,417 @@
+/**
+ * \file envelope.c
+ *
+ * \brief Min/max/mean envelope pyramid of a recording
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "envelope.h"
+#include "common_check.h"
+#include "MAX30003.h"
+#include "dsp.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE REC_PRINT_EN
+#define DBG_TAG      "envelope.c"
+#include "Log_dbg.h"
+
+#define ENV_INIT_BUCKETS 256 /* first allocation of a level */
+
+static const env_bucket_t env_empty = { INT32_MAX, INT32_MIN, 0 };
+
+/**
+ * \brief Samples summarized by a complete bucket of the level
+ */
+static inline uint64_t __span(const uint32_t level)
+{
+    return (uint64_t)ENV_BASE_POINTS << (2 * level);
+}
+
+static inline void __merge(env_bucket_t *const dst, const env_bucket_t *src)
+{
+    dst->min = src->min < dst->min ? src->min : dst->min;
+    dst->max = src->max > dst->max ? src->max : dst->max;
+    dst->sum += src->sum;
+}
+
+/**
+ * \brief Levels holding buckets, a short envelope has the partial bucket
+ * of level 0 only
+ */
+static inline uint32_t __levels(const env_t *const env)
+{
+    return env->levels ? env->levels : (env->samples_num ? 1 : 0);
+}
+
+/**
+ * \brief Grows the buckets of the level to cap at least
+ */
+static ret_code_t __grow(env_level_t *const l, const uint64_t cap)
+{
+    env_bucket_t *tmp;
+
+    if (cap <= l->cap) {
+        return RET_CODE_SUCCESS;
+    }
+    tmp = (env_bucket_t *)realloc(l->b, cap * sizeof(env_bucket_t));
+    if (PTR_INVALID(tmp)) {
+        return RET_CODE_ALLOC_FAIL;
+    }
+    l->b   = tmp;
+    l->cap = cap;
+    return RET_CODE_SUCCESS;
+}
+
+/**
+ * \brief Appends a complete bucket to the level, a bucket completed above
+ * by it is appended to the next level and so on
+ */
+static ret_code_t __push(env_t *const env, uint32_t level, env_bucket_t b)
+{
+    for (; level < ENV_LEVELS_MAX; ++level) {
+        env_level_t *l = &env->level[level];
+        env_level_t *up;
+        uint64_t     cap = l->cap ? l->cap * 2 : ENV_INIT_BUCKETS;
+        if (l->num == l->cap && RET_UNSUCCESS(__grow(l, cap))) {
+            return RET_CODE_ALLOC_FAIL;
+        }
+        l->b[l->num++] = b;
+        if (env->levels < level + 1) {
+            env->levels = level + 1;
+        }
+        if (level + 1 == ENV_LEVELS_MAX) {
+            break;
+        }
+
+        up = &env->level[level + 1];
+        __merge(&up->acc, &b);
+        if (++up->acc_num < ENV_FANOUT) {
+            break;
+        }
+        b           = up->acc;
+        up->acc     = env_empty;
+        up->acc_num = 0;
+    }
+    return RET_CODE_SUCCESS;
+}
+
+/**
+ * \brief Partial bucket of the level: its own accumulator and the partial
+ * bucket of the level below
+ * \retval samples summarized, 0 - the level has no partial bucket
+ */
+static uint64_t __tail(const env_t *const  env,
+                       const uint32_t      level,
+                       env_bucket_t *const b)
+{
+    const env_level_t *l = &env->level[level];
+    uint64_t           n = env->samples_num - l->num * __span(level);
+
+    *b = l->acc;
+    if (n && level) {
+        env_bucket_t below;
+        if (__tail(env, level - 1, &below)) {
+            __merge(b, &below);
+        }
+    }
+    return n;
+}
+
+ret_code_t env_init(env_t *const env, const uint32_t sample_rate)
+{
+    RET_ERR_ON_NULL(env);
+
+    memset(env, 0, sizeof *env);
+    for (uint32_t i = 0; i < ENV_LEVELS_MAX; ++i) {
+        env->level[i].acc = env_empty;
+    }
+    env->sample_rate = sample_rate;
+    return RET_CODE_SUCCESS;
+}
+
+ret_code_t env_reserve(env_t *const env, const uint64_t samples_num)
+{
+    RET_ERR_ON_NULL(env);
+
+    for (uint32_t i = 0; i < ENV_LEVELS_MAX; ++i) {
+        uint64_t buckets = samples_num / __span(i);
+        if (!buckets) {
+            break;
+        }
+        if (RET_UNSUCCESS(__grow(&env->level[i], buckets))) {
+            return RET_CODE_ALLOC_FAIL;
+        }
+    }
+    return RET_CODE_SUCCESS;
+}
+
+ret_code_t env_free(env_t *const env)
+{
+    RET_ERR_ON_NULL(env);
+
+    for (uint32_t i = 0; i < ENV_LEVELS_MAX; ++i) {
+        free(env->level[i].b);
+    }
+    return env_init(env, env->sample_rate);
+}
+
+ret_code_t env_append(env_t *const         env,
+                      const int32_t *const points,
+                      const uint32_t       num)
+{
+    ret_code_t   ret = RET_CODE_SUCCESS;
+    env_level_t *l;
+    RET_ERR_ON_NULL(env);
+    RET_ERR_ON_NULL(points);
+
+    l = &env->level[0];
+    for (uint32_t i = 0; i < num; ++i) {
+        int32_t v;
+        if (ECG_IS_MARKER(points[i])) {
+            continue;
+        }
+        v          = DSP_POINT_TO_SAMPLE(points[i]);
+        l->acc.min = v < l->acc.min ? v : l->acc.min;
+        l->acc.max = v > l->acc.max ? v : l->acc.max;
+        l->acc.sum += v;
+        env->samples_num++;
+        if (++l->acc_num < ENV_BASE_POINTS) {
+            continue;
+        }
+        ret        = __push(env, 0, l->acc);
+        l->acc     = env_empty;
+        l->acc_num = 0;
+        if (RET_UNSUCCESS(ret)) {
+            break;
+        }
+    }
+    return ret;
+}
+
+uint32_t env_level(const env_t *const env,
+                   const uint64_t     num,
+                   const uint32_t     width)
+{
+    uint64_t spp    = width ? num / width : num; /* samples per column */
+    uint32_t levels = env ? __levels(env) : 0;
+    uint32_t level  = 0;
+
+    while (level + 1 < levels && __span(level + 1) <= spp) {
+        ++level;
+    }
+    return level;
+}
+
+/**
+ * \brief Merges level 0 buckets [first, end) into b from the fewest buckets
+ * tiling them exactly, levels up to top, the partial bucket of the newest
+ * samples included
+ * \retval samples summarized
+ */
+static uint64_t __cover(const env_t *const  env,
+                        uint64_t            first,
+                        const uint64_t      end,
+                        const uint32_t      top,
+                        env_bucket_t *const b)
+{
+    const env_level_t *l0 = &env->level[0];
+    uint64_t           n  = 0;
+
+    while (first < end) {
+        uint32_t level = top;
+        uint64_t span  = __span(level) / ENV_BASE_POINTS;
+        /* Largest complete bucket starting at first and ending in range */
+        while (level && (first % span || first + span > end ||
+                         first / span >= env->level[level].num)) {
+            span = __span(--level) / ENV_BASE_POINTS;
+        }
+        if (first >= l0->num) {
+            env_bucket_t t;
+            n += __tail(env, 0, &t);
+            __merge(b, &t);
+            break;
+        }
+        __merge(b, &env->level[level].b[first / span]);
+        n += __span(level);
+        first += span;
+    }
+    return n;
+}
+
+ret_code_t env_query(const env_t *const env,
+                     const uint64_t     first,
+                     const uint64_t     num,
+                     const uint32_t     width,
+                     env_col_t *const   cols)
+{
+    uint32_t level;
+    uint64_t step, rem;
+    RET_ERR_ON_NULL(env);
+    RET_ERR_ON_NULL(cols);
+    if (!num || !width) {
+        return RET_CODE_INVALID_PARAMS;
+    }
+
+    level = env_level(env, num, width);
+    step  = num / width;
+    rem   = num % width;
+    for (uint32_t c = 0; c < width; ++c) {
+        /* Column share of the range, remainder spread over the columns */
+        uint64_t     s0 = first + c * step + (uint64_t)c * rem / width;
+        uint64_t     s1 = first + (c + 1) * step +
+                      (uint64_t)(c + 1) * rem / width;
+        uint64_t     b0, b1;
+        env_bucket_t b = env_empty;
+        uint64_t     n;
+
+        memset(&cols[c], 0, sizeof cols[c]);
+        if (s0 >= env->samples_num) {
+            continue;
+        }
+        s1 = s1 < env->samples_num ? s1 : env->samples_num;
+        /* A level 0 bucket belongs to the column of its first sample */
+        b0 = (s0 + ENV_BASE_POINTS - 1) / ENV_BASE_POINTS;
+        b1 = (s1 + ENV_BASE_POINTS - 1) / ENV_BASE_POINTS;
+        if (b0 == b1) {
+            /* Narrower columns than a bucket get the bucket they start in */
+            b0 = s0 / ENV_BASE_POINTS;
+            b1 = b0 + 1;
+        }
+        n            = __cover(env, b0, b1, level, &b);
+        cols[c].min  = b.min;
+        cols[c].max  = b.max;
+        cols[c].mean = (int32_t)(b.sum / (int64_t)n);
+        cols[c].num  = (uint32_t)(n < UINT32_MAX ? n : UINT32_MAX);
+    }
+    return RET_CODE_SUCCESS;
+}
+
+ret_code_t env_save(const env_t *const env, const char *const path)
+{
+    ret_code_t   ret = RET_CODE_SUCCESS;
+    env_header_t hdr = { 0 };
+    uint32_t     counts[ENV_LEVELS_MAX];
+    FILE *       f   = NULL;
+    RET_ERR_ON_NULL(env);
+    RET_ERR_ON_NULL(path);
+
+    hdr.magic       = ENV_MAGIC;
+    hdr.version     = ENV_VERSION;
+    hdr.sample_rate = env->sample_rate;
+    hdr.base        = ENV_BASE_POINTS;
+    hdr.fanout      = ENV_FANOUT;
+    hdr.levels      = __levels(env);
+    hdr.samples_num = env->samples_num;
+    for (uint32_t i = 0; i < hdr.levels; ++i) {
+        const env_level_t *l = &env->level[i];
+        counts[i] = l->num + (env->samples_num > l->num * __span(i));
+    }
+
+    f = fopen(path, "wb");
+    if (PTR_INVALID(f)) {
+        LOG_ERR("Can't create envelope %s\n", path);
+        ret = RET_CODE_ERROR;
+        goto exit;
+    }
+    if (fwrite(&hdr, sizeof hdr, 1, f) != 1 ||
+        fwrite(counts, sizeof counts[0], hdr.levels, f) != hdr.levels) {
+        ret = RET_CODE_ERROR;
+        goto exit;
+    }
+    for (uint32_t i = 0; i < hdr.levels; ++i) {
+        const env_level_t *l = &env->level[i];
+        env_bucket_t       t;
+        if (fwrite(l->b, sizeof l->b[0], l->num, f) != l->num) {
+            ret = RET_CODE_ERROR;
+            goto exit;
+        }
+        if (counts[i] > l->num && __tail(env, i, &t) &&
+            fwrite(&t, sizeof t, 1, f) != 1) {
+            ret = RET_CODE_ERROR;
+            goto exit;
+        }
+    }
+exit:
+    if (f && fclose(f)) {
+        ret = RET_CODE_ERROR;
+    }
+    return ret;
+}
+
+ret_code_t env_load(env_t *const env, const char *const path)
+{
+    ret_code_t   ret = RET_CODE_SUCCESS;
+    env_header_t hdr;
+    uint32_t     counts[ENV_LEVELS_MAX];
+    FILE *       f   = NULL;
+    RET_ERR_ON_NULL(env);
+    RET_ERR_ON_NULL(path);
+
+    env_init(env, 0);
+    f = fopen(path, "rb");
+    if (PTR_INVALID(f)) {
+        LOG_ERR("Can't open envelope %s\n", path);
+        ret = RET_CODE_ERROR;
+        goto exit;
+    }
+    if (fread(&hdr, sizeof hdr, 1, f) != 1 || hdr.magic != ENV_MAGIC ||
+        hdr.version != ENV_VERSION || hdr.base != ENV_BASE_POINTS ||
+        hdr.fanout != ENV_FANOUT || hdr.levels > ENV_LEVELS_MAX ||
+        fread(counts, sizeof counts[0], hdr.levels, f) != hdr.levels) {
+        LOG_ERR("Unsupported envelope %s\n", path);
+        ret = RET_CODE_INVALID_PARAMS;
+        goto exit;
+    }
+    env->sample_rate = hdr.sample_rate;
+    env->samples_num = hdr.samples_num;
+
+    for (uint32_t i = 0; i < hdr.levels; ++i) {
+        env_level_t *l        = &env->level[i];
+        uint64_t     complete = hdr.samples_num / __span(i);
+        if (counts[i] != complete + (hdr.samples_num > complete * __span(i))) {
+            LOG_ERR("Envelope %s is inconsistent\n", path);
+            ret = RET_CODE_INVALID_PARAMS;
+            goto exit;
+        }
+        l->cap = counts[i] > ENV_INIT_BUCKETS ? counts[i] : ENV_INIT_BUCKETS;
+        l->b   = (env_bucket_t *)malloc(l->cap * sizeof(env_bucket_t));
+        if (PTR_INVALID(l->b)) {
+            ret = RET_CODE_ALLOC_FAIL;
+            goto exit;
+        }
+        if (fread(l->b, sizeof l->b[0], counts[i], f) != counts[i]) {
+            LOG_ERR("Envelope %s is truncated\n", path);
+            ret = RET_CODE_ERROR;
+            goto exit;
+        }
+        l->num      = complete;
+        env->levels = complete ? i + 1 : env->levels;
+        if (!i && counts[i] > complete) {
+            /* Partial bucket of level 0 is its accumulator */
+            l->acc     = l->b[complete];
+            l->acc_num = hdr.samples_num - complete * ENV_BASE_POINTS;
+        }
+    }
+    /* Accumulators of the upper levels are rebuilt from the level below */
+    for (uint32_t i = 1; i < ENV_LEVELS_MAX && i <= env->levels; ++i) {
+        env_level_t *l = &env->level[i];
+        for (uint64_t j = l->num * ENV_FANOUT; j < env->level[i - 1].num;
+             ++j) {
+            __merge(&l->acc, &env->level[i - 1].b[j]);
+            l->acc_num++;
+        }
+    }
+    LOG_INFO("Loaded envelope of %llu samples, %u levels from %s\n",
+             (unsigned long long)env->samples_num,
+             env->levels,
+             path);
+exit:
+    if (f) {
+        fclose(f);
+    }
+    if (RET_UNSUCCESS(ret)) {
+        env_free(env);
+    }
+    return ret;
+}
@@ -0,0 +1,427 @@
+/**
+ * \file fault_inj.c
+ *
+ * \brief Fault injection decorator of the SPI transport
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "fault_inj.h"
+#include "MAX30003.h"
+#include "common_check.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE FAULT_PRINT_EN
+#define DBG_TAG      "fault_inj.c"
+#include "Log_dbg.h"
+
+#define FAULT_SPEC_LEN     128
+#define FAULT_VALS_MAX     4
+#define FAULT_WORD_BITS    24
+#define FAULT_NSEC_IN_USEC 1000
+#define FAULT_USEC_IN_SEC  1000000
+
+struct fault_inj_ {
+    fault_profile_t      prof;
+    fault_counts_t       cnt;
+    uint64_t             rng;
+    uint32_t             stuck_left; /* STATUS reads of the episode left */
+    const spi_backend_t *inner;
+    void *               inner_ctx;
+    /* read being corrupted */
+    uint32_t status_set;
+    uint32_t status_clr;
+    uint32_t word_flip;
+};
+
+static const fault_profile_t profiles[] = {
+    { .name = "none" },
+    { .name = "ioctl", .ioctl_ppm = 500 },
+    { .name = "latency", .latency_ppm = 1000, .latency_us = 100000 },
+    { .name = "flip", .flip_ppm = 1000 },
+    { .name = "overflow", .ovf_ppm = 2000 },
+    { .name        = "pll",
+      .stuck_ppm   = 1000,
+      .stuck_reads = 16,
+      .stuck_set   = PLLINT },
+    { .name = "reset", .reset_ppm = 200 },
+    { .name        = "mixed",
+      .ioctl_ppm   = 100,
+      .latency_ppm = 200,
+      .latency_us  = 50000,
+      .flip_ppm    = 200,
+      .ovf_ppm     = 500,
+      .stuck_ppm   = 200,
+      .stuck_reads = 16,
+      .stuck_set   = PLLINT,
+      .reset_ppm   = 50 },
+};
+
+/**
+ * \brief xorshift64*, the state must not be zero
+ */
+static uint64_t __rand(fault_inj_t *const fi)
+{
+    fi->rng ^= fi->rng >> 12;
+    fi->rng ^= fi->rng << 25;
+    fi->rng ^= fi->rng >> 27;
+    return fi->rng * 0x2545F4914F6CDD1DULL;
+}
+
+static uint8_t __chance(fault_inj_t *const fi, const uint32_t ppm)
+{
+    return ppm && __rand(fi) % FAULT_PPM < ppm;
+}
+
+/**
+ * \brief Message of the wrapped backend, it finds its context in self
+ */
+static int __inner_message(spi_t *const                   self,
+                           struct spi_ioc_transfer *const xfer,
+                           const unsigned int             n)
+{
+    fault_inj_t *fi = (fault_inj_t *)self->backend_ctx;
+    int          ret;
+
+    self->backend_ctx = fi->inner_ctx;
+    ret               = fi->inner->message(self, xfer, n);
+    self->backend_ctx = fi;
+    return ret;
+}
+
+static void __chip_reset(spi_t *const self)
+{
+    struct spi_ioc_transfer xfer = { 0 };
+    uint8_t tx[BYTES_NUM_IN_REG] = { (SW_RST << 1) | WREG, 0, 0, 0 };
+
+    xfer.tx_buf        = (__u64)(uintptr_t)tx;
+    xfer.len           = sizeof tx;
+    xfer.speed_hz      = self->xfer[0].speed_hz;
+    xfer.bits_per_word = self->xfer[0].bits_per_word;
+    __inner_message(self, &xfer, 1);
+}
+
+static void __sleep_us(const uint32_t us)
+{
+    struct timespec ts = {
+        .tv_sec  = us / FAULT_USEC_IN_SEC,
+        .tv_nsec = (long)(us % FAULT_USEC_IN_SEC) * FAULT_NSEC_IN_USEC,
+    };
+    while (nanosleep(&ts, &ts) && errno == EINTR) {
+    }
+}
+
+/**
+ * \brief Faults of a read data byte, idx counts the bytes after the command
+ */
+static void __corrupt_byte(fault_inj_t *const fi,
+                           const uint8_t      addr,
+                           const uint32_t     idx,
+                           uint8_t *const     byte)
+{
+    uint32_t shift = (ECG_FIFO_WORD_BYTES - 1 - idx % ECG_FIFO_WORD_BYTES) * 8;
+
+    switch (addr) {
+    case STATUS:
+        if (idx >= ECG_FIFO_WORD_BYTES) {
+            return;
+        }
+        if (!idx) {
+            fi->status_set = 0;
+            fi->status_clr = 0;
+            if (!fi->stuck_left && __chance(fi, fi->prof.stuck_ppm)) {
+                fi->stuck_left = fi->prof.stuck_reads;
+                fi->cnt.stuck++;
+            }
+            if (fi->stuck_left) {
+                fi->stuck_left--;
+                fi->status_set = fi->prof.stuck_set;
+                fi->status_clr = fi->prof.stuck_clr;
+            }
+            if (__chance(fi, fi->prof.ovf_ppm)) {
+                fi->status_set |= EOVF;
+                fi->cnt.ovfs++;
+            }
+        }
+        *byte = (*byte & ~(fi->status_clr >> shift)) | fi->status_set >> shift;
+        break;
+    case ECG_FIFO:
+    case ECG_FIFO_BURST:
+        if (addr == ECG_FIFO && idx >= ECG_FIFO_WORD_BYTES) {
+            return;
+        }
+        if (!(idx % ECG_FIFO_WORD_BYTES)) {
+            fi->word_flip = 0;
+            if (__chance(fi, fi->prof.flip_ppm)) {
+                fi->word_flip = 1U << (__rand(fi) % FAULT_WORD_BITS);
+                fi->cnt.flips++;
+            }
+        }
+        *byte ^= (uint8_t)(fi->word_flip >> shift);
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * \brief Walks the read bytes of the message by transaction, the way the
+ * chip sees them
+ */
+static void __corrupt(fault_inj_t *const                   fi,
+                      const struct spi_ioc_transfer *const xfer,
+                      const unsigned int                   n)
+{
+    uint8_t  in_trans = 0;
+    uint8_t  cmd      = 0;
+    uint32_t idx      = 0;
+
+    for (unsigned int i = 0; i < n; ++i) {
+        const uint8_t *tx = (const uint8_t *)(uintptr_t)xfer[i].tx_buf;
+        uint8_t *      rx = (uint8_t *)(uintptr_t)xfer[i].rx_buf;
+        for (uint32_t b = 0; b < xfer[i].len; ++b) {
+            if (!in_trans) {
+                in_trans = 1;
+                cmd      = tx ? tx[b] : 0;
+                idx      = 0;
+                continue;
+            }
+            if (rx && (cmd & RREG)) {
+                __corrupt_byte(fi, cmd >> 1, idx, &rx[b]);
+            }
+            idx++;
+        }
+        if ((i + 1 < n) ? xfer[i].cs_change : !xfer[i].cs_change) {
+            in_trans = 0;
+        }
+    }
+}
+
+static int __message(spi_t *const                   self,
+                     struct spi_ioc_transfer *const xfer,
+                     const unsigned int             n)
+{
+    fault_inj_t *fi = (fault_inj_t *)self->backend_ctx;
+    int          ret;
+
+    fi->cnt.messages++;
+    if (__chance(fi, fi->prof.reset_ppm)) {
+        __chip_reset(self);
+        fi->cnt.resets++;
+    }
+    if (__chance(fi, fi->prof.latency_ppm)) {
+        __sleep_us(fi->prof.latency_us);
+        fi->cnt.delayed++;
+    }
+    if (__chance(fi, fi->prof.ioctl_ppm)) {
+        fi->cnt.failed++;
+        errno = EIO;
+        return -1;
+    }
+    ret = __inner_message(self, xfer, n);
+    if (ret >= 0) {
+        __corrupt(fi, xfer, n);
+    }
+    return ret;
+}
+
+static ret_code_t __open(spi_t *const self)
+{
+    fault_inj_t *fi = (fault_inj_t *)self->backend_ctx;
+    ret_code_t   ret;
+    RET_ERR_ON_NULL(fi);
+
+    self->backend_ctx = fi->inner_ctx;
+    ret               = fi->inner->open(self);
+    self->backend_ctx = fi;
+    LOG_INFO("Injecting %s faults into %s, seed %llu\n",
+             fi->prof.name,
+             fi->inner->name,
+             (unsigned long long)fi->prof.seed);
+    return ret;
+}
+
+static ret_code_t __close(spi_t *const self)
+{
+    fault_inj_t *fi = (fault_inj_t *)self->backend_ctx;
+    ret_code_t   ret;
+    RET_ERR_ON_NULL(fi);
+
+    self->backend_ctx = fi->inner_ctx;
+    ret               = fi->inner->close(self);
+    self->backend_ctx = fi;
+    LOG_INFO("%llu messages: %llu failed, %llu delayed, %llu bit flips, "
+             "%llu overflows, %llu stuck STATUS, %llu resets\n",
+             (unsigned long long)fi->cnt.messages,
+             (unsigned long long)fi->cnt.failed,
+             (unsigned long long)fi->cnt.delayed,
+             (unsigned long long)fi->cnt.flips,
+             (unsigned long long)fi->cnt.ovfs,
+             (unsigned long long)fi->cnt.stuck,
+             (unsigned long long)fi->cnt.resets);
+    return ret;
+}
+
+const spi_backend_t fault_inj_backend = {
+    .name    = "fault injection",
+    .open    = __open,
+    .close   = __close,
+    .message = __message,
+};
+
+/**
+ * \brief Parses ':' separated numbers
+ * \retval number of values, 0 on a malformed value
+ */
+static uint32_t __parse_vals(const char *s, uint32_t *const vals)
+{
+    uint32_t num = 0;
+    char *   end;
+
+    while (num < FAULT_VALS_MAX) {
+        vals[num++] = (uint32_t)strtoul(s, &end, 0);
+        if (end == s || (*end && *end != ':')) {
+            return 0;
+        }
+        if (!*end) {
+            return num;
+        }
+        s = end + 1;
+    }
+    return 0;
+}
+
+static ret_code_t __parse_key(fault_profile_t *const profile,
+                              const char *const      key,
+                              const char *const      val)
+{
+    uint32_t v[FAULT_VALS_MAX] = { 0 };
+    uint32_t num               = __parse_vals(val, v);
+
+    if (!num) {
+        return RET_CODE_INVALID_PARAMS;
+    }
+    if (!strcmp(key, "seed")) {
+        profile->seed = strtoull(val, NULL, 0);
+    } else if (!strcmp(key, "ioctl")) {
+        profile->ioctl_ppm = v[0];
+    } else if (!strcmp(key, "latency") && num == 2) {
+        profile->latency_ppm = v[0];
+        profile->latency_us  = v[1];
+    } else if (!strcmp(key, "flip")) {
+        profile->flip_ppm = v[0];
+    } else if (!strcmp(key, "ovf")) {
+        profile->ovf_ppm = v[0];
+    } else if (!strcmp(key, "stuck") && num >= 3) {
+        profile->stuck_ppm   = v[0];
+        profile->stuck_reads = v[1];
+        profile->stuck_set   = v[2];
+        profile->stuck_clr   = v[3];
+    } else if (!strcmp(key, "reset")) {
+        profile->reset_ppm = v[0];
+    } else {
+        return RET_CODE_INVALID_PARAMS;
+    }
+    return RET_CODE_SUCCESS;
+}
+
+ret_code_t fault_profile_parse(fault_profile_t *const profile,
+                               const char *const      spec)
+{
+    ret_code_t ret = RET_CODE_SUCCESS;
+    char       buf[FAULT_SPEC_LEN];
+    char *     save = NULL, *t, *val;
+    uint32_t   i;
+    RET_ERR_ON_NULL(profile);
+    RET_ERR_ON_NULL(spec);
+
+    memset(profile, 0, sizeof *profile);
+    snprintf(buf, sizeof buf, "%s", spec);
+    for (t = strtok_r(buf, ",", &save); t; t = strtok_r(NULL, ",", &save)) {
+        val = strchr(t, '=');
+        if (val) {
+            *val++ = '\0';
+            CONTINUE_ON_SUCCESS(__parse_key(profile, t, val));
+            continue;
+        }
+        for (i = 0; i < ARRAY_SIZE(profiles); ++i) {
+            if (!strcmp(t, profiles[i].name)) {
+                *profile = profiles[i];
+                break;
+            }
+        }
+        if (i == ARRAY_SIZE(profiles)) {
+            ret = RET_CODE_INVALID_PARAMS;
+            goto exit;
+        }
+    }
+    snprintf(profile->name, sizeof profile->name, "%s", spec);
+    profile->seed = profile->seed ? profile->seed : FAULT_SEED_DEFAULT;
+exit:
+    if (RET_UNSUCCESS(ret)) {
+        LOG_ERR("Bad fault profile \"%s\"\n", spec);
+    }
+    return ret;
+}
+
+const char *fault_profile_name(const uint32_t idx)
+{
+    return idx < ARRAY_SIZE(profiles) ? profiles[idx].name : NULL;
+}
+
+fault_inj_t *fault_inj_open(const fault_profile_t *const profile)
+{
+    fault_inj_t *fi = (fault_inj_t *)calloc(1, sizeof(fault_inj_t));
+    if (PTR_INVALID(fi)) {
+        return NULL;
+    }
+    if (RET_UNSUCCESS(fault_inj_set_profile(fi, profile))) {
+        free(fi);
+        return NULL;
+    }
+    return fi;
+}
+
+ret_code_t fault_inj_set_profile(fault_inj_t *const           fi,
+                                 const fault_profile_t *const profile)
+{
+    RET_ERR_ON_NULL(fi);
+    RET_ERR_ON_NULL(profile);
+    fi->prof       = *profile;
+    fi->rng        = profile->seed ? profile->seed : FAULT_SEED_DEFAULT;
+    fi->stuck_left = 0;
+    return RET_CODE_SUCCESS;
+}
+
+ret_code_t fault_inj_close(fault_inj_t **fi)
+{
+    RET_ERR_ON_NULL(fi);
+    RET_ERR_ON_NULL(*fi);
+    free(*fi);
+    *fi = NULL;
+    return RET_CODE_SUCCESS;
+}
+
+ret_code_t fault_inj_attach(fault_inj_t *const fi, spi_t *const spi)
+{
+    RET_ERR_ON_NULL(fi);
+    RET_ERR_ON_NULL(spi);
+    if (!spi->backend) {
+        LOG_ERR("Faults are injected into a backend, none is attached\n");
+        return RET_CODE_INVALID_PARAMS;
+    }
+    fi->inner     = spi->backend;
+    fi->inner_ctx = spi->backend_ctx;
+    return spi_attach_backend(spi, &fault_inj_backend, fi);
+}
+
+ret_code_t fault_inj_counts(const fault_inj_t *const fi,
+                            fault_counts_t *const    counts)
+{
+    RET_ERR_ON_NULL(fi);
+    RET_ERR_ON_NULL(counts);
+    *counts = fi->cnt;
+    return RET_CODE_SUCCESS;
+}
@@ -9,6 +9,7 @@
 #include <stdlib.h>
 #include "spi.h"
 #include "get_opt_parser.h"
+#include "replay.h"
 #include "common_check.h"
 #include "Log_dbg_en.h"
 #include "ctype.h"
@@ -233,6 +234,63 @@ static void print_usage(const char *prog)
             "4 - NO calibration signal applied\n"
             "Default: No calibration signal applied\n\n"
 
+            "-n --samples  number of ECG samples to read (default 1024)\n\n"
+
+            "-R --replay   play a recording (binary or ecg_print_data() "
+            "output) through the chip model instead of spidev\n\n"
+
+            "-x --replay_speed Replay speed multiplier, "
+            "0 - as fast as possible\n"
+            "Default: 1 (real time)\n\n"
+
+            "-O --output   save measured samples to binary recording\n\n"
+
+            "-z --stats    file rewritten every second with counters, "
+            "SIGUSR1 dumps them to stderr\n\n"
+
+            "-q --trace    write binary trace of the run to file, "
+            "see trace_decode\n\n"
+
+            "-V --verify   read back configuration registers every N FIFO "
+            "batches and rewrite them if the chip was reset\n"
+            "Default: 0 (disabled)\n\n"
+
+            "-W --warm     warm start, skip reset if the chip already runs "
+            "with the requested configuration, only differences are "
+            "written\n\n"
+
+            "-K --ctrl     unix datagram socket for live reconfiguration, "
+            "accepts \"gain 20|40|80|160 rate 128|256|512 hpf 0|0.5 "
+            "lpf 0|40|100|150\", lpf 40 and 100 need 256 or 512 sps, "
+            "lpf 150 needs 512 sps\n\n"
+
+            "-Y --busy_poll poll FIFO as fast as possible instead of "
+            "sleeping according to sample rate and EFIT\n\n"
+
+            "-M --low_power FIFO words per wake-up (1-32, 0 - 28), sets "
+            "EFIT and SAMP every 16th sample with auto clear\n\n"
+
+            "-k --calib    SPI clock cache file, the fastest reliable clock "
+            "is calibrated once per device and overrides -s\n\n"
+
+            "-G --pipeline run acquisition, DSP and sink stages on their own "
+            "threads\n\n"
+
+            "-j --stage    stage placement acq|dsp|sink:cpu|any[:prio], "
+            "prio > 0 selects SCHED_FIFO, implies -G, e.g. -j acq:1:50 "
+            "-j dsp:0 -j sink:0\n\n"
+
+            "-Q --quality  signal quality CSV, band powers and quality index "
+            "of every ~2 s window, implies -G\n\n"
+
+            "-A --arrow    Arrow IPC tables prefix, writes <prefix>.samples, "
+            ".beats and .events.arrow, implies -G\n\n"
+
+            "-X --faults   inject bus faults into the replay, a profile "
+            "(none|ioctl|latency|flip|overflow|pll|reset|mixed) and/or "
+            "key=value overrides, e.g. -X overflow,seed=7, see fault_inj.h"
+            "\n\n"
+
     );
     LOG_INFO("Help option used - ending program\n");
     exit(EXIT_FAILURE);
@@ -243,8 +301,11 @@ static void print_usage(const char *prog)
  */
 ret_code_t __check_digit_opt(const char *const opt);
 
-ret_code_t
-parse_opts(int argc, char *argv[], spi_t *const spi, ecg_data_t *const ecg_data)
+ret_code_t parse_opts(int               argc,
+                      char *            argv[],
+                      spi_t *const      spi,
+                      ecg_data_t *const ecg_data,
+                      app_opts_t *const opts)
 {
     ret_code_t ret = RET_CODE_SUCCESS;
     /*Parameters checking section*/
@@ -268,9 +329,16 @@ parse_opts(int argc, char *argv[], spi_t *const spi, ecg_data_t *const ecg_data)
         ret = RET_CODE_NULL_PTR;
         goto exit;
     }
+    if (PTR_INVALID(opts)) {
+        LOG_ERR("opts handler is NULL ptr\n");
+        ret = RET_CODE_NULL_PTR;
+        goto exit;
+    }
 
-    spi->dev_name = SPI_DEVICE_NAME;
-    spi->speed    = SPI_MAX_SPEED;
+    spi->dev_name      = SPI_DEVICE_NAME;
+    spi->speed         = SPI_MAX_SPEED;
+    opts->replay_speed = REPLAY_SPEED_DEFAULT;
+    CHECK_CODE_ERR(pipe_cfg_init(&opts->pipe));
     int      c; /*Get opt return var*/
     uint32_t temp_val = 0;
     while (1) {
@@ -289,13 +357,22 @@ parse_opts(int argc, char *argv[], spi_t *const spi, ecg_data_t *const ecg_data)
             { "cal_bipol", 1, 0, 'o' },     { "cal_mag", 1, 0, 'C' },
             { "cal_freq", 1, 0, 'F' },      { "inv_pol", 1, 0, 'I' },
             { "inp_swt", 1, 0, 'N' },       { "calp_sel", 1, 0, 't' },
-            { "caln_sel", 1, 0, 'T' },      { NULL, 0, 0, 0 },
+            { "caln_sel", 1, 0, 'T' },      { "samples", 1, 0, 'n' },
+            { "replay", 1, 0, 'R' },        { "replay_speed", 1, 0, 'x' },
+            { "output", 1, 0, 'O' },        { "stats", 1, 0, 'z' },
+            { "trace", 1, 0, 'q' },         { "verify", 1, 0, 'V' },
+            { "warm", 0, 0, 'W' },          { "ctrl", 1, 0, 'K' },
+            { "busy_poll", 0, 0, 'Y' },     { "low_power", 1, 0, 'M' },
+            { "calib", 1, 0, 'k' },         { "pipeline", 0, 0, 'G' },
+            { "stage", 1, 0, 'j' },         { "quality", 1, 0, 'Q' },
+            { "arrow", 1, 0, 'A' },         { "faults", 1, 0, 'X' },
+            { NULL, 0, 0, 0 },
         };
 
         c = getopt_long(
                 argc,
                 argv,
-                "D:s:b:i:Lg:S:H:e:p:a:f:e:u:l:P:m:v:B:r:i:c:o:C:F:I:N:t:T:",
+                "D:s:b:i:Lg:S:H:e:p:a:f:e:u:l:P:m:v:B:r:i:c:o:C:F:I:N:t:T:n:R:x:O:z:q:V:WK:YM:k:Gj:Q:A:X:",
                 lopts,
                 NULL);
         if (c == GET_OPT_FAIL) {
@@ -886,6 +963,136 @@ parse_opts(int argc, char *argv[], spi_t *const spi, ecg_data_t *const ecg_data)
             break;
         }
 
+        case 'n':
+            CHECK_CODE_ERR(__check_digit_opt("samples"));
+            if (!atoi(optarg)) {
+                LOG_ERR("Number of samples must be positive \n");
+                ret = RET_CODE_INVALID_PARAMS;
+                goto exit;
+            }
+            CHECK_CODE_ERR(ecg_set_data_len(ecg_data, atoi(optarg)));
+            break;
+
+        case 'R':
+            if (PTR_INVALID(optarg)) {
+                LOG_ERR("Replay file name string is wrong \n");
+                ret = RET_CODE_NULL_PTR;
+                goto exit;
+            }
+            opts->replay_path = optarg;
+            break;
+
+        case 'x':
+            CHECK_CODE_ERR(__check_digit_opt("replay_speed"));
+            opts->replay_speed = atoi(optarg);
+            break;
+
+        case 'O':
+            if (PTR_INVALID(optarg)) {
+                LOG_ERR("Output file name string is wrong \n");
+                ret = RET_CODE_NULL_PTR;
+                goto exit;
+            }
+            opts->output_path = optarg;
+            break;
+
+        case 'z':
+            if (PTR_INVALID(optarg)) {
+                LOG_ERR("Stats file name string is wrong \n");
+                ret = RET_CODE_NULL_PTR;
+                goto exit;
+            }
+            opts->stats_path = optarg;
+            break;
+
+        case 'q':
+            if (PTR_INVALID(optarg)) {
+                LOG_ERR("Trace file name string is wrong \n");
+                ret = RET_CODE_NULL_PTR;
+                goto exit;
+            }
+            opts->trace_path = optarg;
+            break;
+
+        case 'V':
+            CHECK_CODE_ERR(__check_digit_opt("verify"));
+            opts->verify_period = atoi(optarg);
+            break;
+
+        case 'W':
+            opts->warm_start = 1;
+            break;
+
+        case 'K':
+            if (PTR_INVALID(optarg)) {
+                LOG_ERR("Control socket path string is wrong \n");
+                ret = RET_CODE_NULL_PTR;
+                goto exit;
+            }
+            opts->ctrl_path = optarg;
+            break;
+
+        case 'Y':
+            ecg_data->poll_mode = ECG_POLL_BUSY;
+            break;
+
+        case 'k':
+            if (PTR_INVALID(optarg)) {
+                LOG_ERR("SPI clock cache file name string is wrong \n");
+                ret = RET_CODE_NULL_PTR;
+                goto exit;
+            }
+            opts->calib_path = optarg;
+            break;
+
+        case 'M':
+            CHECK_CODE_ERR(__check_digit_opt("low_power"));
+            CHECK_CODE_ERR(ecg_set_low_power(ecg_data, atoi(optarg)));
+            break;
+
+        case 'G':
+            opts->pipeline = 1;
+            break;
+
+        case 'j':
+            if (PTR_INVALID(optarg)) {
+                LOG_ERR("Stage placement string is wrong \n");
+                ret = RET_CODE_NULL_PTR;
+                goto exit;
+            }
+            CHECK_CODE_ERR(pipe_cfg_stage(&opts->pipe, optarg));
+            opts->pipeline = 1;
+            break;
+
+        case 'Q':
+            if (PTR_INVALID(optarg)) {
+                LOG_ERR("Quality file name is wrong \n");
+                ret = RET_CODE_NULL_PTR;
+                goto exit;
+            }
+            opts->pipe.quality_path = optarg;
+            opts->pipeline          = 1;
+            break;
+
+        case 'A':
+            if (PTR_INVALID(optarg)) {
+                LOG_ERR("Arrow prefix is wrong \n");
+                ret = RET_CODE_NULL_PTR;
+                goto exit;
+            }
+            opts->pipe.arrow_path = optarg;
+            opts->pipeline        = 1;
+            break;
+
+        case 'X':
+            if (PTR_INVALID(optarg)) {
+                LOG_ERR("Fault profile string is wrong \n");
+                ret = RET_CODE_NULL_PTR;
+                goto exit;
+            }
+            opts->faults = optarg;
+            break;
+
         default:
             print_usage(argv[0]);
         }
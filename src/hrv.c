@@ -0,0 +1,203 @@
+/**
+ * \file hrv.c
+ *
+ * \brief Streaming HRV metrics
+ */
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include "hrv.h"
+#include "common_check.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE DSP_PRINT_EN
+#define DBG_TAG      "hrv.c"
+#include "Log_dbg.h"
+
+#define HRV_MS_IN_SEC  1000
+#define HRV_SEC_IN_MIN 60.0
+
+ret_code_t hrv_init(hrv_t *const   hrv,
+                    const uint32_t window_s,
+                    const uint32_t spec_period_s)
+{
+    RET_ERR_ON_NULL(hrv);
+
+    memset(hrv, 0, sizeof *hrv);
+    hrv->window_ms      = window_s * HRV_MS_IN_SEC;
+    hrv->spec_period_ms = spec_period_s * HRV_MS_IN_SEC;
+    hrv->spec_due_ms    = hrv->spec_period_ms;
+    return RET_CODE_SUCCESS;
+}
+
+/**
+ * \brief Adds (s = 1) or removes (s = -1) a successive difference
+ */
+static inline void __diff_add(hrv_t *const  hrv,
+                              const int32_t d,
+                              const int8_t  s)
+{
+    hrv->sum_d2 += s * (int64_t)d * d;
+    hrv->diffs += s;
+    hrv->nn50 += s * (abs(d) > HRV_NN50_MS);
+}
+
+/**
+ * \brief Drops the oldest interval and its difference to the next one
+ */
+static void __evict(hrv_t *const hrv)
+{
+    uint32_t next = (hrv->head + 1) % HRV_RR_MAX;
+    int32_t  rr   = hrv->rr[hrv->head];
+
+    hrv->sum -= rr;
+    hrv->sum2 -= (int64_t)rr * rr;
+    if (hrv->num > 1 && hrv->linked[next]) {
+        __diff_add(hrv, hrv->rr[next] - rr, -1);
+        hrv->linked[next] = 0;
+    }
+    hrv->head = next;
+    hrv->num--;
+}
+
+uint8_t hrv_add_rr(hrv_t *const hrv, const uint32_t rr_ms)
+{
+    uint32_t tail, prev;
+
+    if (rr_ms < HRV_RR_MIN_MS || rr_ms > HRV_RR_MAX_MS) {
+        hrv->chained = 0;
+        return 0;
+    }
+    if (hrv->num == HRV_RR_MAX) {
+        __evict(hrv);
+    }
+    tail              = (hrv->head + hrv->num) % HRV_RR_MAX;
+    prev              = (tail + HRV_RR_MAX - 1) % HRV_RR_MAX;
+    hrv->rr[tail]     = (uint16_t)rr_ms;
+    hrv->linked[tail] = hrv->chained && hrv->num;
+    if (hrv->linked[tail]) {
+        __diff_add(hrv, (int32_t)rr_ms - hrv->rr[prev], 1);
+    }
+    hrv->num++;
+    hrv->sum += rr_ms;
+    hrv->sum2 += (int64_t)rr_ms * rr_ms;
+    hrv->chained = 1;
+    while (hrv->num > 1 && hrv->sum > hrv->window_ms) {
+        __evict(hrv);
+    }
+
+    if (!hrv->spec_period_ms) {
+        return 0;
+    }
+    if (hrv->spec_due_ms > rr_ms) {
+        hrv->spec_due_ms -= rr_ms;
+        return 0;
+    }
+    hrv->spec_due_ms = hrv->spec_period_ms;
+    hrv_spectral(hrv);
+    return 1;
+}
+
+uint8_t hrv_add_rtor(hrv_t *const hrv, const uint32_t rtor)
+{
+    return hrv_add_rr(hrv, HRV_RTOR_TO_MS(rtor));
+}
+
+uint8_t hrv_add_beat(hrv_t *const   hrv,
+                     const uint64_t beat,
+                     const uint32_t rate)
+{
+    uint8_t refreshed = 0;
+
+    if (hrv->rate == rate && beat > hrv->last_beat) {
+        refreshed = hrv_add_rr(hrv,
+                               (beat - hrv->last_beat) * HRV_MS_IN_SEC / rate);
+    } else {
+        hrv->chained = 0;
+    }
+    hrv->last_beat = beat;
+    hrv->rate      = rate;
+    return refreshed;
+}
+
+void hrv_spectral(hrv_t *const hrv)
+{
+    double   mean, t, x, w, tau, c, s, ss, cc, s2, c2, p;
+    double   lf = 0, hf = 0, span, df;
+    uint32_t idx;
+
+    hrv->lf = hrv->hf = 0;
+    if (hrv->num < 2 || hrv->sum < HRV_SPEC_MIN_S * HRV_MS_IN_SEC) {
+        return;
+    }
+    mean = (double)hrv->sum / hrv->num;
+    span = hrv->sum / (double)HRV_MS_IN_SEC;
+    df   = 1 / (HRV_OVERSAMPLE * span);
+
+    for (double f = HRV_LF_LO; f < HRV_HF_HI; f += df) {
+        w = 2 * M_PI * f;
+        /* Time offset which makes sine and cosine terms orthogonal */
+        s2 = c2 = 0;
+        t       = 0;
+        for (uint32_t i = 0; i < hrv->num; ++i) {
+            idx = (hrv->head + i) % HRV_RR_MAX;
+            t += hrv->rr[idx] / (double)HRV_MS_IN_SEC;
+            s2 += sin(2 * w * t);
+            c2 += cos(2 * w * t);
+        }
+        tau = atan2(s2, c2) / (2 * w);
+
+        ss = cc = s2 = c2 = 0;
+        t                 = 0;
+        for (uint32_t i = 0; i < hrv->num; ++i) {
+            idx = (hrv->head + i) % HRV_RR_MAX;
+            t += hrv->rr[idx] / (double)HRV_MS_IN_SEC;
+            x = hrv->rr[idx] - mean;
+            c = cos(w * (t - tau));
+            s = sin(w * (t - tau));
+            cc += x * c;
+            ss += x * s;
+            c2 += c * c;
+            s2 += s * s;
+        }
+        /* Periodogram scaled to power spectral density, ms^2/Hz */
+        p = 0.5 * (cc * cc / c2 + ss * ss / s2);
+        p = 2 * p * span / hrv->num * df;
+        if (f < HRV_LF_HI) {
+            lf += p;
+        } else {
+            hf += p;
+        }
+    }
+    hrv->lf = lf;
+    hrv->hf = hf;
+}
+
+ret_code_t hrv_get(const hrv_t *const hrv, hrv_metrics_t *const m)
+{
+    double var;
+    RET_ERR_ON_NULL(hrv);
+    RET_ERR_ON_NULL(m);
+
+    memset(m, 0, sizeof *m);
+    m->beats = hrv->num;
+    m->lf    = hrv->lf;
+    m->hf    = hrv->hf;
+    m->lf_hf = hrv->hf > 0 ? hrv->lf / hrv->hf : 0;
+    if (!hrv->num) {
+        return RET_CODE_SUCCESS;
+    }
+    m->mean_rr = (double)hrv->sum / hrv->num;
+    m->hr      = HRV_SEC_IN_MIN * HRV_MS_IN_SEC / m->mean_rr;
+    if (hrv->num > 1) {
+        /* Integer sums, no drift however long the stream is */
+        var = ((double)hrv->sum2 - (double)hrv->sum * hrv->sum / hrv->num) /
+              (hrv->num - 1);
+        m->sdnn = var > 0 ? sqrt(var) : 0;
+    }
+    if (hrv->diffs) {
+        m->rmssd = sqrt((double)hrv->sum_d2 / hrv->diffs);
+        m->pnn50 = 100.0 * hrv->nn50 / hrv->diffs;
+    }
+    return RET_CODE_SUCCESS;
+}
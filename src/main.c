@@ -15,6 +15,15 @@
 #include "spi.h"
 #include "get_opt_parser.h"
 #include "MAX30003.h"
+#include "reg_shadow.h"
+#include "ctrl.h"
+#include "spi_calib.h"
+#include "pipeline.h"
+#include "replay.h"
+#include "fault_inj.h"
+#include "recording.h"
+#include "stats.h"
+#include "trace.h"
 #include "common_check.h"
 
 #include "Log_dbg_en.h"
@@ -22,20 +31,73 @@
 #define DBG_TAG      "main.c"
 #include "Log_dbg.h"
 
+#define NSEC_IN_SEC 1e9
+
 spi_t spi;
 
+static double __clock_s(const clockid_t clk)
+{
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return ts.tv_sec + ts.tv_nsec / NSEC_IN_SEC;
+}
+
 int main(int argc, char **argv)
 {
+    app_opts_t   opts   = { 0 };
+    replay_t *   replay = NULL;
+    fault_inj_t *faults = NULL;
+    ctrl_t *     ctrl   = NULL;
+    double       wall_s, cpu_s, start_s;
+    uint64_t     wakeups;
+
+    if (log_start()) {
+        errExit("log_start");
+    }
 
     ecg_data_t *ecg_data = ecg_create_handle();
     EXIT_ON_NULL(ecg_data);
 
     CHECK_CODE_ERR(ecg_init_handle(ecg_data));
 
-    CHECK_CODE_ERR(parse_opts(argc, argv, &spi, ecg_data));
+    CHECK_CODE_ERR(parse_opts(argc, argv, &spi, ecg_data, &opts));
+    CHECK_CODE_ERR(stats_start(opts.stats_path, STATS_PERIOD_S_DEFAULT));
+    if (opts.pipeline) {
+        /* All the sample memory of the stages, nothing allocated later */
+        opts.pipe.pool = block_pool_create(PIPE_POOL_BLOCKS, PIPE_BLOCK_POINTS);
+        EXIT_ON_NULL(opts.pipe.pool);
+    }
+
+    if (opts.replay_path) {
+        replay = replay_open(opts.replay_path, opts.replay_speed);
+        EXIT_ON_NULL(replay);
+        CHECK_CODE_ERR(replay_attach(replay, &spi));
+    }
+    if (opts.faults) {
+        fault_profile_t profile;
+        CHECK_CODE_ERR(fault_profile_parse(&profile, opts.faults));
+        faults = fault_inj_open(&profile);
+        EXIT_ON_NULL(faults);
+        CHECK_CODE_ERR(fault_inj_attach(faults, &spi));
+    }
 
+    if (opts.ctrl_path) {
+        ctrl = ctrl_open(opts.ctrl_path);
+        EXIT_ON_NULL(ctrl);
+        CHECK_CODE_ERR(ctrl_attach(ctrl, ecg_data));
+    }
+
+    start_s = __clock_s(CLOCK_MONOTONIC);
     CHECK_CODE_ERR(spi_init(&spi));
-    CHECK_CODE_ERR(max30003_init(ecg_data));
+    if (opts.calib_path) {
+        CHECK_CODE_ERR(spi_calib_run(&spi, opts.calib_path));
+    }
+    max30003_shadow.verify_period = opts.verify_period;
+    if (opts.warm_start) {
+        CHECK_CODE_ERR(max30003_warm_init(ecg_data, NULL));
+    } else {
+        CHECK_CODE_ERR(max30003_init(ecg_data));
+    }
 
 #ifdef TEST
     uint8_t test_buff[BYTES_NUM_IN_REG] = { 0 };
@@ -44,11 +106,68 @@ int main(int argc, char **argv)
     max30003_read_reg(&spi, CNFG_ECG, test_buff);
 #endif
 
-    CHECK_CODE_ERR(ecg_get_data(ecg_data));
-    CHECK_CODE_ERR(ecg_print_data(ecg_data));
+    wakeups = stats_get(STAT_POLL_WAKEUPS);
+    wall_s  = __clock_s(CLOCK_MONOTONIC);
+    cpu_s   = __clock_s(CLOCK_PROCESS_CPUTIME_ID);
+    if (opts.pipeline) {
+        /* Sinks run on their own thread while samples arrive */
+        opts.pipe.output_path = opts.output_path;
+        CHECK_CODE_ERR(pipe_run(&opts.pipe, ecg_data, NULL));
+    } else {
+        CHECK_CODE_ERR(ecg_get_data(ecg_data));
+    }
+    wall_s  = __clock_s(CLOCK_MONOTONIC) - wall_s;
+    cpu_s   = __clock_s(CLOCK_PROCESS_CPUTIME_ID) - cpu_s;
+    wakeups = stats_get(STAT_POLL_WAKEUPS) - wakeups;
+    LOG_INFO("%u samples in %.3f s (%.0f samples/s), CPU %.3f s\n",
+             ecg_data->data_ID,
+             wall_s,
+             ecg_data->data_ID / wall_s,
+             cpu_s);
+    if (ecg_data->poll_mode == ECG_POLL_SCHED) {
+        LOG_INFO("%.1f wake-ups/s, CPU %.2f ms/s\n",
+                 wakeups / wall_s,
+                 cpu_s / wall_s * 1e3);
+    }
+    if (ecg_data->first_sample_ns) {
+        LOG_INFO("%s start to first valid sample %.3f ms\n",
+                 opts.warm_start ? "Warm" : "Cold",
+                 (ecg_data->first_sample_ns / NSEC_IN_SEC - start_s) * 1e3);
+    }
+
+    if (!opts.pipeline) {
+        wall_s = __clock_s(CLOCK_MONOTONIC);
+        TRACE(TRACE_EV_SINK_BEGIN, ecg_data->data_ID, 0);
+        if (opts.output_path) {
+            CHECK_CODE_ERR(rec_save(opts.output_path, ecg_data));
+            STAT_INC(STAT_SINK_WRITES);
+        }
+        CHECK_CODE_ERR(ecg_print_data(ecg_data));
+        STAT_INC(STAT_SINK_WRITES);
+        TRACE(TRACE_EV_SINK_END, 0, 0);
+        STAT_ADD(STAT_SINK_NS,
+                 (__clock_s(CLOCK_MONOTONIC) - wall_s) * NSEC_IN_SEC);
+    }
 
     CHECK_CODE_ERR(ecg_delete_handle(&ecg_data));
+    if (opts.pipe.pool) {
+        CHECK_CODE_ERR(block_pool_destroy(&opts.pipe.pool));
+    }
     CHECK_CODE_ERR(spi_free(&spi));
+    if (faults) {
+        CHECK_CODE_ERR(fault_inj_close(&faults));
+    }
+    if (replay) {
+        CHECK_CODE_ERR(replay_close(&replay));
+    }
+    if (ctrl) {
+        CHECK_CODE_ERR(ctrl_close(&ctrl));
+    }
+    CHECK_CODE_ERR(stats_stop());
+    if (opts.trace_path) {
+        CHECK_CODE_ERR(trace_dump(opts.trace_path));
+    }
     LOG_INFO("Exiting ECG runner program\n");
+    log_stop();
     return 0;
 }
@@ -0,0 +1,794 @@
+/**
+ * \file pipeline.c
+ *
+ * \brief Threaded acquisition, DSP and sink stages
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "pipeline.h"
+#include "dsp.h"
+#include "qrs.h"
+#include "hrv.h"
+#include "sqi.h"
+#include "block_pool.h"
+#include "recording.h"
+#include "arrow_ipc.h"
+#include "stats.h"
+#include "trace.h"
+#include "common_check.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE PIPE_PRINT_EN
+#define DBG_TAG      "pipeline.c"
+#include "Log_dbg.h"
+
+#define PIPE_NSEC_IN_SEC  1000000000ULL
+#define PIPE_FULL_WAIT_NS 1000000 /* DSP retry period on a full sink queue */
+#define PIPE_DSP_CHUNK    256     /* scratch points without cfg->filtered */
+#define PIPE_SPEC_LEN     32
+#define PIPE_CACHE_LINE   64
+
+static const char *const stage_names[PIPE_STAGE_NUM] = {
+    [PIPE_STAGE_ACQ]  = "acq",
+    [PIPE_STAGE_DSP]  = "dsp",
+    [PIPE_STAGE_SINK] = "sink",
+};
+
+/**
+ * \brief Range of a pooled block holding a reference to it, num 0 ends
+ * the stream
+ */
+typedef struct {
+    ecg_block_t *blk;
+    uint32_t     off; /* first point in blk->points */
+    uint32_t     num;
+    uint64_t     t_ns; /* sample time of the first point, 0 - unknown */
+} pipe_block_t;
+
+/**
+ * \brief SPSC queue, producer and consumer fields on separate cache lines
+ */
+typedef struct {
+    /* Producer side, tail is the futex word of a sleeping consumer */
+    uint32_t tail __attribute__((aligned(PIPE_CACHE_LINE)));
+    uint32_t max_depth;
+    uint64_t full;
+    /* Consumer side */
+    uint32_t head __attribute__((aligned(PIPE_CACHE_LINE)));
+    uint32_t waiting;
+    uint64_t depth_sum;
+    uint64_t pops;
+    pipe_block_t slot[PIPE_QUEUE_LEN] __attribute__((aligned(PIPE_CACHE_LINE)));
+} pipe_queue_t;
+
+typedef struct {
+    pipe_queue_t      q[PIPE_QUEUE_NUM];
+    const pipe_cfg_t *cfg;
+    ecg_data_t *      ecg_data;
+    block_pool_t *    pool;
+    ecg_block_t *     cur;       /* block filled by the acquisition */
+    uint32_t          published; /* points of cur handed over to DSP */
+    uint32_t          acquired;  /* points in the blocks before cur */
+    uint32_t          total;     /* points to acquire */
+    uint64_t          pend_ns;   /* sample time of the first pending point */
+    uint64_t          cpu_ns[PIPE_STAGE_NUM];
+    ret_code_t        ret[PIPE_STAGE_NUM];
+    sqi_t             sqi;
+    FILE *            quality; /* signal quality windows if set */
+    uint8_t           poor;    /* last window under SQI_POOR */
+} pipe_t;
+
+static long __futex(uint32_t *const addr, const int op, const uint32_t val)
+{
+    return syscall(SYS_futex, addr, op, val, NULL, NULL, 0);
+}
+
+static uint64_t __clock_ns(const clockid_t clk)
+{
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return (uint64_t)ts.tv_sec * PIPE_NSEC_IN_SEC + ts.tv_nsec;
+}
+
+/**
+ * \brief Records the latency of a step just done for points sampled at
+ * t_ns, see max30003_batch_ns()
+ */
+static void __lat(const lat_id_t id, const uint64_t t_ns)
+{
+    uint64_t now = __clock_ns(CLOCK_MONOTONIC);
+    if (t_ns && now > t_ns) {
+        stats_lat(id, now - t_ns);
+    }
+}
+
+/**
+ * \brief Never blocks, RET_CODE_BUSY if the queue is full
+ */
+static ret_code_t __queue_push(pipe_queue_t *const       q,
+                               const uint32_t            id,
+                               const pipe_block_t *const blk)
+{
+    uint32_t tail  = q->tail;
+    uint32_t depth = tail - __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+
+    if (depth == PIPE_QUEUE_LEN) {
+        q->full++;
+        STAT_INC(STAT_PIPE_FULL);
+        return RET_CODE_BUSY;
+    }
+    q->slot[tail & (PIPE_QUEUE_LEN - 1)] = *blk;
+    /* Orders the tail store before the waiting load, see __queue_pop() */
+    __atomic_store_n(&q->tail, tail + 1, __ATOMIC_SEQ_CST);
+    if (++depth > q->max_depth) {
+        q->max_depth = depth;
+    }
+    TRACE(TRACE_EV_QUEUE, id, depth);
+    if (__atomic_load_n(&q->waiting, __ATOMIC_SEQ_CST)) {
+        __futex(&q->tail, FUTEX_WAKE_PRIVATE, 1);
+    }
+    return RET_CODE_SUCCESS;
+}
+
+/**
+ * \brief Blocks until a block is available
+ */
+static void __queue_pop(pipe_queue_t *const q, pipe_block_t *const blk)
+{
+    uint32_t head = q->head;
+    uint32_t tail;
+
+    while ((tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE)) == head) {
+        __atomic_store_n(&q->waiting, 1, __ATOMIC_SEQ_CST);
+        /* A push between the first load and the flag doesn't wake us */
+        if (__atomic_load_n(&q->tail, __ATOMIC_SEQ_CST) == head) {
+            __futex(&q->tail, FUTEX_WAIT_PRIVATE, head);
+        }
+        __atomic_store_n(&q->waiting, 0, __ATOMIC_RELAXED);
+    }
+    *blk = q->slot[head & (PIPE_QUEUE_LEN - 1)];
+    q->depth_sum += tail - head;
+    q->pops++;
+    __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * \brief Pushes, retrying while the queue is full
+ */
+static void __queue_push_wait(pipe_queue_t *const       q,
+                              const uint32_t            id,
+                              const pipe_block_t *const blk)
+{
+    const struct timespec wait = { 0, PIPE_FULL_WAIT_NS };
+
+    while (__queue_push(q, id, blk) != RET_CODE_SUCCESS) {
+        nanosleep(&wait, NULL);
+    }
+}
+
+/**
+ * \brief Hands points of the current block over to DSP, each range holds
+ * a reference to the block
+ */
+static ret_code_t __acq_push(pipe_t *const      p,
+                             const uint32_t     num,
+                             const uint8_t      wait)
+{
+    pipe_block_t blk = { p->cur, p->published, num, p->pend_ns };
+    ret_code_t   ret = RET_CODE_SUCCESS;
+
+    block_ref(p->cur);
+    if (wait) {
+        __queue_push_wait(&p->q[PIPE_STAGE_ACQ], PIPE_STAGE_ACQ, &blk);
+    } else {
+        ret = __queue_push(&p->q[PIPE_STAGE_ACQ], PIPE_STAGE_ACQ, &blk);
+    }
+    if (ret == RET_CODE_SUCCESS) {
+        p->published += num;
+        p->pend_ns = 0;
+    } else {
+        block_release(p->cur);
+    }
+    return ret;
+}
+
+/**
+ * \brief Continues the acquisition in a free block of the pool
+ */
+static void __acq_block(pipe_t *const p, ecg_data_t *const ecg_data)
+{
+    const struct timespec wait = { 0, PIPE_FULL_WAIT_NS };
+    ecg_block_t *         blk;
+
+    while (!(blk = block_pool_get(p->pool))) {
+        /* Readers hold all the blocks, the FIFO buffers meanwhile */
+        STAT_INC(STAT_POOL_EMPTY);
+        nanosleep(&wait, NULL);
+    }
+    blk->first         = p->acquired;
+    p->cur             = blk;
+    p->published       = 0;
+    ecg_data->data_arr = blk->points;
+    ecg_data->data_len = (int32_t)MIN(blk->cap, p->total - p->acquired);
+    ecg_data->data_ID  = 0;
+}
+
+/**
+ * \brief ecg_data_t::store_hook of the acquisition stage
+ */
+static ret_code_t __acq_publish(ecg_data_t *const ecg_data, void *ctx)
+{
+    pipe_t * p    = (pipe_t *)ctx;
+    uint32_t num  = ecg_data->data_ID - p->published;
+    uint32_t room = ecg_data->data_len - ecg_data->data_ID;
+
+    if (!p->pend_ns && num) {
+        /* Nothing was pending, the batch stored last is the oldest */
+        p->pend_ns = max30003_batch_ns();
+    }
+    p->cur->num = ecg_data->data_ID;
+    if (num >= p->cfg->block_min) {
+        /* On a full queue the points stay pending for the next batch */
+        __acq_push(p, num, 0);
+    }
+    /* A FIFO drain and a marker of max30003_reconfig() must fit */
+    if (room > ECG_FIFO_DEPTH ||
+        p->acquired + ecg_data->data_len >= p->total) {
+        return RET_CODE_SUCCESS;
+    }
+    if (ecg_data->data_ID > p->published) {
+        __acq_push(p, ecg_data->data_ID - p->published, 1);
+    }
+    p->acquired += ecg_data->data_ID;
+    block_release(p->cur);
+    __acq_block(p, ecg_data);
+    return RET_CODE_SUCCESS;
+}
+
+static void *__acq_thread(void *arg)
+{
+    pipe_t *     p        = (pipe_t *)arg;
+    ecg_data_t * ecg_data = p->ecg_data;
+    pipe_block_t blk      = { 0 };
+
+    pthread_setname_np(pthread_self(), "ecg_acq");
+    __acq_block(p, ecg_data);
+    p->ret[PIPE_STAGE_ACQ] = ecg_get_data(ecg_data);
+
+    /* Rest of the points and the end of the stream, even after errors */
+    p->cur->num = ecg_data->data_ID;
+    if (ecg_data->data_ID > p->published) {
+        __acq_push(p, ecg_data->data_ID - p->published, 1);
+    }
+    p->acquired += ecg_data->data_ID;
+    block_release(p->cur);
+    p->cur = NULL;
+    __queue_push_wait(&p->q[PIPE_STAGE_ACQ], PIPE_STAGE_ACQ, &blk);
+
+    p->cpu_ns[PIPE_STAGE_ACQ] = __clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    return NULL;
+}
+
+static void __log_hrv(const hrv_t *const hrv)
+{
+    hrv_metrics_t m;
+
+    hrv_get(hrv, &m);
+    LOG_INFO("HRV %u beats: HR %.0f, SDNN %.1f ms, RMSSD %.1f ms, "
+             "pNN50 %.1f%%, LF/HF %.2f\n",
+             m.beats,
+             m.hr,
+             m.sdnn,
+             m.rmssd,
+             m.pnn50,
+             m.lf_hf);
+}
+
+/**
+ * \brief Writes the window to the quality stream, logs quality changes
+ */
+static void __quality_report(pipe_t *const p, const sqi_metrics_t *const m)
+{
+    uint8_t poor = m->quality < SQI_POOR;
+
+    if (p->quality) {
+        fprintf(p->quality, "%llu,%u", (unsigned long long)m->start, m->len);
+        for (uint32_t b = 0; b < SQI_BAND_NUM; ++b) {
+            fprintf(p->quality, ",%.1f", m->power[b]);
+        }
+        fprintf(p->quality, ",%u\n", m->quality);
+    }
+    if (poor && !p->poor) {
+        LOG_WARN("Poor signal from sample %llu: quality %u%%, baseline %.0f, "
+                 "mains %.0f, hf %.0f\n",
+                 (unsigned long long)m->start,
+                 m->quality,
+                 m->power[SQI_BAND_BASELINE],
+                 m->power[SQI_BAND_MAINS],
+                 m->power[SQI_BAND_HF]);
+    } else if (!poor && p->poor) {
+        LOG_INFO("Signal recovered at sample %llu: quality %u%%\n",
+                 (unsigned long long)m->start,
+                 m->quality);
+    }
+    p->poor = poor;
+}
+
+static void *__dsp_thread(void *arg)
+{
+    pipe_t *      p = (pipe_t *)arg;
+    pipe_block_t  blk;
+    dsp_t         dsp;
+    qrs_t         qrs;
+    hrv_t         hrv;
+    int32_t       scratch[PIPE_DSP_CHUNK];
+    uint64_t      found[PIPE_DSP_CHUNK];
+    sqi_metrics_t win[2]; /* a chunk completes one window at most */
+    ecg_arrow_t   arrow = { 0 }; /* beats table */
+    int32_t *     out;
+    uint32_t      n, n_beats, n_win, beats = 0;
+    uint64_t      start_ns, idx, t_ns, period_ns = 0;
+    uint8_t       ready = 0;
+
+    pthread_setname_np(pthread_self(), "ecg_dsp");
+    do {
+        __queue_pop(&p->q[PIPE_STAGE_ACQ], &blk);
+        if (!blk.num) {
+            __queue_push_wait(&p->q[PIPE_STAGE_DSP], PIPE_STAGE_DSP, &blk);
+            break;
+        }
+        idx = blk.blk->first + blk.off;
+        if (!ready) {
+            /* cnfg_ecg_acq is published together with the first block */
+            dsp_init(&dsp, p->ecg_data->cnfg_ecg_acq);
+            qrs_init(&qrs, p->ecg_data->cnfg_ecg_acq, idx);
+            hrv_init(&hrv, HRV_WINDOW_S_DEFAULT, HRV_SPEC_S_DEFAULT);
+            sqi_init(&p->sqi, p->ecg_data->cnfg_ecg_acq, idx);
+            period_ns = PIPE_NSEC_IN_SEC /
+                        max30003_rate_sps(p->ecg_data->cnfg_ecg_acq);
+            if (p->cfg->arrow_path) {
+                p->ret[PIPE_STAGE_DSP] =
+                        ecg_arrow_open(&arrow,
+                                       p->cfg->arrow_path,
+                                       ECG_ARROW_BEATS,
+                                       p->ecg_data->cnfg_ecg_acq,
+                                       idx,
+                                       0);
+            }
+            ready = 1;
+        }
+        start_ns = __clock_ns(CLOCK_MONOTONIC);
+        for (uint32_t done = 0; done < blk.num; done += n) {
+            const int32_t *in = blk.blk->points + blk.off + done;
+            n    = MIN(blk.num - done, PIPE_DSP_CHUNK);
+            out  = p->cfg->filtered ? p->cfg->filtered + idx + done : scratch;
+            t_ns = blk.t_ns ? blk.t_ns + done * period_ns : 0;
+            dsp_process(&dsp, in, out, n);
+            __lat(LAT_DSP_FILTER, t_ns);
+            n_beats = qrs_process(&qrs, in, out, n, found, PIPE_DSP_CHUNK);
+            for (uint32_t i = 0; i < n_beats; ++i) {
+                if (hrv_add_beat(&hrv, found[i], qrs.rate)) {
+                    __log_hrv(&hrv);
+                }
+            }
+            __lat(LAT_DSP_QRS, t_ns);
+            beats += n_beats;
+            if (arrow.beats.f &&
+                (RET_UNSUCCESS(ecg_arrow_points(&arrow, in, NULL, n)) ||
+                 RET_UNSUCCESS(ecg_arrow_beats(
+                         &arrow, found, MIN(n_beats, PIPE_DSP_CHUNK))))) {
+                p->ret[PIPE_STAGE_DSP] = RET_CODE_ERROR;
+                ecg_arrow_close(&arrow);
+            }
+            n_win = sqi_process(&p->sqi, in, n, win, ARRAY_SIZE(win));
+            __lat(LAT_DSP_SQI, t_ns);
+            for (uint32_t i = 0; i < MIN(n_win, ARRAY_SIZE(win)); ++i) {
+                __quality_report(p, &win[i]);
+            }
+        }
+        STAT_ADD(STAT_DSP_NS, __clock_ns(CLOCK_MONOTONIC) - start_ns);
+        /* The reference of the range moves on to the sink */
+        __queue_push_wait(&p->q[PIPE_STAGE_DSP], PIPE_STAGE_DSP, &blk);
+    } while (1);
+    STAT_ADD(STAT_BEATS, beats);
+    LOG_INFO("%u beats detected\n", beats);
+    if (arrow.beats.f && ecg_arrow_close(&arrow) != RET_CODE_SUCCESS) {
+        p->ret[PIPE_STAGE_DSP] = RET_CODE_ERROR;
+    }
+    if (ready) {
+        hrv_spectral(&hrv);
+        __log_hrv(&hrv);
+    }
+
+    p->cpu_ns[PIPE_STAGE_DSP] = __clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    return NULL;
+}
+
+static void *__sink_thread(void *arg)
+{
+    pipe_t *     p   = (pipe_t *)arg;
+    ret_code_t   ret = RET_CODE_SUCCESS;
+    rec_writer_t w   = { 0 };
+    ecg_arrow_t  arrow = { 0 }; /* samples and events tables */
+    pipe_block_t blk;
+    uint64_t     start_ns;
+
+    pthread_setname_np(pthread_self(), "ecg_sink");
+    do {
+        __queue_pop(&p->q[PIPE_STAGE_DSP], &blk);
+        /* After errors keep draining, upstream must not stall */
+        if (ret == RET_CODE_SUCCESS && p->cfg->output_path && !w.f) {
+            ret = rec_writer_open(&w,
+                                  p->cfg->output_path,
+                                  p->ecg_data->cnfg_ecg_acq,
+                                  p->total);
+        }
+        if (ret == RET_CODE_SUCCESS && p->cfg->arrow_path &&
+            !arrow.samples.f) {
+            ret = ecg_arrow_open(&arrow,
+                                 p->cfg->arrow_path,
+                                 ECG_ARROW_SAMPLES | ECG_ARROW_EVENTS,
+                                 p->ecg_data->cnfg_ecg_acq,
+                                 blk.num ? blk.blk->first + blk.off : 0,
+                                 0);
+        }
+        if (ret == RET_CODE_SUCCESS && blk.num) {
+            start_ns = __clock_ns(CLOCK_MONOTONIC);
+            TRACE(TRACE_EV_SINK_BEGIN, blk.num, 0);
+            if (w.f) {
+                ret = rec_writer_append(&w, blk.blk->points + blk.off, blk.num);
+                STAT_INC(STAT_SINK_WRITES);
+                __lat(LAT_SINK_REC, blk.t_ns);
+            }
+            if (ret == RET_CODE_SUCCESS && arrow.samples.f) {
+                ret = ecg_arrow_points(&arrow,
+                                       blk.blk->points + blk.off,
+                                       NULL,
+                                       blk.num);
+                STAT_INC(STAT_SINK_WRITES);
+                __lat(LAT_SINK_ARROW, blk.t_ns);
+            }
+            ecg_print_points(blk.blk->points + blk.off, blk.num);
+            STAT_INC(STAT_SINK_WRITES);
+            __lat(LAT_SINK_TEXT, blk.t_ns);
+            TRACE(TRACE_EV_SINK_END, 0, 0);
+            STAT_ADD(STAT_SINK_NS, __clock_ns(CLOCK_MONOTONIC) - start_ns);
+        }
+        if (blk.num) {
+            block_release(blk.blk);
+        }
+    } while (blk.num);
+
+    if (w.f) {
+        if (rec_writer_close(&w) != RET_CODE_SUCCESS) {
+            ret = RET_CODE_ERROR;
+        } else if (ret == RET_CODE_SUCCESS) {
+            LOG_INFO("Saved %u samples to %s\n",
+                     w.hdr.words_num,
+                     p->cfg->output_path);
+        }
+    }
+    if (arrow.samples.f && ecg_arrow_close(&arrow) != RET_CODE_SUCCESS) {
+        ret = RET_CODE_ERROR;
+    }
+    p->ret[PIPE_STAGE_SINK]    = ret;
+    p->cpu_ns[PIPE_STAGE_SINK] = __clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    return NULL;
+}
+
+static void *(*const stage_fn[PIPE_STAGE_NUM])(void *) = {
+    [PIPE_STAGE_ACQ]  = __acq_thread,
+    [PIPE_STAGE_DSP]  = __dsp_thread,
+    [PIPE_STAGE_SINK] = __sink_thread,
+};
+
+/**
+ * \brief Starts stage thread with its affinity and priority. Without the
+ * permission for SCHED_FIFO the thread runs with the default policy.
+ */
+static ret_code_t __stage_start(pipe_t *const         p,
+                                const pipe_stage_id_t id,
+                                pthread_t *const      thr)
+{
+    const pipe_stage_cfg_t *scfg = &p->cfg->stage[id];
+    struct sched_param      sp   = { .sched_priority = (int)scfg->prio };
+    pthread_attr_t          attr;
+    cpu_set_t               set;
+    int                     err;
+    uint8_t                 rt = scfg->prio != 0;
+
+    do {
+        pthread_attr_init(&attr);
+        if (scfg->cpu != PIPE_CPU_ANY) {
+            CPU_ZERO(&set);
+            CPU_SET(scfg->cpu, &set);
+            pthread_attr_setaffinity_np(&attr, sizeof set, &set);
+        }
+        if (rt) {
+            pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+            pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+            pthread_attr_setschedparam(&attr, &sp);
+        }
+        err = pthread_create(thr, &attr, stage_fn[id], p);
+        pthread_attr_destroy(&attr);
+        if (err == EPERM && rt) {
+            LOG_WARN("No permission for SCHED_FIFO %u of %s stage\n",
+                     scfg->prio,
+                     stage_names[id]);
+            rt = 0;
+            continue;
+        }
+        break;
+    } while (1);
+
+    if (err) {
+        LOG_ERR("Can't start %s stage: %s\n", stage_names[id], strerror(err));
+        return RET_CODE_ERROR;
+    }
+    LOG_DBG("%s stage: cpu %d, prio %u\n",
+            stage_names[id],
+            scfg->cpu,
+            rt ? scfg->prio : 0);
+    return RET_CODE_SUCCESS;
+}
+
+ret_code_t pipe_cfg_init(pipe_cfg_t *const cfg)
+{
+    RET_ERR_ON_NULL(cfg);
+
+    memset(cfg, 0, sizeof *cfg);
+    for (uint32_t i = 0; i < PIPE_STAGE_NUM; ++i) {
+        cfg->stage[i].cpu = PIPE_CPU_ANY;
+    }
+    cfg->block_min = PIPE_BLOCK_MIN;
+    return RET_CODE_SUCCESS;
+}
+
+ret_code_t pipe_cfg_stage(pipe_cfg_t *const cfg, const char *const spec)
+{
+    ret_code_t       ret = RET_CODE_SUCCESS;
+    char             buf[PIPE_SPEC_LEN];
+    char *           name, *cpu, *prio, *end, *save = NULL;
+    pipe_stage_cfg_t scfg = { PIPE_CPU_ANY, 0 };
+    uint32_t         id;
+    long             val;
+    RET_ERR_ON_NULL(cfg);
+    RET_ERR_ON_NULL(spec);
+
+    if (strlen(spec) >= sizeof buf) {
+        ret = RET_CODE_INVALID_PARAMS;
+        goto exit;
+    }
+    strcpy(buf, spec);
+    name = strtok_r(buf, ":", &save);
+    cpu  = strtok_r(NULL, ":", &save);
+    prio = strtok_r(NULL, ":", &save);
+    for (id = 0; name && id < PIPE_STAGE_NUM; ++id) {
+        if (!strcmp(name, stage_names[id])) {
+            break;
+        }
+    }
+    if (!name || id == PIPE_STAGE_NUM || !cpu) {
+        ret = RET_CODE_INVALID_PARAMS;
+        goto exit;
+    }
+    if (strcmp(cpu, "any")) {
+        val = strtol(cpu, &end, 10);
+        if (*end || val < 0 || val >= CPU_SETSIZE ||
+            val >= sysconf(_SC_NPROCESSORS_CONF)) {
+            ret = RET_CODE_INVALID_PARAMS;
+            goto exit;
+        }
+        scfg.cpu = (int32_t)val;
+    }
+    if (prio) {
+        val = strtol(prio, &end, 10);
+        if (*end || val < 0 || val > sched_get_priority_max(SCHED_FIFO)) {
+            ret = RET_CODE_INVALID_PARAMS;
+            goto exit;
+        }
+        scfg.prio = (uint32_t)val;
+    }
+    cfg->stage[id] = scfg;
+
+exit:
+    if (ret != RET_CODE_SUCCESS) {
+        LOG_ERR("Wrong stage \"%s\", expected acq|dsp|sink:cpu|any[:prio]\n",
+                spec);
+    }
+    return ret;
+}
+
+ret_code_t pipe_run(const pipe_cfg_t *const cfg,
+                    ecg_data_t *const       ecg_data,
+                    pipe_queue_stats_t *    qstats)
+{
+    ret_code_t         ret      = RET_CODE_SUCCESS;
+    pipe_t *           p        = NULL;
+    int32_t *          data_arr = ecg_data ? ecg_data->data_arr : NULL;
+    pthread_t          thr[PIPE_STAGE_NUM];
+    uint32_t           started = 0;
+    block_pool_stats_t ps;
+    RET_ERR_ON_NULL(cfg);
+    RET_ERR_ON_NULL(ecg_data);
+
+    if (posix_memalign((void **)&p, PIPE_CACHE_LINE, sizeof *p)) {
+        return RET_CODE_ALLOC_FAIL;
+    }
+    memset(p, 0, sizeof *p);
+    p->cfg               = cfg;
+    p->ecg_data          = ecg_data;
+    p->total             = (uint32_t)ecg_data->data_len;
+    p->pool              = cfg->pool;
+    ecg_data->store_hook = __acq_publish;
+    ecg_data->store_ctx  = p;
+    if (!p->pool) {
+        p->pool = block_pool_create(PIPE_POOL_BLOCKS, PIPE_BLOCK_POINTS);
+        CHECK_PTR(p->pool, ret, RET_CODE_ALLOC_FAIL);
+    }
+    block_pool_stats(p->pool, &ps);
+    if (ps.points <= ECG_FIFO_DEPTH + cfg->block_min) {
+        LOG_ERR("Blocks of %u points are too small\n", ps.points);
+        ret = RET_CODE_INVALID_PARAMS;
+        goto exit;
+    }
+    if (cfg->quality_path) {
+        p->quality = fopen(cfg->quality_path, "w");
+        if (PTR_INVALID(p->quality)) {
+            LOG_ERR("Can't open %s\n", cfg->quality_path);
+            ret = RET_CODE_ERROR;
+            goto exit;
+        }
+        fprintf(p->quality, "sample,len");
+        for (uint32_t b = 0; b < SQI_BAND_NUM; ++b) {
+            fprintf(p->quality, ",%s", sqi_band_name(b));
+        }
+        fprintf(p->quality, ",quality\n");
+    }
+
+    /* Consumers first, the acquisition starts last */
+    for (int32_t id = PIPE_STAGE_NUM - 1; id >= 0; --id) {
+        CONTINUE_ON_SUCCESS(__stage_start(p, id, &thr[id]));
+        started |= 1 << id;
+    }
+
+exit:
+    if (ret != RET_CODE_SUCCESS && started) {
+        /* Started consumers wait for the end of the stream */
+        pipe_block_t blk = { 0 };
+        uint32_t     q   = (started & (1 << PIPE_STAGE_DSP)) ? PIPE_STAGE_ACQ :
+                                                                PIPE_STAGE_DSP;
+        __queue_push_wait(&p->q[q], q, &blk);
+    }
+    for (uint32_t id = 0; id < PIPE_STAGE_NUM; ++id) {
+        if (started & (1 << id)) {
+            pthread_join(thr[id], NULL);
+        }
+    }
+    ecg_data->store_hook = NULL;
+    ecg_data->store_ctx  = NULL;
+    /* Points stayed in the blocks, data_ID counts all of them */
+    ecg_data->data_arr = data_arr;
+    ecg_data->data_len = (int32_t)p->total;
+    ecg_data->data_ID  = p->acquired;
+    if (p->quality) {
+        fclose(p->quality);
+    }
+    if (p->pool && block_pool_stats(p->pool, &ps) == RET_CODE_SUCCESS) {
+        LOG_INFO("Pool: %u blocks of %u points, %llu taken, min free %u, "
+                 "%llu empty\n",
+                 ps.blocks,
+                 ps.points,
+                 (unsigned long long)ps.gets,
+                 ps.min_free,
+                 (unsigned long long)ps.empty);
+    }
+    if (p->pool && !cfg->pool) {
+        block_pool_destroy(&p->pool);
+    }
+
+    for (uint32_t i = 0; ret == RET_CODE_SUCCESS && i < PIPE_QUEUE_NUM; ++i) {
+        pipe_queue_t *     q = &p->q[i];
+        pipe_queue_stats_t s = {
+            .blocks     = q->pops,
+            .full       = q->full,
+            .max_depth  = q->max_depth,
+            .mean_depth = q->pops ? (double)q->depth_sum / q->pops : 0,
+        };
+        LOG_INFO("Queue %s->%s: %llu blocks, depth max %u/%u mean %.2f, "
+                 "%llu full\n",
+                 stage_names[i],
+                 stage_names[i + 1],
+                 (unsigned long long)s.blocks,
+                 s.max_depth,
+                 PIPE_QUEUE_LEN,
+                 s.mean_depth,
+                 (unsigned long long)s.full);
+        if (qstats) {
+            qstats[i] = s;
+        }
+    }
+    for (uint32_t id = 0; ret == RET_CODE_SUCCESS && id < PIPE_STAGE_NUM;
+         ++id) {
+        LOG_INFO("Stage %s: CPU %.3f ms\n",
+                 stage_names[id],
+                 p->cpu_ns[id] / 1e6);
+    }
+    for (uint32_t id = 0; ret == RET_CODE_SUCCESS && id < LAT_NUM; ++id) {
+        stats_lat_t lat;
+        if (stats_lat_get(id, &lat) != RET_CODE_SUCCESS || !lat.count) {
+            continue;
+        }
+        LOG_INFO("Latency %s: p50 %.2f ms, p99 %.2f ms, p99.9 %.2f ms, "
+                 "max %.2f ms\n",
+                 stats_lat_name(id),
+                 lat.p50_ns / 1e6,
+                 lat.p99_ns / 1e6,
+                 lat.p999_ns / 1e6,
+                 lat.max_ns / 1e6);
+    }
+    for (uint32_t id = 0; ret == RET_CODE_SUCCESS && id < PIPE_STAGE_NUM;
+         ++id) {
+        ret = p->ret[id];
+    }
+    free(p);
+    return ret;
+}
+
+static void *__queue_consumer(void *arg)
+{
+    pipe_queue_t *q = (pipe_queue_t *)arg;
+    pipe_block_t  blk;
+
+    pthread_setname_np(pthread_self(), "ecg_queue");
+    do {
+        __queue_pop(q, &blk);
+    } while (blk.num);
+    return NULL;
+}
+
+ret_code_t pipe_queue_run(const uint64_t ops, pipe_queue_stats_t *qstats)
+{
+    pipe_queue_t *q   = NULL;
+    pipe_block_t  blk = { 0 };
+    pthread_t     consumer;
+
+    if (posix_memalign((void **)&q, PIPE_CACHE_LINE, sizeof *q)) {
+        return RET_CODE_ALLOC_FAIL;
+    }
+    memset(q, 0, sizeof *q);
+    if (pthread_create(&consumer, NULL, __queue_consumer, q)) {
+        free(q);
+        return RET_CODE_ERROR;
+    }
+    /* Full queue yields instead of sleeping, the back-off of
+     * __queue_push_wait() would be measured rather than the queue */
+    blk.num = 1;
+    for (uint64_t i = 0; i < ops; ++i) {
+        blk.off = (uint32_t)i;
+        while (__queue_push(q, PIPE_STAGE_ACQ, &blk) != RET_CODE_SUCCESS) {
+            sched_yield();
+        }
+    }
+    blk.num = 0;
+    __queue_push_wait(q, PIPE_STAGE_ACQ, &blk);
+    pthread_join(consumer, NULL);
+
+    if (qstats) {
+        qstats->blocks     = q->pops;
+        qstats->full       = q->full;
+        qstats->max_depth  = q->max_depth;
+        qstats->mean_depth = q->pops ? (double)q->depth_sum / q->pops : 0;
+    }
+    free(q);
+    return RET_CODE_SUCCESS;
+}
@@ -0,0 +1,97 @@
+/**
+ * \file poll_sched.c
+ *
+ * \brief FIFO polling scheduler
+ */
+#include <time.h>
+#include <errno.h>
+#include "MAX30003.h"
+#include "poll_sched.h"
+#include "stats.h"
+#include "common_check.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE POLL_PRINT_EN
+#define DBG_TAG      "poll_sched.c"
+#include "Log_dbg.h"
+
+#define POLL_NSEC_IN_SEC 1000000000ULL
+#define POLL_GAIN_SHIFT  2 /* interval moves 1/4 of the error per poll */
+
+static uint64_t __now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * POLL_NSEC_IN_SEC + ts.tv_nsec;
+}
+
+ret_code_t poll_sched_init(poll_sched_t *const ps,
+                           const uint32_t      cnfg_ecg,
+                           const uint32_t      mngr_int)
+{
+    uint32_t efit;
+    RET_ERR_ON_NULL(ps);
+
+    efit          = ((mngr_int & EFIT_1_RESET) >> EFIT_SHIFT) + 1;
+    ps->cnfg_ecg  = cnfg_ecg;
+    ps->mngr_int  = mngr_int;
+    ps->sample_ns = POLL_NSEC_IN_SEC / max30003_rate_sps(cnfg_ecg);
+    /* Leave headroom above EFIT, a late wake-up must not overflow */
+    ps->target = efit < ECG_FIFO_DEPTH - POLL_HEADROOM ?
+                         efit :
+                         ECG_FIFO_DEPTH - POLL_HEADROOM;
+    ps->near_full   = (ps->target + ECG_FIFO_DEPTH) / 2;
+    ps->min_ns      = ps->sample_ns / POLL_MIN_DIV;
+    ps->max_ns      = ps->sample_ns * ps->near_full;
+    ps->interval_ns = ps->sample_ns * ps->target;
+    ps->next_ns     = __now_ns() + ps->interval_ns;
+    LOG_DBG("Polling every %llu us, %u words per poll\n",
+            (unsigned long long)ps->interval_ns / 1000,
+            ps->target);
+    return RET_CODE_SUCCESS;
+}
+
+ret_code_t poll_sched_wait(poll_sched_t *const ps)
+{
+    struct timespec ts;
+    int             err;
+    RET_ERR_ON_NULL(ps);
+
+    ts.tv_sec  = ps->next_ns / POLL_NSEC_IN_SEC;
+    ts.tv_nsec = ps->next_ns % POLL_NSEC_IN_SEC;
+    do {
+        err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    } while (err == EINTR);
+    STAT_INC(STAT_POLL_WAKEUPS);
+    return err ? RET_CODE_ERROR : RET_CODE_SUCCESS;
+}
+
+ret_code_t poll_sched_update(poll_sched_t *const ps,
+                             const uint32_t      words,
+                             const uint8_t       ovf)
+{
+    uint64_t now;
+    RET_ERR_ON_NULL(ps);
+
+    now = __now_ns();
+    if (ovf || words >= ps->near_full) {
+        ps->interval_ns /= 2;
+    } else if (!words) {
+        /* Early by less than a sample, retry at half a sample period */
+        ps->interval_ns += ps->sample_ns >> POLL_GAIN_SHIFT;
+        ps->next_ns = now + ps->sample_ns / 2;
+    } else {
+        int64_t err = (int64_t)(ps->interval_ns * ps->target / words) -
+                      (int64_t)ps->interval_ns;
+        ps->interval_ns += err / (1 << POLL_GAIN_SHIFT);
+    }
+    if (ps->interval_ns < ps->min_ns) {
+        ps->interval_ns = ps->min_ns;
+    } else if (ps->interval_ns > ps->max_ns) {
+        ps->interval_ns = ps->max_ns;
+    }
+    if (words) {
+        ps->next_ns = now + ps->interval_ns;
+    }
+    return RET_CODE_SUCCESS;
+}
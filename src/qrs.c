@@ -0,0 +1,134 @@
+/**
+ * \file qrs.c
+ *
+ * \brief QRS detection
+ */
+#include <string.h>
+#include "qrs.h"
+#include "common_check.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE DSP_PRINT_EN
+#define DBG_TAG      "qrs.c"
+#include "Log_dbg.h"
+
+#define QRS_MS_IN_SEC   1000
+#define QRS_LEVEL_SHIFT 3    /* levels move 1/8 towards a new peak */
+#define QRS_QUIET_MS    1500 /* no beat for longer lowers signal level */
+
+ret_code_t qrs_init(qrs_t *const   qrs,
+                    const uint32_t cnfg_ecg,
+                    const uint64_t idx)
+{
+    RET_ERR_ON_NULL(qrs);
+
+    memset(qrs, 0, sizeof *qrs);
+    qrs->rate       = max30003_rate_sps(cnfg_ecg);
+    qrs->window     = qrs->rate * QRS_WINDOW_MS / QRS_MS_IN_SEC;
+    qrs->window     = MIN(qrs->window, QRS_WINDOW_MAX);
+    qrs->refractory = qrs->rate * QRS_REFRACTORY_MS / QRS_MS_IN_SEC;
+    qrs->learn      = qrs->rate * QRS_LEARN_MS / QRS_MS_IN_SEC;
+    qrs->idx        = idx;
+    qrs->last_beat  = idx;
+    return RET_CODE_SUCCESS;
+}
+
+/**
+ * \brief Moves the level 1/8 towards the peak
+ */
+static inline uint64_t __level(const uint64_t level, const uint64_t peak)
+{
+    return level - (level >> QRS_LEVEL_SHIFT) + (peak >> QRS_LEVEL_SHIFT);
+}
+
+/**
+ * \brief Classifies the episode which fell below half of the threshold
+ * \retval 1 - beat
+ */
+static uint8_t __episode_end(qrs_t *const qrs)
+{
+    if (qrs->beat_seen && qrs->ep_idx - qrs->last_beat < qrs->refractory) {
+        qrs->npk = __level(qrs->npk, qrs->ep_max);
+        return 0;
+    }
+    qrs->spk       = __level(qrs->spk, qrs->ep_max);
+    qrs->last_beat = qrs->ep_idx;
+    qrs->beat_seen = 1;
+    return 1;
+}
+
+uint32_t qrs_process(qrs_t *const         qrs,
+                     const int32_t *const points,
+                     const int32_t *const filtered,
+                     const uint32_t       num,
+                     uint64_t *const      beats,
+                     const uint32_t       max_beats)
+{
+    uint32_t found = 0;
+    uint64_t sq, th, delay;
+    int64_t  d;
+
+    for (uint32_t i = 0; i < num; ++i) {
+        if (ECG_IS_MARKER(points[i])) {
+            /* New rate or gain, levels have to be learnt again */
+            qrs_init(qrs, ECG_MARKER_CNFG(points[i]), qrs->idx + 1);
+            continue;
+        }
+        d       = (int64_t)filtered[i] - qrs->x2;
+        qrs->x2 = qrs->x1;
+        qrs->x1 = filtered[i];
+        sq      = MIN((uint64_t)(d * d) >> QRS_SQUARE_SHIFT, UINT32_MAX);
+        qrs->integ += sq - qrs->sq[qrs->sq_pos];
+        qrs->sq[qrs->sq_pos] = (uint32_t)sq;
+        qrs->sq_pos          = (qrs->sq_pos + 1) % qrs->window;
+
+        if (qrs->learn) {
+            /* Start from the highest peak and the average level */
+            qrs->learn--;
+            qrs->spk = qrs->integ > qrs->spk ? qrs->integ : qrs->spk;
+            qrs->npk = __level(qrs->npk, qrs->integ);
+            if (!qrs->learn) {
+                qrs->spk >>= 1;
+            }
+            qrs->idx++;
+            continue;
+        }
+
+        th = qrs->npk;
+        if (qrs->spk > qrs->npk) {
+            th += (qrs->spk - qrs->npk) >> 2;
+        }
+        if (!qrs->above) {
+            if (qrs->integ > th) {
+                qrs->above  = 1;
+                qrs->ep_max = qrs->integ;
+                qrs->ep_idx = qrs->idx;
+            } else if (qrs->idx - qrs->last_beat >
+                       qrs->rate * QRS_QUIET_MS / QRS_MS_IN_SEC) {
+                /* Missed beats, the signal level was too high */
+                qrs->spk       = (qrs->spk + qrs->npk) >> 1;
+                qrs->last_beat = qrs->idx - qrs->refractory;
+            }
+        } else {
+            if (qrs->integ > qrs->ep_max) {
+                qrs->ep_max = qrs->integ;
+                qrs->ep_idx = qrs->idx;
+            }
+            if (qrs->integ < th >> 1) {
+                qrs->above = 0;
+                if (__episode_end(qrs)) {
+                    /* R wave is in the middle of the integration window */
+                    delay = qrs->window / 2 + 1;
+                    if (beats && found < max_beats) {
+                        beats[found] = qrs->ep_idx > delay ?
+                                               qrs->ep_idx - delay :
+                                               0;
+                    }
+                    found++;
+                }
+            }
+        }
+        qrs->idx++;
+    }
+    return found;
+}
@@ -0,0 +1,323 @@
+/**
+ * \file recording.c
+ *
+ * \brief Binary ECG recordings and legacy ecg_print_data() text output
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "recording.h"
+#include "common_check.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE REC_PRINT_EN
+#define DBG_TAG      "recording.c"
+#include "Log_dbg.h"
+
+#define REC_TEXT_LINE_LEN   64
+#define REC_TEXT_INIT_WORDS 4096
+#define REC_WRITE_CHUNK     256 /* words converted per fwrite() */
+
+#define REC_SYNTH_BEAT_S    (60.0 / 72)
+#define REC_SYNTH_AMPLITUDE 20000.0 /* ADC counts of the R wave */
+
+/**
+ * \brief Gaussian waves of a synthetic beat: center [s], width [s], amplitude
+ */
+static const struct {
+    double center;
+    double width;
+    double amp;
+} synth_waves[] = {
+    { 0.20, 0.025, 0.15 },  /* P */
+    { 0.36, 0.010, -0.10 }, /* Q */
+    { 0.38, 0.012, 1.00 },  /* R */
+    { 0.40, 0.010, -0.25 }, /* S */
+    { 0.62, 0.040, 0.30 },  /* T */
+};
+
+/**
+ * \brief Parses the text output of ecg_print_data(), lines which are not
+ * a plain number (log output) are skipped
+ */
+static ret_code_t __load_text(rec_t *const rec, FILE *const f)
+{
+    char     line[REC_TEXT_LINE_LEN];
+    uint32_t cap = REC_TEXT_INIT_WORDS;
+    char *   end = NULL;
+
+    rec->words = (uint32_t *)malloc(cap * sizeof(uint32_t));
+    if (PTR_INVALID(rec->words)) {
+        return RET_CODE_ALLOC_FAIL;
+    }
+
+    while (fgets(line, sizeof line, f)) {
+        long point = strtol(line, &end, 10);
+        if (end == line || (*end != '\n' && *end != '\r' && *end != '\0')) {
+            continue;
+        }
+        if (rec->words_num == cap) {
+            uint32_t *tmp;
+            cap *= 2;
+            tmp = (uint32_t *)realloc(rec->words, cap * sizeof(uint32_t));
+            if (PTR_INVALID(tmp)) {
+                return RET_CODE_ALLOC_FAIL;
+            }
+            rec->words = tmp;
+        }
+        rec->words[rec->words_num++] = ECG_IS_MARKER(point) ?
+                                               REC_MARKER_TO_WORD(point) :
+                                               REC_LEGACY_TO_WORD(point);
+    }
+    rec->hdr.words_num = rec->words_num;
+    return RET_CODE_SUCCESS;
+}
+
+ret_code_t rec_load(rec_t *const rec, const char *const path)
+{
+    ret_code_t ret = RET_CODE_SUCCESS;
+    FILE *     f   = NULL;
+    RET_ERR_ON_NULL(rec);
+    RET_ERR_ON_NULL(path);
+
+    memset(rec, 0, sizeof(*rec));
+    f = fopen(path, "rb");
+    if (PTR_INVALID(f)) {
+        LOG_ERR("Can't open recording %s\n", path);
+        ret = RET_CODE_ERROR;
+        goto exit;
+    }
+
+    if (fread(&rec->hdr, sizeof rec->hdr, 1, f) != 1 ||
+        rec->hdr.magic != REC_MAGIC) {
+        /* Not a binary recording - parse as ecg_print_data() output */
+        memset(&rec->hdr, 0, sizeof rec->hdr);
+        rewind(f);
+        ret = __load_text(rec, f);
+        goto exit;
+    }
+
+    if (rec->hdr.version != REC_VERSION) {
+        LOG_ERR("Unsupported recording version %d\n", rec->hdr.version);
+        ret = RET_CODE_INVALID_PARAMS;
+        goto exit;
+    }
+
+    rec->words = (uint32_t *)malloc(rec->hdr.words_num * sizeof(uint32_t));
+    if (PTR_INVALID(rec->words)) {
+        ret = RET_CODE_ALLOC_FAIL;
+        goto exit;
+    }
+    rec->words_num = fread(rec->words, sizeof(uint32_t), rec->hdr.words_num, f);
+    if (rec->words_num != rec->hdr.words_num) {
+        LOG_ERR("Recording %s is truncated, %u of %u samples\n",
+                path,
+                rec->words_num,
+                rec->hdr.words_num);
+        ret = RET_CODE_ERROR;
+    }
+
+exit:
+    if (f) {
+        fclose(f);
+    }
+    if (RET_UNSUCCESS(ret)) {
+        rec_free(rec);
+    } else {
+        LOG_INFO("Loaded %u samples from %s\n", rec->words_num, path);
+    }
+    return ret;
+}
+
+ret_code_t rec_synth(rec_t *const   rec,
+                     const uint32_t sample_rate,
+                     const uint32_t seconds)
+{
+    RET_ERR_ON_NULL(rec);
+    if (!sample_rate || !seconds) {
+        return RET_CODE_INVALID_PARAMS;
+    }
+
+    memset(rec, 0, sizeof(*rec));
+    rec->words_num = sample_rate * seconds;
+    rec->words     = (uint32_t *)malloc(rec->words_num * sizeof(uint32_t));
+    if (PTR_INVALID(rec->words)) {
+        rec->words_num = 0;
+        return RET_CODE_ALLOC_FAIL;
+    }
+
+    for (uint32_t i = 0; i < rec->words_num; ++i) {
+        double t   = fmod((double)i / sample_rate, REC_SYNTH_BEAT_S);
+        double val = 0;
+        for (uint32_t w = 0; w < ARRAY_SIZE(synth_waves); ++w) {
+            double d = (t - synth_waves[w].center) / synth_waves[w].width;
+            val += synth_waves[w].amp * exp(-0.5 * d * d);
+        }
+        rec->words[i] = ((uint32_t)lrint(val * REC_SYNTH_AMPLITUDE) &
+                         REC_SAMPLE_MASK)
+                        << ECG_FIFO_DATA_SHIFT;
+    }
+
+    rec->hdr.magic       = REC_MAGIC;
+    rec->hdr.version     = REC_VERSION;
+    rec->hdr.sample_rate = sample_rate;
+    rec->hdr.words_num   = rec->words_num;
+    return RET_CODE_SUCCESS;
+}
+
+ret_code_t rec_free(rec_t *const rec)
+{
+    RET_ERR_ON_NULL(rec);
+    free(rec->words);
+    rec->words     = NULL;
+    rec->words_num = 0;
+    return RET_CODE_SUCCESS;
+}
+
+ret_code_t rec_writer_open(rec_writer_t *const w,
+                           const char *const   path,
+                           const uint32_t      cnfg_ecg,
+                           const uint32_t      words_num)
+{
+    ret_code_t ret = RET_CODE_SUCCESS;
+    RET_ERR_ON_NULL(w);
+    RET_ERR_ON_NULL(path);
+
+    memset(w, 0, sizeof *w);
+    w->f = fopen(path, "wb");
+    if (PTR_INVALID(w->f)) {
+        LOG_ERR("Can't create recording %s\n", path);
+        ret = RET_CODE_ERROR;
+        goto exit;
+    }
+
+    w->hdr.magic       = REC_MAGIC;
+    w->hdr.version     = REC_VERSION;
+    w->hdr.cnfg_ecg    = cnfg_ecg;
+    w->hdr.sample_rate = max30003_rate_sps(cnfg_ecg);
+    env_init(&w->env, w->hdr.sample_rate);
+    CONTINUE_ON_SUCCESS(env_reserve(&w->env, words_num));
+    w->env_path = (char *)malloc(strlen(path) + sizeof ENV_SUFFIX);
+    if (PTR_INVALID(w->env_path)) {
+        ret = RET_CODE_ALLOC_FAIL;
+        goto exit;
+    }
+    sprintf(w->env_path, "%s" ENV_SUFFIX, path);
+    /* words_num stays 0 until the recording is closed */
+    if (fwrite(&w->hdr, sizeof w->hdr, 1, w->f) != 1) {
+        ret = RET_CODE_ERROR;
+    }
+exit:
+    if (RET_UNSUCCESS(ret) && w->f) {
+        fclose(w->f);
+        w->f = NULL;
+        env_free(&w->env);
+        free(w->env_path);
+        w->env_path = NULL;
+    }
+    return ret;
+}
+
+ret_code_t rec_writer_append(rec_writer_t *const  w,
+                             const int32_t *const points,
+                             const uint32_t       num)
+{
+    ret_code_t ret = RET_CODE_SUCCESS;
+    uint32_t   words[REC_WRITE_CHUNK];
+    uint32_t   n;
+    RET_ERR_ON_NULL(w);
+    RET_ERR_ON_NULL(points);
+    RET_ERR_ON_NULL(w->f);
+
+    for (uint32_t done = 0; done < num; done += n) {
+        n = MIN(num - done, REC_WRITE_CHUNK);
+        for (uint32_t i = 0; i < n; ++i) {
+            int32_t point = points[done + i];
+            words[i]      = ECG_IS_MARKER(point) ? REC_MARKER_TO_WORD(point) :
+                                                   REC_LEGACY_TO_WORD(point);
+        }
+        if (fwrite(words, sizeof words[0], n, w->f) != n) {
+            ret = RET_CODE_ERROR;
+            goto exit;
+        }
+        w->hdr.words_num += n;
+        CONTINUE_ON_SUCCESS(env_append(&w->env, points + done, n));
+    }
+exit:
+    return ret;
+}
+
+ret_code_t rec_writer_close(rec_writer_t *const w)
+{
+    ret_code_t ret = RET_CODE_SUCCESS;
+    RET_ERR_ON_NULL(w);
+    RET_ERR_ON_NULL(w->f);
+
+    if (fseek(w->f, 0, SEEK_SET) ||
+        fwrite(&w->hdr, sizeof w->hdr, 1, w->f) != 1) {
+        ret = RET_CODE_ERROR;
+    }
+    if (fclose(w->f)) {
+        ret = RET_CODE_ERROR;
+    }
+    w->f = NULL;
+    if (w->env_path && env_save(&w->env, w->env_path) != RET_CODE_SUCCESS) {
+        ret = RET_CODE_ERROR;
+    }
+    env_free(&w->env);
+    free(w->env_path);
+    w->env_path = NULL;
+    return ret;
+}
+
+ret_code_t rec_envelope(const rec_t *const rec, env_t *const env)
+{
+    ret_code_t ret = RET_CODE_SUCCESS;
+    int32_t    points[REC_WRITE_CHUNK];
+    uint32_t   n;
+    RET_ERR_ON_NULL(rec);
+    RET_ERR_ON_NULL(env);
+
+    env_init(env, rec->hdr.sample_rate);
+    for (uint32_t done = 0; done < rec->words_num; done += n) {
+        n = MIN(rec->words_num - done, REC_WRITE_CHUNK);
+        for (uint32_t i = 0; i < n; ++i) {
+            points[i] = REC_WORD_TO_POINT(rec->words[done + i]);
+        }
+        CONTINUE_ON_SUCCESS(env_append(env, points, n));
+    }
+exit:
+    if (RET_UNSUCCESS(ret)) {
+        env_free(env);
+    }
+    return ret;
+}
+
+ret_code_t rec_save(const char *const path, const ecg_data_t *const ecg_data)
+{
+    ret_code_t   ret = RET_CODE_SUCCESS;
+    rec_writer_t w;
+    RET_ERR_ON_NULL(path);
+    RET_ERR_ON_NULL(ecg_data);
+
+    /* Header holds the configuration of the first samples */
+    ret = rec_writer_open(&w,
+                          path,
+                          ecg_data->cnfg_ecg_acq ? ecg_data->cnfg_ecg_acq :
+                                                   ecg_data->cnfg_ecg,
+                          ecg_data->data_ID);
+    if (ret != RET_CODE_SUCCESS) {
+        goto exit;
+    }
+    ret = rec_writer_append(&w, ecg_data->data_arr, ecg_data->data_ID);
+    if (rec_writer_close(&w) != RET_CODE_SUCCESS) {
+        ret = RET_CODE_ERROR;
+    }
+    if (ret == RET_CODE_SUCCESS) {
+        LOG_INFO("Saved %u samples to %s\n", ecg_data->data_ID, path);
+    }
+
+exit:
+    return ret;
+}
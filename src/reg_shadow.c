@@ -0,0 +1,182 @@
+/**
+ * \file reg_shadow.c
+ *
+ * \brief In-memory mirror of MAX30003 registers with dirty tracking
+ */
+#include <string.h>
+#include "reg_shadow.h"
+#include "common_check.h"
+#include "stats.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE SHADOW_PRINT_EN
+#define DBG_TAG      "reg_shadow.c"
+#include "Log_dbg.h"
+
+#define REG_SHADOW_VAL_MASK 0xFFFFFF
+
+reg_shadow_t max30003_shadow;
+
+/**
+ * \brief Addresses of the registers in the mask, ascending
+ */
+static uint32_t __addrs(const uint64_t mask, uint8_t *const addrs)
+{
+    uint32_t num = 0;
+    for (uint8_t addr = 0; addr < MAX30003_REGS_NUM; ++addr) {
+        if (mask & REG_BIT(addr)) {
+            addrs[num++] = addr;
+        }
+    }
+    return num;
+}
+
+ret_code_t reg_shadow_invalidate(reg_shadow_t *const sh)
+{
+    RET_ERR_ON_NULL(sh);
+    sh->valid = 0;
+    sh->dirty = sh->used;
+    return RET_CODE_SUCCESS;
+}
+
+ret_code_t reg_shadow_set(reg_shadow_t *const sh,
+                          const uint8_t       addr,
+                          const uint32_t      val)
+{
+    RET_ERR_ON_NULL(sh);
+    if (addr >= MAX30003_REGS_NUM ||
+        !(REG_SHADOW_CNFG_MASK & REG_BIT(addr))) {
+        return RET_CODE_INVALID_PARAMS;
+    }
+    if (sh->val[addr] != (val & REG_SHADOW_VAL_MASK) ||
+        !(sh->valid & REG_BIT(addr))) {
+        sh->val[addr] = val & REG_SHADOW_VAL_MASK;
+        sh->dirty |= REG_BIT(addr);
+    }
+    sh->used |= REG_BIT(addr);
+    return RET_CODE_SUCCESS;
+}
+
+ret_code_t reg_shadow_set_bits(reg_shadow_t *const sh,
+                               const uint8_t       addr,
+                               const uint32_t      mask)
+{
+    uint32_t val;
+    RET_ERR_ON_NULL(sh);
+    val = reg_shadow_get(sh, addr);
+    BITMASK_SET(val, mask);
+    return reg_shadow_set(sh, addr, val);
+}
+
+ret_code_t reg_shadow_clear_bits(reg_shadow_t *const sh,
+                                 const uint8_t       addr,
+                                 const uint32_t      mask)
+{
+    uint32_t val;
+    RET_ERR_ON_NULL(sh);
+    val = reg_shadow_get(sh, addr);
+    BITMASK_CLEAR(val, mask);
+    return reg_shadow_set(sh, addr, val);
+}
+
+ret_code_t reg_shadow_set_field(reg_shadow_t *const sh,
+                                const uint8_t       addr,
+                                const uint32_t      mask,
+                                const uint32_t      val)
+{
+    uint32_t reg;
+    RET_ERR_ON_NULL(sh);
+    reg = reg_shadow_get(sh, addr);
+    BITMASK_CLEAR(reg, mask);
+    BITMASK_SET(reg, val & mask);
+    return reg_shadow_set(sh, addr, reg);
+}
+
+uint32_t reg_shadow_get(const reg_shadow_t *const sh, const uint8_t addr)
+{
+    return addr < MAX30003_REGS_NUM ? sh->val[addr] : 0;
+}
+
+ret_code_t reg_shadow_flush(reg_shadow_t *const sh, spi_t *const spi)
+{
+    ret_code_t ret = RET_CODE_SUCCESS;
+    uint8_t    addrs[MAX30003_REGS_NUM];
+    uint32_t   vals[MAX30003_REGS_NUM];
+    uint32_t   num;
+    RET_ERR_ON_NULL(sh);
+
+    num = __addrs(sh->dirty, addrs);
+    for (uint32_t i = 0; i < num; ++i) {
+        vals[i] = sh->val[addrs[i]];
+    }
+    CONTINUE_ON_SUCCESS(max30003_write_regs(spi, addrs, vals, num));
+    sh->valid |= sh->dirty;
+    sh->dirty = 0;
+    LOG_DBG("%u registers flushed\n", num);
+exit:
+    return ret;
+}
+
+ret_code_t reg_shadow_load(reg_shadow_t *const sh,
+                           spi_t *const        spi,
+                           const uint64_t      mask)
+{
+    ret_code_t ret = RET_CODE_SUCCESS;
+    uint8_t    addrs[MAX30003_REGS_NUM];
+    uint32_t   vals[MAX30003_REGS_NUM];
+    uint32_t   num;
+    RET_ERR_ON_NULL(sh);
+
+    num = __addrs(mask & REG_SHADOW_CNFG_MASK, addrs);
+    CONTINUE_ON_SUCCESS(max30003_read_regs(spi, addrs, vals, num));
+    for (uint32_t i = 0; i < num; ++i) {
+        sh->val[addrs[i]] = vals[i];
+        sh->valid |= REG_BIT(addrs[i]);
+        sh->dirty &= ~REG_BIT(addrs[i]);
+    }
+exit:
+    return ret;
+}
+
+ret_code_t reg_shadow_verify(reg_shadow_t *const sh,
+                             spi_t *const        spi,
+                             uint64_t *const     mismatch)
+{
+    ret_code_t ret  = RET_CODE_SUCCESS;
+    uint64_t   diff = 0;
+    uint8_t    addrs[MAX30003_REGS_NUM];
+    uint32_t   vals[MAX30003_REGS_NUM];
+    uint32_t   num;
+    RET_ERR_ON_NULL(sh);
+
+    num = __addrs(sh->valid & ~sh->dirty & REG_SHADOW_CNFG_MASK, addrs);
+    CONTINUE_ON_SUCCESS(max30003_read_regs(spi, addrs, vals, num));
+    for (uint32_t i = 0; i < num; ++i) {
+        if (vals[i] != sh->val[addrs[i]]) {
+            diff |= REG_BIT(addrs[i]);
+        }
+    }
+    if (diff) {
+        LOG_ERR("Registers mismatch 0x%llx, chip reset?\n",
+                (unsigned long long)diff);
+        STAT_INC(STAT_REG_MISMATCH);
+        sh->valid &= ~diff;
+        sh->dirty |= diff;
+        ret = RET_CODE_CRC_MISMATCH;
+    }
+exit:
+    if (mismatch) {
+        *mismatch = diff;
+    }
+    return ret;
+}
+
+ret_code_t reg_shadow_tick(reg_shadow_t *const sh, spi_t *const spi)
+{
+    RET_ERR_ON_NULL(sh);
+    if (!sh->verify_period || ++sh->ticks < sh->verify_period) {
+        return RET_CODE_SUCCESS;
+    }
+    sh->ticks = 0;
+    return reg_shadow_verify(sh, spi, NULL);
+}
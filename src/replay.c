@@ -0,0 +1,420 @@
+/**
+ * \file replay.c
+ *
+ * \brief Replay backend for the SPI transport. Models the MAX30003 on the
+ * byte level: command byte, 24 bit register shift, ECG FIFO with EOF/empty/
+ * overflow tags and STATUS flags, so the driver code runs unchanged.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "replay.h"
+#include "recording.h"
+#include "MAX30003.h"
+#include "common_check.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE REPLAY_PRINT_EN
+#define DBG_TAG      "replay.c"
+#include "Log_dbg.h"
+
+#define REPLAY_REGS_NUM    (RTOR + 1)
+#define REPLAY_REG_MASK    0xFFFFFF
+#define REPLAY_INFO_VAL    0x500000 /* MAX30003 part id, revision 0 */
+#define REPLAY_PTAG_NONE   THREE_LSB_BITS_MASK
+#define REPLAY_NSEC_IN_SEC 1000000000ULL
+
+#define REPLAY_EMPTY_WORD \
+    ((ETAG_EMPTY << ECG_FIFO_ETAG_SHIFT) | REPLAY_PTAG_NONE)
+#define REPLAY_OVF_WORD \
+    ((ETAG_OVERFLOW << ECG_FIFO_ETAG_SHIFT) | REPLAY_PTAG_NONE)
+
+struct replay_ {
+    rec_t    rec;
+    uint32_t rec_pos;
+    uint32_t speed;
+    uint32_t sclk_max; /* board clock limit, 0 - none */
+    uint32_t regs[REPLAY_REGS_NUM];
+    /* ECG FIFO model */
+    uint32_t fifo[ECG_FIFO_DEPTH];
+    uint32_t fifo_head;
+    uint32_t fifo_cnt;
+    uint8_t  ovf; /* set on overflow, cleared by FIFO_RST or SYNCH */
+    /* sample clock */
+    uint64_t start_ns;
+    uint64_t produced; /* since start_ns */
+    uint64_t produced_total;
+    uint64_t lost;
+    uint64_t dropped; /* unread samples of FIFO_RST, SYNCH and SW_RST */
+    /* SPI transaction state */
+    uint8_t  in_trans;
+    uint8_t  cmd;
+    uint8_t  byte_idx;
+    uint8_t  load_next;
+    uint32_t shift;
+};
+
+/* Power-on reset values of MAX30003 registers */
+static const struct {
+    uint8_t  addr;
+    uint32_t val;
+} por_vals[] = {
+    { EN_INT, 0x000003 },     { EN_INT2, 0x000003 },
+    { MNGR_INT, 0x7B0004 },   { MNGR_DYN, 0x3F0000 },
+    { INFO, REPLAY_INFO_VAL }, { CNFG_GEN, 0x080004 },
+    { CNFG_CAL, 0x720000 },   { CNFG_EMUX, 0x0B0000 },
+    { CNFG_ECG, 0x805000 },   { CNFG_RTOR1, 0x3FC600 },
+    { CNFG_RTOR2, 0x202400 },
+};
+
+static uint64_t __now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * REPLAY_NSEC_IN_SEC + ts.tv_nsec;
+}
+
+static void __fifo_reset(replay_t *const r)
+{
+    r->dropped += r->fifo_cnt;
+    r->fifo_head = 0;
+    r->fifo_cnt  = 0;
+    r->ovf       = 0;
+}
+
+static void __clock_restart(replay_t *const r)
+{
+    r->start_ns = __now_ns();
+    r->produced = 0;
+}
+
+static void __chip_reset(replay_t *const r)
+{
+    memset(r->regs, 0, sizeof r->regs);
+    for (uint32_t i = 0; i < ARRAY_SIZE(por_vals); ++i) {
+        r->regs[por_vals[i].addr] = por_vals[i].val;
+    }
+    __fifo_reset(r);
+    __clock_restart(r);
+}
+
+/**
+ * \brief Next sample of the recording, gaps (empty and overflow words)
+ * recorded from the chip and configuration markers are skipped, recording
+ * is looped
+ */
+static uint32_t __rec_next(replay_t *const r)
+{
+    uint32_t word, etag;
+    do {
+        word       = r->rec.words[r->rec_pos];
+        r->rec_pos = (r->rec_pos + 1) % r->rec.words_num;
+        etag       = (word & ECG_FIFO_ETAG_MASK) >> ECG_FIFO_ETAG_SHIFT;
+    } while (etag == ETAG_EMPTY || etag == ETAG_OVERFLOW ||
+             etag == ETAG_CNFG);
+
+    /* EOF tags are assigned on the read out, keep fast mode flag only */
+    word &= ~(ECG_FIFO_ETAG_MASK);
+    if (etag == ETAG_FAST || etag == ETAG_FAST_EOF) {
+        word |= ETAG_FAST << ECG_FIFO_ETAG_SHIFT;
+    }
+    return word & REPLAY_REG_MASK;
+}
+
+static void __produce(replay_t *const r)
+{
+    uint32_t word = __rec_next(r);
+    r->produced_total++;
+    if (r->ovf || r->fifo_cnt == ECG_FIFO_DEPTH) {
+        r->ovf = 1;
+        r->lost++;
+        return;
+    }
+    r->fifo[(r->fifo_head + r->fifo_cnt) % ECG_FIFO_DEPTH] = word;
+    r->fifo_cnt++;
+}
+
+/**
+ * \brief Moves the modelled sample clock to the current time
+ */
+static void __advance(replay_t *const r)
+{
+    if (r->speed == REPLAY_SPEED_MAX) {
+        while (r->fifo_cnt < ECG_FIFO_DEPTH) {
+            __produce(r);
+        }
+        return;
+    }
+
+    uint64_t rate = (uint64_t)max30003_rate_sps(r->regs[CNFG_ECG]) * r->speed;
+    uint64_t due  = (__now_ns() - r->start_ns) * rate / REPLAY_NSEC_IN_SEC;
+    while (r->produced < due) {
+        __produce(r);
+        r->produced++;
+    }
+}
+
+static uint32_t __fifo_pop(replay_t *const r)
+{
+    uint32_t word;
+    if (!r->fifo_cnt) {
+        return r->ovf ? REPLAY_OVF_WORD : REPLAY_EMPTY_WORD;
+    }
+    word         = r->fifo[r->fifo_head];
+    r->fifo_head = (r->fifo_head + 1) % ECG_FIFO_DEPTH;
+    r->fifo_cnt--;
+    if (!r->fifo_cnt) {
+        word |= ETAG_VALID_EOF << ECG_FIFO_ETAG_SHIFT;
+    }
+    return word;
+}
+
+static uint32_t __status(const replay_t *const r)
+{
+    uint32_t status = 0;
+    uint32_t efit   = ((r->regs[MNGR_INT] & EFIT_1_RESET) >> EFIT_SHIFT) + 1;
+    if (r->fifo_cnt >= efit) {
+        status |= EINT;
+    }
+    if (r->ovf) {
+        status |= EOVF;
+    }
+    return status;
+}
+
+static uint32_t __read_reg(replay_t *const r, const uint8_t addr)
+{
+    switch (addr) {
+    case STATUS:
+        return __status(r);
+    case ECG_FIFO:
+    case ECG_FIFO_BURST:
+        return __fifo_pop(r);
+    default:
+        return addr < REPLAY_REGS_NUM ? r->regs[addr] : 0;
+    }
+}
+
+static void __write_reg(replay_t *const r, const uint8_t addr, uint32_t val)
+{
+    switch (addr) {
+    case SW_RST:
+        __chip_reset(r);
+        break;
+    case SYNCH:
+        __fifo_reset(r);
+        __clock_restart(r);
+        break;
+    case FIFO_RST:
+        __fifo_reset(r);
+        break;
+    case NO_OP:
+    case STATUS:
+    case INFO:
+    case RTOR:
+        break; /* read only */
+    case CNFG_ECG:
+        /* Samples due so far were taken at the old rate */
+        if (max30003_rate_sps(val) != max30003_rate_sps(r->regs[CNFG_ECG])) {
+            __advance(r);
+            __clock_restart(r);
+        }
+        r->regs[addr] = val & REPLAY_REG_MASK;
+        break;
+    default:
+        if (addr < REPLAY_REGS_NUM) {
+            r->regs[addr] = val & REPLAY_REG_MASK;
+        }
+        break;
+    }
+}
+
+/**
+ * \brief Exchange of a single byte on the bus
+ */
+static uint8_t __exchange(replay_t *const r, const uint8_t in)
+{
+    uint8_t out = 0;
+
+    if (!r->in_trans) {
+        r->in_trans  = 1;
+        r->cmd       = in;
+        r->byte_idx  = 0;
+        r->load_next = 0;
+        r->shift     = (in & RREG) ? __read_reg(r, in >> 1) : 0;
+        return out;
+    }
+
+    if (r->cmd & RREG) {
+        if (r->load_next) {
+            r->shift     = __fifo_pop(r);
+            r->load_next = 0;
+        }
+        out = (r->shift >> 16) & 0xFF;
+        r->shift <<= 8;
+        if (++r->byte_idx == ECG_FIFO_WORD_BYTES) {
+            r->byte_idx  = 0;
+            r->load_next = ((r->cmd >> 1) == ECG_FIFO_BURST);
+        }
+    } else {
+        r->shift = (r->shift << 8) | in;
+        r->byte_idx++;
+    }
+    return out;
+}
+
+static void __end_transaction(replay_t *const r)
+{
+    if (r->in_trans && !(r->cmd & RREG) &&
+        r->byte_idx >= ECG_FIFO_WORD_BYTES) {
+        __write_reg(r, r->cmd >> 1, r->shift);
+    }
+    r->in_trans = 0;
+}
+
+static int __message(spi_t *const                   self,
+                     struct spi_ioc_transfer *const xfer,
+                     const unsigned int             n)
+{
+    replay_t *r     = (replay_t *)self->backend_ctx;
+    int       total = 0;
+
+    __advance(r);
+    for (unsigned int i = 0; i < n; ++i) {
+        const uint8_t *tx   = (const uint8_t *)(uintptr_t)xfer[i].tx_buf;
+        uint8_t *      rx   = (uint8_t *)(uintptr_t)xfer[i].rx_buf;
+        uint8_t        late = r->sclk_max && xfer[i].speed_hz > r->sclk_max;
+        for (uint32_t b = 0; b < xfer[i].len; ++b) {
+            uint8_t out = __exchange(r, tx ? tx[b] : 0);
+            if (rx) {
+                rx[b] = late ? (uint8_t)(out << 1) : out;
+            }
+        }
+        total += xfer[i].len;
+        /* cs_change deselects the chip between transfers and keeps it
+         * selected after the last one */
+        if ((i + 1 < n) ? xfer[i].cs_change : !xfer[i].cs_change) {
+            __end_transaction(r);
+        }
+    }
+    return total;
+}
+
+static ret_code_t __open(spi_t *const self)
+{
+    replay_t *r = (replay_t *)self->backend_ctx;
+    RET_ERR_ON_NULL(r);
+    __chip_reset(r);
+    LOG_INFO("Replaying %u samples at speed %u (0 - max)\n",
+             r->rec.words_num,
+             r->speed);
+    return RET_CODE_SUCCESS;
+}
+
+static ret_code_t __close(spi_t *const self)
+{
+    replay_t *r = (replay_t *)self->backend_ctx;
+    RET_ERR_ON_NULL(r);
+    LOG_INFO("Replay produced %llu samples, %llu lost on FIFO overflow\n",
+             (unsigned long long)r->produced_total,
+             (unsigned long long)r->lost);
+    return RET_CODE_SUCCESS;
+}
+
+const spi_backend_t replay_backend = {
+    .name    = "replay",
+    .open    = __open,
+    .close   = __close,
+    .message = __message,
+};
+
+/**
+ * \brief Creates replay handle for the recording loaded into r->rec
+ */
+static replay_t *__create(replay_t *r, const uint32_t speed)
+{
+    uint32_t valid = 0;
+    for (uint32_t i = 0; i < r->rec.words_num; ++i) {
+        uint32_t etag = (r->rec.words[i] & ECG_FIFO_ETAG_MASK) >>
+                        ECG_FIFO_ETAG_SHIFT;
+        valid += (etag != ETAG_EMPTY && etag != ETAG_OVERFLOW &&
+                  etag != ETAG_CNFG);
+    }
+    if (!valid) {
+        LOG_ERR("Recording has no valid samples\n");
+        replay_close(&r);
+        return NULL;
+    }
+
+    r->speed = speed;
+    __chip_reset(r);
+    return r;
+}
+
+replay_t *replay_open(const char *const path, const uint32_t speed)
+{
+    replay_t *r = (replay_t *)calloc(1, sizeof(replay_t));
+    if (PTR_INVALID(r)) {
+        return NULL;
+    }
+
+    if (RET_UNSUCCESS(rec_load(&r->rec, path))) {
+        free(r);
+        return NULL;
+    }
+    return __create(r, speed);
+}
+
+replay_t *replay_open_synth(const uint32_t sample_rate,
+                            const uint32_t seconds,
+                            const uint32_t speed)
+{
+    replay_t *r = (replay_t *)calloc(1, sizeof(replay_t));
+    if (PTR_INVALID(r)) {
+        return NULL;
+    }
+
+    if (RET_UNSUCCESS(rec_synth(&r->rec, sample_rate, seconds))) {
+        free(r);
+        return NULL;
+    }
+    return __create(r, speed);
+}
+
+ret_code_t replay_close(replay_t **replay)
+{
+    RET_ERR_ON_NULL(replay);
+    RET_ERR_ON_NULL(*replay);
+    rec_free(&(*replay)->rec);
+    free(*replay);
+    *replay = NULL;
+    return RET_CODE_SUCCESS;
+}
+
+ret_code_t replay_attach(replay_t *const replay, spi_t *const spi)
+{
+    RET_ERR_ON_NULL(replay);
+    return spi_attach_backend(spi, &replay_backend, replay);
+}
+
+uint64_t replay_samples_produced(const replay_t *const replay)
+{
+    return replay->produced_total;
+}
+
+uint64_t replay_samples_lost(const replay_t *const replay)
+{
+    return replay->lost;
+}
+
+uint64_t replay_samples_dropped(const replay_t *const replay)
+{
+    return replay->dropped;
+}
+
+ret_code_t replay_set_sclk_max(replay_t *const replay, const uint32_t sclk_max)
+{
+    RET_ERR_ON_NULL(replay);
+    replay->sclk_max = sclk_max;
+    return RET_CODE_SUCCESS;
+}
@@ -11,6 +11,8 @@
 #include "spi.h"
 #include "common_types.h"
 #include "common_check.h"
+#include "stats.h"
+#include "trace.h"
 
 #include "Log_dbg_en.h"
 #define DEBUG_ENABLE SPI_PRINT_EN
@@ -27,6 +29,16 @@ ret_code_t spi_init(spi_t *const self)
 
     memset(&self->xfer, 0, sizeof(self->xfer));
 
+    if (self->backend) {
+        LOG_INFO("Open the %s backend\n", self->backend->name);
+        ret = self->backend->open(self);
+        if (RET_UNSUCCESS(ret)) {
+            LOG_ERR("failed to open the %s backend\n", self->backend->name);
+            goto exit;
+        }
+        goto xfer_setup;
+    }
+
     LOG_INFO("Open the spi_dev\n");
     self->fd = open(self->dev_name, O_RDWR);
     if (self->fd < 0) {
@@ -94,13 +106,17 @@ ret_code_t spi_init(spi_t *const self)
              (int)self->lsb,
              (int)self->speed);
 
-    self->xfer[0].len                   = 4; /* Length of  command to write*/
-    self->xfer[0].cs_change             = 0; /* Keep CS activated */
-    self->xfer[0].delay_usecs           = 0, /* delay in us */
-            self->xfer[0].speed_hz      = 1000000, /* speed */
-            self->xfer[0].bits_per_word = 8,       /* bites per word 8 */
-            self->xfer[1].len           = 4;       /* Length of Data to read */
-    self->xfer[1].cs_change             = 0;       /* Keep CS activated */
+xfer_setup:
+    self->xfer[0].len           = 4; /* Length of  command to write*/
+    self->xfer[0].cs_change     = 0; /* Keep CS activated */
+    self->xfer[0].delay_usecs   = 0; /* delay in us */
+    self->xfer[0].bits_per_word = 8; /* bites per word 8 */
+    self->xfer[1].len           = 4; /* Length of Data to read */
+    self->xfer[1].cs_change     = 0; /* Keep CS activated */
+    self->xfer[1].bits_per_word = 8;
+    /* Both transfers run at the requested clock, 0 - spidev max speed */
+    self->xfer[0].speed_hz = self->speed;
+    self->xfer[1].speed_hz = self->speed;
 
 exit:
     return ret;
@@ -116,6 +132,12 @@ ret_code_t spi_free(spi_t *self)
         goto exit;
     }
 
+    if (self->backend) {
+        ret = self->backend->close(self);
+        LOG_INFO("%s backend closed\n", self->backend->name);
+        goto exit;
+    }
+
     if (close(self->fd) < 0) {
         LOG_ERR("Faild to close SPI \n");
         ret = RET_CODE_ERROR;
@@ -140,7 +162,7 @@ ret_code_t spi_read(spi_t *const self, char *const rx_buf, const size_t len)
     self->xfer[0].len    = (__u64)SPI_COMMAND_LEN; /* input buffer */
     self->xfer[1].len    = (__u32)len;             /* length of data to read */
 
-    if ((ioctl(self->fd, SPI_IOC_MESSAGE(2), self->xfer)) < 0) {
+    if (spi_message(self, self->xfer, 2) < 0) {
         LOG_ERR("error in spi_read(): ioctl(SPI_IOC_MESSAGE(2))\n");
         ret = RET_CODE_SPI_READ_ERR;
         goto exit;
@@ -166,7 +188,7 @@ spi_write(spi_t *const self, const char *const tx_buf, const size_t len)
     self->xfer[0].tx_buf = (__u64)self->tx_buf;
     self->xfer[0].len    = (__u64)len;
 
-    if ((ioctl(self->fd, SPI_IOC_MESSAGE(1), self->xfer)) < 0) {
+    if (spi_message(self, self->xfer, 1) < 0) {
         LOG_ERR(" ioctl(SPI_IOC_MESSAGE(1)) failed \n ");
         ret = RET_CODE_SPI_WRITE_ERR;
         goto exit;
@@ -175,3 +197,50 @@ spi_write(spi_t *const self, const char *const tx_buf, const size_t len)
 exit:
     return ret;
 }
+
+ret_code_t spi_set_speed(spi_t *const self, const __u32 speed_hz)
+{
+    if (!self) {
+        return RET_CODE_NULL_PTR;
+    }
+    if (!self->backend &&
+        ioctl(self->fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed_hz) < 0) {
+        LOG_ERR("can't set max speed %u [Hz]\n", speed_hz);
+        return RET_CODE_SPI_ERROR;
+    }
+    self->speed            = speed_hz;
+    self->xfer[0].speed_hz = speed_hz;
+    self->xfer[1].speed_hz = speed_hz;
+    return RET_CODE_SUCCESS;
+}
+
+ret_code_t spi_attach_backend(spi_t *const               self,
+                              const spi_backend_t *const backend,
+                              void *const                ctx)
+{
+    if (!self || !backend) {
+        LOG_ERR("Null ptr in spi_attach_backend parameters\n");
+        return RET_CODE_NULL_PTR;
+    }
+    self->backend     = backend;
+    self->backend_ctx = ctx;
+    return RET_CODE_SUCCESS;
+}
+
+int spi_message(spi_t *const                   self,
+                struct spi_ioc_transfer *const xfer,
+                const unsigned int             n)
+{
+    uint32_t bytes = 0;
+    for (unsigned int i = 0; i < n; ++i) {
+        bytes += xfer[i].len;
+    }
+    STAT_INC(STAT_IOCTLS);
+    STAT_ADD(STAT_SPI_BYTES, bytes);
+    TRACE(TRACE_EV_SPI_MSG, n, bytes);
+
+    if (self->backend) {
+        return self->backend->message(self, xfer, n);
+    }
+    return ioctl(self->fd, SPI_IOC_MESSAGE(n), xfer);
+}
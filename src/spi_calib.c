@@ -0,0 +1,268 @@
+/**
+ * \file spi_calib.c
+ *
+ * \brief SPI clock calibration
+ */
+#include <stdio.h>
+#include <string.h>
+#include "spi_calib.h"
+#include "MAX30003.h"
+#include "common_check.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE CALIB_PRINT_EN
+#define DBG_TAG      "spi_calib.c"
+#include "Log_dbg.h"
+
+#define CALIB_INFO_ID_SHIFT 20
+#define CALIB_INFO_ID       0x5      /* INFO[23:20] of MAX30003 */
+#define CALIB_RTOR2_MASK    0x3F3700 /* HOFF, RAVG, RHSF */
+#define CALIB_CACHE_LINES   16
+
+/* Swept upwards, above SPI_CALIB_SCLK_MAX only to find the board edge */
+static const uint32_t rates[] = {
+    1000000, 2000000, 4000000, 5000000, 8000000,
+    10000000, 12000000, 16000000, 20000000,
+};
+
+static const uint32_t patterns[] = {
+    0xAAAAAA, 0x555555, 0xFFFFFF, 0x000000,
+    0xCCCCCC, 0x333333, 0xF0F0F0, 0x0F0F0F,
+};
+
+static const char *__dev(const spi_t *const spi)
+{
+    return spi->backend ? spi->backend->name : (const char *)spi->dev_name;
+}
+
+static ret_code_t __read(spi_t *const spi, uint8_t addr, uint32_t *val)
+{
+    return max30003_read_regs(spi, &addr, val, 1);
+}
+
+static ret_code_t __write(spi_t *const spi, uint8_t addr, uint32_t val)
+{
+    return max30003_write_regs(spi, &addr, &val, 1);
+}
+
+/**
+ * \brief CNFG_RTOR2 read at the slowest rate, the rate under test may
+ * already corrupt it
+ */
+static ret_code_t __save(spi_t *const spi, uint32_t *const saved)
+{
+    ret_code_t ret   = RET_CODE_SUCCESS;
+    uint32_t   speed = spi->speed;
+
+    CONTINUE_ON_SUCCESS(spi_set_speed(spi, rates[0]));
+    ret = __read(spi, CNFG_RTOR2, saved);
+    if (RET_UNSUCCESS(spi_set_speed(spi, speed)) && !ret) {
+        ret = RET_CODE_SPI_ERROR;
+    }
+exit:
+    return ret;
+}
+
+/**
+ * \brief Bus integrity at the current clock, CNFG_RTOR2 is restored to
+ * saved at the slowest rate once the patterns have been written, the
+ * clock under test is set again afterwards
+ */
+static ret_code_t __verify(spi_t *const   spi,
+                           const uint32_t reads,
+                           const uint32_t patterns_num,
+                           const uint32_t saved)
+{
+    ret_code_t ret   = RET_CODE_SUCCESS;
+    uint32_t   ref   = 0, val = 0, pattern;
+    uint32_t   speed = spi->speed;
+
+    for (uint32_t i = 0; i < reads; ++i) {
+        CONTINUE_ON_SUCCESS(__read(spi, INFO, &val));
+        if (!i) {
+            ref = val;
+        }
+        if (val != ref || (val >> CALIB_INFO_ID_SHIFT) != CALIB_INFO_ID) {
+            LOG_DBG("INFO 0x%06x at %u Hz\n", val, spi->speed);
+            ret = RET_CODE_CRC_MISMATCH;
+            goto exit;
+        }
+    }
+
+    for (uint32_t i = 0; i < patterns_num; ++i) {
+        pattern = patterns[i % ARRAY_SIZE(patterns)] & CALIB_RTOR2_MASK;
+        ret     = __write(spi, CNFG_RTOR2, pattern);
+        if (ret == RET_CODE_SUCCESS) {
+            ret = __read(spi, CNFG_RTOR2, &val);
+        }
+        if (RET_UNSUCCESS(ret)) {
+            break;
+        }
+        if ((val & CALIB_RTOR2_MASK) != pattern) {
+            LOG_DBG("CNFG_RTOR2 0x%06x != 0x%06x at %u Hz\n",
+                    val,
+                    pattern,
+                    spi->speed);
+            ret = RET_CODE_CRC_MISMATCH;
+            break;
+        }
+    }
+    if (patterns_num) {
+        if ((RET_UNSUCCESS(spi_set_speed(spi, rates[0])) ||
+             RET_UNSUCCESS(__write(spi, CNFG_RTOR2, saved)) ||
+             RET_UNSUCCESS(spi_set_speed(spi, speed))) &&
+            !ret) {
+            ret = RET_CODE_SPI_WRITE_ERR;
+        }
+    }
+exit:
+    return ret;
+}
+
+ret_code_t spi_calib_verify(spi_t *const   spi,
+                            const uint32_t reads,
+                            const uint32_t patterns_num)
+{
+    ret_code_t ret   = RET_CODE_SUCCESS;
+    uint32_t   saved = 0;
+    RET_ERR_ON_NULL(spi);
+
+    CONTINUE_ON_SUCCESS(__save(spi, &saved));
+    ret = __verify(spi, reads, patterns_num, saved);
+exit:
+    return ret;
+}
+
+ret_code_t spi_calib_sweep(spi_t *const spi, uint32_t *const speed_hz)
+{
+    ret_code_t ret    = RET_CODE_SUCCESS;
+    uint32_t   best   = 0;
+    uint32_t   chosen = 0;
+    uint32_t   saved  = 0;
+    RET_ERR_ON_NULL(spi);
+
+    CONTINUE_ON_SUCCESS(__save(spi, &saved));
+    for (uint32_t i = 0; i < ARRAY_SIZE(rates); ++i) {
+        CONTINUE_ON_SUCCESS(spi_set_speed(spi, rates[i]));
+        if (RET_UNSUCCESS(__verify(spi,
+                                   SPI_CALIB_READS,
+                                   SPI_CALIB_PATTERNS,
+                                   saved))) {
+            break;
+        }
+        best = rates[i];
+    }
+    if (!best) {
+        LOG_ERR("No reliable SPI clock on %s\n", __dev(spi));
+        ret = RET_CODE_SPI_ERROR;
+        goto exit;
+    }
+
+    for (uint32_t i = 0; i < ARRAY_SIZE(rates); ++i) {
+        if (rates[i] <= (uint64_t)best * SPI_CALIB_MARGIN_PCT / 100 &&
+            rates[i] <= SPI_CALIB_SCLK_MAX) {
+            chosen = rates[i];
+        }
+    }
+    if (!chosen) {
+        LOG_WARN("No margin below %u Hz on %s\n", best, __dev(spi));
+        chosen = best;
+    }
+    CONTINUE_ON_SUCCESS(spi_set_speed(spi, chosen));
+    LOG_INFO("SPI clock %u Hz on %s, reliable up to %u Hz\n",
+             chosen,
+             __dev(spi),
+             best);
+exit:
+    if (speed_hz) {
+        *speed_hz = chosen;
+    }
+    return ret;
+}
+
+/**
+ * \brief Cache file lines, loaded whole as it holds a line per device
+ */
+typedef struct {
+    char     dev[CALIB_CACHE_LINES][SPI_CALIB_DEV_LEN];
+    uint32_t hz[CALIB_CACHE_LINES];
+    uint32_t num;
+} calib_cache_t;
+
+static void __cache_load(calib_cache_t *const c, const char *const path)
+{
+    FILE *f = fopen(path, "r");
+    c->num  = 0;
+    if (!f) {
+        return;
+    }
+    while (c->num < CALIB_CACHE_LINES &&
+           fscanf(f, "%63s %u", c->dev[c->num], &c->hz[c->num]) == 2) {
+        c->num++;
+    }
+    fclose(f);
+}
+
+static ret_code_t __cache_save(const calib_cache_t *const c,
+                               const char *const          path)
+{
+    char  tmp[SPI_CALIB_DEV_LEN * 4];
+    FILE *f;
+
+    snprintf(tmp, sizeof tmp, "%s.tmp", path);
+    f = fopen(tmp, "w");
+    if (!f) {
+        LOG_ERR("Can't write SPI clock cache %s\n", tmp);
+        return RET_CODE_ERROR;
+    }
+    for (uint32_t i = 0; i < c->num; ++i) {
+        fprintf(f, "%s %u\n", c->dev[i], c->hz[i]);
+    }
+    if (fclose(f) || rename(tmp, path)) {
+        LOG_ERR("Can't update SPI clock cache %s\n", path);
+        return RET_CODE_ERROR;
+    }
+    return RET_CODE_SUCCESS;
+}
+
+ret_code_t spi_calib_run(spi_t *const spi, const char *const cache_path)
+{
+    ret_code_t    ret   = RET_CODE_SUCCESS;
+    calib_cache_t cache = { 0 };
+    const char *  dev;
+    uint32_t      idx, hz = 0;
+    RET_ERR_ON_NULL(spi);
+    RET_ERR_ON_NULL(cache_path);
+
+    dev = __dev(spi);
+    __cache_load(&cache, cache_path);
+    for (idx = 0; idx < cache.num; ++idx) {
+        if (!strcmp(cache.dev[idx], dev)) {
+            break;
+        }
+    }
+
+    if (idx < cache.num) {
+        CONTINUE_ON_SUCCESS(spi_set_speed(spi, cache.hz[idx]));
+        if (!spi_calib_verify(spi,
+                              SPI_CALIB_READS / SPI_CALIB_VERIFY_DIV,
+                              SPI_CALIB_PATTERNS / SPI_CALIB_VERIFY_DIV)) {
+            LOG_INFO("Cached SPI clock %u Hz on %s\n", cache.hz[idx], dev);
+            goto exit;
+        }
+        LOG_WARN("Cached SPI clock %u Hz fails on %s, recalibrating\n",
+                cache.hz[idx],
+                dev);
+    } else if (cache.num == CALIB_CACHE_LINES) {
+        idx = CALIB_CACHE_LINES - 1; /* full, replace the last device */
+    } else {
+        cache.num++;
+    }
+
+    CONTINUE_ON_SUCCESS(spi_calib_sweep(spi, &hz));
+    snprintf(cache.dev[idx], SPI_CALIB_DEV_LEN, "%s", dev);
+    cache.hz[idx] = hz;
+    CONTINUE_ON_SUCCESS(__cache_save(&cache, cache_path));
+exit:
+    return ret;
+}
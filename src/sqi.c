@@ -0,0 +1,219 @@
+/**
+ * \file sqi.c
+ *
+ * \brief Spectral signal quality
+ */
+#include <string.h>
+#include <math.h>
+#include "sqi.h"
+#include "dsp.h"
+#include "common_check.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE DSP_PRINT_EN
+#define DBG_TAG      "sqi.c"
+#include "Log_dbg.h"
+
+static const char *const band_names[SQI_BAND_NUM] = {
+    [SQI_BAND_BASELINE] = "baseline",
+    [SQI_BAND_QRS]      = "qrs",
+    [SQI_BAND_MAINS]    = "mains",
+    [SQI_BAND_HF]       = "hf",
+};
+
+/**
+ * \brief Assigns bins lo..hi Hz to the band, later calls override
+ */
+static void __band_set(sqi_t *const     sqi,
+                       const double     lo,
+                       const double     hi,
+                       const sqi_band_t band)
+{
+    double df = (double)sqi->rate / sqi->len;
+
+    for (uint32_t k = 1; k <= sqi->len / 2; ++k) {
+        if (k * df >= lo && k * df <= hi) {
+            sqi->band[k] = band;
+        }
+    }
+}
+
+ret_code_t sqi_init(sqi_t *const   sqi,
+                    const uint32_t cnfg_ecg,
+                    const uint64_t idx)
+{
+    uint32_t n, bits = 0;
+    double   a, w2 = 0;
+    RET_ERR_ON_NULL(sqi);
+
+    sqi->rate = max30003_rate_sps(cnfg_ecg);
+    sqi->idx  = idx;
+    sqi->fill = 0;
+    sqi->len  = 4;
+    while (sqi->len < SQI_FFT_MAX && sqi->len < SQI_WINDOW_S * sqi->rate) {
+        sqi->len *= 2;
+    }
+    n = sqi->len / 2; /* real input is transformed as n complex points */
+    while ((1u << bits) < n) {
+        bits++;
+    }
+
+    for (uint32_t i = 0; i < sqi->len; ++i) {
+        sqi->win[i] = (float)(0.5 - 0.5 * cos(2 * M_PI * i / sqi->len));
+        w2 += (double)sqi->win[i] * sqi->win[i];
+    }
+    /* Parseval, one sided bins sum up to the mean square of the window */
+    sqi->scale = (float)(2 / (sqi->len * w2));
+
+    for (uint32_t i = 0; i < n; ++i) {
+        uint32_t r = 0;
+        for (uint32_t b = 0; b < bits; ++b) {
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        sqi->rev[i] = (uint16_t)r;
+    }
+    /* Twiddles of a stage are contiguous, butterflies run over them */
+    for (uint32_t h = 1; h < n; h *= 2) {
+        for (uint32_t j = 0; j < h; ++j) {
+            a                 = -M_PI * j / h;
+            sqi->tw_re[h + j] = (float)cos(a);
+            sqi->tw_im[h + j] = (float)sin(a);
+        }
+    }
+    for (uint32_t k = 0; k < n; ++k) {
+        a              = -2 * M_PI * k / sqi->len;
+        sqi->rtw_re[k] = (float)cos(a);
+        sqi->rtw_im[k] = (float)sin(a);
+    }
+
+    memset(sqi->band, SQI_BAND_NONE, sizeof sqi->band);
+    __band_set(sqi, 0, SQI_BASELINE_HI, SQI_BAND_BASELINE);
+    __band_set(sqi, SQI_QRS_LO, SQI_QRS_HI, SQI_BAND_QRS);
+    __band_set(sqi, SQI_HF_LO, sqi->rate / 2.0, SQI_BAND_HF);
+    __band_set(sqi,
+               SQI_MAINS_50 - SQI_MAINS_DHZ,
+               SQI_MAINS_50 + SQI_MAINS_DHZ,
+               SQI_BAND_MAINS);
+    __band_set(sqi,
+               SQI_MAINS_60 - SQI_MAINS_DHZ,
+               SQI_MAINS_60 + SQI_MAINS_DHZ,
+               SQI_BAND_MAINS);
+    return RET_CODE_SUCCESS;
+}
+
+/**
+ * \brief In place radix-2 complex FFT of n points in bit reversed order.
+ * Real and imaginary parts are split and the twiddles of a stage are
+ * contiguous, so the inner loop is vectorized by the compiler.
+ */
+static void __fft(float *restrict re,
+                  float *restrict im,
+                  const float *restrict tw_re,
+                  const float *restrict tw_im,
+                  const uint32_t n)
+{
+    float tr, ti;
+
+    for (uint32_t h = 1; h < n; h *= 2) {
+        for (uint32_t i = 0; i < n; i += 2 * h) {
+            float *restrict ar = re + i;
+            float *restrict ai = im + i;
+            float *restrict br = re + i + h;
+            float *restrict bi = im + i + h;
+            for (uint32_t j = 0; j < h; ++j) {
+                tr    = br[j] * tw_re[h + j] - bi[j] * tw_im[h + j];
+                ti    = br[j] * tw_im[h + j] + bi[j] * tw_re[h + j];
+                br[j] = ar[j] - tr;
+                bi[j] = ai[j] - ti;
+                ar[j] += tr;
+                ai[j] += ti;
+            }
+        }
+    }
+}
+
+/**
+ * \brief Band powers of the full window
+ */
+static void __window_done(sqi_t *const sqi, sqi_metrics_t *const m)
+{
+    uint32_t n = sqi->len / 2;
+    uint32_t a, b;
+    int64_t  sum = 0;
+    float    mean, p, er, ei, odr, odi, wr, wi, xr, xi, total = 0;
+
+    /* Mean is removed, DC of the electrodes would swamp the baseline */
+    for (uint32_t i = 0; i < sqi->len; ++i) {
+        sum += sqi->buf[i];
+    }
+    mean = (float)sum / sqi->len;
+    /* Even samples are the real parts, odd the imaginary ones */
+    for (uint32_t i = 0; i < n; ++i) {
+        sqi->re[sqi->rev[i]] = (sqi->buf[2 * i] - mean) * sqi->win[2 * i];
+        sqi->im[sqi->rev[i]] =
+                (sqi->buf[2 * i + 1] - mean) * sqi->win[2 * i + 1];
+    }
+    __fft(sqi->re, sqi->im, sqi->tw_re, sqi->tw_im, n);
+
+    memset(m, 0, sizeof *m);
+    m->start = sqi->idx - sqi->len;
+    m->len   = sqi->len;
+    for (uint32_t k = 1; k <= n; ++k) {
+        if (sqi->band[k] == SQI_BAND_NONE) {
+            continue;
+        }
+        /* Bin k of the real input from bins k and n - k of the complex */
+        a   = k % n;
+        b   = (n - k) % n;
+        er  = (sqi->re[a] + sqi->re[b]) / 2;
+        ei  = (sqi->im[a] - sqi->im[b]) / 2;
+        odr = (sqi->im[a] + sqi->im[b]) / 2;
+        odi = (sqi->re[b] - sqi->re[a]) / 2;
+        wr  = k < n ? sqi->rtw_re[k] : -1;
+        wi  = k < n ? sqi->rtw_im[k] : 0;
+        xr  = er + wr * odr - wi * odi;
+        xi  = ei + wr * odi + wi * odr;
+        p   = (xr * xr + xi * xi) * sqi->scale;
+        m->power[sqi->band[k]] += k < n ? p : p / 2;
+    }
+    for (uint32_t i = 0; i < SQI_BAND_NUM; ++i) {
+        total += m->power[i];
+    }
+    if (total > 0) {
+        m->quality = (uint8_t)lroundf(100 * m->power[SQI_BAND_QRS] / total);
+    }
+}
+
+uint32_t sqi_process(sqi_t *const         sqi,
+                     const int32_t *const points,
+                     const uint32_t       num,
+                     sqi_metrics_t *const metrics,
+                     const uint32_t       max_metrics)
+{
+    uint32_t      found = 0;
+    sqi_metrics_t m;
+
+    for (uint32_t i = 0; i < num; ++i) {
+        if (ECG_IS_MARKER(points[i])) {
+            sqi_init(sqi, ECG_MARKER_CNFG(points[i]), sqi->idx + 1);
+            continue;
+        }
+        sqi->buf[sqi->fill++] = DSP_POINT_TO_SAMPLE(points[i]);
+        sqi->idx++;
+        if (sqi->fill < sqi->len) {
+            continue;
+        }
+        __window_done(sqi, &m);
+        sqi->fill = 0;
+        if (metrics && found < max_metrics) {
+            metrics[found] = m;
+        }
+        found++;
+    }
+    return found;
+}
+
+const char *sqi_band_name(const sqi_band_t band)
+{
+    return band < SQI_BAND_NUM ? band_names[band] : "none";
+}
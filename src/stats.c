@@ -0,0 +1,294 @@
+/**
+ * \file stats.c
+ *
+ * \brief Always-on hot path counters and the stats thread
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include "stats.h"
+#include "common_check.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE STATS_PRINT_EN
+#define DBG_TAG      "stats.c"
+#include "Log_dbg.h"
+
+#define STATS_PATH_LEN 256
+
+__thread stats_shard_t *stats_tls_shard;
+
+static stats_shard_t *shards;
+
+static const char *const stat_names[STAT_NUM] = {
+    [STAT_IOCTLS]         = "ioctls",
+    [STAT_SPI_BYTES]      = "spi_bytes",
+    [STAT_SAMPLES_READ]   = "samples_read",
+    [STAT_EMPTY_POLLS]    = "empty_polls",
+    [STAT_FIFO_OVERFLOWS] = "fifo_overflows",
+    [STAT_SAMPLES_LOST]   = "samples_lost",
+    [STAT_SINK_WRITES]    = "sink_writes",
+    [STAT_SINK_NS]        = "sink_ns",
+    [STAT_LOG_DROPS]      = "log_drops",
+    [STAT_REG_MISMATCH]   = "reg_mismatch",
+    [STAT_RECONFIGS]      = "reconfigs",
+    [STAT_RECONF_GAP_NS]  = "reconf_gap_ns",
+    [STAT_POLL_WAKEUPS]   = "poll_wakeups",
+    [STAT_PIPE_FULL]      = "pipe_full",
+    [STAT_DSP_NS]         = "dsp_ns",
+    [STAT_BEATS]          = "beats",
+    [STAT_POOL_EMPTY]     = "pool_empty",
+    [STAT_RECOVERIES]     = "recoveries",
+    [STAT_RECOVER_GAP_NS] = "recover_gap_ns",
+    [STAT_RECOVER_GAPS]   = "recover_gaps",
+    [STAT_SPI_ERRORS]     = "spi_errors",
+};
+
+static const char *const lat_names[LAT_NUM] = {
+    [LAT_FIFO_READ]  = "fifo_read",
+    [LAT_DECODE]     = "decode",
+    [LAT_DSP_FILTER] = "dsp_filter",
+    [LAT_DSP_QRS]    = "dsp_qrs",
+    [LAT_DSP_SQI]    = "dsp_sqi",
+    [LAT_SINK_REC]   = "sink_rec",
+    [LAT_SINK_ARROW] = "sink_arrow",
+    [LAT_SINK_TEXT]  = "sink_text",
+};
+
+static struct {
+    pthread_t thread;
+    uint8_t   running;
+    uint8_t   stop;
+    uint32_t  period_s;
+    char      path[STATS_PATH_LEN];
+} stats_thr;
+
+stats_shard_t *stats_shard_new(void)
+{
+    stats_shard_t *shard = NULL;
+    /* Cache line aligned, the size is not a power of two */
+    if (posix_memalign((void **)&shard,
+                       __alignof__(stats_shard_t),
+                       sizeof *shard)) {
+        return NULL;
+    }
+    memset(shard, 0, sizeof *shard);
+
+    /* Shards are never freed, counters of exited threads stay in sums */
+    shard->next = __atomic_load_n(&shards, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&shards,
+                                        &shard->next,
+                                        shard,
+                                        1,
+                                        __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED)) {
+        ;
+    }
+    stats_tls_shard = shard;
+    return shard;
+}
+
+uint64_t stats_get(const stat_id_t id)
+{
+    uint64_t sum = 0;
+    if (id >= STAT_NUM) {
+        return 0;
+    }
+    for (stats_shard_t *s = __atomic_load_n(&shards, __ATOMIC_ACQUIRE); s;
+         s                = s->next) {
+        sum += __atomic_load_n(&s->cnt[id], __ATOMIC_RELAXED);
+    }
+    return sum;
+}
+
+/**
+ * \brief Highest latency of the bucket, see stats_lat_bucket()
+ */
+static uint64_t __lat_bucket_max(const uint32_t b)
+{
+    uint64_t sub = (b & ((1U << LAT_SUB_BITS) - 1)) | (1U << LAT_SUB_BITS);
+    if (b < (1U << LAT_SUB_BITS)) {
+        return b;
+    }
+    return ((sub + 1) << ((b >> LAT_SUB_BITS) - 1)) - 1;
+}
+
+/**
+ * \brief Latency of the count * ppt / 1000 th lowest record
+ */
+static uint64_t __lat_pct(const uint64_t *const bucket,
+                          const uint64_t        count,
+                          const uint64_t        max_ns,
+                          const uint32_t        ppt)
+{
+    uint64_t rank = (count * ppt + 999) / 1000;
+    uint64_t seen = 0;
+    uint64_t val;
+
+    rank = rank ? rank : 1;
+    for (uint32_t b = 0; b < LAT_BUCKETS; ++b) {
+        seen += bucket[b];
+        if (seen >= rank) {
+            val = __lat_bucket_max(b);
+            return val < max_ns ? val : max_ns;
+        }
+    }
+    return max_ns;
+}
+
+ret_code_t stats_lat_get(const lat_id_t id, stats_lat_t *const lat)
+{
+    uint64_t bucket[LAT_BUCKETS] = { 0 };
+    uint64_t sum = 0, max = 0, val;
+    RET_ERR_ON_NULL(lat);
+
+    memset(lat, 0, sizeof *lat);
+    if (id >= LAT_NUM) {
+        return RET_CODE_INVALID_PARAMS;
+    }
+    for (stats_shard_t *s = __atomic_load_n(&shards, __ATOMIC_ACQUIRE); s;
+         s                = s->next) {
+        for (uint32_t b = 0; b < LAT_BUCKETS; ++b) {
+            val = __atomic_load_n(&s->lat[id].bucket[b], __ATOMIC_RELAXED);
+            bucket[b] += val;
+            lat->count += val;
+        }
+        sum += __atomic_load_n(&s->lat[id].sum_ns, __ATOMIC_RELAXED);
+        val = __atomic_load_n(&s->lat[id].max_ns, __ATOMIC_RELAXED);
+        max = val > max ? val : max;
+    }
+    if (!lat->count) {
+        return RET_CODE_SUCCESS;
+    }
+    lat->mean_ns = sum / lat->count;
+    lat->p50_ns  = __lat_pct(bucket, lat->count, max, 500);
+    lat->p99_ns  = __lat_pct(bucket, lat->count, max, 990);
+    lat->p999_ns = __lat_pct(bucket, lat->count, max, 999);
+    lat->max_ns  = max;
+    return RET_CODE_SUCCESS;
+}
+
+void stats_lat_reset(void)
+{
+    for (stats_shard_t *s = __atomic_load_n(&shards, __ATOMIC_ACQUIRE); s;
+         s                = s->next) {
+        memset(s->lat, 0, sizeof s->lat);
+    }
+}
+
+const char *stats_lat_name(const lat_id_t id)
+{
+    return id < LAT_NUM ? lat_names[id] : "unknown";
+}
+
+ret_code_t stats_dump(FILE *const out)
+{
+    stats_lat_t lat;
+    RET_ERR_ON_NULL(out);
+    for (uint32_t i = 0; i < STAT_NUM; ++i) {
+        fprintf(out,
+                "%s %llu\n",
+                stat_names[i],
+                (unsigned long long)stats_get((stat_id_t)i));
+    }
+    for (uint32_t i = 0; i < LAT_NUM; ++i) {
+        stats_lat_get((lat_id_t)i, &lat);
+        fprintf(out,
+                "lat_%s_count %llu\nlat_%s_mean_ns %llu\n"
+                "lat_%s_p50_ns %llu\nlat_%s_p99_ns %llu\n"
+                "lat_%s_p999_ns %llu\nlat_%s_max_ns %llu\n",
+                lat_names[i],
+                (unsigned long long)lat.count,
+                lat_names[i],
+                (unsigned long long)lat.mean_ns,
+                lat_names[i],
+                (unsigned long long)lat.p50_ns,
+                lat_names[i],
+                (unsigned long long)lat.p99_ns,
+                lat_names[i],
+                (unsigned long long)lat.p999_ns,
+                lat_names[i],
+                (unsigned long long)lat.max_ns);
+    }
+    return RET_CODE_SUCCESS;
+}
+
+/**
+ * \brief Rewrites the stats file, readers never see a partial file
+ */
+static void __write_file(void)
+{
+    char  tmp[STATS_PATH_LEN + 4];
+    FILE *f;
+    if (!stats_thr.path[0]) {
+        return;
+    }
+    snprintf(tmp, sizeof tmp, "%s.tmp", stats_thr.path);
+    f = fopen(tmp, "w");
+    if (!f) {
+        return;
+    }
+    stats_dump(f);
+    if (!fclose(f)) {
+        rename(tmp, stats_thr.path);
+    }
+}
+
+static void *__stats_thread(void *arg)
+{
+    sigset_t        set;
+    struct timespec ts = { .tv_sec = stats_thr.period_s, .tv_nsec = 0 };
+    (void)arg;
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    while (!__atomic_load_n(&stats_thr.stop, __ATOMIC_ACQUIRE)) {
+        if (sigtimedwait(&set, NULL, &ts) == SIGUSR1 &&
+            !__atomic_load_n(&stats_thr.stop, __ATOMIC_ACQUIRE)) {
+            stats_dump(stderr);
+        }
+        __write_file();
+    }
+    return NULL;
+}
+
+ret_code_t stats_start(const char *const path, const uint32_t period_s)
+{
+    sigset_t set;
+    if (stats_thr.running) {
+        return RET_CODE_BUSY;
+    }
+
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    if (pthread_sigmask(SIG_BLOCK, &set, NULL)) {
+        LOG_ERR("Can't block SIGUSR1\n");
+        return RET_CODE_ERROR;
+    }
+
+    snprintf(stats_thr.path, sizeof stats_thr.path, "%s", path ? path : "");
+    stats_thr.period_s = period_s ? period_s : STATS_PERIOD_S_DEFAULT;
+    stats_thr.stop     = 0;
+    if (pthread_create(&stats_thr.thread, NULL, __stats_thread, NULL)) {
+        LOG_ERR("Can't create stats thread\n");
+        return RET_CODE_ERROR;
+    }
+    stats_thr.running = 1;
+    LOG_INFO("Stats thread started, SIGUSR1 dumps counters\n");
+    return RET_CODE_SUCCESS;
+}
+
+ret_code_t stats_stop(void)
+{
+    if (!stats_thr.running) {
+        return RET_CODE_SUCCESS;
+    }
+    __atomic_store_n(&stats_thr.stop, 1, __ATOMIC_RELEASE);
+    pthread_kill(stats_thr.thread, SIGUSR1);
+    pthread_join(stats_thr.thread, NULL);
+    stats_thr.running = 0;
+    return RET_CODE_SUCCESS;
+}
@@ -0,0 +1,148 @@
+/**
+ * \file supervisor.c
+ *
+ * \brief Fault supervisor of the acquisition loop
+ */
+#include "MAX30003.h"
+#include "supervisor.h"
+#include "stats.h"
+#include "trace.h"
+#include "common_check.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE SUP_PRINT_EN
+#define DBG_TAG      "supervisor.c"
+#include "Log_dbg.h"
+
+#define SUP_NSEC_IN_SEC  1000000000ULL
+#define SUP_NSEC_IN_USEC 1000
+
+static const char *const fault_names[SUP_FAULT_NUM] = {
+    [SUP_FAULT_NONE]     = "none",
+    [SUP_FAULT_OVERFLOW] = "FIFO overflow",
+    [SUP_FAULT_PLL]      = "PLL unlock",
+    [SUP_FAULT_STALL]    = "stuck FIFO",
+    [SUP_FAULT_RESET]    = "chip reset",
+};
+
+/**
+ * \brief Counts the recovery and opens a gap if none is open, a fault
+ * inside an open gap does not move its start
+ */
+static sup_action_t __fault(sup_t *const       sup,
+                            const sup_fault_t  fault,
+                            const sup_action_t act,
+                            const uint64_t     now_ns)
+{
+    STAT_INC(STAT_RECOVERIES);
+    TRACE(TRACE_EV_RECOVER, fault, act);
+    LOG_DBG("%s, action %u\n", sup_fault_name(fault), act);
+    if (!sup->gap_ns) {
+        sup->gap_ns     = now_ns;
+        sup->gap_fault  = fault;
+        sup->marker_due = 1;
+    }
+    return act;
+}
+
+ret_code_t sup_init(sup_t *const   sup,
+                    const uint32_t cnfg_ecg,
+                    const uint32_t mngr_int,
+                    const uint64_t now_ns)
+{
+    uint32_t efit;
+    RET_ERR_ON_NULL(sup);
+
+    efit             = ((mngr_int & EFIT_1_RESET) >> EFIT_SHIFT) + 1;
+    sup->cnfg_ecg    = cnfg_ecg;
+    sup->sample_ns   = SUP_NSEC_IN_SEC / max30003_rate_sps(cnfg_ecg);
+    sup->stall_ns    = sup->sample_ns * efit * SUP_STALL_BATCHES;
+    sup->stall_ns    = sup->stall_ns < SUP_STALL_MIN_NS ? SUP_STALL_MIN_NS :
+                                                          sup->stall_ns;
+    sup->progress_ns = now_ns;
+    sup->stalls      = 0;
+    return RET_CODE_SUCCESS;
+}
+
+sup_action_t sup_check(sup_t *const   sup,
+                       const uint32_t status,
+                       const uint64_t now_ns)
+{
+    if (status & PLLINT) {
+        if (!sup->unlock_ns) {
+            sup->unlock_ns = now_ns;
+            return __fault(sup, SUP_FAULT_PLL, SUP_ACT_FIFO_RST, now_ns);
+        }
+        /* Not locking, PLL settings may be lost with the rest */
+        if (now_ns - sup->unlock_ns > sup->stall_ns) {
+            sup->unlock_ns = now_ns;
+            return __fault(sup, SUP_FAULT_PLL, SUP_ACT_REPLAY, now_ns);
+        }
+        return SUP_ACT_FIFO_RST; /* samples of the unlocked clock */
+    }
+    if (sup->unlock_ns) {
+        /* Locked again, decimation restarts on the locked clock */
+        sup->unlock_ns   = 0;
+        sup->progress_ns = now_ns;
+        return SUP_ACT_SYNCH;
+    }
+    if (status & EOVF) {
+        return __fault(sup, SUP_FAULT_OVERFLOW, SUP_ACT_FIFO_RST, now_ns);
+    }
+    if (!(status & EINT) && now_ns - sup->progress_ns > sup->stall_ns) {
+        sup->progress_ns = now_ns;
+        return __fault(sup,
+                       SUP_FAULT_STALL,
+                       sup->stalls++ ? SUP_ACT_REPLAY : SUP_ACT_VERIFY,
+                       now_ns);
+    }
+    return SUP_ACT_NONE;
+}
+
+sup_action_t sup_report(sup_t *const      sup,
+                        const sup_fault_t fault,
+                        const uint64_t    now_ns)
+{
+    switch (fault) {
+    case SUP_FAULT_OVERFLOW:
+        return __fault(sup, fault, SUP_ACT_FIFO_RST, now_ns);
+    case SUP_FAULT_PLL:
+        return __fault(sup, fault, SUP_ACT_SYNCH, now_ns);
+    case SUP_FAULT_STALL:
+        return __fault(sup, fault, SUP_ACT_VERIFY, now_ns);
+    case SUP_FAULT_RESET:
+        return __fault(sup, fault, SUP_ACT_REPLAY, now_ns);
+    default:
+        return SUP_ACT_NONE;
+    }
+}
+
+void sup_progress(sup_t *const   sup,
+                  const uint32_t words,
+                  const uint64_t now_ns)
+{
+    uint64_t gap;
+
+    if (!words) {
+        return;
+    }
+    sup->progress_ns = now_ns;
+    sup->stalls      = 0;
+    if (!sup->gap_ns || sup->unlock_ns) {
+        return;
+    }
+    gap         = now_ns - sup->gap_ns;
+    sup->gap_ns = 0;
+    STAT_INC(STAT_RECOVER_GAPS);
+    STAT_ADD(STAT_RECOVER_GAP_NS, gap);
+    TRACE(TRACE_EV_RECOVERED, sup->gap_fault, gap / SUP_NSEC_IN_USEC);
+    LOG_INFO("Recovered from %s, gap %llu us (%llu samples)\n",
+             sup_fault_name(sup->gap_fault),
+             (unsigned long long)gap / SUP_NSEC_IN_USEC,
+             (unsigned long long)(gap / sup->sample_ns));
+}
+
+const char *sup_fault_name(const sup_fault_t fault)
+{
+    return fault < SUP_FAULT_NUM ? fault_names[fault] : "unknown";
+}
@@ -0,0 +1,194 @@
+/**
+ * \file trace.c
+ *
+ * \brief Binary tracing into per thread in-memory rings
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "trace.h"
+#include "common_check.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE TRACE_PRINT_EN
+#define DBG_TAG      "trace.c"
+#include "Log_dbg.h"
+
+__thread trace_ring_t *trace_tls_ring;
+uint8_t                trace_enabled = 1;
+
+static trace_ring_t * rings;
+static uint32_t       ring_events = TRACE_RING_EVENTS_DEFAULT;
+static uint32_t       next_tid;
+static pthread_key_t  ring_key; /* releases the ring when its thread exits */
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+static uint8_t        ring_key_ok;
+
+static const trace_ev_info_t ev_info[TRACE_EV_NUM] = {
+    [TRACE_EV_SPI_MSG]    = { "spi_msg", TRACE_PH_INSTANT, "xfers", "bytes" },
+    [TRACE_EV_ACQ_BEGIN]  = { "acquisition", TRACE_PH_BEGIN, "samples", NULL },
+    [TRACE_EV_ACQ_END]    = { "acquisition", TRACE_PH_END, "samples", NULL },
+    [TRACE_EV_STATUS]     = { "status", TRACE_PH_INSTANT, "status", NULL },
+    [TRACE_EV_FIFO_OVF]   = { "fifo_overflow", TRACE_PH_INSTANT, "status",
+                            NULL },
+    [TRACE_EV_SAMPLE]     = { "sample", TRACE_PH_INSTANT, "sample_id",
+                          "point" },
+    [TRACE_EV_SINK_BEGIN] = { "sink", TRACE_PH_BEGIN, "samples", NULL },
+    [TRACE_EV_SINK_END]   = { "sink", TRACE_PH_END, NULL, NULL },
+    [TRACE_EV_RECONF]     = { "reconfig", TRACE_PH_INSTANT, "cnfg_ecg",
+                          "regs" },
+    [TRACE_EV_QUEUE]      = { "queue", TRACE_PH_INSTANT, "queue", "depth" },
+    [TRACE_EV_RECOVER]    = { "recover", TRACE_PH_INSTANT, "fault", "action" },
+    [TRACE_EV_RECOVERED]  = { "recovered", TRACE_PH_INSTANT, "fault",
+                          "gap_us" },
+};
+
+static void __ring_release(void *arg)
+{
+    trace_ring_t *ring = (trace_ring_t *)arg;
+    trace_tls_ring     = NULL;
+    __atomic_store_n(&ring->idle, 1, __ATOMIC_RELEASE);
+}
+
+static void __ring_key_create(void)
+{
+    if (pthread_key_create(&ring_key, __ring_release)) {
+        LOG_ERR("Can't create trace ring key, rings are not reused\n");
+        return;
+    }
+    ring_key_ok = 1;
+}
+
+/**
+ * \brief Takes over the ring of an exited thread
+ * \retval ring, NULL - all the rings are in use
+ */
+static trace_ring_t *__ring_take(void)
+{
+    for (trace_ring_t *r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r;
+         r               = r->next) {
+        uint32_t idle = 1;
+        if (__atomic_load_n(&r->idle, __ATOMIC_RELAXED) &&
+            __atomic_compare_exchange_n(&r->idle,
+                                        &idle,
+                                        0,
+                                        0,
+                                        __ATOMIC_ACQUIRE,
+                                        __ATOMIC_RELAXED)) {
+            return r;
+        }
+    }
+    return NULL;
+}
+
+trace_ring_t *trace_ring_new(void)
+{
+    trace_ring_t *ring;
+
+    pthread_once(&ring_once, __ring_key_create);
+    ring = __ring_take();
+    if (PTR_INVALID(ring)) {
+        ring = (trace_ring_t *)calloc(1, sizeof(trace_ring_t));
+        if (PTR_INVALID(ring)) {
+            return NULL;
+        }
+        ring->ev = (trace_event_t *)calloc(ring_events, sizeof(trace_event_t));
+        if (PTR_INVALID(ring->ev)) {
+            free(ring);
+            return NULL;
+        }
+        ring->mask = ring_events - 1;
+
+        ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&rings,
+                                            &ring->next,
+                                            ring,
+                                            1,
+                                            __ATOMIC_RELEASE,
+                                            __ATOMIC_RELAXED)) {
+            ;
+        }
+    }
+    /* Events keep the tid they were written with, the dump tells the
+     * threads of a taken over ring apart */
+    ring->tid = __atomic_add_fetch(&next_tid, 1, __ATOMIC_RELAXED);
+    if (ring_key_ok) {
+        pthread_setspecific(ring_key, ring);
+    }
+    trace_tls_ring = ring;
+    return ring;
+}
+
+ret_code_t trace_init(const uint32_t events, const uint8_t enable)
+{
+    uint32_t size = 1;
+    if (!events) {
+        return RET_CODE_INVALID_PARAMS;
+    }
+    while (size < events) {
+        size <<= 1;
+    }
+    ring_events   = size;
+    trace_enabled = enable;
+    return RET_CODE_SUCCESS;
+}
+
+ret_code_t trace_dump(const char *const path)
+{
+    ret_code_t       ret = RET_CODE_SUCCESS;
+    trace_file_hdr_t hdr = { 0 };
+    FILE *           f   = NULL;
+    RET_ERR_ON_NULL(path);
+
+    f = fopen(path, "wb");
+    if (PTR_INVALID(f)) {
+        LOG_ERR("Can't create trace file %s\n", path);
+        return RET_CODE_ERROR;
+    }
+
+    hdr.magic   = TRACE_MAGIC;
+    hdr.version = TRACE_VERSION;
+    hdr.ev_size = sizeof(trace_event_t);
+    for (trace_ring_t *r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r;
+         r               = r->next) {
+        hdr.rings_num++;
+    }
+    if (fwrite(&hdr, sizeof hdr, 1, f) != 1) {
+        ret = RET_CODE_ERROR;
+        goto exit;
+    }
+
+    /* Rings of running threads may be written meanwhile, the dump is meant
+     * to be taken when the traced threads are idle or done */
+    for (trace_ring_t *r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+         r && hdr.rings_num;
+         r = r->next, hdr.rings_num--) {
+        uint64_t         head  = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        uint64_t         size  = (uint64_t)r->mask + 1;
+        uint64_t         first = head > size ? head - size : 0;
+        trace_ring_hdr_t rhdr  = { r->tid, (uint32_t)(head - first), first };
+        if (fwrite(&rhdr, sizeof rhdr, 1, f) != 1) {
+            ret = RET_CODE_ERROR;
+            goto exit;
+        }
+        for (uint64_t i = first; i < head; ++i) {
+            if (fwrite(&r->ev[i & r->mask], sizeof(trace_event_t), 1, f) != 1) {
+                ret = RET_CODE_ERROR;
+                goto exit;
+            }
+        }
+    }
+    LOG_INFO("Trace written to %s\n", path);
+
+exit:
+    if (fclose(f)) {
+        ret = RET_CODE_ERROR;
+    }
+    return ret;
+}
+
+const trace_ev_info_t *trace_ev_info(const uint16_t id)
+{
+    return id < TRACE_EV_NUM ? &ev_info[id] : NULL;
+}
@@ -0,0 +1,297 @@
+/**
+ * \file work_pool.c
+ *
+ * \brief Work-stealing thread pool
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "work_pool.h"
+#include "common_check.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE POOL_PRINT_EN
+#define DBG_TAG      "work_pool.c"
+#include "Log_dbg.h"
+
+#define WORK_DEQUE_INIT 64 /* tasks, grows twice when full */
+#define WORK_CACHE_LINE 64
+
+typedef struct {
+    work_fn_t fn;
+    void *    arg;
+} work_item_t;
+
+/**
+ * \brief Deque of a worker: the owner uses the bottom, thieves the top
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    work_item_t *   items;
+    uint32_t        cap;
+    uint32_t        top;
+    uint32_t        bottom;
+    uint64_t        tasks;
+    uint64_t        steals;
+} __attribute__((aligned(WORK_CACHE_LINE))) work_deque_t;
+
+struct work_pool_ {
+    work_deque_t *  dq;
+    pthread_t *     thr;
+    uint32_t        threads;
+    uint32_t        started;
+    uint32_t        next;    /* round robin of outside submissions */
+    uint32_t        queued;  /* tasks in the deques */
+    uint32_t        pending; /* tasks submitted and not finished */
+    uint8_t         stop;
+    pthread_mutex_t lock;
+    pthread_cond_t  work;    /* queued became non zero or stop */
+    pthread_cond_t  done;    /* pending became zero */
+};
+
+typedef struct {
+    work_pool_t *pool;
+    uint32_t     id;
+} work_worker_t;
+
+static __thread work_deque_t *self_dq; /* deque of the calling worker */
+
+static ret_code_t __push(work_deque_t *const dq, const work_item_t *item)
+{
+    ret_code_t ret = RET_CODE_SUCCESS;
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->bottom == dq->cap) {
+        if (dq->top) {
+            /* Reuse the room left by thieves */
+            memmove(dq->items,
+                    dq->items + dq->top,
+                    (dq->bottom - dq->top) * sizeof(work_item_t));
+            dq->bottom -= dq->top;
+            dq->top = 0;
+        } else {
+            work_item_t *tmp = (work_item_t *)realloc(
+                    dq->items, 2 * dq->cap * sizeof(work_item_t));
+            CHECK_PTR(tmp, ret, RET_CODE_ALLOC_FAIL);
+            dq->items = tmp;
+            dq->cap *= 2;
+        }
+    }
+    dq->items[dq->bottom++] = *item;
+exit:
+    pthread_mutex_unlock(&dq->lock);
+    return ret;
+}
+
+/**
+ * \brief Takes the newest task if own, the oldest one otherwise
+ */
+static uint8_t __take(work_deque_t *const dq,
+                      work_item_t *const  item,
+                      const uint8_t       own)
+{
+    uint8_t found = 0;
+
+    pthread_mutex_lock(&dq->lock);
+    if (dq->top != dq->bottom) {
+        *item = own ? dq->items[--dq->bottom] : dq->items[dq->top++];
+        if (dq->top == dq->bottom) {
+            dq->top = dq->bottom = 0;
+        }
+        found = 1;
+    }
+    pthread_mutex_unlock(&dq->lock);
+    return found;
+}
+
+static void *__worker(void *arg)
+{
+    work_worker_t *w    = (work_worker_t *)arg;
+    work_pool_t *  pool = w->pool;
+    work_deque_t * own  = &pool->dq[w->id];
+    work_item_t    item;
+    uint8_t        found;
+
+    self_dq = own;
+    while (1) {
+        found = __take(own, &item, 1);
+        for (uint32_t i = 1; !found && i < pool->threads; ++i) {
+            found = __take(&pool->dq[(w->id + i) % pool->threads], &item, 0);
+            own->steals += found;
+        }
+        if (found) {
+            __atomic_sub_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+            item.fn(item.arg);
+            own->tasks++;
+            pthread_mutex_lock(&pool->lock);
+            if (!--pool->pending) {
+                pthread_cond_broadcast(&pool->done);
+            }
+            pthread_mutex_unlock(&pool->lock);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->stop &&
+               !__atomic_load_n(&pool->queued, __ATOMIC_SEQ_CST)) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        found = pool->stop;
+        pthread_mutex_unlock(&pool->lock);
+        if (found) {
+            break;
+        }
+    }
+    free(w);
+    return NULL;
+}
+
+work_pool_t *work_pool_create(uint32_t threads)
+{
+    work_pool_t *  pool = NULL;
+    work_worker_t *w;
+
+    if (!threads) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads   = cpus > 0 ? (uint32_t)cpus : 1;
+    }
+    pool = (work_pool_t *)calloc(1, sizeof *pool);
+    if (PTR_INVALID(pool)) {
+        return NULL;
+    }
+    pool->threads = threads;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->thr = (pthread_t *)calloc(threads, sizeof(pthread_t));
+    if (posix_memalign((void **)&pool->dq,
+                       WORK_CACHE_LINE,
+                       threads * sizeof(work_deque_t))) {
+        pool->dq = NULL;
+    }
+    if (PTR_INVALID(pool->thr) || PTR_INVALID(pool->dq)) {
+        goto error;
+    }
+    memset(pool->dq, 0, threads * sizeof(work_deque_t));
+    for (uint32_t i = 0; i < threads; ++i) {
+        pthread_mutex_init(&pool->dq[i].lock, NULL);
+        pool->dq[i].cap   = WORK_DEQUE_INIT;
+        pool->dq[i].items = (work_item_t *)malloc(WORK_DEQUE_INIT *
+                                                  sizeof(work_item_t));
+        if (PTR_INVALID(pool->dq[i].items)) {
+            goto error;
+        }
+    }
+    for (; pool->started < threads; ++pool->started) {
+        w = (work_worker_t *)malloc(sizeof *w);
+        if (PTR_INVALID(w)) {
+            goto error;
+        }
+        w->pool = pool;
+        w->id   = pool->started;
+        if (pthread_create(&pool->thr[pool->started], NULL, __worker, w)) {
+            free(w);
+            goto error;
+        }
+    }
+    LOG_DBG("%u workers started\n", threads);
+    return pool;
+
+error:
+    LOG_ERR("Can't start %u workers\n", threads);
+    work_pool_destroy(&pool);
+    return NULL;
+}
+
+ret_code_t work_pool_submit(work_pool_t *const pool,
+                            const work_fn_t    fn,
+                            void *             arg)
+{
+    ret_code_t    ret  = RET_CODE_SUCCESS;
+    work_item_t   item = { fn, arg };
+    work_deque_t *dq;
+    RET_ERR_ON_NULL(pool);
+    RET_ERR_ON_NULL(fn);
+
+    dq = self_dq;
+    if (!dq || dq < pool->dq || dq >= pool->dq + pool->threads) {
+        dq = &pool->dq[__atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED) %
+                       pool->threads];
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->pending++;
+    pthread_mutex_unlock(&pool->lock);
+
+    ret = __push(dq, &item);
+    if (ret != RET_CODE_SUCCESS) {
+        pthread_mutex_lock(&pool->lock);
+        if (!--pool->pending) {
+            pthread_cond_broadcast(&pool->done);
+        }
+        pthread_mutex_unlock(&pool->lock);
+        return ret;
+    }
+    /* Counted after the push, a worker seeing it finds the task */
+    __atomic_add_fetch(&pool->queued, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_signal(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    return ret;
+}
+
+ret_code_t work_pool_wait(work_pool_t *const       pool,
+                          work_pool_stats_t *const stats)
+{
+    RET_ERR_ON_NULL(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (stats) {
+        memset(stats, 0, sizeof *stats);
+        for (uint32_t i = 0; i < pool->threads; ++i) {
+            pthread_mutex_lock(&pool->dq[i].lock);
+            stats->tasks += pool->dq[i].tasks;
+            stats->steals += pool->dq[i].steals;
+            pthread_mutex_unlock(&pool->dq[i].lock);
+        }
+    }
+    return RET_CODE_SUCCESS;
+}
+
+ret_code_t work_pool_destroy(work_pool_t **const pool)
+{
+    work_pool_t *p;
+    RET_ERR_ON_NULL(pool);
+    RET_ERR_ON_NULL(*pool);
+
+    p = *pool;
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_cond_broadcast(&p->work);
+    pthread_mutex_unlock(&p->lock);
+    for (uint32_t i = 0; i < p->started; ++i) {
+        pthread_join(p->thr[i], NULL);
+    }
+    for (uint32_t i = 0; p->dq && i < p->threads; ++i) {
+        free(p->dq[i].items);
+        pthread_mutex_destroy(&p->dq[i].lock);
+    }
+    pthread_cond_destroy(&p->done);
+    pthread_cond_destroy(&p->work);
+    pthread_mutex_destroy(&p->lock);
+    free(p->dq);
+    free(p->thr);
+    free(p);
+    *pool = NULL;
+    return RET_CODE_SUCCESS;
+}
+
+uint32_t work_pool_threads(const work_pool_t *const pool)
+{
+    return pool ? pool->threads : 0;
+}
@@ -0,0 +1,353 @@
+/**
+ * \file ecg_batch.c
+ *
+ * \brief Offline batch analysis of recordings: baseline removal and QRS
+ * detection of the live DSP stage run on many files in parallel. Files
+ * are split into chunks which idle workers steal. Every chunk starts
+ * BATCH_WARMUP_S earlier and ends BATCH_TAIL_S later than the samples it
+ * reports, so filter and detector state is settled at its borders.
+ * Summary of every file is printed as a CSV line, in the order of the
+ * arguments.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include "common_types.h"
+#include "common_check.h"
+#include "spi.h"
+#include "MAX30003.h"
+#include "recording.h"
+#include "dsp.h"
+#include "qrs.h"
+#include "work_pool.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE MAIN_PRINT_EN
+#define DBG_TAG      "ecg_batch.c"
+#include "Log_dbg.h"
+
+#define BATCH_CHUNK_S_DEFAULT 60
+#define BATCH_WARMUP_S        4 /* >= QRS_LEARN_MS and HPF settling */
+#define BATCH_TAIL_S          1 /* lets beats at the chunk end finish */
+#define BATCH_PIECE           1024 /* samples filtered at once */
+#define BATCH_NSEC_IN_SEC     1e9
+#define BATCH_SEC_IN_MIN      60.0
+
+struct batch_file_;
+
+/**
+ * \brief Part of a file, [first, first + num) is reported
+ */
+typedef struct {
+    struct batch_file_ *file;
+    uint32_t            first;
+    uint32_t            num;
+    uint32_t            start;    /* processing starts here */
+    uint32_t            end;      /* and ends here */
+    uint32_t            cnfg_ecg; /* configuration at start */
+    /* Results */
+    uint64_t beats;
+    uint64_t first_beat;
+    uint64_t last_beat;
+    uint64_t samples;
+    uint64_t markers;
+    double   sum_sq;
+} batch_chunk_t;
+
+typedef struct batch_file_ {
+    const char *   path;
+    uint32_t       cnfg_default;
+    uint32_t       chunk_s;
+    rec_t          rec;
+    int32_t *      points;
+    batch_chunk_t *chunks;
+    uint32_t       chunks_num;
+    uint32_t       chunks_left;
+    uint32_t       rate;
+    ret_code_t     ret;
+    /* Summary */
+    uint64_t beats;
+    uint64_t samples;
+    uint64_t markers;
+    double   mean_hr;
+    double   rms;
+} batch_file_t;
+
+spi_t spi; /* driver library refers to it, no device is opened */
+
+static work_pool_t *pool;
+
+static double __clock_s(const clockid_t clk)
+{
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return ts.tv_sec + ts.tv_nsec / BATCH_NSEC_IN_SEC;
+}
+
+static void print_usage(void)
+{
+    fprintf(stderr,
+            "ecg_batch [-j threads] [-c seconds] [-S 128|256|512] [-o file] "
+            "recording...\n"
+            "-j --threads  worker threads (default: online CPUs)\n"
+            "-c --chunk    seconds of a file per task (default 60)\n"
+            "-S --s_rate   sample rate of text recordings (default: "
+            "CNFG_ECG_DEFAULT)\n"
+            "-o --output   CSV output (default stdout)\n");
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * \brief Sums chunk results into the file summary, frees the samples
+ */
+static void __file_done(batch_file_t *const f)
+{
+    const batch_chunk_t *c;
+    uint64_t             first = 0, last = 0;
+    uint8_t              seen  = 0;
+    double               sum_sq = 0;
+
+    for (uint32_t i = 0; i < f->chunks_num; ++i) {
+        c = &f->chunks[i];
+        f->beats += c->beats;
+        f->samples += c->samples;
+        f->markers += c->markers;
+        sum_sq += c->sum_sq;
+        if (c->beats) {
+            first = seen ? first : c->first_beat;
+            last  = c->last_beat;
+            seen  = 1;
+        }
+    }
+    if (f->beats > 1 && last > first) {
+        f->mean_hr = BATCH_SEC_IN_MIN * f->rate * (f->beats - 1) /
+                     (last - first);
+    }
+    f->rms = f->samples ? sqrt(sum_sq / f->samples) : 0;
+    free(f->points);
+    f->points = NULL;
+    rec_free(&f->rec);
+}
+
+static void __chunk_task(void *arg)
+{
+    batch_chunk_t *c = (batch_chunk_t *)arg;
+    batch_file_t * f = c->file;
+    int32_t        out[BATCH_PIECE];
+    uint64_t       beats[BATCH_PIECE];
+    dsp_t          dsp;
+    qrs_t          qrs;
+    uint32_t       n, found;
+    const int32_t *in;
+
+    dsp_init(&dsp, c->cnfg_ecg);
+    qrs_init(&qrs, c->cnfg_ecg, c->start);
+    for (uint32_t pos = c->start; pos < c->end; pos += n) {
+        n     = MIN(c->end - pos, BATCH_PIECE);
+        in    = f->points + pos;
+        dsp_process(&dsp, in, out, n);
+        found = qrs_process(&qrs, in, out, n, beats, BATCH_PIECE);
+        for (uint32_t i = 0; i < MIN(found, BATCH_PIECE); ++i) {
+            if (beats[i] < c->first || beats[i] >= c->first + c->num) {
+                continue;
+            }
+            c->first_beat = c->beats ? c->first_beat : beats[i];
+            c->last_beat  = beats[i];
+            c->beats++;
+        }
+        for (uint32_t i = 0; i < n; ++i) {
+            if (pos + i < c->first || pos + i >= c->first + c->num) {
+                continue;
+            }
+            if (ECG_IS_MARKER(in[i])) {
+                c->markers++;
+                continue;
+            }
+            c->samples++;
+            c->sum_sq += (double)out[i] * out[i];
+        }
+    }
+
+    if (!__atomic_sub_fetch(&f->chunks_left, 1, __ATOMIC_ACQ_REL)) {
+        __file_done(f);
+    }
+}
+
+/**
+ * \brief Loads the file and splits it into chunk tasks, the chunks go to
+ * the deque of this worker and get stolen by idle ones
+ */
+static void __file_task(void *arg)
+{
+    batch_file_t *f    = (batch_file_t *)arg;
+    uint32_t      cnfg, chunk, warmup, tail, pos = 0;
+
+    f->ret = rec_load(&f->rec, f->path);
+    if (RET_UNSUCCESS(f->ret)) {
+        return;
+    }
+    cnfg    = f->rec.hdr.cnfg_ecg ? f->rec.hdr.cnfg_ecg : f->cnfg_default;
+    f->rate = max30003_rate_sps(cnfg);
+    chunk   = f->chunk_s * f->rate;
+    warmup  = BATCH_WARMUP_S * f->rate;
+    tail    = BATCH_TAIL_S * f->rate;
+
+    f->chunks_num = (f->rec.words_num + chunk - 1) / chunk;
+    f->points     = (int32_t *)malloc(f->rec.words_num * sizeof(int32_t));
+    f->chunks     = (batch_chunk_t *)calloc(
+            f->chunks_num ? f->chunks_num : 1, sizeof(batch_chunk_t));
+    if (PTR_INVALID(f->points) || PTR_INVALID(f->chunks)) {
+        f->ret = RET_CODE_ALLOC_FAIL;
+        free(f->points);
+        f->points = NULL;
+        rec_free(&f->rec);
+        return;
+    }
+
+    /* Configuration in effect at the start of every chunk */
+    for (uint32_t i = 0; i < f->chunks_num; ++i) {
+        batch_chunk_t *c = &f->chunks[i];
+        c->file          = f;
+        c->first         = i * chunk;
+        c->num           = MIN(chunk, f->rec.words_num - c->first);
+        c->start         = c->first > warmup ? c->first - warmup : 0;
+        c->end           = MIN(c->first + c->num + tail, f->rec.words_num);
+        for (; pos < f->rec.words_num && pos < c->start; ++pos) {
+            f->points[pos] = REC_WORD_TO_POINT(f->rec.words[pos]);
+            if (ECG_IS_MARKER(f->points[pos])) {
+                cnfg = ECG_MARKER_CNFG(f->points[pos]);
+            }
+        }
+        c->cnfg_ecg = cnfg;
+    }
+    for (; pos < f->rec.words_num; ++pos) {
+        f->points[pos] = REC_WORD_TO_POINT(f->rec.words[pos]);
+    }
+
+    f->chunks_left = f->chunks_num;
+    if (!f->chunks_num) {
+        __file_done(f);
+        return;
+    }
+    for (uint32_t i = 0; i < f->chunks_num; ++i) {
+        if (RET_UNSUCCESS(
+                    work_pool_submit(pool, __chunk_task, &f->chunks[i]))) {
+            /* Run it here, the file must not be left incomplete */
+            __chunk_task(&f->chunks[i]);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    batch_file_t *    files   = NULL;
+    uint32_t          threads = 0;
+    uint32_t          chunk_s = BATCH_CHUNK_S_DEFAULT;
+    uint32_t          cnfg    = CNFG_ECG_DEFAULT;
+    uint32_t          files_num, failed = 0;
+    uint64_t          samples = 0;
+    const char *      path    = NULL;
+    FILE *            out     = NULL;
+    work_pool_stats_t stats;
+    double            wall_s;
+    int               c;
+
+    static const struct option lopts[] = {
+        { "threads", 1, 0, 'j' }, { "chunk", 1, 0, 'c' },
+        { "s_rate", 1, 0, 'S' },  { "output", 1, 0, 'o' },
+        { NULL, 0, 0, 0 },
+    };
+    while ((c = getopt_long(argc, argv, "j:c:S:o:", lopts, NULL)) != -1) {
+        switch (c) {
+        case 'j':
+            threads = atoi(optarg) > 0 ? atoi(optarg) : 0;
+            break;
+        case 'c':
+            chunk_s = atoi(optarg) > 0 ? atoi(optarg) : BATCH_CHUNK_S_DEFAULT;
+            break;
+        case 'S':
+            BITMASK_CLEAR(cnfg, ECG_GAIN_512_RESET);
+            if (atoi(optarg) == 256) {
+                BITMASK_SET(cnfg, ECG_RATE_256);
+            } else if (atoi(optarg) == 128) {
+                BITMASK_SET(cnfg, ECG_RATE_128);
+            } else if (atoi(optarg) != 512) {
+                print_usage();
+            }
+            break;
+        case 'o':
+            path = optarg;
+            break;
+        default:
+            print_usage();
+        }
+    }
+    if (optind >= argc) {
+        print_usage();
+    }
+
+    /* Results go to the original stdout, logs to stderr */
+    out = path ? fopen(path, "w") : fdopen(dup(STDOUT_FILENO), "w");
+    EXIT_ON_NULL(out);
+    if (dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        errExit("dup2");
+    }
+
+    files_num = argc - optind;
+    files     = (batch_file_t *)calloc(files_num, sizeof(batch_file_t));
+    EXIT_ON_NULL(files);
+    pool = work_pool_create(threads);
+    EXIT_ON_NULL(pool);
+
+    wall_s = __clock_s(CLOCK_MONOTONIC);
+    for (uint32_t i = 0; i < files_num; ++i) {
+        files[i].path         = argv[optind + i];
+        files[i].cnfg_default = cnfg;
+        files[i].chunk_s      = chunk_s;
+        CHECK_CODE_ERR(work_pool_submit(pool, __file_task, &files[i]));
+    }
+    CHECK_CODE_ERR(work_pool_wait(pool, &stats));
+    wall_s = __clock_s(CLOCK_MONOTONIC) - wall_s;
+
+    fprintf(out, "file,samples,seconds,sample_rate,beats,mean_hr_bpm,rms,"
+                 "markers\n");
+    for (uint32_t i = 0; i < files_num; ++i) {
+        batch_file_t *f = &files[i];
+        free(f->chunks);
+        if (RET_UNSUCCESS(f->ret)) {
+            fprintf(stderr, "%s: failed with code %d\n", f->path, f->ret);
+            failed++;
+            continue;
+        }
+        fprintf(out,
+                "%s,%llu,%.3f,%u,%llu,%.1f,%.1f,%llu\n",
+                f->path,
+                (unsigned long long)f->samples,
+                f->rate ? (double)f->samples / f->rate : 0,
+                f->rate,
+                (unsigned long long)f->beats,
+                f->mean_hr,
+                f->rms,
+                (unsigned long long)f->markers);
+        samples += f->samples;
+    }
+    fprintf(stderr,
+            "%u files, %llu samples in %.3f s (%.0f samples/s), %u threads, "
+            "%llu tasks, %llu stolen\n",
+            files_num,
+            (unsigned long long)samples,
+            wall_s,
+            samples / wall_s,
+            work_pool_threads(pool),
+            (unsigned long long)stats.tasks,
+            (unsigned long long)stats.steals);
+
+    work_pool_destroy(&pool);
+    free(files);
+    fclose(out);
+    return failed ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,175 @@
+/**
+ * \file rec_arrow.c
+ *
+ * \brief Exports a recording to Arrow IPC tables: samples with their time
+ * and ETAG, beats of the DSP stage detector and status events, see
+ * arrow_ipc.h. The tables are memory-mapped by columnar tools as written.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include "common_types.h"
+#include "common_check.h"
+#include "spi.h"
+#include "MAX30003.h"
+#include "recording.h"
+#include "arrow_ipc.h"
+#include "dsp.h"
+#include "qrs.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE MAIN_PRINT_EN
+#define DBG_TAG      "rec_arrow.c"
+#include "Log_dbg.h"
+
+#define EXPORT_PIECE      1024 /* points filtered and exported at once */
+#define EXPORT_NSEC_IN_SEC 1e9
+
+spi_t spi; /* driver library refers to it, no device is opened */
+
+static double __clock_s(const clockid_t clk)
+{
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return ts.tv_sec + ts.tv_nsec / EXPORT_NSEC_IN_SEC;
+}
+
+static void print_usage(void)
+{
+    fprintf(stderr,
+            "rec_arrow [-o prefix] [-c rows] [-t samples,beats,events] "
+            "[-S 128|256|512] recording\n"
+            "-o --output   prefix of the tables (default: the recording "
+            "path)\n"
+            "-c --chunk    rows per record batch (default %u)\n"
+            "-t --tables   tables to write (default all)\n"
+            "-S --s_rate   sample rate of text recordings (default: "
+            "CNFG_ECG_DEFAULT)\n",
+            ARROW_CHUNK_ROWS_DEFAULT);
+    exit(EXIT_FAILURE);
+}
+
+static uint32_t __parse_tables(char *const arg)
+{
+    uint32_t tables = 0;
+
+    for (char *t = strtok(arg, ","); t; t = strtok(NULL, ",")) {
+        if (!strcmp(t, "samples")) {
+            tables |= ECG_ARROW_SAMPLES;
+        } else if (!strcmp(t, "beats")) {
+            tables |= ECG_ARROW_BEATS;
+        } else if (!strcmp(t, "events")) {
+            tables |= ECG_ARROW_EVENTS;
+        } else {
+            print_usage();
+        }
+    }
+    return tables;
+}
+
+/**
+ * \brief Filters the points as the DSP stage does and exports them with
+ * the beats found
+ */
+static ret_code_t __export(ecg_arrow_t *const   ex,
+                           const rec_t *const   rec,
+                           const uint32_t       cnfg_ecg,
+                           uint64_t *const      beats_num)
+{
+    ret_code_t ret = RET_CODE_SUCCESS;
+    int32_t    points[EXPORT_PIECE], out[EXPORT_PIECE];
+    uint8_t    etags[EXPORT_PIECE];
+    uint64_t   beats[EXPORT_PIECE];
+    dsp_t      dsp;
+    qrs_t      qrs;
+    uint32_t   n, found;
+
+    dsp_init(&dsp, cnfg_ecg);
+    qrs_init(&qrs, cnfg_ecg, 0);
+    for (uint32_t pos = 0; pos < rec->words_num; pos += n) {
+        n = MIN(rec->words_num - pos, EXPORT_PIECE);
+        for (uint32_t i = 0; i < n; ++i) {
+            uint32_t word = rec->words[pos + i];
+            points[i]     = REC_WORD_TO_POINT(word);
+            etags[i] = (word & ECG_FIFO_ETAG_MASK) >> ECG_FIFO_ETAG_SHIFT;
+        }
+        dsp_process(&dsp, points, out, n);
+        found = qrs_process(&qrs, points, out, n, beats, EXPORT_PIECE);
+        found = MIN(found, EXPORT_PIECE);
+        CONTINUE_ON_SUCCESS(ecg_arrow_points(ex, points, etags, n));
+        CONTINUE_ON_SUCCESS(ecg_arrow_beats(ex, beats, found));
+        *beats_num += found;
+    }
+exit:
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    ret_code_t  ret        = RET_CODE_SUCCESS;
+    uint32_t    tables     = ECG_ARROW_ALL;
+    uint32_t    chunk_rows = 0;
+    uint32_t    cnfg       = CNFG_ECG_DEFAULT;
+    uint64_t    beats      = 0;
+    const char *prefix     = NULL;
+    rec_t       rec        = { 0 };
+    ecg_arrow_t ex;
+    double      wall_s;
+    int         c;
+
+    static const struct option lopts[] = {
+        { "output", 1, 0, 'o' }, { "chunk", 1, 0, 'c' },
+        { "tables", 1, 0, 't' }, { "s_rate", 1, 0, 'S' },
+        { NULL, 0, 0, 0 },
+    };
+    while ((c = getopt_long(argc, argv, "o:c:t:S:", lopts, NULL)) != -1) {
+        switch (c) {
+        case 'o':
+            prefix = optarg;
+            break;
+        case 'c':
+            chunk_rows = atoi(optarg) > 0 ? atoi(optarg) : 0;
+            break;
+        case 't':
+            tables = __parse_tables(optarg);
+            break;
+        case 'S':
+            BITMASK_CLEAR(cnfg, ECG_GAIN_512_RESET);
+            if (atoi(optarg) == 256) {
+                BITMASK_SET(cnfg, ECG_RATE_256);
+            } else if (atoi(optarg) == 128) {
+                BITMASK_SET(cnfg, ECG_RATE_128);
+            } else if (atoi(optarg) != 512) {
+                print_usage();
+            }
+            break;
+        default:
+            print_usage();
+        }
+    }
+    if (optind + 1 != argc) {
+        print_usage();
+    }
+    prefix = prefix ? prefix : argv[optind];
+
+    CHECK_CODE_ERR(rec_load(&rec, argv[optind]));
+    cnfg   = rec.hdr.cnfg_ecg ? rec.hdr.cnfg_ecg : cnfg;
+    wall_s = __clock_s(CLOCK_MONOTONIC);
+    CHECK_CODE_ERR(ecg_arrow_open(&ex, prefix, tables, cnfg, 0, chunk_rows));
+    ret = __export(&ex, &rec, cnfg, &beats);
+    if (ecg_arrow_close(&ex) != RET_CODE_SUCCESS) {
+        ret = RET_CODE_ERROR;
+    }
+    wall_s = __clock_s(CLOCK_MONOTONIC) - wall_s;
+    CHECK_CODE_ERR(ret);
+
+    LOG_INFO("%s: %u points, %llu beats exported in %.3f s\n",
+             argv[optind],
+             rec.words_num,
+             (unsigned long long)beats,
+             wall_s);
+    rec_free(&rec);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,200 @@
+/**
+ * \file rec_env.c
+ *
+ * \brief Builds the envelope pyramid of a recording (see envelope.h) and
+ * queries it for a time range drawn in a number of columns, as a review UI
+ * does when zooming. Recordings written by the driver have the envelope
+ * already, it is built here for older and text recordings. Columns are
+ * printed as CSV lines.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <time.h>
+#include "common_types.h"
+#include "common_check.h"
+#include "spi.h"
+#include "MAX30003.h"
+#include "recording.h"
+#include "envelope.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE MAIN_PRINT_EN
+#define DBG_TAG      "rec_env.c"
+#include "Log_dbg.h"
+
+#define ENV_NSEC_IN_SEC 1e9
+#define ENV_MSEC_IN_SEC 1e3
+
+spi_t spi; /* driver library refers to it, no device is opened */
+
+static double __clock_s(const clockid_t clk)
+{
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return ts.tv_sec + ts.tv_nsec / ENV_NSEC_IN_SEC;
+}
+
+static void print_usage(void)
+{
+    fprintf(stderr,
+            "rec_env [-b] [-t start] [-d duration] [-w columns] [-o file] "
+            "[-S 128|256|512] recording\n"
+            "-b --build     rebuild %s even if it exists\n"
+            "-t --start     first second of the range (default 0)\n"
+            "-d --duration  seconds of the range (default: to the end)\n"
+            "-w --width     columns of the range (default: no query)\n"
+            "-o --output    columns file (default stdout)\n"
+            "-S --s_rate    sample rate of text recordings (default: "
+            "CNFG_ECG_DEFAULT)\n",
+            "<recording>" ENV_SUFFIX);
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * \brief Loads the envelope of the recording, builds and saves it if it is
+ * missing or a rebuild is asked for
+ */
+static ret_code_t __envelope(env_t *const      env,
+                             const char *const rec_path,
+                             const char *const env_path,
+                             const uint8_t     build)
+{
+    ret_code_t ret = RET_CODE_SUCCESS;
+    rec_t      rec = { 0 };
+    double     wall_s;
+
+    if (!build && !access(env_path, R_OK) &&
+        env_load(env, env_path) == RET_CODE_SUCCESS) {
+        return RET_CODE_SUCCESS;
+    }
+    CONTINUE_ON_SUCCESS(rec_load(&rec, rec_path));
+    wall_s = __clock_s(CLOCK_MONOTONIC);
+    CONTINUE_ON_SUCCESS(rec_envelope(&rec, env));
+    CONTINUE_ON_SUCCESS(env_save(env, env_path));
+    LOG_INFO("Envelope of %llu samples built in %.3f s, saved to %s\n",
+             (unsigned long long)env->samples_num,
+             __clock_s(CLOCK_MONOTONIC) - wall_s,
+             env_path);
+exit:
+    rec_free(&rec);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t     build    = 0;
+    uint32_t    width    = 0;
+    uint32_t    cnfg     = CNFG_ECG_DEFAULT;
+    uint32_t    rate;
+    double      start_s  = 0;
+    double      dur_s    = 0;
+    const char *path     = NULL;
+    char *      env_path = NULL;
+    env_col_t * cols     = NULL;
+    FILE *      out      = NULL;
+    env_t       env;
+    uint64_t    first, num;
+    double      query_s;
+    int         c;
+
+    static const struct option lopts[] = {
+        { "build", 0, 0, 'b' },  { "start", 1, 0, 't' },
+        { "duration", 1, 0, 'd' }, { "width", 1, 0, 'w' },
+        { "output", 1, 0, 'o' }, { "s_rate", 1, 0, 'S' },
+        { NULL, 0, 0, 0 },
+    };
+    while ((c = getopt_long(argc, argv, "bt:d:w:o:S:", lopts, NULL)) != -1) {
+        switch (c) {
+        case 'b':
+            build = 1;
+            break;
+        case 't':
+            start_s = atof(optarg) > 0 ? atof(optarg) : 0;
+            break;
+        case 'd':
+            dur_s = atof(optarg) > 0 ? atof(optarg) : 0;
+            break;
+        case 'w':
+            width = atoi(optarg) > 0 ? atoi(optarg) : 0;
+            break;
+        case 'o':
+            path = optarg;
+            break;
+        case 'S':
+            BITMASK_CLEAR(cnfg, ECG_GAIN_512_RESET);
+            if (atoi(optarg) == 256) {
+                BITMASK_SET(cnfg, ECG_RATE_256);
+            } else if (atoi(optarg) == 128) {
+                BITMASK_SET(cnfg, ECG_RATE_128);
+            } else if (atoi(optarg) != 512) {
+                print_usage();
+            }
+            break;
+        default:
+            print_usage();
+        }
+    }
+    if (optind + 1 != argc) {
+        print_usage();
+    }
+
+    /* Results go to the original stdout, logs to stderr */
+    out = path ? fopen(path, "w") : fdopen(dup(STDOUT_FILENO), "w");
+    EXIT_ON_NULL(out);
+    if (dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        errExit("dup2");
+    }
+
+    env_path = (char *)malloc(strlen(argv[optind]) + sizeof ENV_SUFFIX);
+    EXIT_ON_NULL(env_path);
+    sprintf(env_path, "%s" ENV_SUFFIX, argv[optind]);
+    CHECK_CODE_ERR(__envelope(&env, argv[optind], env_path, build));
+    rate = env.sample_rate ? env.sample_rate : max30003_rate_sps(cnfg);
+
+    if (width) {
+        first = (uint64_t)(start_s * rate);
+        if (first >= env.samples_num) {
+            fprintf(stderr,
+                    "%s: range starts past the end, %.3f s\n",
+                    argv[optind],
+                    (double)env.samples_num / rate);
+            return EXIT_FAILURE;
+        }
+        num  = dur_s ? (uint64_t)(dur_s * rate) : env.samples_num - first;
+        num  = num ? num : 1;
+        cols = (env_col_t *)calloc(width, sizeof(env_col_t));
+        EXIT_ON_NULL(cols);
+
+        query_s = __clock_s(CLOCK_MONOTONIC);
+        CHECK_CODE_ERR(env_query(&env, first, num, width, cols));
+        query_s = __clock_s(CLOCK_MONOTONIC) - query_s;
+
+        fprintf(out, "col,time_s,min,max,mean,samples\n");
+        for (uint32_t i = 0; i < width; ++i) {
+            fprintf(out,
+                    "%u,%.3f,%d,%d,%d,%u\n",
+                    i,
+                    (first + (double)i * num / width) / rate,
+                    cols[i].num ? cols[i].min : 0,
+                    cols[i].num ? cols[i].max : 0,
+                    cols[i].mean,
+                    cols[i].num);
+        }
+        fprintf(stderr,
+                "%llu samples in %u columns from level %u of %u in %.3f ms\n",
+                (unsigned long long)num,
+                width,
+                env_level(&env, num, width),
+                env.levels,
+                query_s * ENV_MSEC_IN_SEC);
+    }
+
+    fclose(out);
+    free(cols);
+    free(env_path);
+    env_free(&env);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,151 @@
+/**
+ * \file trace_decode.c
+ *
+ * \brief Renders trace dump written by trace_dump() as text or as
+ * Chrome-trace JSON (loadable in chrome://tracing and Perfetto UI)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include "trace.h"
+#include "common_types.h"
+#include "common_check.h"
+
+#include "Log_dbg_en.h"
+#define DEBUG_ENABLE MAIN_PRINT_EN
+#define DBG_TAG      "trace_decode.c"
+#include "Log_dbg.h"
+
+#define NSEC_IN_USEC 1000.0
+
+static void print_usage(void)
+{
+    fprintf(stderr,
+            "trace_decode [-j] trace_file\n"
+            "-j --json  Chrome-trace/Perfetto JSON instead of text\n");
+    exit(EXIT_FAILURE);
+}
+
+static void __print_text(const trace_event_t *const ev, const uint64_t t0)
+{
+    const trace_ev_info_t *info = trace_ev_info(ev->id);
+    printf("%14.3f us tid %u %-14s",
+           (ev->ts_ns - t0) / NSEC_IN_USEC,
+           ev->tid,
+           info ? info->name : "unknown");
+    if (!info) {
+        printf(" id=%u", ev->id);
+    }
+    if (!info || info->arg0) {
+        printf(" %s=%u", info ? info->arg0 : "arg0", ev->arg0);
+    }
+    if (!info || info->arg1) {
+        printf(" %s=%u", info ? info->arg1 : "arg1", ev->arg1);
+    }
+    printf(" %c\n", info ? info->phase : TRACE_PH_INSTANT);
+}
+
+static void __print_json(const trace_event_t *const ev,
+                         const uint64_t             t0,
+                         const uint8_t              first)
+{
+    const trace_ev_info_t *info = trace_ev_info(ev->id);
+    printf("%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,"
+           "\"tid\":%u",
+           first ? "" : ",",
+           info ? info->name : "unknown",
+           info ? info->phase : TRACE_PH_INSTANT,
+           (ev->ts_ns - t0) / NSEC_IN_USEC,
+           ev->tid);
+    if (!info || info->phase == TRACE_PH_INSTANT) {
+        printf(",\"s\":\"t\"");
+    }
+    printf(",\"args\":{");
+    if (!info || info->arg0) {
+        printf("\"%s\":%u", info ? info->arg0 : "arg0", ev->arg0);
+    }
+    if (!info || info->arg1) {
+        printf(",\"%s\":%u", info ? info->arg1 : "arg1", ev->arg1);
+    }
+    printf("}}");
+}
+
+int main(int argc, char **argv)
+{
+    trace_file_hdr_t hdr    = { 0 };
+    trace_event_t *  events = NULL;
+    uint64_t         total  = 0;
+    uint64_t         t0     = UINT64_MAX;
+    uint8_t          json   = 0;
+    FILE *           f      = NULL;
+    int              c;
+
+    static const struct option lopts[] = {
+        { "json", 0, 0, 'j' },
+        { NULL, 0, 0, 0 },
+    };
+    while ((c = getopt_long(argc, argv, "j", lopts, NULL)) != -1) {
+        if (c != 'j') {
+            print_usage();
+        }
+        json = 1;
+    }
+    if (optind >= argc) {
+        print_usage();
+    }
+
+    f = fopen(argv[optind], "rb");
+    if (!f) {
+        errExit("fopen");
+    }
+    if (fread(&hdr, sizeof hdr, 1, f) != 1 || hdr.magic != TRACE_MAGIC ||
+        hdr.version != TRACE_VERSION || hdr.ev_size != sizeof(trace_event_t)) {
+        fprintf(stderr, "%s is not a trace file\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    /* Events of all the rings are rendered together, each ring is in order */
+    for (uint32_t r = 0; r < hdr.rings_num; ++r) {
+        trace_ring_hdr_t rhdr;
+        trace_event_t *  tmp;
+        if (fread(&rhdr, sizeof rhdr, 1, f) != 1) {
+            break;
+        }
+        if (rhdr.dropped) {
+            fprintf(stderr,
+                    "tid %u: %llu oldest events overwritten\n",
+                    rhdr.tid,
+                    (unsigned long long)rhdr.dropped);
+        }
+        tmp = (trace_event_t *)realloc(
+                events, (total + rhdr.events_num) * sizeof(trace_event_t));
+        EXIT_ON_NULL(tmp);
+        events = tmp;
+        total += fread(events + total,
+                       sizeof(trace_event_t),
+                       rhdr.events_num,
+                       f);
+    }
+    fclose(f);
+
+    for (uint64_t i = 0; i < total; ++i) {
+        t0 = events[i].ts_ns < t0 ? events[i].ts_ns : t0;
+    }
+
+    if (json) {
+        printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    }
+    for (uint64_t i = 0; i < total; ++i) {
+        if (json) {
+            __print_json(&events[i], t0, i == 0);
+        } else {
+            __print_text(&events[i], t0);
+        }
+    }
+    if (json) {
+        printf("\n]}\n");
+    }
+    free(events);
+    return 0;
+}